@@ -0,0 +1,43 @@
+﻿#pragma once
+#include "Components/Camera.h"
+
+class MaterialSystem;
+class TransformSystem;
+
+/// <summary>
+/// Component that caches the world space bounds of an entity, used to skip it when it can't be seen.<br>
+/// Entities without bounds are never culled.
+/// </summary>
+struct Bounds final
+{
+	// Bounding sphere in world space, with the radius stored in w. Derived from the material's mesh.
+	glm::vec4 sphere{ 0 };
+};
+
+/// <summary>
+/// System that handles the bounds components.
+/// </summary>
+class BoundsSystem final : public ce::System<Bounds>
+{
+public:
+	explicit BoundsSystem(ce::Cecsar& cecsar, MaterialSystem& materials, TransformSystem& transforms);
+
+	// Recalculates the world space bounds based on the meshes and transforms. Call this once per frame, before rendering.
+	void Update();
+
+	// Returns the bounding sphere of an entity. Entities without bounds return an infinitely large sphere.
+	[[nodiscard]] glm::vec4 GetSphere(uint16_t index);
+	// Returns true if the entity is (partially) within range of the given position.
+	[[nodiscard]] bool Intersects(uint16_t index, const glm::vec3& position, float range);
+
+	// Returns true if the sphere is (partially) within the frustum.
+	[[nodiscard]] static bool Intersects(const Camera::Frustum& frustum, const glm::vec4& sphere);
+	// Estimates the part of the screen height that the sphere covers, as seen from the origin. Returns 1 if the origin is inside.
+	[[nodiscard]] static float GetCoverage(const glm::vec4& sphere, const glm::vec3& origin, float fieldOfView);
+	// Tests any number of spheres against the frustum, four at a time.
+	static void Cull(const Camera::Frustum& frustum, const glm::vec4* spheres, uint32_t count, bool* outVisible);
+
+private:
+	MaterialSystem& _materials;
+	TransformSystem& _transforms;
+};
@@ -13,6 +13,12 @@ struct Camera final
 		glm::mat4 projection;
 	};
 
+	// Planes that enclose the visible area, with the normals pointing inwards and the distance stored in w.
+	struct Frustum final
+	{
+		glm::vec4 planes[6];
+	};
+
 	glm::vec3 lookAt{ 0 };
 	float fieldOfView = 45;
 	float clipNear = .1f;
@@ -30,9 +36,20 @@ public:
 
 	void Update();
 
-	[[nodiscard]] VkDescriptorSet GetDescriptor(uint32_t sparseIndex) const;
+	// Get the camera descriptor set for the current frame.
+	[[nodiscard]] VkDescriptorSet GetDescriptor() const;
+	// Get the dynamic offset for the camera ubo. The index is the camera's position in iteration order.
+	[[nodiscard]] uint32_t GetDynamicOffset(uint32_t index) const;
+	// Get the frustum of the current frame. The index is the camera's position in iteration order.
+	[[nodiscard]] const Camera::Frustum& GetFrustum(uint32_t index) const;
+	// Get the view and projection of the current frame. The index is the camera's position in iteration order.
+	[[nodiscard]] const Camera::Ubo& GetUbo(uint32_t index) const;
+	// Maximum amount of cameras.
+	[[nodiscard]] uint32_t GetCapacity() const;
 	[[nodiscard]] VkDescriptorSetLayout GetLayout() const;
 	[[nodiscard]] static vi::VkLayoutHandler::CreateInfo::Binding GetBindingInfo();
+	// Extracts the frustum planes from a view projection matrix.
+	[[nodiscard]] static Camera::Frustum CreateFrustum(const glm::mat4& viewProjection);
 
 private:
 	VulkanRenderer& _renderer;
@@ -42,13 +59,14 @@ private:
 	VkDescriptorSetLayout _layout;
 	// Descriptor pool used for the cameras.
 	VkDescriptorPool _descriptorPool;
-	// Descriptor sets used per-frame (all the cameras are batched in one go).
+	// Descriptor sets used per-frame. All the cameras share the same set, using dynamic offsets.
 	vi::ArrayPtr<VkDescriptorSet> _descriptorSets;
-	// Allocator from which to get update bound ubos.
+	// Allocator from which to get the per-frame ubos.
 	UboAllocator<Camera::Ubo> _uboAllocator;
-	// Ubos that are attached to the camera descriptor sets.
+	// Dynamic offsets for the cameras of the current frame.
+	vi::ArrayPtr<uint32_t> _dynamicOffsets;
+	// Frustums for the cameras of the current frame, used for culling.
+	vi::ArrayPtr<Camera::Frustum> _frustums;
+	// Matrices for the cameras of the current frame, used for light clustering.
 	vi::ArrayPtr<Camera::Ubo> _ubos;
-
-	// Get the current descriptor index based on the swap chain image index.
-	[[nodiscard]] uint32_t GetDescriptorStartIndex() const;
 };
@@ -2,7 +2,10 @@
 #include "Rendering/SwapChainExt.h"
 #include "Rendering/ShaderExt.h"
 #include "Rendering/UboAllocator.h"
+#include "Components/Camera.h"
 
+class BoundsSystem;
+class CameraSystem;
 class TransformSystem;
 class MaterialSystem;
 
@@ -34,49 +37,96 @@ public:
 /// <summary>
 /// System that handles the light components.
 /// </summary>
-class LightSystem final : public ce::SmallSystem<Light>, SwapChainExt::Dependency
+class LightSystem final : public ce::SmallSystem<Light>, ShaderExt::Dependency
 {
 public:
+	// Amount of shadow resolutions, each having their own cubemap array.
+	// Make sure this corresponds to the shader code.
+	static constexpr uint32_t SHADOW_LOD_COUNT = 3;
+	// Dimensions of the froxel grid that the lights are binned into for every camera.
+	// Depth slices are distributed exponentially between the camera's clip planes.
+	// Make sure this corresponds to the shader code.
+	static constexpr uint32_t CLUSTER_X = 16;
+	static constexpr uint32_t CLUSTER_Y = 9;
+	static constexpr uint32_t CLUSTER_Z = 24;
+	static constexpr uint32_t CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+	// Maximum amount of light references over all the clusters of a single camera.
+	static constexpr uint32_t CLUSTER_INDEX_CAPACITY = CLUSTER_COUNT * 8;
+
 	/// <summary>
 	/// Struct used to construct the light system.
 	/// </summary>
 	struct Info final
 	{
 		// Maximum amount of lights present.
-		// Make sure this corresponds to the shader code.
-		size_t size = 6;
-		// Individual face sizes of the cubemap the light is rendered to.
+		size_t size = 16;
+		// Individual face sizes of the highest resolution shadow cubemaps. Every next level of detail halves the resolution.
 		glm::ivec2 shadowResolution{ 512 };
+		// Amount of shadow cubemaps available per level of detail, starting with the highest resolution.
+		// Lights that don't fit in any of them don't cast shadows.
+		uint32_t shadowCapacities[SHADOW_LOD_COUNT]{ 2, 4, 8 };
+		// Minimum screen coverage of a light's range to use the level of detail, starting with the highest resolution.
+		float shadowCoverages[SHADOW_LOD_COUNT]{ .5f, .15f, 0 };
 	};
 
-	LightSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, MaterialSystem& materials,
-		ShadowCasterSystem& shadowCasters, TransformSystem& transforms, const Info& info = {});
+	LightSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, MaterialSystem& materials, ShadowCasterSystem& shadowCasters,
+		TransformSystem& transforms, BoundsSystem& bounds, CameraSystem& cameras, const Info& info = {});
 	~LightSystem();
 
-	void Render(VkSemaphore waitSemaphore);
-
-	/// <returns>Semaphore which triggers once all the lights have been drawn.</returns>
-	[[nodiscard]] VkSemaphore GetRenderFinishedSemaphore() const;
+	// Records the shadow maps and adds them to the frame's submission.
+	void Render();
 
 	[[nodiscard]] VkDescriptorSetLayout GetLayout() const;
 	[[nodiscard]] VkDescriptorSet GetDescriptorSet(uint32_t index) const;
+	// Dynamic offsets that need to be used when binding the external descriptor set. The index is the camera's position in iteration order.
+	[[nodiscard]] const uint32_t* GetDynamicOffsets(uint32_t cameraIndex) const;
+	[[nodiscard]] static constexpr uint32_t GetDynamicOffsetCount();
+
+protected:
+	void OnReloadShaders() override;
 
 private:
-	// Contains buffers and memory to a depth-only cubemap.
-	// This is used for point lights to render the scene from every direction (camera origin being the light itself).
-	struct CubeMapDepthBuffer final
+	// Method used to render all six faces of a cubemap, chosen based on what the device supports.
+	enum class ShadowMethod
 	{
-		VkImage image;
-		VkDeviceMemory memory;
+		// Renders every face as a separate view of a single pass, using VK_KHR_multiview.
+		multiview,
+		// Draws every mesh six times, with the vertex shader selecting the face through gl_Layer.
+		viewportLayer,
+		// Renders every face in a separate pass, culling the shadow casters per face.
+		perFace
+	};
+
+	// Single cubemap in a shadow map array. A light keeps its slot for as long as it uses the same level of detail.
+	struct ShadowSlot final
+	{
+		// View of the six faces, used for rendering all of them at once.
 		VkImageView view;
 		VkFramebuffer frameBuffer;
+		// Single layer views and frame buffers for every face, only used when rendering the faces separately.
+		VkImageView faceViews[6];
+		VkFramebuffer faceFrameBuffers[6];
+
+		// Sparse index of the light that uses this slot, or -1 if it is free.
+		int32_t owner = -1;
+		// If the cubemap contains valid shadows, so that it can be reused if nothing changed since.
+		bool cached = false;
+		// Hash of the light and the shadow casters in range at the moment the cubemap was rendered.
+		size_t hash = 0;
 	};
 
-	// Contains sync objects used to syncronize rendering with the next commands.
-	struct Frame final
+	// Depth-only cubemap array that contains all the shadow maps of a single level of detail, for every frame in flight.
+	// Point lights render the scene from every direction into one of the slots (camera origin being the light itself).
+	struct ShadowMapArray final
 	{
-		VkCommandBuffer commandBuffer;
-		VkSemaphore signalSemaphore;
+		VkImage image;
+		vi::VkGpuAllocator::Allocation memory;
+		// Cube array view, used for sampling.
+		VkImageView view;
+		glm::ivec2 resolution;
+		// Amount of slots per frame in flight.
+		uint32_t capacity;
+		vi::ArrayPtr<ShadowSlot> slots;
 	};
 
 	// UBO that contains a view matrix for every cubemap face, all multiplied by a projection matrix.
@@ -85,11 +135,15 @@ private:
 		glm::mat4 matrices[6]{};
 	};
 
-	// UBO that contains data for a single light.
-	struct FragmentLightUbo final
+	// Data for a single light. These are stored in a storage buffer, so the amount of lights isn't limited by the shader.
+	struct alignas(16) FragmentLightUbo final
 	{
 		glm::vec3 position;
 		float range;
+		// Cube index in the shadow map array, or -1 if the light doesn't have a shadow map this frame.
+		int32_t shadowIndex;
+		// Level of detail, which determines the shadow map array that is used.
+		uint32_t shadowLod;
 	};
 
 	// UBO that contains data for lighting purposes.
@@ -98,39 +152,76 @@ private:
 		uint32_t count;
 	};
 
+	// Froxel grid of a single camera, used to only evaluate the lights that can affect a fragment.
+	struct ClusterGrid final
+	{
+		// Used to convert the view depth to a depth slice.
+		float sliceScale;
+		float sliceBias;
+		// Offset into the light index list and the amount of lights, for every cluster.
+		glm::uvec2 clusters[CLUSTER_COUNT];
+	};
+
+	// Light index lists of all the clusters of a single camera.
+	struct ClusterIndices final
+	{
+		uint32_t values[CLUSTER_INDEX_CAPACITY];
+	};
+
 	struct PushConstant final
 	{
 		glm::mat4 modelMatrix;
 		uint32_t index;
+		// Cubemap face that is being rendered, only used when rendering the faces separately.
+		uint32_t face;
+	};
+
+	// Shared state for the ranges of shadow casters that are drawn in parallel.
+	struct ShadowJob final
+	{
+		LightSystem* system;
+		VkDescriptorSet* descriptorSet;
+		// Geometry and light array offsets.
+		uint32_t* dynamicOffsets;
+		uint32_t lightIndex;
+		uint32_t face;
 	};
 
+	VulkanRenderer& _renderer;
 	MaterialSystem& _materials;
 	ShadowCasterSystem& _shadowCasters;
 	TransformSystem& _transforms;
+	BoundsSystem& _bounds;
+	CameraSystem& _cameras;
 
-	// Resolution per-face for the cubemap.
-	glm::ivec2 _shadowResolution;
+	ShadowMethod _shadowMethod;
+	float _shadowCoverages[SHADOW_LOD_COUNT];
 	Shader _shader;
-	// Descriptor set per-light for the cubemap rendering.
+	// Descriptor set per-frame for the cubemap rendering. Lights are separated by dynamic offsets.
 	vi::ArrayPtr<VkDescriptorSet> _descriptorSets;
 	VkDescriptorPool _descriptorPool;
 
 	// External descriptor set that can be used to attach the rendered cubemaps to another renderer.
 	vi::ArrayPtr<VkDescriptorSet> _extDescriptorSets;
 	VkDescriptorPool _extDescriptorPool;
-	// External samplers for the cubemaps.
-	vi::ArrayPtr<VkSampler> _extSamplers;
+	// External samplers for the shadow map arrays.
+	VkSampler _extSamplers[SHADOW_LOD_COUNT];
 
 	UboAllocator<GeometryUbo> _geometryUboAllocator;
 	UboAllocator<FragmentLightUbo> _fragmentLightUboAllocator;
 	UboAllocator<FragmentLightingUbo> _fragmentLightingUboAllocator;
-	vi::ArrayPtr<GeometryUbo> _geometryUbos;
+	UboAllocator<ClusterGrid> _clusterGridAllocator;
+	UboAllocator<ClusterIndices> _clusterIndexAllocator;
 	vi::ArrayPtr<FragmentLightUbo> _fragmentUbos;
+	// Dynamic offsets for the geometry ubos of the current frame.
+	vi::ArrayPtr<uint32_t> _geometryOffsets;
+	// Frustums for every cubemap face of every light, used to cull the shadow casters when rendering the faces separately.
+	vi::ArrayPtr<Camera::Frustum> _faceFrustums;
+	// Dynamic offsets for the fragment light array, the lighting info and the clusters of every camera of the current frame.
+	vi::ArrayPtr<uint32_t> _extDynamicOffsets;
 
-	// Per-frame syncronization objects.
-	vi::ArrayPtr<Frame> _frames;
-	// Depth-only cubemaps that can be used for shadow mapping.
-	vi::ArrayPtr<CubeMapDepthBuffer> _cubeMaps;
+	// Shadow maps for every level of detail.
+	ShadowMapArray _shadowMaps[SHADOW_LOD_COUNT];
 
 	// Internal layout.
 	VkDescriptorSetLayout _layout;
@@ -138,16 +229,46 @@ private:
 	VkDescriptorSetLayout _extLayout;
 
 	VkRenderPass _renderPass;
+	// Shared by every level of detail, since the viewport is dynamic.
+	// Prewarmed in the background, and picked up when the shadows are first rendered.
 	VkPipeline _pipeline = VK_NULL_HANDLE;
 	VkPipelineLayout _pipelineLayout;
 
-	void CreateCubeMaps(vi::VkCoreSwapchain& swapChain, glm::ivec2 resolution);
-	void DestroyCubeMaps();
+	// Hashes the light and every shadow caster in range, used to check if the cubemap has to be rendered again.
+	[[nodiscard]] size_t HashShadowCasters(const FragmentLightUbo& light);
+	[[nodiscard]] static size_t Hash(size_t hash, const void* data, size_t size);
+
+	// Bins the lights into the froxel grids of every camera.
+	void UpdateClusters(uint32_t lightCount);
+	// Finds the clusters that the light's range overlaps. Returns false if the light is outside of the view.
+	[[nodiscard]] static bool GetClusterBounds(const Camera::Ubo& ubo, const Camera& camera, 
+		const FragmentLightUbo& light, glm::uvec3& outMin, glm::uvec3& outMax);
+
+	// Picks the level of detail based on how much of the screen the light's range covers.
+	[[nodiscard]] uint32_t GetShadowLod(const glm::vec3& position, float range);
+	// Hands out a shadow slot for the current frame, preferably with the given level of detail.
+	// Returns false if all the slots are taken.
+	[[nodiscard]] bool AssignShadowSlot(uint16_t lightIndex, uint32_t lod, uint32_t& outLod, uint32_t& outIndex);
+	// Frees the current frame's shadow slots of lights that no longer exist.
+	void ReleaseShadowSlots();
+	// Draws a range of shadow casters in iteration order into the shadow map of a single light.
+	static void RenderShadowRange(vi::CommandContext& context, uint32_t start, uint32_t end, void* userPtr);
+
+	void CreateShadowMaps(uint32_t frameCount, const Info& info);
+	void DestroyShadowMaps();
 
 	// Sets up the buffers to make sure the cubemaps can be used externally.
 	void CreateExtDescriptorDependencies();
 	void DestroyExtDescriptorDependencies() const;
 
-	void OnRecreateSwapChainAssets() override;
-	void DestroySwapChainAssets() const;
+	void CreatePipelineInfo(vi::VkPipelineHandler::CreateInfo& outInfo) const;
+	// Waits for the pipeline to be compiled, if it hasn't been picked up yet.
+	void AcquirePipeline();
+	void DestroyPipeline() const;
 };
+
+constexpr uint32_t LightSystem::GetDynamicOffsetCount()
+{
+	// Light array, lighting info, cluster grid and cluster indices.
+	return 4;
+}
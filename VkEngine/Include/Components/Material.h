@@ -13,6 +13,8 @@ struct Material
 {
 	Mesh* mesh = nullptr;
 	Texture* texture = nullptr;
+	// Minimum screen coverage of the mesh's bounds to use the level of detail, starting with the highest detail.
+	float lodCoverages[Mesh::MAX_LODS]{ .4f, .15f, .05f, 0 };
 };
 
 /// <summary>
@@ -26,6 +28,8 @@ public:
 
 	[[nodiscard]] Mesh& GetFallbackMesh();
 	[[nodiscard]] Texture& GetFallbackTexture();
+	// Picks the level of detail based on how much of the screen the mesh covers.
+	[[nodiscard]] static uint32_t GetLod(const Material& material, float coverage);
 
 private:
 	VulkanRenderer& _renderer;
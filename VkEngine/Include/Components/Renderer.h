@@ -1,7 +1,10 @@
 ﻿#pragma once
 #include "Rendering/ShaderExt.h"
 #include "Rendering/SwapChainExt.h"
+#include "Components/Camera.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
 
+class BoundsSystem;
 class CameraSystem;
 class LightSystem;
 class MaterialSystem;
@@ -19,34 +22,127 @@ struct Renderer final
 /// <summary>
 /// System that handles the render components.
 /// </summary>
-class RenderSystem final : public ce::System<Renderer>, SwapChainExt::Dependency
+class RenderSystem final : public ce::System<Renderer>, ShaderExt::Dependency
 {
 public:
 	explicit RenderSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, MaterialSystem& materials,
-		CameraSystem& cameras, LightSystem& lights, TransformSystem& transforms, const char* shaderName = "");
+		CameraSystem& cameras, LightSystem& lights, TransformSystem& transforms, BoundsSystem& bounds, const char* shaderName = "");
 	~RenderSystem();
 
+	// Culls the renderers against every camera on the GPU, and prepares the draw commands used when drawing.
+	// Only does work when GPU driven rendering is enabled, but has to be called every frame regardless.
+	void Cull();
 	void Draw();
 
 	/// <returns>Shader used for this renderer.<returns>
 	[[nodiscard]] Shader& GetShader();
 
 protected:
-	void OnRecreateSwapChainAssets() override;
+	void OnReloadShaders() override;
 
 private:
+	// Push constant used when textures are bound through the global bindless array.
+	struct BindlessPushConstant final
+	{
+		glm::mat4 modelMatrix;
+		uint32_t textureIndex;
+	};
+
+	// Per-renderer data used by the culling shader and the GPU driven vertex shader.
+	struct GpuInstance final
+	{
+		glm::mat4 modelMatrix;
+		// Bounding sphere in model space.
+		glm::vec4 bounds;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t textureIndex;
+	};
+
+	struct CullPushConstant final
+	{
+		Camera::Frustum frustum;
+		uint32_t instanceCount;
+		uint32_t instanceCapacity;
+		uint32_t cameraIndex;
+		// If the visible draws are packed together, which is only possible when the draw count is read from a buffer.
+		uint32_t compact;
+	};
+
+	// Resources used for GPU driven rendering, one for every frame in flight.
+	struct GpuFrame final
+	{
+		// Host visible, rewritten every frame.
+		VkBuffer instanceBuffer;
+		vi::VkGpuAllocator::Allocation instanceMemory;
+		// Draw commands written by the culling shader, with a range for every camera.
+		VkBuffer drawBuffer;
+		vi::VkGpuAllocator::Allocation drawMemory;
+		// Amount of visible draws for every camera. Host visible, so that it can be reset without a transfer.
+		VkBuffer countBuffer;
+		vi::VkGpuAllocator::Allocation countMemory;
+
+		VkDescriptorSet cullSet;
+		VkDescriptorSet instanceSet;
+	};
+
+	// Shared state for the ranges of renderers that are drawn in parallel.
+	struct DrawJob final
+	{
+		RenderSystem* system;
+		VkDescriptorSet* sets;
+		uint32_t setCount;
+		uint32_t* dynamicOffsets;
+		uint32_t dynamicOffsetCount;
+		// Used to pick the level of detail.
+		glm::vec3 cameraPosition;
+		float fieldOfView;
+	};
+
+	// Make sure this corresponds to the local size of the culling shader.
+	static constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+	VulkanRenderer& _renderer;
 	CameraSystem& _cameras;
 	LightSystem& _lights;
 	MaterialSystem& _materials;
 	TransformSystem& _transforms;
+	BoundsSystem& _bounds;
+
+	// Bounding spheres of the renderers in iteration order, gathered once per frame and culled against every camera.
+	vi::ArrayPtr<glm::vec4> _spheres;
+	vi::ArrayPtr<bool> _visible;
 
-	VkDescriptorSetLayout _layout;
+	// If the textures are bound once per frame through the texture handler's global array.
+	bool _bindless;
+	VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
 	VkPipeline _pipeline = VK_NULL_HANDLE;
 	VkPipelineLayout _pipelineLayout;
-	VkDescriptorPool _descriptorPool;
+	VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
 	vi::ArrayPtr<VkDescriptorSet> _descriptorSets;
 	Shader _shader;
 
-	void DestroySwapChainAssets() const;
+	// If culling and draw submission is done on the GPU with indirect draws.
+	bool _gpuDriven;
+	Shader _cullShader;
+	VkDescriptorSetLayout _cullLayout;
+	VkDescriptorSetLayout _instanceLayout = VK_NULL_HANDLE;
+	VkPipeline _cullPipeline;
+	VkPipelineLayout _cullPipelineLayout;
+	VkDescriptorPool _gpuDescriptorPool;
+	vi::ArrayPtr<GpuFrame> _gpuFrames;
+	// Amount of renderers written to the instance buffer this frame.
+	uint32_t _instanceCount = 0;
+
+	// Draws a range of renderers in iteration order, using the visibility of the current camera.
+	static void DrawBindlessRange(vi::CommandContext& context, uint32_t start, uint32_t end, void* userPtr);
+
+	void CreateGpuAssets();
+	void DestroyGpuAssets();
+	void CreateCullPipeline();
+	// The viewport is dynamic, so the pipeline doesn't have to be recreated when the swap chain is.
+	void CreatePipeline();
+	void DestroyPipeline() const;
 	[[nodiscard]] uint32_t GetDescriptorStartIndex() const;
 };
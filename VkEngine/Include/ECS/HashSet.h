@@ -18,6 +18,7 @@ public:
 	[[nodiscard]] bool Contains(uint16_t sparseIndex);
 
 	[[nodiscard]] size_t GetLength() const;
+	[[nodiscard]] size_t GetCount() const;
 
 	[[nodiscard]] vi::Iterator<Instance> begin() const;
 	[[nodiscard]] vi::Iterator<Instance> end() const;
@@ -102,6 +103,12 @@ size_t HashSet<T>::GetLength() const
 	return _hashMap.GetLength();
 }
 
+template <typename T>
+size_t HashSet<T>::GetCount() const
+{
+	return _instances.GetCount();
+}
+
 template <typename T>
 vi::Iterator<typename HashSet<T>::Instance> HashSet<T>::begin() const
 {
@@ -9,6 +9,12 @@
 #include "VkRenderer/VkCore/VkCoreSwapchain.h"
 #include "Rendering/PostEffectHandler.h"
 #include "Components/Renderer.h"
+#include "Components/Bounds.h"
+#include "Rendering/CommandRecorder.h"
+#include "Rendering/UploadQueue.h"
+#include "Rendering/AssetStreamer.h"
+#include "Rendering/TextureCooker.h"
+#include "Rendering/MeshOptimizer.h"
 
 /// <summary>
 /// An engine specifically made for a single game.
@@ -25,6 +31,33 @@ public:
 		// Debug using render doc.
 		bool useRenderDoc = false;
 		VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+		// Bind all textures through a single global descriptor array, instead of a descriptor set per material.
+		// Requires VK_EXT_descriptor_indexing.
+		bool bindlessTextures = false;
+		// Pack all meshes into one vertex and one index buffer, so that they can be drawn without rebinding buffers.
+		bool sharedMeshBuffers = false;
+		// Draw the renderers and shadow casters with half-sized quantized vertices. 
+		// Meshes have to be created with MeshHandler::Quantize or loaded from files cooked with quantized vertices.
+		bool quantizedVertices = false;
+		// Cull the renderers and prepare their draw commands on the GPU, so that the CPU cost doesn't grow with the amount of renderers.
+		// Implies bindless textures and shared mesh buffers, and requires multi draw indirect.
+		bool gpuDrivenRendering = false;
+		// Amount of frames the CPU can prepare ahead of the GPU. Trades latency for throughput.
+		uint32_t framesInFlight = 2;
+		// Amount of worker threads that help recording the draws, on top of the main thread.
+		uint32_t workerThreads = 3;
+		// Amount of threads that load textures in the background.
+		uint32_t streamingThreads = 2;
+		// Cook the textures that changed since they were last cooked, before anything is loaded.
+		// Cooked textures are loaded by using the cooked extension.
+		bool cookTextures = false;
+		TextureCooker::Compression cookCompression = TextureCooker::Compression::none;
+		// Writes the passes and resources of the post effect render graph, once the post effects have been added.
+		bool dumpRenderGraph = false;
+		// Recompile the shaders listed in the shader build script when their sources change, and swap them in at the end of the frame.
+		bool hotReloadShaders = false;
+		// Optional, called for every shader that has been recompiled by the hot reload, or that failed to compile.
+		ShaderExt::HotReloadInfo::OnCompiled onShaderCompiled = nullptr;
 
 		typedef void (*Awake)(Engine& engine, GameState& gameState);
 		typedef void (*Start)(Engine& engine, GameState& gameState);
@@ -45,6 +78,7 @@ public:
 
 	[[nodiscard]] VulkanRenderer& GetVulkanRenderer() const;
 	[[nodiscard]] ce::Cecsar& GetCecsar() const;
+	[[nodiscard]] AssetStreamer& GetAssetStreamer() const;
 
 	[[nodiscard]] CameraSystem& GetCameras() const;
 	[[nodiscard]] LightSystem& GetLights() const;
@@ -52,12 +86,14 @@ public:
 	[[nodiscard]] RenderSystem& GetRenderers() const;
 	[[nodiscard]] TransformSystem& GetTransforms() const;
 	[[nodiscard]] ShadowCasterSystem& GetShadowCasters() const;
+	[[nodiscard]] BoundsSystem& GetBounds() const;
 
 private:
 	bool _isRunning = false;
 	vi::WindowHandlerGLFW* _windowHandler;
 	VulkanRenderer* _renderer;
 	ce::Cecsar* _cecsar;
+	AssetStreamer* _assetStreamer;
 
 	CameraSystem* _cameras;
 	LightSystem* _lights;
@@ -65,6 +101,7 @@ private:
 	RenderSystem* _renderers;
 	ShadowCasterSystem* _shadowCasters;
 	TransformSystem* _transforms;
+	BoundsSystem* _bounds;
 
 	GameState* _gameState;
 	BasicPostEffect* _defaultPostEffect = nullptr;
@@ -76,6 +113,9 @@ int Engine<GameState>::Run(const Info& info)
 	assert(!_isRunning);
 	_isRunning = true;
 
+	if (info.cookTextures)
+		TextureCooker::CookFolder("Textures/", std::cerr, info.cookCompression);
+
 	_windowHandler = GMEM.New<vi::WindowHandlerGLFW>();
 
 	// Create the vulkan renderer.
@@ -83,7 +123,15 @@ int Engine<GameState>::Run(const Info& info)
 		vi::VkCoreInfo vkInfo{};
 		VulkanRenderer::Info addInfo{};
 		addInfo.msaaSamples = info.msaaSamples;
+		addInfo.meshInfo.sharedBuffers = info.sharedMeshBuffers || info.gpuDrivenRendering;
+		addInfo.meshInfo.quantizedVertices = info.quantizedVertices;
+		addInfo.workerCount = info.workerThreads;
 		vkInfo.windowHandler = _windowHandler;
+		vkInfo.descriptorIndexing = info.bindlessTextures || info.gpuDrivenRendering;
+		vkInfo.indirectDrawing = info.gpuDrivenRendering;
+		vkInfo.framesInFlight = info.framesInFlight;
+		// Lets the lights render their cubemaps in a single pass when the device supports it.
+		vkInfo.layeredRendering = true;
 		if(info.useRenderDoc)
 			vkInfo.validationLayers.Add("VK_LAYER_RENDERDOC_Capture");
 		_renderer = GMEM.New<VulkanRenderer>(vkInfo, addInfo);
@@ -93,15 +141,31 @@ int Engine<GameState>::Run(const Info& info)
 	_transforms = GMEM.New<TransformSystem>(*_cecsar);
 	_cameras = GMEM.New<CameraSystem>(*_cecsar, *_renderer, *_transforms);
 	_materials = GMEM.New<MaterialSystem>(*_cecsar, *_renderer);
+	{
+		// Streamed textures use the fallback texture until they are loaded.
+		AssetStreamer::Info streamerInfo{};
+		streamerInfo.workerCount = info.streamingThreads;
+		_assetStreamer = GMEM.New<AssetStreamer>(*_renderer, _materials->GetFallbackTexture(), streamerInfo);
+	}
 	_shadowCasters = GMEM.New<ShadowCasterSystem>(*_cecsar);
-	_lights = GMEM.New<LightSystem>(*_cecsar, *_renderer, *_materials, *_shadowCasters, *_transforms);
-	_renderers = GMEM.New<RenderSystem>(*_cecsar, *_renderer, *_materials, *_cameras, *_lights, *_transforms);
+	_bounds = GMEM.New<BoundsSystem>(*_cecsar, *_materials, *_transforms);
+	_lights = GMEM.New<LightSystem>(*_cecsar, *_renderer, *_materials, *_shadowCasters, *_transforms, *_bounds, *_cameras);
+	const char* shaderName = info.gpuDrivenRendering ? "gpu-" : info.bindlessTextures ? "bindless-" : "";
+	_renderers = GMEM.New<RenderSystem>(*_cecsar, *_renderer, *_materials, *_cameras, *_lights, *_transforms, *_bounds, shaderName);
 
 	_gameState = GMEM.New<GameState>();
 
 	auto& postEffectHandler = _renderer->GetPostEffectHandler();
 	auto& swapChain = _renderer->GetSwapChain();
 	auto& swapChainExt = _renderer->GetSwapChainExt();
+	auto& shaderExt = _renderer->GetShaderExt();
+
+	if (info.hotReloadShaders)
+	{
+		ShaderExt::HotReloadInfo hotReloadInfo{};
+		hotReloadInfo.onCompiled = info.onShaderCompiled;
+		shaderExt.EnableHotReload(hotReloadInfo);
+	}
 
 	if (info.awake)
 		info.awake(*this, *_gameState);
@@ -115,6 +179,9 @@ int Engine<GameState>::Run(const Info& info)
 		postEffectHandler.Add(_defaultPostEffect);
 	}
 
+	if (info.dumpRenderGraph)
+		postEffectHandler.GetRenderGraph().Dump(std::cout);
+
 	// Game update.
 	while (true)
 	{
@@ -138,13 +205,22 @@ int Engine<GameState>::Run(const Info& info)
 			break;
 
 		swapChain.WaitForImage();
-
+		// The secondary command buffers of this frame are no longer in use.
+		_renderer->GetCommandRecorder().BeginFrame();
+		// Swap in the textures that finished decoding, before anything refers to them in this frame.
+		_assetStreamer->Update();
+
+		// Both the lights and the renderers cull against the bounds.
+		_bounds->Update();
+		// The cameras have to be updated before the lights are clustered and the renderers are culled.
+		_cameras->Update();
 		// Render the lights before rendering anything else, since they might want to use the lightmaps.
-		_lights->Render(swapChain.GetImageAvaiableSemaphore());
+		// Every pass adds its commands to the swap chain, which submits all of them at once when the frame ends.
+		_lights->Render();
+		_renderers->Cull();
 		// Render the scene to the first post effect layer.
-		postEffectHandler.BeginFrame(_lights->GetRenderFinishedSemaphore());
+		postEffectHandler.BeginFrame();
 
-		_cameras->Update();
 		_renderers->Draw();
 
 		if (info.renderUpdate)
@@ -156,9 +232,13 @@ int Engine<GameState>::Run(const Info& info)
 		postEffectHandler.EndFrame();
 		swapChain.BeginFrame(false);
 		postEffectHandler.Render();
-		
-		swapChain.EndFrame(postEffectHandler.GetRenderFinishedSemaphore());
+
+		// Submit this frame's uploads ahead of the frame itself, so that it can already use them.
+		_renderer->GetUploadQueue().Update();
+		swapChain.EndFrame();
 		swapChainExt.Update();
+		// Recompiled shaders are swapped in between frames, since their pipelines are recreated.
+		shaderExt.Update();
 	}
 
 	_renderer->DeviceWaitIdle();
@@ -169,8 +249,10 @@ int Engine<GameState>::Run(const Info& info)
 	GMEM.Delete(_gameState);
 	GMEM.Delete(_renderers);
 	GMEM.Delete(_lights);
+	GMEM.Delete(_bounds);
 	GMEM.Delete(_shadowCasters);
 	GMEM.Delete(_defaultPostEffect);
+	GMEM.Delete(_assetStreamer);
 	GMEM.Delete(_materials);
 	GMEM.Delete(_cameras);
 	GMEM.Delete(_transforms);
@@ -200,6 +282,12 @@ ce::Cecsar& Engine<GameState>::GetCecsar() const
 	return *_cecsar;
 }
 
+template <typename GameState>
+AssetStreamer& Engine<GameState>::GetAssetStreamer() const
+{
+	return *_assetStreamer;
+}
+
 template <typename GameState>
 CameraSystem& Engine<GameState>::GetCameras() const
 {
@@ -224,6 +312,12 @@ TransformSystem& Engine<GameState>::GetTransforms() const
 	return *_transforms;
 }
 
+template <typename GameState>
+BoundsSystem& Engine<GameState>::GetBounds() const
+{
+	return *_bounds;
+}
+
 template <typename GameState>
 MaterialSystem& Engine<GameState>::GetMaterials() const
 {
@@ -0,0 +1,115 @@
+﻿#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Rendering/TextureHandler.h"
+#include "Utils/LockFreeQueue.h"
+
+class VulkanRenderer;
+
+/// <summary>
+/// Loads textures in the background, so that level loads and runtime streaming don't stall the frame.<br>
+/// A pool of worker threads reads and decodes the files, highest priority first, and hands the pixels back through a lock-free queue.<br>
+/// The main thread uploads them once per frame. Until then, the texture is a copy of the placeholder,
+/// so it can be assigned to materials directly after requesting it.
+/// </summary>
+class AssetStreamer final
+{
+public:
+	// Index of a streamed texture.
+	typedef uint32_t Handle;
+
+	// Maximum amount of decoded textures waiting to be uploaded.
+	static constexpr uint32_t RESULT_CAPACITY = 64;
+	// Maximum length of a texture path, including the folder and extension.
+	static constexpr uint32_t MAX_PATH_LENGTH = 128;
+
+	/// <summary>
+	/// Struct used to construct the asset streamer.
+	/// </summary>
+	struct Info final
+	{
+		// Amount of threads that read and decode files. Clamped to the amount of hardware threads.
+		uint32_t workerCount = 2;
+		// Maximum amount of streamed textures present.
+		uint32_t capacity = 256;
+		// Maximum amount of textures that are uploaded per frame, which spreads out the cost of large loads.
+		uint32_t maxUploadsPerFrame = 4;
+	};
+
+	AssetStreamer(VulkanRenderer& renderer, const Texture& placeholder, const Info& info = {});
+	~AssetStreamer();
+
+	// Starts loading a texture in the background. Assumes the texture is in the correct folder.
+	// Textures with a higher priority are decoded first.
+	[[nodiscard]] Handle Load(const char* name, const char* extension, int32_t priority = 0);
+	// Changes the priority of a texture that hasn't started decoding yet.
+	void SetPriority(Handle handle, int32_t priority);
+	// Cancels the load if it hasn't finished yet, otherwise destroys the texture.
+	// Like with the texture handler, the texture shouldn't be in use by the GPU anymore.
+	void Unload(Handle handle);
+
+	/// <returns>The placeholder until the texture has been loaded. Its address stays the same, so it can be stored in materials.</returns>
+	[[nodiscard]] Texture& GetTexture(Handle handle) const;
+	[[nodiscard]] bool IsLoaded(Handle handle) const;
+
+	// Uploads the textures that have been decoded. Call this once per frame, before anything is recorded.
+	void Update();
+
+private:
+	enum class State
+	{
+		free,
+		// Waiting for a worker, or being read and decoded by one.
+		queued,
+		// Unloaded while decoding, so the result is thrown away.
+		cancelled,
+		loaded,
+		// The file couldn't be read or decoded, so the placeholder is kept.
+		failed
+	};
+
+	// Only the main thread touches the slots, except for the path and priority which are also read by the workers.
+	struct Slot final
+	{
+		Texture texture;
+		char path[MAX_PATH_LENGTH];
+		int32_t priority;
+		State state;
+	};
+
+	// Decoded pixels, handed from the workers to the main thread.
+	struct Result final
+	{
+		Handle handle;
+		// Null if the file couldn't be read or decoded.
+		unsigned char* pixels;
+		glm::ivec2 resolution;
+		uint8_t channels;
+	};
+
+	VulkanRenderer& _renderer;
+	Texture _placeholder;
+	uint32_t _maxUploadsPerFrame;
+
+	vi::ArrayPtr<Slot> _slots;
+	vi::Vector<Handle> _freeHandles{ 8, GMEM_VOL };
+
+	// Handles that are waiting for a worker. Shared with the workers, so only accessed while locked.
+	vi::ArrayPtr<Handle> _queued;
+	uint32_t _queuedCount = 0;
+
+	std::mutex _mutex;
+	// Wakes up the workers when a texture has been queued.
+	std::condition_variable _wake;
+	bool _quit = false;
+	vi::ArrayPtr<std::thread*> _workers;
+
+	LockFreeQueue<Result, RESULT_CAPACITY> _results;
+
+	void WorkerLoop();
+	// Takes the queued texture with the highest priority. Only call this while locked.
+	[[nodiscard]] Handle PopQueued();
+	// Removes the texture from the queue if it's still in there. Only call this while locked.
+	[[nodiscard]] bool RemoveQueued(Handle handle);
+};
@@ -0,0 +1,85 @@
+﻿#pragma once
+#include "Utils/JobSystem.h"
+#include "VkRenderer/VkHandlers/CommandContext.h"
+
+class VulkanRenderer;
+
+/// <summary>
+/// Records render passes through secondary command buffers, so that large amounts of draws can be recorded on multiple threads.<br>
+/// Every thread has its own command pools for every frame in flight, which are reset as a whole at the start of the frame.<br>
+/// Commands recorded on the calling thread go to an "inline" secondary command buffer, so that the render pass can still be used as if it was inline.<br>
+/// Every range gets its own context, so the ranges don't share any recording state.
+/// </summary>
+class CommandRecorder final
+{
+public:
+	// Records the items in the range [start, end) into the context.
+	// Ranges can be recorded in separate command buffers, so the pipeline and descriptor sets have to be bound every time.
+	typedef void (*RecordRange)(vi::CommandContext& context, uint32_t start, uint32_t end, void* userPtr);
+
+	// Maximum amount of secondary command buffers a single thread can record per frame.
+	static constexpr uint32_t MAX_SECONDARIES_PER_THREAD = 64;
+	// Items are never split into smaller ranges than this, since every secondary command buffer comes with some overhead.
+	static constexpr uint32_t MIN_RANGE_SIZE = 64;
+
+	explicit CommandRecorder(VulkanRenderer& renderer, JobSystem& jobSystem);
+	~CommandRecorder();
+
+	// Resets the command pools of the current frame in flight. Call this once per frame, after waiting for the frame's fence.
+	void BeginFrame();
+
+	// Call directly after beginning a render pass with secondary command buffer contents in the primary context.
+	// Every secondary command buffer gets a viewport and scissor that cover the extent, since they aren't inherited.
+	void BeginRenderPass(vi::CommandContext& primary, VkRenderPass renderPass, VkFramebuffer frameBuffer, glm::ivec2 extent);
+	// Splits the items into ranges that are recorded in parallel. They're executed in order, after the previously recorded commands.
+	void Record(uint32_t count, RecordRange record, void* userPtr = nullptr);
+	// Call directly before ending the render pass.
+	void EndRenderPass();
+
+	// Context of the inline command buffer, which records the commands of the calling thread between the ranges.
+	// Its bound state is reset after every parallel recording, since the ranges continue in a new command buffer.
+	[[nodiscard]] vi::CommandContext& GetContext();
+
+private:
+	struct Pool final
+	{
+		VkCommandPool pool;
+		// Amount of command buffers that have been handed out this frame.
+		uint32_t used;
+	};
+
+	struct RangeJob final
+	{
+		CommandRecorder* recorder;
+		RecordRange record;
+		void* userPtr;
+		uint32_t count;
+		uint32_t rangeCount;
+	};
+
+	VulkanRenderer& _renderer;
+	JobSystem& _jobSystem;
+
+	// Pools for every thread of every frame in flight, sequenced like so:
+	// [Frame 0: [thread 0, thread 1 ...], Frame 1: [thread 0, thread 1 ...]]
+	vi::ArrayPtr<Pool> _pools;
+	// Secondary command buffers of every pool, allocated when they're first needed.
+	vi::ArrayPtr<VkCommandBuffer> _buffers;
+	uint32_t _frameIndex = 0;
+
+	VkCommandBufferInheritanceInfo _inheritance{};
+	glm::ivec2 _extent{};
+	// Context of the render pass' primary command buffer, which executes the secondary command buffers.
+	vi::CommandContext* _primary = nullptr;
+	vi::CommandContext _inline{};
+	// The inline command buffer, followed by the command buffers of the ranges that are being recorded.
+	vi::ArrayPtr<VkCommandBuffer> _recorded;
+
+	// Hands out the next secondary command buffer of the calling thread.
+	[[nodiscard]] VkCommandBuffer GetSecondary();
+	// Begins recording the secondary command buffer with the current render pass.
+	void BeginSecondary(vi::CommandContext& context, VkCommandBuffer buffer) const;
+	void BeginInline();
+
+	static void RecordJob(uint32_t index, void* userPtr);
+};
@@ -4,19 +4,54 @@
 #include "VkRenderer/VkCore/VkCore.h"
 #include "VkRenderer/VkHandlers/VkCommandBufferHandler.h"
 #include "VkRenderer/VkHandlers/VkShaderHandler.h"
-#include "VkRenderer/VkHandlers/VkMemoryHandler.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
 #include "VkRenderer/VkHandlers/VkSyncHandler.h"
+#include "Rendering/UploadQueue.h"
 
 /// <summary>
 /// Struct that contains relevant mesh data.
 /// </summary>
 struct Mesh final
 {
+	static constexpr uint32_t MAX_LODS = 4;
+
+	// Byte range within a vertex or index buffer.
+	struct Range final
+	{
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+	};
+
+	// Index range of a single level of detail. All levels share the same vertices.
+	struct Lod final
+	{
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+	};
+
 	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexMemory;
+	vi::VkGpuAllocator::Allocation vertexMemory;
 	VkBuffer indexBuffer;
-	VkDeviceMemory indexMemory;
+	vi::VkGpuAllocator::Allocation indexMemory;
 	uint32_t indexCount;
+	// Based on the index type the mesh was created with.
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+
+	// Where the mesh starts within the buffers. Only non-zero when the mesh is part of the shared buffers.
+	uint32_t firstIndex = 0;
+	int32_t vertexOffset = 0;
+	Range vertexRange{};
+	Range indexRange{};
+
+	// Levels of detail, starting with the highest detail. The first level matches the first index and index count.
+	Lod lods[MAX_LODS]{};
+	uint32_t lodCount = 1;
+
+	// Bounding sphere in model space, with the radius stored in w.
+	glm::vec4 bounds{ 0 };
+
+	// Batch in which the vertices and indices are uploaded.
+	UploadQueue::Handle upload = 0;
 };
 
 /// <summary>
@@ -25,12 +60,15 @@ struct Mesh final
 class MeshHandler final : public vi::VkHandler
 {
 public:
-	// Struct from which to create a new mesh.
+	// Struct from which to create a new mesh. Indices can be 16 or 32 bit.
 	template <typename Vert = Vertex, typename Ind = Vertex::Index>
 	struct VertexData final
 	{
 		vi::ArrayPtr<Vert> vertices{};
 		vi::ArrayPtr<Ind> indices{};
+		// Index count of every level of detail, which are stored back to back in the indices starting with the highest detail.
+		// Leave empty if the mesh only has one level.
+		vi::ArrayPtr<uint32_t> lods{};
 	};
 
 	// The axes to use as the forward direction.
@@ -39,94 +77,196 @@ public:
 		x, y, z
 	};
 
-	explicit MeshHandler(vi::VkCore& core);
+	// Used to create the mesh handler with.
+	struct Info final
+	{
+		// Pack all meshes into one vertex and one index buffer, so that switching meshes doesn't require rebinding buffers.
+		bool sharedBuffers = false;
+		// Size of the shared vertex buffer in bytes.
+		VkDeviceSize vertexCapacity = 16 * 1024 * 1024;
+		// Size of the shared index buffer in bytes.
+		VkDeviceSize indexCapacity = 4 * 1024 * 1024;
+		// Use quantized vertices for the meshes drawn by the render and light systems, which halves the vertex bandwidth.
+		bool quantizedVertices = false;
+	};
+
+	// "VKMS" in little endian.
+	static constexpr uint32_t FILE_MAGIC = 0x534D4B56;
+	// Increment this when the layout changes.
+	static constexpr uint32_t FILE_VERSION = 2;
+	static constexpr const char* FILE_EXTENSION = "vkmesh";
+
+	// Header of a cooked mesh file, followed by the vertices and then the indices. 
+	// Both are stored exactly as they are in GPU memory.
+	struct FileHeader final
+	{
+		uint32_t magic;
+		uint32_t version;
+		VertexLayout layout;
+		uint32_t vertexStride;
+		uint32_t indexStride;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t lodCount;
+		uint32_t lodIndexCounts[Mesh::MAX_LODS];
+		// Offsets from the start of the file.
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		glm::vec4 bounds;
+	};
+
+	MeshHandler(vi::VkCore& core, UploadQueue& uploadQueue, const Info& info = {});
+	~MeshHandler();
 
 	// Generate vertex data for a quad rotated based on the forward axis.
 	[[nodiscard]] static VertexData<Vertex, Vertex::Index> GenerateQuad(ForwardAxis axis = z, bool counterClockwise = false, vi::FreeListAllocator& allocator = GMEM_TEMP);
 	// Generate vertex data for a cube.
 	[[nodiscard]] static VertexData<Vertex, Vertex::Index> GenerateCube(vi::FreeListAllocator& allocator = GMEM_TEMP);
+	// Converts standard vertex data to quantized vertices.
+	template <typename Ind>
+	[[nodiscard]] static VertexData<QuantizedVertex, Ind> Quantize(const VertexData<Vertex, Ind>& vertexData, 
+		vi::FreeListAllocator& allocator = GMEM_TEMP);
+	// Writes the vertex data to a cooked mesh file, which can be loaded without any parsing.
+	template <typename Vert = Vertex, typename Ind = Vertex::Index>
+	static bool Save(const char* path, const VertexData<Vert, Ind>& vertexData);
 
 	// Create a mesh based on the given vertex data.
+	// The data is uploaded asynchronously, but the mesh can be drawn right away.
 	template <typename Vert = Vertex, typename Ind = Vertex::Index>
-	[[nodiscard]] Mesh Create(const VertexData<Vert, Ind>& vertexData) const;
-	// Bind a mesh to use it for drawing purposes.
-	void Bind(Mesh& mesh);
-	// Draw the mesh based on the bound pipeline and shaders.
-	void Draw() const;
+	[[nodiscard]] Mesh Create(const VertexData<Vert, Ind>& vertexData);
+	// Loads a cooked mesh. Assumes the mesh is in the correct folder.
+	// The file is mapped and its contents are copied straight into the staging buffer.
+	// Throws an exception if the file is missing, invalid or cooked with a different vertex layout.
+	[[nodiscard]] Mesh Load(const char* name);
+	/// <returns>The header if the data contains a valid mesh of the current version, otherwise a nullptr.</returns>
+	[[nodiscard]] static const FileHeader* Validate(const void* data, size_t size);
+	// Bind a mesh to use it for drawing purposes. Levels of detail beyond the mesh's level count use the lowest detail.
+	// The buffers are only rebound when they differ from the ones already bound to the context.
+	void Bind(vi::CommandContext& context, Mesh& mesh, uint32_t lod = 0) const;
+	// Draw the mesh that was last bound to the context, based on the bound pipeline and shaders.
+	void Draw(const vi::CommandContext& context, uint32_t instanceCount = 1) const;
 	// Destroy the mesh.
-	void Destroy(const Mesh& mesh) const;
+	void Destroy(const Mesh& mesh);
+
+	// Returns true if all meshes are packed into the shared buffers.
+	[[nodiscard]] bool IsShared() const;
+	// Shared vertex buffer. Only valid when the buffers are shared.
+	[[nodiscard]] VkBuffer GetVertexBuffer() const;
+	// Shared index buffer. Only valid when the buffers are shared.
+	[[nodiscard]] VkBuffer GetIndexBuffer() const;
+	// Returns true if the render and light systems expect quantized vertices.
+	[[nodiscard]] bool IsQuantized() const;
+	// Returns a vulkan description for the vertex binding of the meshes drawn by the render and light systems.
+	[[nodiscard]] VkVertexInputBindingDescription GetBindingDescription() const;
+	// Returns a vulkan description for the vertex attributes of the meshes drawn by the render and light systems.
+	[[nodiscard]] vi::Vector<VkVertexInputAttributeDescription> GetAttributeDescriptions() const;
 
 private:
-	uint32_t _boundIndexCount = UINT32_MAX;
+	// Type independent mesh data.
+	struct CreateInfo final
+	{
+		const void* vertices;
+		VkDeviceSize vertexSize;
+		VkDeviceSize vertexStride;
+		const void* indices;
+		VkDeviceSize indexSize;
+		VkDeviceSize indexStride;
+		// Index count of every level of detail. Can be empty.
+		const uint32_t* lods;
+		uint32_t lodCount;
+		glm::vec4 bounds;
+	};
+
+	UploadQueue& _uploadQueue;
+	bool _shared;
+	bool _quantized;
+
+	VkBuffer _vertexBuffer = VK_NULL_HANDLE;
+	vi::VkGpuAllocator::Allocation _vertexMemory{};
+	VkBuffer _indexBuffer = VK_NULL_HANDLE;
+	vi::VkGpuAllocator::Allocation _indexMemory{};
+	// Unused ranges within the shared buffers. Adjacent ranges are always merged.
+	vi::Vector<Mesh::Range> _freeVertexRanges{ 8, GMEM_VOL };
+	vi::Vector<Mesh::Range> _freeIndexRanges{ 8, GMEM_VOL };
+
+	// Finds the first free range that fits, and returns the aligned offset to it.
+	[[nodiscard]] static VkDeviceSize AllocateRange(vi::Vector<Mesh::Range>& freeRanges, VkDeviceSize size, VkDeviceSize alignment);
+	static void FreeRange(vi::Vector<Mesh::Range>& freeRanges, const Mesh::Range& range);
+
+	[[nodiscard]] Mesh Create(const CreateInfo& info);
+	[[nodiscard]] static VkIndexType GetIndexType(VkDeviceSize indexStride);
+	// Fills in the offsets and writes the header and the data.
+	static bool Save(const char* path, FileHeader& header, const void* vertices, const void* indices);
+	template <typename Vert>
+	[[nodiscard]] static glm::vec4 CalculateBounds(const vi::ArrayPtr<Vert>& vertices);
 };
 
 template <typename Vert, typename Ind>
-Mesh MeshHandler::Create(const VertexData<Vert, Ind>& vertexData) const
+Mesh MeshHandler::Create(const VertexData<Vert, Ind>& vertexData)
 {
+	static_assert(sizeof(Ind) == sizeof(uint16_t) || sizeof(Ind) == sizeof(uint32_t), "Indices have to be 16 or 32 bit.");
+
 	auto& vertices = vertexData.vertices;
 	auto& indices = vertexData.indices;
 
-	auto& commandBufferHandler = core.GetCommandBufferHandler();
-	auto& memoryHandler = core.GetMemoryHandler();
-	auto& shaderHandler = core.GetShaderHandler();
-	auto& syncHandler = core.GetSyncHandler();
-
-	auto cpyCommandBuffer = commandBufferHandler.Create();
-	const auto cpyFence = syncHandler.CreateFence();
-
-	// Allocate staging memory for vertices.
-	const auto vertStagingBuffer = shaderHandler.CreateBuffer(sizeof(Vert) * vertices.GetLength(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	const auto vertStagingMem = memoryHandler.Allocate(vertStagingBuffer,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	memoryHandler.Bind(vertStagingBuffer, vertStagingMem);
-	memoryHandler.Map(vertStagingMem, vertices.GetData(), 0, sizeof(Vert) * vertices.GetLength());
-
-	// Allocate shader efficient memory for the vertices.
-	const auto vertBuffer = shaderHandler.CreateBuffer(sizeof(Vert) * vertices.GetLength(),
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-	const auto vertMem = memoryHandler.Allocate(vertBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	memoryHandler.Bind(vertBuffer, vertMem);
-
-	// Allocate staging memory for indices.
-	const auto indStagingBuffer = shaderHandler.CreateBuffer(sizeof(Ind) * indices.GetLength(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	const auto indStagingMem = memoryHandler.Allocate(indStagingBuffer,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	memoryHandler.Bind(indStagingBuffer, indStagingMem);
-	memoryHandler.Map(indStagingMem, indices.GetData(), 0, sizeof(Ind) * indices.GetLength());
-
-	// Allocate shader efficient memory for the indices.
-	const auto indBuffer = shaderHandler.CreateBuffer(sizeof(Ind) * indices.GetLength(),
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-	const auto indMem = memoryHandler.Allocate(indBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	memoryHandler.Bind(indBuffer, indMem);
-
-	// Copy data from the staging buffers to the gpu efficient buffers.
-	commandBufferHandler.BeginRecording(cpyCommandBuffer);
-	shaderHandler.CopyBuffer(vertStagingBuffer, vertBuffer, vertices.GetLength() * sizeof(Vert));
-	shaderHandler.CopyBuffer(indStagingBuffer, indBuffer, indices.GetLength() * sizeof(Ind));
-	commandBufferHandler.EndRecording();
-
-	vi::VkCommandBufferHandler::SubmitInfo submitInfo{};
-	submitInfo.buffers = &cpyCommandBuffer;
-	submitInfo.buffersCount = 1;
-	submitInfo.fence = cpyFence;
-	commandBufferHandler.Submit(submitInfo);
-	syncHandler.WaitForFence(cpyFence);
-
-	// Free staging buffers/memory.
-	shaderHandler.DestroyBuffer(vertStagingBuffer);
-	memoryHandler.Free(vertStagingMem);
-	shaderHandler.DestroyBuffer(indStagingBuffer);
-	memoryHandler.Free(indStagingMem);
-
-	syncHandler.DestroyFence(cpyFence);
-	commandBufferHandler.Destroy(cpyCommandBuffer);
-
-	Mesh mesh{};
-	mesh.vertexBuffer = vertBuffer;
-	mesh.vertexMemory = vertMem;
-	mesh.indexBuffer = indBuffer;
-	mesh.indexMemory = indMem;
-	mesh.indexCount = indices.GetLength();
-	return mesh;
+	CreateInfo info{};
+	info.vertices = vertices.GetData();
+	info.vertexSize = sizeof(Vert) * vertices.GetLength();
+	info.vertexStride = sizeof(Vert);
+	info.indices = indices.GetData();
+	info.indexSize = sizeof(Ind) * indices.GetLength();
+	info.indexStride = sizeof(Ind);
+	info.lods = vertexData.lods.GetData();
+	info.lodCount = static_cast<uint32_t>(vertexData.lods.GetLength());
+	info.bounds = CalculateBounds(vertices);
+	return Create(info);
+}
+
+template <typename Ind>
+MeshHandler::VertexData<QuantizedVertex, Ind> MeshHandler::Quantize(const VertexData<Vertex, Ind>& vertexData, 
+	vi::FreeListAllocator& allocator)
+{
+	VertexData<QuantizedVertex, Ind> quantized{};
+	quantized.vertices = vi::ArrayPtr<QuantizedVertex>(vertexData.vertices.GetLength(), allocator);
+	quantized.indices = vi::ArrayPtr<Ind>(vertexData.indices.GetData(), vertexData.indices.GetLength(), allocator);
+	if (vertexData.lods.GetLength() > 0)
+		quantized.lods = vi::ArrayPtr<uint32_t>(vertexData.lods.GetData(), vertexData.lods.GetLength(), allocator);
+	for (uint32_t i = 0; i < vertexData.vertices.GetLength(); ++i)
+		quantized.vertices[i] = QuantizedVertex::Quantize(vertexData.vertices[i]);
+	return quantized;
+}
+
+template <typename Vert, typename Ind>
+bool MeshHandler::Save(const char* path, const VertexData<Vert, Ind>& vertexData)
+{
+	FileHeader header{};
+	header.layout = Vert::LAYOUT;
+	header.vertexStride = sizeof(Vert);
+	header.indexStride = sizeof(Ind);
+	header.vertexCount = vertexData.vertices.GetLength();
+	header.indexCount = vertexData.indices.GetLength();
+	header.lodCount = vi::Ut::Max<uint32_t>(vertexData.lods.GetLength(), 1);
+	assert(header.lodCount <= Mesh::MAX_LODS);
+	for (uint32_t i = 0; i < header.lodCount; ++i)
+		header.lodIndexCounts[i] = vertexData.lods.GetLength() > 0 ? vertexData.lods[i] : header.indexCount;
+	header.bounds = CalculateBounds(vertexData.vertices);
+	return Save(path, header, vertexData.vertices.GetData(), vertexData.indices.GetData());
+}
+
+template <typename Vert>
+glm::vec4 MeshHandler::CalculateBounds(const vi::ArrayPtr<Vert>& vertices)
+{
+	// Fit a sphere around the center of the bounding box, used for culling.
+	glm::vec3 min{ FLT_MAX };
+	glm::vec3 max{ -FLT_MAX };
+	for (auto& vertex : vertices)
+	{
+		min = glm::min(min, vertex.GetPosition());
+		max = glm::max(max, vertex.GetPosition());
+	}
+	const glm::vec3 center = (min + max) * .5f;
+	float radius = 0;
+	for (auto& vertex : vertices)
+		radius = vi::Ut::Max(radius, glm::length(vertex.GetPosition() - center));
+	return glm::vec4(center, radius);
 }
@@ -0,0 +1,120 @@
+﻿#pragma once
+#include "Rendering/MeshHandler.h"
+
+/// <summary>
+/// Processes vertex data before it's used to create or save a mesh.<br>
+/// Removes duplicate vertices, orders the triangles for the post-transform cache and to reduce overdraw,
+/// orders the vertices in the order they're fetched, and generates levels of detail that share the same vertices.
+/// </summary>
+class MeshOptimizer final
+{
+public:
+	// Size of the simulated post-transform cache. Kept small, so that the order holds up on most hardware.
+	static constexpr uint32_t CACHE_SIZE = 16;
+
+	struct Info final
+	{
+		// Merge vertices with identical contents.
+		bool deduplicate = true;
+		// Order the triangles so that their vertices are likely to still be in the post-transform cache.
+		bool optimizeCache = true;
+		// Draw the clusters of triangles that face outwards first, as long as the cache miss ratio grows less than the threshold.
+		bool optimizeOverdraw = true;
+		float overdrawThreshold = 1.05f;
+		// Order the vertices by their first use, which also removes unused vertices.
+		bool optimizeFetch = true;
+		// Amount of levels of detail, including the original.
+		uint32_t lodCount = 1;
+		// Fraction of the triangles kept by every next level of detail.
+		float lodReduction = .5f;
+	};
+
+	struct Stats final
+	{
+		// Average cache miss ratio, or the amount of vertices transformed per triangle. Lower is better, with .5 as the practical minimum.
+		float acmrBefore;
+		float acmrAfter;
+		uint32_t vertexCountBefore;
+		uint32_t vertexCountAfter;
+		// Levels of detail that were generated. Can be less than requested when a mesh can't be simplified any further.
+		uint32_t lodCount;
+		uint32_t lodIndexCounts[Mesh::MAX_LODS];
+	};
+
+	// Returns optimized vertex data. If the data already has levels of detail, only the first one is used.
+	template <typename Vert = Vertex, typename Ind = Vertex::Index>
+	[[nodiscard]] static MeshHandler::VertexData<Vert, Ind> Optimize(const MeshHandler::VertexData<Vert, Ind>& vertexData,
+		const Info& info = {}, Stats* outStats = nullptr, vi::FreeListAllocator& allocator = GMEM_TEMP);
+
+	// Simulates a FIFO post-transform cache, and returns the average amount of cache misses per triangle.
+	[[nodiscard]] static float CalculateAcmr(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+private:
+	// Symmetric 4x4 matrix that sums the squared distances to a set of planes.
+	struct Quadric final
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		void Add(const Quadric& other);
+		[[nodiscard]] double Evaluate(const glm::vec3& position) const;
+		[[nodiscard]] static Quadric FromPlane(const glm::vec3& normal, float distance, float weight);
+	};
+
+	// Type independent part of the optimization.
+	// Outputs the source vertex of every optimized vertex, and replaces the indices with those of every level of detail.
+	static void Optimize(const void* vertices, size_t stride, uint32_t vertexCount, const glm::vec3* positions,
+		vi::Vector<uint32_t>& indices, const Info& info, vi::Vector<uint32_t>& outVertexOrder, Stats& outStats);
+
+	static void Deduplicate(const void* vertices, size_t stride, uint32_t vertexCount, 
+		vi::Vector<uint32_t>& indices, vi::Vector<uint32_t>& outVertexOrder);
+	// Tom Forsyth's linear-speed vertex cache optimization.
+	static void OptimizeCache(vi::Vector<uint32_t>& indices, uint32_t vertexCount);
+	[[nodiscard]] static float GetVertexScore(int32_t cachePosition, uint32_t remainingValence);
+	// Splits the triangles into clusters where the cache order starts over, and sorts them from the outside in.
+	static void OptimizeOverdraw(vi::Vector<uint32_t>& indices, const vi::ArrayPtr<glm::vec3>& positions, float threshold);
+	static void OptimizeFetch(vi::Vector<uint32_t>& indices, vi::Vector<uint32_t>& vertexOrder);
+	// Quadric error vertex clustering. Searches for the finest grid that fits the target, and keeps the vertex with the lowest error for every cell.
+	static void Simplify(const vi::Vector<uint32_t>& indices, const vi::ArrayPtr<glm::vec3>& positions,
+		uint32_t targetIndexCount, vi::Vector<uint32_t>& outIndices);
+	static void Cluster(const vi::Vector<uint32_t>& indices, const vi::ArrayPtr<glm::vec3>& positions, 
+		const vi::ArrayPtr<Quadric>& quadrics, const glm::vec3& min, float cellSize, uint32_t resolution, vi::Vector<uint32_t>& outIndices);
+};
+
+template <typename Vert, typename Ind>
+MeshHandler::VertexData<Vert, Ind> MeshOptimizer::Optimize(const MeshHandler::VertexData<Vert, Ind>& vertexData,
+	const Info& info, Stats* outStats, vi::FreeListAllocator& allocator)
+{
+	const auto vertexCount = static_cast<uint32_t>(vertexData.vertices.GetLength());
+	vi::ArrayPtr<glm::vec3> positions{ vertexCount, GMEM_TEMP };
+	for (uint32_t i = 0; i < vertexCount; ++i)
+		positions[i] = vertexData.vertices[i].GetPosition();
+
+	const auto indexCount = static_cast<uint32_t>(vertexData.lods.GetLength() > 0 ? vertexData.lods[0] : vertexData.indices.GetLength());
+	vi::Vector<uint32_t> indices{ indexCount, GMEM_TEMP, indexCount };
+	for (uint32_t i = 0; i < indexCount; ++i)
+		indices[i] = vertexData.indices[i];
+
+	Stats stats{};
+	vi::Vector<uint32_t> vertexOrder{ vertexCount, GMEM_TEMP };
+	Optimize(vertexData.vertices.GetData(), sizeof(Vert), vertexCount, positions.GetData(), indices, info, vertexOrder, stats);
+	if (outStats)
+		*outStats = stats;
+
+	MeshHandler::VertexData<Vert, Ind> optimized{};
+	const auto optimizedVertexCount = static_cast<uint32_t>(vertexOrder.GetCount());
+	optimized.vertices = vi::ArrayPtr<Vert>(optimizedVertexCount, allocator);
+	for (uint32_t i = 0; i < optimizedVertexCount; ++i)
+		optimized.vertices[i] = vertexData.vertices[vertexOrder[i]];
+
+	const auto optimizedIndexCount = static_cast<uint32_t>(indices.GetCount());
+	optimized.indices = vi::ArrayPtr<Ind>(optimizedIndexCount, allocator);
+	for (uint32_t i = 0; i < optimizedIndexCount; ++i)
+	{
+		assert(indices[i] <= std::numeric_limits<Ind>::max());
+		optimized.indices[i] = static_cast<Ind>(indices[i]);
+	}
+
+	if (stats.lodCount > 1)
+		optimized.lods = vi::ArrayPtr<uint32_t>(stats.lodIndexCounts, stats.lodCount, allocator);
+	return optimized;
+}
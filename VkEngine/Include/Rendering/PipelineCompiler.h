@@ -0,0 +1,73 @@
+﻿#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "VkRenderer/VkHandlers/VkHandler.h"
+#include "VkRenderer/VkHandlers/VkPipelineHandler.h"
+
+/// <summary>
+/// Creates graphics pipelines on background threads, so that compiling them doesn't stall the frame.<br>
+/// Compilation starts right away and the pipeline can be picked up once it's ready, 
+/// which also allows multiple pipelines to be compiled in parallel.
+/// </summary>
+class PipelineCompiler final : public vi::VkHandler
+{
+public:
+	// Index of a pipeline that is being compiled.
+	typedef uint32_t Handle;
+
+	// Maximum amount of pipelines that can be compiled at the same time.
+	static constexpr uint32_t CAPACITY = 32;
+
+	// The amount of workers is clamped to the amount of hardware threads.
+	PipelineCompiler(vi::VkCore& core, uint32_t workerCount);
+	~PipelineCompiler();
+
+	// Starts compiling the pipeline in the background. Takes over the contents of the info, so it can't be used afterwards.
+	// If a layout is given, the pipeline uses it instead of creating its own. The layout has to outlive the compilation.
+	[[nodiscard]] Handle Compile(vi::VkPipelineHandler::CreateInfo& info, VkPipelineLayout layout = VK_NULL_HANDLE);
+	[[nodiscard]] bool IsReady(Handle handle);
+	// Hands over the pipeline, after which the handle is no longer valid. 
+	// Blocks until the pipeline is ready. If it hasn't started compiling yet, it's compiled on the calling thread instead.
+	void Acquire(Handle handle, VkPipeline& outPipeline, VkPipelineLayout& outLayout);
+
+private:
+	enum class State
+	{
+		free,
+		queued,
+		compiling,
+		done
+	};
+
+	struct Job final
+	{
+		// Owned by the job, since the caller's info might go out of scope before the pipeline is compiled.
+		vi::VkPipelineHandler::CreateInfo* info;
+		VkPipeline pipeline;
+		VkPipelineLayout layout;
+		State state;
+		// If the layout was handed over by the caller, in which case it isn't owned by the job.
+		bool sharedLayout;
+	};
+
+	// Only the main thread touches the info, except for the workers reading it while compiling.
+	vi::ArrayPtr<Job> _jobs;
+	vi::Vector<Handle> _freeHandles{ CAPACITY, GMEM };
+
+	std::mutex _mutex;
+	// Wakes up the workers when a pipeline has been queued.
+	std::condition_variable _wake;
+	// Wakes up the main thread when a pipeline has been compiled.
+	std::condition_variable _done;
+	// Queued handles in the order they were compiled in.
+	Handle _queue[CAPACITY];
+	uint32_t _queueStart = 0;
+	uint32_t _queuedCount = 0;
+	bool _quit = false;
+
+	vi::ArrayPtr<std::thread*> _workers;
+
+	void WorkerLoop();
+	void Create(const Job& job, VkPipeline& outPipeline, VkPipelineLayout& outLayout) const;
+};
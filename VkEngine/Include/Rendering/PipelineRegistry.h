@@ -0,0 +1,102 @@
+﻿#pragma once
+#include "VkRenderer/VkHandlers/VkPipelineHandler.h"
+#include "Rendering/PipelineCompiler.h"
+#include "Rendering/ShaderExt.h"
+
+class VulkanRenderer;
+
+/// <summary>
+/// Shares graphics pipelines between everything that creates them with identical create infos.<br>
+/// Pipelines are keyed by their full create info and reference counted. The key is hashed for lookups,
+/// and compared in full when the hashes match. 
+/// Pipeline layouts are shared the same way, between pipelines with the same set layouts and push constants.<br>
+/// Pipelines stop being shared once one of their modules is destroyed, since a new module can get the same handle.
+/// </summary>
+class PipelineRegistry final : ShaderExt::Dependency
+{
+public:
+	explicit PipelineRegistry(VulkanRenderer& renderer);
+	~PipelineRegistry();
+
+	// Returns the pipeline that matches the info, and creates it if there isn't one yet. Release it when it's no longer needed.
+	// If the pipeline is still being prewarmed, this waits for it to finish.
+	void Get(const vi::VkPipelineHandler::CreateInfo& info, VkPipeline& outPipeline, VkPipelineLayout& outLayout);
+	void Release(VkPipeline pipeline);
+	// Starts compiling the pipelines in the background, so that getting them later on doesn't stall.
+	// Takes over the contents of the infos. The registry keeps a prewarmed pipeline alive until it's first taken with Get,
+	// after which the caller owns that reference.
+	void Prewarm(vi::VkPipelineHandler::CreateInfo* infos, uint32_t count);
+
+	// Amount of unique pipelines and layouts, useful for debugging.
+	[[nodiscard]] uint32_t GetPipelineCount() const;
+	[[nodiscard]] uint32_t GetLayoutCount() const;
+
+protected:
+	void OnReloadShaders() override;
+	void OnDestroyModule(VkShaderModule module) override;
+
+private:
+	// Serialized create info. Only compared when the hashes match, so collisions can't return the wrong entry.
+	struct Key final
+	{
+		size_t hash;
+		uint8_t* data;
+		uint32_t size;
+	};
+
+	struct PipelineEntry final
+	{
+		Key key;
+		VkPipeline pipeline;
+		VkPipelineLayout layout;
+		uint32_t refCount;
+		// Modules the pipeline was created with.
+		VkShaderModule modules[vi::VkPipelineHandler::MAX_STAGES];
+		uint32_t moduleCount;
+		// If one of the modules has been destroyed, in which case it's only kept until it's released.
+		bool evicted;
+		// If it's still being compiled by the pipeline compiler.
+		bool pending;
+		// If the only reference is the one the registry took when prewarming.
+		bool prewarmed;
+		PipelineCompiler::Handle handle;
+	};
+
+	struct LayoutEntry final
+	{
+		Key key;
+		VkPipelineLayout layout;
+		uint32_t refCount;
+	};
+
+	VulkanRenderer& _renderer;
+	vi::Vector<PipelineEntry> _pipelines{ 16, GMEM_VOL };
+	vi::Vector<LayoutEntry> _layouts{ 8, GMEM_VOL };
+
+	[[nodiscard]] int32_t FindPipeline(const vi::Vector<uint8_t>& key, size_t hash) const;
+	// Returns the layout that matches the info's set layouts and push constants, and creates it if there isn't one yet.
+	[[nodiscard]] VkPipelineLayout GetLayout(const vi::VkPipelineHandler::CreateInfo& info);
+	void ReleaseLayout(VkPipelineLayout layout);
+	// Hands over the pipeline from the compiler, if it's still pending.
+	void Resolve(PipelineEntry& entry) const;
+	static void SetModules(PipelineEntry& entry, const vi::VkPipelineHandler::CreateInfo& info);
+
+	// Writes everything that ends up in the pipeline. The base pipeline is left out, since it's only a hint for the driver.
+	static void WriteKey(const vi::VkPipelineHandler::CreateInfo& info, vi::Vector<uint8_t>& outKey);
+	static void WriteLayoutKey(const vi::VkPipelineHandler::CreateInfo& info, vi::Vector<uint8_t>& outKey);
+	template <typename T>
+	static void Write(vi::Vector<uint8_t>& key, const T& value);
+
+	[[nodiscard]] static Key CreateKey(const vi::Vector<uint8_t>& key, size_t hash);
+	static void DestroyKey(const Key& key);
+	[[nodiscard]] static bool Matches(const Key& key, const vi::Vector<uint8_t>& other, size_t hash);
+	[[nodiscard]] static size_t Hash(const vi::Vector<uint8_t>& key);
+};
+
+template <typename T>
+void PipelineRegistry::Write(vi::Vector<uint8_t>& key, const T& value)
+{
+	const auto bytes = reinterpret_cast<const uint8_t*>(&value);
+	for (size_t i = 0; i < sizeof(T); ++i)
+		key.Add(bytes[i]);
+}
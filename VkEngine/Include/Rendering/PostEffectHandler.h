@@ -4,6 +4,7 @@
 #include "ShaderExt.h"
 #include "DescriptorPool.h"
 #include "MeshHandler.h"
+#include "RenderGraph.h"
 
 class PostEffectHandler;
 class VulkanRenderer;
@@ -21,16 +22,13 @@ public:
 	/// </summary>
 	struct Frame final
 	{
+		// Owned by the render graph, which might let them share memory with the images of other layers.
 		VkImage colorImage;
 		VkImage depthImage;
-		VkDeviceMemory colorMemory;
-		VkDeviceMemory depthMemory;
 		// Render target.
 		VkFramebuffer frameBuffer;
-		// Reusable command buffer.
+		// Command buffer of the current frame, handed out by the swap chain every time the layer is recorded.
 		VkCommandBuffer commandBuffer;
-		// Triggers on render finished.
-		VkSemaphore renderFinishedSemaphore;
 
 		union
 		{
@@ -52,29 +50,29 @@ public:
 		VkDescriptorSet descriptorSet;
 	};
 
-	// Post effect specific method to inherit from.
-	virtual void Render(Frame& frame) = 0;
+	// Post effect specific method to inherit from. Records into the context of the next layer, or into the swap chain for the last one.
+	virtual void Render(vi::CommandContext& context, Frame& frame) = 0;
 
 protected:
 	VulkanRenderer& renderer;
 
 	explicit PostEffect(VulkanRenderer& renderer);
-	// Called by the swap chain recreation event and startup.
+	// Called when the post effect is added to the handler.
 	virtual void OnRecreateAssets() = 0;
-	// Called by the swap chain recreation event and cleanup.
+	// Called by the post effect itself on cleanup.
 	virtual void DestroyAssets() = 0;
 };
 
 /// <summary>
 /// Inherit from this to create a standardized post effect with some stuff already set up.
 /// </summary>
-class BasicPostEffect final : public PostEffect
+class BasicPostEffect final : public PostEffect, ShaderExt::Dependency
 {
 public:
 	explicit BasicPostEffect(VulkanRenderer& renderer, const char* shaderName);
 	~BasicPostEffect();
 
-	void Render(Frame& frame) override;
+	void Render(vi::CommandContext& context, Frame& frame) override;
 
 private:
 	Shader _shader;
@@ -83,6 +81,7 @@ private:
 
 	void OnRecreateAssets() override;
 	void DestroyAssets() override;
+	void OnReloadShaders() override;
 };
 
 /// <summary>
@@ -94,18 +93,20 @@ public:
 	explicit PostEffectHandler(VulkanRenderer& renderer, VkSampleCountFlagBits msaaSamples);
 	~PostEffectHandler();
 
-	void BeginFrame(VkSemaphore waitSemaphore);
+	// Begins rendering the scene to the first layer. Draws can be recorded in parallel through the renderer's command recorder,
+	// or on the calling thread through the recorder's context.
+	void BeginFrame();
 	void EndFrame();
 
 	void Render() const;
 
-	/// <returns>Semaphore which triggers once all the post effects have been drawn.</returns>
-	[[nodiscard]] VkSemaphore GetRenderFinishedSemaphore() const;
 	[[nodiscard]] VkRenderPass GetRenderPass() const;
 	[[nodiscard]] glm::ivec2 GetExtent() const;
 	[[nodiscard]] VkDescriptorSetLayout GetLayout() const;
 	/// <returns>Render quad.</returns>
 	[[nodiscard]] Mesh& GetMesh();
+	// Graph that contains a pass for every layer. Useful for debugging.
+	[[nodiscard]] const RenderGraph& GetRenderGraph() const;
 
 	void Add(PostEffect* postEffect);
 
@@ -120,7 +121,9 @@ private:
 	VkRenderPass _renderPass = VK_NULL_HANDLE;
 	glm::ivec2 _extent;
 
-	uint32_t _imageIndex;
+	uint32_t _frameIndex;
+	// Recording of the layer that is being rendered to. The layers are recorded one after another.
+	vi::CommandContext _context{};
 
 	Shader _shader;
 	VkDescriptorSetLayout _layout;
@@ -128,22 +131,24 @@ private:
 	DescriptorPool _descriptorPool{};
 
 	vi::Vector<PostEffect*> _postEffects{4, GMEM_VOL};
-	// Frames for all the swapchain images. Sequenced linearly like so:
-	// [Swap chain image 0: [0, 1, 2 ...], Swap chain image 1: [0, 1, ...]]
+	// Frames for every layer, one for every frame in flight. Sequenced linearly like so:
+	// [Layer 0: [frame 0, frame 1 ...], Layer 1: [frame 0, frame 1 ...]]
 	vi::Vector<PostEffect::Frame> _frames;
-
-	// Semaphore to wait for before the drawing starts.
-	VkSemaphore _waitSemaphore;
+	// Manages the images of every layer, and the transitions between the layers.
+	// Every layer is a pass, with the same index as the layer.
+	RenderGraph _graph;
 
 	void LayerBeginFrame(uint32_t index);
-	void LayerEndFrame(uint32_t index) const;
+	void LayerEndFrame(uint32_t index);
+
+	void CreateLayerAssets(uint32_t index);
 
-	void RecreateLayerAssets(uint32_t index);
-	void DestroyLayerAssets(uint32_t index, bool calledByDestructor) const;
-	void DestroySwapChainAssets(bool calledByDestructor) const;
+	// Declares the layers in the render graph and creates their render targets.
+	void BuildGraph();
+	void DestroyGraph();
 
-	// Get the first layer frame based on the given swap chain image index.
+	// Get the first frame of the given layer.
 	[[nodiscard]] PostEffect::Frame& GetStartFrame(uint32_t index) const;
-	// Get the active layer frame based on the given swap chain image index.
+	// Get the frame of the given layer that is used by the current frame in flight.
 	[[nodiscard]] PostEffect::Frame& GetActiveFrame(uint32_t index) const;
 };
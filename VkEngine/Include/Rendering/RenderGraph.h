@@ -0,0 +1,161 @@
+﻿#pragma once
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
+#include "VkRenderer/VkHandlers/CommandContext.h"
+
+class VulkanRenderer;
+
+/// <summary>
+/// Declarative description of the passes in a frame and the transient images they share.<br>
+/// Passes declare which images they read and write, after which the graph is compiled once (and again on swap chain recreation).<br>
+/// Compiling culls the passes that don't contribute to an output, calculates the layout transitions and barriers between passes,
+/// and lets images whose lifetimes don't overlap alias the same memory.
+/// </summary>
+class RenderGraph final
+{
+public:
+	// Handle to a declared image.
+	typedef uint32_t Image;
+	// Handle to a declared pass.
+	typedef uint32_t Pass;
+
+	// How a pass uses an image. Determines the layout, stages and access flags.
+	enum class Usage
+	{
+		colorAttachment,
+		depthAttachment,
+		sampled
+	};
+
+	/// <summary>
+	/// Struct used to declare a transient image. The graph creates one for every frame in flight.
+	/// </summary>
+	struct ImageInfo final
+	{
+		glm::ivec2 resolution;
+		VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+		VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
+	};
+
+	explicit RenderGraph(VulkanRenderer& renderer);
+	~RenderGraph();
+
+	// Declares an image. The name is only used for debugging and has to outlive the graph.
+	[[nodiscard]] Image AddImage(const char* name, const ImageInfo& info);
+	// Declares a pass. Passes are executed in the order in which they are declared.
+	[[nodiscard]] Pass AddPass(const char* name);
+	void Read(Pass pass, Image image, Usage usage = Usage::sampled);
+	void Write(Pass pass, Image image, Usage usage);
+	// Marks the image as being used outside of the graph after the last pass.
+	// Passes are culled if they don't (indirectly) write to an output.
+	void AddOutput(Image image, Usage usage = Usage::sampled);
+
+	// Culls the passes, calculates the barriers and creates the images.
+	void Compile();
+	// Destroys the images and removes all the declarations.
+	void Clear();
+
+	// Records the barriers that are needed before the pass in the context.
+	// Returns false if the pass has been culled, in which case it shouldn't be recorded at all.
+	bool BeginPass(const vi::CommandContext& context, Pass pass) const;
+	// Records the transitions to the output usages in the context. Call this after the last pass.
+	void EndFrame(const vi::CommandContext& context) const;
+
+	[[nodiscard]] VkImage GetImage(Image image, uint32_t frameIndex) const;
+	[[nodiscard]] VkImageView GetView(Image image, uint32_t frameIndex) const;
+	[[nodiscard]] bool IsCulled(Pass pass) const;
+	// Layout the image is in during the pass. Render passes should use this as both the initial and final layout,
+	// since the graph takes care of all the transitions.
+	[[nodiscard]] static VkImageLayout GetLayout(Usage usage);
+
+	// Writes the compiled graph in a human readable form, including the culled passes, barriers and memory aliasing.
+	void Dump(std::ostream& stream) const;
+
+private:
+	struct ImageData final
+	{
+		const char* name;
+		ImageInfo info;
+		VkMemoryRequirements memRequirements;
+		// First and last pass that use the image, after culling. The last pass is the pass count for outputs.
+		uint32_t firstPass;
+		uint32_t lastPass;
+		// Memory block shared with other images.
+		uint32_t alias;
+		bool used;
+		bool output;
+		Usage outputUsage;
+	};
+
+	struct PassData final
+	{
+		const char* name;
+		bool culled;
+		// Range in the barrier list.
+		uint32_t barrierStart;
+		uint32_t barrierCount;
+	};
+
+	struct Access final
+	{
+		Pass pass;
+		Image image;
+		Usage usage;
+		bool write;
+	};
+
+	struct Barrier final
+	{
+		Image image;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		VkPipelineStageFlags srcStage;
+		VkPipelineStageFlags dstStage;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+	};
+
+	// Memory block that is shared by images with non-overlapping lifetimes.
+	struct Alias final
+	{
+		VkMemoryRequirements memRequirements;
+		// Last stages and accesses of the image that most recently occupied the block, while calculating the barriers.
+		VkPipelineStageFlags stage;
+		VkAccessFlags access;
+	};
+
+	VulkanRenderer& _renderer;
+
+	vi::Vector<ImageData> _images{ 8, GMEM_VOL };
+	vi::Vector<PassData> _passes{ 8, GMEM_VOL };
+	vi::Vector<Access> _accesses{ 16, GMEM_VOL };
+	vi::Vector<Barrier> _barriers{ 16, GMEM_VOL };
+	vi::Vector<Alias> _aliases{ 8, GMEM_VOL };
+	// Barriers recorded after the last pass.
+	uint32_t _outputBarrierStart = 0;
+
+	// Physical resources for every frame in flight, sequenced like so:
+	// [Frame 0: [image 0, image 1 ...], Frame 1: [image 0, image 1 ...]]
+	vi::ArrayPtr<VkImage> _vkImages;
+	vi::ArrayPtr<VkImageView> _views;
+	// Memory for every alias of every frame in flight, sequenced the same way.
+	vi::ArrayPtr<vi::VkGpuAllocator::Allocation> _memory;
+	bool _compiled = false;
+
+	// Culls the passes that don't contribute to any of the outputs.
+	void Cull();
+	void CalculateLifetimes();
+	void CreateImages();
+	// Assigns every image to a memory block that isn't used by another image during its lifetime.
+	void CreateAliases();
+	void AllocateMemory();
+	// Walks through the passes and tracks the state of every image to find the transitions that are needed.
+	void CreateBarriers();
+
+	void RecordBarriers(const vi::CommandContext& context, uint32_t start, uint32_t count) const;
+
+	static void GetUsageMasks(Usage usage, bool write, VkAccessFlags& outAccessFlags, VkPipelineStageFlags& outPipelineStageFlags);
+	[[nodiscard]] static const char* GetUsageName(Usage usage);
+	[[nodiscard]] static const char* GetLayoutName(VkImageLayout layout);
+};
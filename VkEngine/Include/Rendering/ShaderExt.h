@@ -1,19 +1,54 @@
 ﻿#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include "VkRenderer/VkHandlers/VkHandler.h"
 #include "VkRenderer/VkHandlers/VkPipelineHandler.h"
 
 // Struct that contains relevant shader data.
 struct Shader final
 {
+	static constexpr uint32_t MAX_NAME_LENGTH = 32;
+
 	vi::Vector<vi::VkPipelineHandler::CreateInfo::Module> modules{3, GMEM_TEMP};
+	// Name the modules were loaded with, used to find them in the module cache.
+	char name[MAX_NAME_LENGTH]{};
 };
 
 /// <summary>
-/// Contains engine specific shader methods.
+/// Contains engine specific shader methods.<br>
+/// Modules are cached by name and stage, so shaders that are loaded multiple times share them.<br>
+/// Optionally watches the shader sources and recompiles them in the background, 
+/// after which the modules are swapped at the end of the frame.
 /// </summary>
 class ShaderExt : public vi::VkHandler
 {
 public:
+	/// <summary>
+	/// Inherit from this to subscribe to the shader reload event.
+	/// </summary>
+	class Dependency
+	{
+		friend ShaderExt;
+
+	public:
+		explicit Dependency(ShaderExt& shaderExt);
+		virtual ~Dependency();
+
+	protected:
+		// Event that fires at the end of the frame when modules have been reloaded. The device is idle at this point.
+		// Use Refresh to check if a shader is affected, and recreate the pipelines that use it if so.
+		virtual void OnReloadShaders() = 0;
+		// Event that fires right before a module is destroyed, because it has been reloaded or is no longer used.
+		// Anything that is looked up by the module's handle should forget it, since a new module can get the same handle.
+		virtual void OnDestroyModule(VkShaderModule module);
+
+	private:
+		ShaderExt& _shaderExt;
+	};
+
 	// Struct used for loading shaders.
 	struct LoadInfo final
 	{
@@ -27,18 +62,113 @@ public:
 				bool geometry;
 				// Load fragment shader?
 				bool fragment;
+				// Load compute shader? Compute shaders are used in their own pipeline, so this is usually the only one loaded.
+				bool compute;
 			};
-			bool values[3]{true, false, true};
+			bool values[4]{true, false, true, false};
 		};
 	};
 
+	// Struct used for watching the shader sources.
+	struct HotReloadInfo final
+	{
+		// Called at the end of the frame for every module that has been recompiled, or that failed to compile.
+		// Modules that failed to compile keep their last working version.
+		typedef void (*OnCompiled)(const char* fileName, bool succeeded);
+
+		// Build script that lists every shader as "<compiler> <source> [-D<define>...] -o <output>", one per line.
+		// Sources and outputs are relative to the shader directory.
+		const char* manifest = "Shaders/compile.bat";
+		// Compiler that is called with the arguments from the manifest. Has to be reachable from the working directory.
+		const char* compiler = "glslc";
+		// Milliseconds between checking the sources for changes.
+		uint32_t pollInterval = 500;
+		// Optional, for reporting the results of the recompilations.
+		OnCompiled onCompiled = nullptr;
+	};
+
 	explicit ShaderExt(vi::VkCore& core);
+	~ShaderExt();
 
 	// Load shader. Will throw an exception if the selected modules are not found.
-	[[nodiscard]] Shader Load(const char* name, const LoadInfo& info = {}) const;
+	[[nodiscard]] Shader Load(const char* name, const LoadInfo& info = {});
 	// Destroy shader assets.
 	void DestroyShader(const Shader& shader);
+	// Replaces the modules of the shader that have been reloaded. Returns true if any of them changed.
+	bool Refresh(Shader& shader) const;
+
+	// Starts watching the sources of the shaders listed in the manifest. Changed sources are recompiled on a background thread.
+	void EnableHotReload(const HotReloadInfo& info = {});
+	// Swaps in the recompiled modules. Call this once per frame, at the end of the frame.
+	void Update();
 
 private:
-	[[nodiscard]] static vi::String ToCode(const vi::String& name, const vi::String& postFix);
+	static constexpr const char* DIRECTORY = "Shaders/";
+	static constexpr uint32_t STAGE_COUNT = 4;
+	static constexpr const char* STAGE_POSTFIXES[STAGE_COUNT]
+	{
+		"vert.spv",
+		"geom.spv",
+		"frag.spv",
+		"comp.spv"
+	};
+	static constexpr VkShaderStageFlagBits STAGE_FLAGS[STAGE_COUNT]
+	{
+		VK_SHADER_STAGE_VERTEX_BIT,
+		VK_SHADER_STAGE_GEOMETRY_BIT,
+		VK_SHADER_STAGE_FRAGMENT_BIT,
+		VK_SHADER_STAGE_COMPUTE_BIT
+	};
+	static constexpr uint32_t MAX_PATH_LENGTH = 128;
+
+	struct ModuleEntry final
+	{
+		char name[Shader::MAX_NAME_LENGTH];
+		uint32_t stage;
+		VkShaderModule module;
+		uint32_t refCount;
+	};
+
+	// File name of a module the watcher compiled, copied out on the main thread.
+	struct CompiledOutput final
+	{
+		char name[MAX_PATH_LENGTH];
+	};
+
+	// Single line of the manifest. Only used by the watcher.
+	struct SourceJob final
+	{
+		std::string source;
+		std::string defines;
+		std::string output;
+	};
+
+	vi::Vector<ModuleEntry> _modules{ 16, GMEM_VOL };
+	vi::Vector<Dependency*> _dependencies{ 8, GMEM_VOL };
+
+	// The watcher only uses the standard library, since the allocators aren't thread safe.
+	std::thread* _watcher = nullptr;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	bool _quit = false;
+	std::string _manifest;
+	std::string _compiler;
+	uint32_t _pollInterval = 0;
+	HotReloadInfo::OnCompiled _onCompiled = nullptr;
+	// File names of the recompiled modules, waiting to be swapped in.
+	std::vector<std::string> _reloaded;
+	// File names of the modules that failed to compile, waiting to be reported.
+	std::vector<std::string> _failed;
+
+	[[nodiscard]] int32_t FindModule(const char* name, uint32_t stage) const;
+	[[nodiscard]] VkShaderModule CreateModule(const char* name, uint32_t stage) const;
+	// Lets the dependencies know before the module is destroyed.
+	void DestroyModule(VkShaderModule module);
+	[[nodiscard]] static uint32_t GetStage(VkShaderStageFlagBits flags);
+
+	void WatchLoop();
+	[[nodiscard]] std::vector<SourceJob> ParseManifest() const;
+	// Compiles to a temporary file first, so that a failed compilation doesn't leave a broken module behind.
+	[[nodiscard]] bool Compile(const SourceJob& job) const;
+	[[nodiscard]] static bool IsSource(const std::string& fileName);
 };
@@ -80,7 +80,7 @@ private:
 
 		// Garbage type.
 		Type type;
-		// Swap chain image index from when it was deleted.
+		// Frame in flight index from when it was deleted.
 		uint32_t index;
 		// If the object has made a full swap chain loop.
 		bool looped = false;
@@ -0,0 +1,83 @@
+﻿#pragma once
+
+/// <summary>
+/// Converts source images into a GPU-ready container, so that loading a texture doesn't need any decoding or mip map generation.<br>
+/// The container starts with a header, followed by every mip level from large to small. 
+/// The levels are stored in the format the image uses on the GPU, optionally block compressed.
+/// </summary>
+class TextureCooker final
+{
+public:
+	// "VKTX" in little endian.
+	static constexpr uint32_t MAGIC = 0x58544B56;
+	// Increment this when the layout changes, so that old files are cooked again.
+	static constexpr uint32_t VERSION = 1;
+	static constexpr uint32_t MAX_MIP_LEVELS = 16;
+	// Levels are aligned so that they can be copied into the staging buffer as is.
+	static constexpr uint32_t LEVEL_ALIGNMENT = 16;
+	static constexpr const char* EXTENSION = "vktx";
+
+	enum class Compression : uint32_t
+	{
+		// Uncompressed sRGB RGBA, 4 bytes per pixel.
+		none,
+		// sRGB BC1 with 1 bit alpha, 8 bytes per 4x4 block.
+		bc1
+	};
+
+	struct Level final
+	{
+		// Offset from the start of the file.
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct Header final
+	{
+		uint32_t magic;
+		uint32_t version;
+		Compression compression;
+		uint32_t width;
+		uint32_t height;
+		// Channels of the source image, the levels always contain all four.
+		uint32_t channels;
+		uint32_t mipLevels;
+		Level levels[MAX_MIP_LEVELS];
+	};
+
+	/// <summary>
+	/// Decodes the source image, generates all the mip levels and writes them to the destination.
+	/// </summary>
+	/// <returns>False if the source couldn't be decoded, or if the destination couldn't be written.</returns>
+	static bool Cook(const char* srcPath, const char* dstPath, Compression compression = Compression::none);
+	/// <summary>
+	/// Generates all the mip levels of the RGBA pixels and writes the container to memory. 
+	/// The channels are only stored in the header.
+	/// </summary>
+	[[nodiscard]] static vi::ArrayPtr<unsigned char> CookPixels(const unsigned char* pixels, uint32_t width, uint32_t height, 
+		uint32_t channels, Compression compression, vi::FreeListAllocator& allocator = GMEM_TEMP);
+	/// <summary>
+	/// Cooks every png in the folder that doesn't have an up to date cooked file next to it.<br>
+	/// Images that can't be cooked are skipped and written to the error stream.
+	/// </summary>
+	/// <returns>Amount of images that couldn't be cooked.</returns>
+	static uint32_t CookFolder(const char* folder, std::ostream& errors, Compression compression = Compression::none);
+
+	/// <returns>The header if the data contains a valid container of the current version, otherwise a nullptr.</returns>
+	[[nodiscard]] static const Header* Validate(const void* data, size_t size);
+	[[nodiscard]] static VkFormat GetFormat(Compression compression);
+	/// <returns>Amount of bytes a level with the given resolution takes up.</returns>
+	[[nodiscard]] static uint64_t GetLevelSize(Compression compression, uint32_t width, uint32_t height);
+
+private:
+	// Halves the resolution with a box filter, averaging the colors in linear space.
+	static void Downsample(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight, unsigned char* dst);
+	static void CompressBc1(const unsigned char* src, uint32_t width, uint32_t height, unsigned char* dst);
+	// Encodes a single block of 16 RGBA pixels.
+	static void CompressBc1Block(const unsigned char* pixels, unsigned char* dst);
+
+	[[nodiscard]] static float ToLinear(unsigned char value);
+	[[nodiscard]] static unsigned char ToSrgb(float value);
+	[[nodiscard]] static uint16_t To565(uint32_t r, uint32_t g, uint32_t b);
+	static void From565(uint16_t color, uint32_t* outRgb);
+};
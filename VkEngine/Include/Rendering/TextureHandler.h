@@ -1,5 +1,7 @@
 ﻿#pragma once
 #include "VkRenderer/VkHandlers/VkHandler.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
+#include "Rendering/UploadQueue.h"
 
 /// <summary>
 /// Contains all relevant texture information.
@@ -12,8 +14,13 @@ struct Texture final
 
 	VkImage image;
 	VkImageView imageView;
-	VkDeviceMemory memory;
+	vi::VkGpuAllocator::Allocation memory;
 	VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	// Index into the bindless texture array. Only valid when bindless textures are enabled.
+	uint32_t index = UINT32_MAX;
+	// Batch in which the pixels are uploaded.
+	UploadQueue::Handle upload = 0;
 };
 
 /// <summary>
@@ -22,17 +29,50 @@ struct Texture final
 class TextureHandler final : public vi::VkHandler
 {
 public:
-	explicit TextureHandler(vi::VkCore& core);
+	/// <param name="bindlessCapacity">Size of the bindless texture array. Only used when descriptor indexing is enabled.</param>
+	TextureHandler(vi::VkCore& core, UploadQueue& uploadQueue, uint32_t bindlessCapacity = 1024);
+	~TextureHandler();
 
 	// Creates a new texture. Assumes the texture is in the correct folder.
-	[[nodiscard]] Texture Create(const char* name, const char* extension) const;
+	// Cooked textures are mapped and copied as is, without decoding or generating mip maps.
+	// When bindless textures are enabled, the texture is also registered in the global texture array.
+	// The pixels are uploaded asynchronously, but the texture can be used right away.
+	[[nodiscard]] Texture Create(const char* name, const char* extension);
+	// Creates a new texture from decoded RGBA pixels, which can be freed directly after.
+	[[nodiscard]] Texture Create(const unsigned char* pixels, glm::ivec2 resolution, uint8_t channels);
 	// Destroys the resources for target texture.
-	void Destroy(const Texture& texture) const;
+	void Destroy(const Texture& texture);
 
-private:
-	// Generate mip maps for an image.
-	void GenerateMipMaps(VkImage image, glm::ivec2 resolution, uint32_t mipLevels, VkFormat imageFormat) const;
+	/// <returns>If the textures are registered in a single global descriptor array.</returns>
+	[[nodiscard]] bool IsBindless() const;
+	/// <returns>Layout containing the global sampler2D array. Null if bindless textures are disabled.</returns>
+	[[nodiscard]] VkDescriptorSetLayout GetBindlessLayout() const;
+	/// <returns>Descriptor set containing all the registered textures.</returns>
+	[[nodiscard]] VkDescriptorSet GetBindlessSet() const;
 
-	static unsigned char* Load(const std::string& path, int32_t& width, int32_t& height, int32_t& numChannels);
+	// Reads and decodes an image file into RGBA pixels. Doesn't touch any shared state, so it can be called from any thread.
+	// Returns nullptr if the file couldn't be read or decoded.
+	[[nodiscard]] static unsigned char* Load(const std::string& path, int32_t& width, int32_t& height, int32_t& numChannels);
 	static void Free(unsigned char* pixels);
+
+private:
+	UploadQueue& _uploadQueue;
+
+	// Global bindless texture array.
+	VkDescriptorSetLayout _bindlessLayout = VK_NULL_HANDLE;
+	VkDescriptorPool _bindlessPool = VK_NULL_HANDLE;
+	VkDescriptorSet _bindlessSet = VK_NULL_HANDLE;
+	// Shared sampler for all the bindless textures.
+	VkSampler _bindlessSampler = VK_NULL_HANDLE;
+	// Indices that have been freed and can be reused.
+	vi::Vector<uint32_t> _bindlessFreeIndices{ 8, GMEM_VOL };
+	uint32_t _bindlessCapacity;
+	uint32_t _bindlessCount = 0;
+
+	void RegisterBindless(Texture& texture);
+	void UnregisterBindless(const Texture& texture);
+
+	[[nodiscard]] Texture CreateCooked(const char* path);
+	// Creates the image, its memory and a view of all the mip levels. The contents are left undefined.
+	[[nodiscard]] Texture CreateImage(glm::ivec2 resolution, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage) const;
 };
@@ -2,80 +2,141 @@
 #include "Rendering/VulkanRenderer.h"
 #include "VkRenderer/VkHandlers/VkShaderHandler.h"
 #include "VkRenderer/VkHandlers/VkMemoryHandler.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
 #include "VkRenderer/VkCore/VkCoreSwapchain.h"
 
 /// <summary>
-/// Manages a chunk of GPU memory and is able to create uniform sized buffers for it.
+/// Manages a persistently mapped chunk of GPU memory, split into a uniform buffer for every frame in flight.<br>
+/// Instances are linearly allocated from the current frame's buffer, and are meant to be bound with dynamic offsets.<br>
+/// This way the descriptor sets only have to be written once.<br>
+/// Can also be used for storage buffers, for arrays that are too large or too dynamic to be uniform.
 /// </summary>
 template <typename T>
 class UboAllocator final
 {
 public:
-	/// <param name="bufferSize">Size of a single buffer.</param>
-	explicit UboAllocator(VulkanRenderer& renderer, size_t bufferSize);
+	/// <param name="capacity">Maximum amount of instances that can be allocated per frame.</param>
+	/// <param name="usage">Either uniform or storage buffer usage.</param>
+	explicit UboAllocator(VulkanRenderer& renderer, size_t capacity,
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 	~UboAllocator();
 
-	// Create buffer for the managed memory.
-	[[nodiscard]] VkBuffer CreateBuffer() const;
-	// Get the managed memory.
-	[[nodiscard]] VkDeviceMemory GetMemory() const;
-	// Get the memory alignment requirement for the buffers.
+	// Resets the linear allocator for the current frame in flight. Call this once per frame, before allocating.
+	void BeginFrame();
+	// Copies the instances into the current frame's buffer. Returns the dynamic offset to the first instance.
+	[[nodiscard]] uint32_t Allocate(const T* instances, size_t count = 1);
+	// Reserves the instances in the current frame's buffer, so that they can be written to directly. Avoid reading from them.
+	[[nodiscard]] T* Reserve(uint32_t& outOffset, size_t count = 1);
+
+	// Get the buffer for target frame in flight.
+	[[nodiscard]] VkBuffer GetBuffer(uint32_t frameIndex) const;
+	// Get the minimum alignment for the dynamic offsets.
 	[[nodiscard]] size_t GetAlignment() const;
-	[[nodiscard]] size_t GetOffset(uint32_t swapChainImageIndex) const;
 
 private:
 	VulkanRenderer& _renderer;
-	VkDeviceMemory _memory;
-	VkMemoryRequirements _bufferMemoryRequirements;
-	size_t _bufferSize;
+	vi::VkGpuAllocator::Allocation _memory;
+	vi::ArrayPtr<VkBuffer> _buffers;
+	// Persistently mapped memory range.
+	char* _mapped;
+
+	size_t _alignment;
+	// Size of a single buffer.
+	size_t _size;
+	// Size of a single buffer, including the padding between the buffers.
 	size_t _blockSize;
+
+	// Linear allocator state.
+	size_t _head = 0;
+	uint32_t _frameIndex = 0;
 };
 
 template <typename T>
-UboAllocator<T>::UboAllocator(VulkanRenderer& renderer, const size_t bufferSize) :
-	_renderer(renderer), _bufferSize(bufferSize)
+UboAllocator<T>::UboAllocator(VulkanRenderer& renderer, const size_t capacity, const VkBufferUsageFlags usage) :
+	_renderer(renderer)
 {
+	auto& gpuAllocator = renderer.GetGpuAllocator();
 	auto& memoryHandler = renderer.GetMemoryHandler();
 	auto& shaderHandler = renderer.GetShaderHandler();
 	auto& swapChain = renderer.GetSwapChain();
 
-	// Used to get the memory requirement bits.
-	const auto tempBuffer = shaderHandler.CreateBuffer(sizeof(T) * bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-	auto memRequirements = _bufferMemoryRequirements = memoryHandler.GetRequirements(tempBuffer);
-	_blockSize = memRequirements.size;
-	memRequirements.size *= swapChain.GetLength();
-	_memory = memoryHandler.Allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	shaderHandler.DestroyBuffer(tempBuffer);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(renderer.GetPhysicalDevice(), &properties);
+	const bool storage = usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	_alignment = storage ? properties.limits.minStorageBufferOffsetAlignment : properties.limits.minUniformBufferOffsetAlignment;
+
+	// Reserve enough space to be able to allocate every instance separately.
+	_size = vi::Ut::Align(sizeof(T), _alignment) * capacity;
+
+	const uint32_t length = swapChain.GetFrameCount();
+	_buffers = vi::ArrayPtr<VkBuffer>(length, GMEM);
+	for (auto& buffer : _buffers)
+		buffer = shaderHandler.CreateBuffer(_size, usage);
+
+	// Allocate the memory for all the buffers in one go.
+	auto memRequirements = memoryHandler.GetRequirements(_buffers[0]);
+	_blockSize = vi::Ut::Align(memRequirements.size, memRequirements.alignment);
+	memRequirements.size = _blockSize * length;
+	_memory = gpuAllocator.Allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+
+	for (uint32_t i = 0; i < length; ++i)
+		memoryHandler.Bind(_buffers[i], _memory.memory, _memory.offset + _blockSize * i);
+
+	// Since the memory is coherent, it stays mapped for the entire lifetime of the allocator.
+	_mapped = static_cast<char*>(_memory.mapped);
 }
 
 template <typename T>
 UboAllocator<T>::~UboAllocator()
 {
-	auto& memoryHandler = _renderer.GetMemoryHandler();
-	memoryHandler.Free(_memory);
+	auto& gpuAllocator = _renderer.GetGpuAllocator();
+	auto& shaderHandler = _renderer.GetShaderHandler();
+
+	for (auto& buffer : _buffers)
+		shaderHandler.DestroyBuffer(buffer);
+	gpuAllocator.Free(_memory);
 }
 
 template <typename T>
-VkBuffer UboAllocator<T>::CreateBuffer() const
+void UboAllocator<T>::BeginFrame()
 {
-	auto& shaderHandler = _renderer.GetShaderHandler();
-	return shaderHandler.CreateBuffer(sizeof(T) * _bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	_frameIndex = _renderer.GetSwapChain().GetFrameIndex();
+	_head = 0;
 }
 
 template <typename T>
-VkDeviceMemory UboAllocator<T>::GetMemory() const
+uint32_t UboAllocator<T>::Allocate(const T* instances, const size_t count)
 {
-	return _memory;
+	const size_t size = sizeof(T) * count;
+	assert(_head + size <= _size);
+
+	const size_t offset = _head;
+	memcpy(&_mapped[_blockSize * _frameIndex + offset], instances, size);
+	_head += vi::Ut::Align(size, _alignment);
+
+	return static_cast<uint32_t>(offset);
 }
 
 template <typename T>
-size_t UboAllocator<T>::GetAlignment() const
+T* UboAllocator<T>::Reserve(uint32_t& outOffset, const size_t count)
+{
+	const size_t size = sizeof(T) * count;
+	assert(_head + size <= _size);
+
+	outOffset = static_cast<uint32_t>(_head);
+	_head += vi::Ut::Align(size, _alignment);
+
+	return reinterpret_cast<T*>(&_mapped[_blockSize * _frameIndex + outOffset]);
+}
+
+template <typename T>
+VkBuffer UboAllocator<T>::GetBuffer(const uint32_t frameIndex) const
 {
-	return _bufferMemoryRequirements.alignment;
+	return _buffers[frameIndex];
 }
 
 template <typename T>
-VkDeviceSize UboAllocator<T>::GetOffset(const uint32_t swapChainImageIndex) const
+size_t UboAllocator<T>::GetAlignment() const
 {
-	return _blockSize * swapChainImageIndex;
+	return _alignment;
 }
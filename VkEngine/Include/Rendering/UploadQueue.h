@@ -0,0 +1,116 @@
+﻿#pragma once
+#include "VkRenderer/VkHandlers/VkHandler.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
+
+/// <summary>
+/// Batches the uploads of meshes and textures into a single command buffer, which is submitted once per frame.<br>
+/// The data is copied into a persistently mapped staging ring buffer, so nothing has to be allocated per upload.<br>
+/// Uploads that are larger than the ring get a temporary staging buffer, which is destroyed once the batch has finished.<br>
+/// Copies are done on the dedicated transfer queue if the hardware has one, after which the ownership is transferred to the graphics queue.<br>
+/// Since the graphics side of a batch is always submitted before the frame, the resources can be used directly after uploading.
+/// </summary>
+class UploadQueue final : public vi::VkHandler
+{
+public:
+	// Identifies the batch an upload is part of. Can be used to check if the resource is resident.
+	typedef uint64_t Handle;
+
+	// Maximum amount of batches that can be in flight at the same time.
+	static constexpr uint32_t MAX_BATCHES = 4;
+
+	explicit UploadQueue(vi::VkCore& core, VkDeviceSize stagingCapacity = 32 * 1024 * 1024);
+	~UploadQueue();
+
+	/// <summary>
+	/// Copies the data into a buffer. The buffer has to have transfer destination usage.
+	/// </summary>
+	/// <param name="dstStage">Stages in which the buffer is used after the upload, like the vertex input stage.</param>
+	/// <param name="dstAccess">The way the buffer is used after the upload, like vertex attribute reads.</param>
+	[[nodiscard]] Handle UploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+	/// <summary>
+	/// Copies the pixels into the first mip level of an image in an undefined layout, and generates the other mip levels.<br>
+	/// The image ends up in the shader read only layout.
+	/// </summary>
+	[[nodiscard]] Handle UploadImage(const void* data, VkDeviceSize size, VkImage dstImage, 
+		glm::ivec2 resolution, uint32_t mipLevels, VkFormat format);
+	/// <summary>
+	/// Copies precomputed mip levels into an image in an undefined layout. Also works for block compressed formats.<br>
+	/// The image ends up in the shader read only layout.
+	/// </summary>
+	/// <param name="levelOffsets">Offset of every mip level in the data.</param>
+	[[nodiscard]] Handle UploadImageLevels(const void* data, VkDeviceSize size, const VkDeviceSize* levelOffsets, 
+		VkImage dstImage, glm::ivec2 resolution, uint32_t mipLevels);
+
+	/// <summary>
+	/// Releases the batches that have finished and submits the pending one.<br>
+	/// Call this once per frame, before the frame itself is submitted.
+	/// </summary>
+	void Update();
+	/// <returns>If the upload has been completed by the GPU. Never blocks.</returns>
+	[[nodiscard]] bool IsResident(Handle handle);
+	// Submits the pending uploads and waits until all of them are resident. Only use this when blocking is acceptable, like when loading.
+	void WaitIdle();
+
+private:
+	struct Batch final
+	{
+		VkCommandPool transferPool;
+		VkCommandPool graphicsPool;
+		VkCommandBuffer transferCommandBuffer;
+		VkCommandBuffer graphicsCommandBuffer;
+		// Signaled by the transfer submission, waited on by the graphics submission.
+		VkSemaphore transferFinished;
+		VkFence fence;
+		// Stages of the graphics submission that wait for the transfer submission.
+		VkPipelineStageFlags waitStages;
+		// End of the batch's range in the staging ring, which can be reused once the batch has finished.
+		VkDeviceSize stagingEnd;
+		// Staging buffer for an upload that doesn't fit in the ring. Every batch holds at most one.
+		VkBuffer temporaryBuffer;
+		vi::VkGpuAllocator::Allocation temporaryMemory;
+		Handle handle;
+		bool recording;
+		bool inFlight;
+	};
+
+	VkBuffer _stagingBuffer;
+	vi::VkGpuAllocator::Allocation _stagingMemory;
+	VkDeviceSize _stagingCapacity;
+	// Ring buffer state. New data is written at the head, and the tail is the start of the oldest range that's still in use.
+	VkDeviceSize _stagingHead = 0;
+	VkDeviceSize _stagingTail = 0;
+
+	uint32_t _graphicsFamily;
+	uint32_t _transferFamily;
+
+	// Batches are used in a circular order, so they finish in the same order as they are submitted.
+	Batch _batches[MAX_BATCHES]{};
+	// Batch that new uploads are recorded into.
+	uint32_t _current = 0;
+	// Oldest batch that might still be in flight.
+	uint32_t _oldest = 0;
+	Handle _nextHandle = 1;
+	// Every upload up until this handle is resident.
+	Handle _residentHandle = 0;
+
+	[[nodiscard]] bool IsDedicated() const;
+	// Returns the batch that's being recorded, starting a new one if needed.
+	[[nodiscard]] Batch& BeginBatch();
+	void Submit();
+	// Releases the batches that have finished, optionally waiting for the oldest one.
+	void Retire(bool wait);
+
+	// Reserves a range in the staging ring and copies the data into it. Blocks only if the ring is full.
+	// Data that's larger than the ring is copied into a temporary buffer instead, which is returned in outBuffer.
+	[[nodiscard]] VkDeviceSize AllocateStaging(const void* data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer& outBuffer);
+	[[nodiscard]] bool TryAllocateStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset);
+	void DestroyTemporary(Batch& batch);
+
+	// Transitions every level of the image, copies the regions into it and hands it over to the graphics queue.
+	// The image is left in the transfer destination layout.
+	void RecordImageCopy(Batch& batch, VkBuffer srcBuffer, VkImage image, 
+		const VkBufferImageCopy* regions, uint32_t regionCount, uint32_t mipLevels) const;
+	// Records the mip map generation on the graphics queue. Expects every level to be in the transfer destination layout.
+	static void RecordMipMaps(VkCommandBuffer commandBuffer, VkImage image, glm::ivec2 resolution, uint32_t mipLevels);
+};
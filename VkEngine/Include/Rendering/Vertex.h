@@ -1,10 +1,18 @@
 ﻿#pragma once
 
+// Memory layout of a vertex type. Stored in cooked meshes, so that they can be checked against the vertex type they're loaded as.
+enum class VertexLayout : uint32_t
+{
+	standard,
+	quantized
+};
+
 // Standard (optional) struct that can be used to define renderable triangles in shaders.
 struct Vertex final
 {
-	// Using uint16_t for this, because the models for this game won't be that large. 
+	// Default index type. Meshes with more than 65535 vertices can use uint32_t instead.
 	typedef uint16_t Index;
+	static constexpr VertexLayout LAYOUT = VertexLayout::standard;
 
 	glm::vec3 position{0};
 	// The forward vector for this vertex.
@@ -12,8 +20,33 @@ struct Vertex final
 	// Sample coordinates for texture attachments.
 	glm::vec2 textureCoordinates{0};
 
+	[[nodiscard]] glm::vec3 GetPosition() const;
+
 	// Returns a vulkan description for the vertex binding.
 	[[nodiscard]] static VkVertexInputBindingDescription GetBindingDescription();
 	// Returns a vulkan description for the vertex attributes.
 	[[nodiscard]] static vi::Vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
 };
+
+// Standard vertex at half the size. Positions and texture coordinates are stored as half floats, and normals as normalized bytes.
+// The GPU converts the attributes back to floats when fetching them, so the same shaders can be used for both.
+struct QuantizedVertex final
+{
+	typedef uint16_t Index;
+	static constexpr VertexLayout LAYOUT = VertexLayout::quantized;
+
+	// Half floats, with the last component as padding.
+	uint16_t position[4]{};
+	// Signed normalized bytes, with the last component as padding.
+	int8_t normal[4]{ 0, 127, 0, 0 };
+	// Half floats.
+	uint16_t textureCoordinates[2]{};
+
+	[[nodiscard]] static QuantizedVertex Quantize(const Vertex& vertex);
+	[[nodiscard]] glm::vec3 GetPosition() const;
+
+	// Returns a vulkan description for the vertex binding.
+	[[nodiscard]] static VkVertexInputBindingDescription GetBindingDescription();
+	// Returns a vulkan description for the vertex attributes. The locations match those of the standard vertex.
+	[[nodiscard]] static vi::Vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+};
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "VkRenderer/VkCore/VkCore.h"
+#include "Rendering/MeshHandler.h"
 
 /// <summary>
 /// Handy class that extends VkCore and manages some core rendering classes.
@@ -12,6 +13,18 @@ public:
 	{
 		// Anti aliasing sample count. Will be lowered if the hardware doesn't support it.
 		VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+		// Size of the global texture array, used when descriptor indexing is enabled.
+		uint32_t bindlessTextureCapacity = 1024;
+		// Settings for the mesh handler, like packing all meshes into shared buffers.
+		MeshHandler::Info meshInfo{};
+		// Amount of worker threads used to record command buffers in parallel, on top of the main thread.
+		// Clamped to the amount of hardware threads.
+		uint32_t workerCount = 3;
+		// Size of the staging ring buffer that mesh and texture uploads go through.
+		// Uploads only block when it runs out of space.
+		VkDeviceSize uploadStagingCapacity = 32 * 1024 * 1024;
+		// Amount of threads that compile pipelines in the background. Clamped to the amount of hardware threads.
+		uint32_t pipelineCompilerThreads = 2;
 	};
 
 	explicit VulkanRenderer(vi::VkCoreInfo& info, const Info& addInfo);
@@ -22,6 +35,11 @@ public:
 	[[nodiscard]] class SwapChainExt& GetSwapChainExt() const;
 	[[nodiscard]] class TextureHandler& GetTextureHandler() const;
 	[[nodiscard]] class PostEffectHandler& GetPostEffectHandler() const;
+	[[nodiscard]] class JobSystem& GetJobSystem() const;
+	[[nodiscard]] class CommandRecorder& GetCommandRecorder() const;
+	[[nodiscard]] class UploadQueue& GetUploadQueue() const;
+	[[nodiscard]] class PipelineCompiler& GetPipelineCompiler() const;
+	[[nodiscard]] class PipelineRegistry& GetPipelineRegistry() const;
 
 private:
 	MeshHandler* _meshHandler;
@@ -29,4 +47,9 @@ private:
 	TextureHandler* _textureHandler;
 	SwapChainExt* _swapChainExt;
 	PostEffectHandler* _postEffectHandler;
+	JobSystem* _jobSystem;
+	CommandRecorder* _commandRecorder;
+	UploadQueue* _uploadQueue;
+	PipelineCompiler* _pipelineCompiler;
+	PipelineRegistry* _pipelineRegistry;
 };
@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/// <summary>
+/// Pool of worker threads that split a job over a range of indices.<br>
+/// The thread that dispatches the job participates as well, so jobs also run when there are no workers.
+/// </summary>
+class JobSystem final
+{
+public:
+	// Executes a single index of the job. Can be called from any thread, so it should only touch data that belongs to the index.
+	typedef void (*Job)(uint32_t index, void* userPtr);
+
+	// The amount of workers is clamped to the hardware concurrency, minus the thread that creates the job system.
+	explicit JobSystem(uint32_t workerCount);
+	~JobSystem();
+
+	// Executes the job for every index in the range [0, count), and blocks until they are all done.
+	void Dispatch(uint32_t count, Job job, void* userPtr = nullptr);
+
+	// Amount of threads that execute jobs, including the dispatching thread.
+	[[nodiscard]] uint32_t GetThreadCount() const;
+	// Index of the calling thread, where 0 is the dispatching thread. Can be used to access per-thread resources.
+	[[nodiscard]] static uint32_t GetThreadIndex();
+
+private:
+	vi::ArrayPtr<std::thread*> _workers;
+
+	std::mutex _mutex;
+	// Wakes up the workers when a new job has been dispatched.
+	std::condition_variable _wake;
+	// Wakes up the dispatching thread when every index has been executed, or when the last worker left the job.
+	std::condition_variable _done;
+	// Incremented for every dispatch, so that sleeping workers know that there's new work.
+	uint32_t _generation = 0;
+	// Amount of workers that are taking indices from the current job. Only accessed under the mutex.
+	uint32_t _active = 0;
+	bool _quit = false;
+
+	Job _job = nullptr;
+	void* _userPtr = nullptr;
+	std::atomic<uint32_t> _count{ 0 };
+	std::atomic<uint32_t> _next{ 0 };
+	std::atomic<uint32_t> _remaining{ 0 };
+
+	static thread_local uint32_t _threadIndex;
+
+	void WorkerLoop(uint32_t threadIndex);
+	// Takes indices from the current job until there are none left.
+	void Work();
+};
@@ -0,0 +1,96 @@
+﻿#pragma once
+#include <atomic>
+
+/// <summary>
+/// Bounded queue that can be pushed to and popped from by any amount of threads without locking.<br>
+/// Every cell has a sequence number that tells the threads if it's ready to be written to or read from.
+/// </summary>
+template <typename T, uint32_t Capacity>
+class LockFreeQueue final
+{
+public:
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two.");
+
+	LockFreeQueue();
+
+	// Returns false if the queue is full.
+	[[nodiscard]] bool TryPush(const T& value);
+	// Returns false if the queue is empty.
+	[[nodiscard]] bool TryPop(T& outValue);
+
+private:
+	struct Cell final
+	{
+		std::atomic<uint32_t> sequence;
+		T value;
+	};
+
+	Cell _cells[Capacity];
+	std::atomic<uint32_t> _pushPosition{ 0 };
+	std::atomic<uint32_t> _popPosition{ 0 };
+};
+
+template <typename T, uint32_t Capacity>
+LockFreeQueue<T, Capacity>::LockFreeQueue()
+{
+	for (uint32_t i = 0; i < Capacity; ++i)
+		_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T, uint32_t Capacity>
+bool LockFreeQueue<T, Capacity>::TryPush(const T& value)
+{
+	uint32_t position = _pushPosition.load(std::memory_order_relaxed);
+	while (true)
+	{
+		auto& cell = _cells[position & (Capacity - 1)];
+		const uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+		const int32_t difference = static_cast<int32_t>(sequence - position);
+
+		// The cell is free, so try to claim it before another thread does.
+		if (difference == 0)
+		{
+			if (_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				cell.value = value;
+				// Hands the cell over to the readers.
+				cell.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		// The cell still contains a value from the previous lap.
+		else if (difference < 0)
+			return false;
+		// Another thread claimed the cell first.
+		else
+			position = _pushPosition.load(std::memory_order_relaxed);
+	}
+}
+
+template <typename T, uint32_t Capacity>
+bool LockFreeQueue<T, Capacity>::TryPop(T& outValue)
+{
+	uint32_t position = _popPosition.load(std::memory_order_relaxed);
+	while (true)
+	{
+		auto& cell = _cells[position & (Capacity - 1)];
+		const uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+		const int32_t difference = static_cast<int32_t>(sequence - (position + 1));
+
+		if (difference == 0)
+		{
+			if (_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				outValue = cell.value;
+				// Hands the cell back to the writers for the next lap.
+				cell.sequence.store(position + Capacity, std::memory_order_release);
+				return true;
+			}
+		}
+		// Nothing has been written to the cell yet.
+		else if (difference < 0)
+			return false;
+		else
+			position = _popPosition.load(std::memory_order_relaxed);
+	}
+}
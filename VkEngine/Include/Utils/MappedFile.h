@@ -0,0 +1,30 @@
+﻿#pragma once
+
+/// <summary>
+/// Read-only view of a file that is mapped into memory by the OS, instead of being read into a buffer.<br>
+/// Pages are only loaded when they are accessed, so the contents can be copied straight to where they are needed.
+/// </summary>
+class MappedFile final
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	// Returns false if the file doesn't exist or is empty.
+	[[nodiscard]] bool Open(const char* path);
+	void Close();
+
+	[[nodiscard]] bool IsOpen() const;
+	[[nodiscard]] const void* GetData() const;
+	[[nodiscard]] size_t GetSize() const;
+
+private:
+	const void* _data = nullptr;
+	size_t _size = 0;
+#ifdef _WIN32
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#endif
+};
@@ -1,11 +1,28 @@
-%~dp0/glslc.exe shader.vert -o vert.spv
-%~dp0/glslc.exe shader.frag -o frag.spv
+@echo off
+rem Compiles every shader module. The build calls this with "nopause" before compiling the engine.
+rem Uses the glslc next to this script if there is one, otherwise the one from the Vulkan SDK.
+cd /d %~dp0
+set GLSLC=%~dp0glslc.exe
+if not exist "%GLSLC%" set GLSLC=%VULKAN_SDK%\Bin\glslc.exe
 
-%~dp0/glslc.exe post.vert -o post-vert.spv
-%~dp0/glslc.exe post.frag -o post-frag.spv
+"%GLSLC%" shader.vert -o vert.spv || exit /b 1
+"%GLSLC%" shader.frag -o frag.spv || exit /b 1
 
-%~dp0/glslc.exe light.vert -o light-vert.spv
-%~dp0/glslc.exe light.geom -o light-geom.spv
-%~dp0/glslc.exe light.frag -o light-frag.spv
+"%GLSLC%" shader.vert -DBINDLESS -o bindless-vert.spv || exit /b 1
+"%GLSLC%" shader.frag -DBINDLESS -o bindless-frag.spv || exit /b 1
 
-pause
\ No newline at end of file
+"%GLSLC%" shader.vert -DBINDLESS -DGPU_DRIVEN -o gpu-vert.spv || exit /b 1
+"%GLSLC%" shader.frag -DBINDLESS -DGPU_DRIVEN -o gpu-frag.spv || exit /b 1
+"%GLSLC%" cull.comp -o cull-comp.spv || exit /b 1
+
+"%GLSLC%" post.vert -o post-vert.spv || exit /b 1
+"%GLSLC%" post.frag -o post-frag.spv || exit /b 1
+
+"%GLSLC%" light.vert -o light-vert.spv || exit /b 1
+"%GLSLC%" light.frag -o light-frag.spv || exit /b 1
+"%GLSLC%" light.vert -DLAYERED -o light-layered-vert.spv || exit /b 1
+"%GLSLC%" light.frag -o light-layered-frag.spv || exit /b 1
+"%GLSLC%" light.vert -DMULTIVIEW -o light-multiview-vert.spv || exit /b 1
+"%GLSLC%" light.frag -o light-multiview-frag.spv || exit /b 1
+
+if not "%1"=="nopause" pause
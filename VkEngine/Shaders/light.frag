@@ -2,9 +2,9 @@
 #extension GL_KHR_vulkan_glsl : enable
 #include "shader.glsl"
 
-layout (set = 0, binding = 1) uniform Lights
+layout (set = 0, binding = 1) readonly buffer Lights
 {
-    Light values[LIGHT_COUNT];
+    Light values[];
 } lights;
 
 layout(location = 0) in flat int inIndex;
@@ -1,21 +1,45 @@
 #version 450
 #extension GL_KHR_vulkan_glsl : enable
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : enable
+#endif
+#ifdef LAYERED
+#extension GL_ARB_shader_viewport_layer_array : enable
+#endif
 #include "shader.glsl"
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoords;
 
+layout(set = 0, binding = 0) uniform Matrices
+{
+    mat4 values[6];
+} matrices;
+
 layout (push_constant) uniform PushConstants
 {
     mat4 model;
     int index;
+    int face;
 } pushConstants;
 
 layout(location = 0) out int outIndex;
+layout(location = 1) out vec4 outFragPos;
 
 void main() 
 {
-    gl_Position = pushConstants.model * vec4(inPosition, 1);
+    // Select the cubemap face, depending on how the faces are being rendered.
+#if defined(MULTIVIEW)
+    int face = int(gl_ViewIndex);
+#elif defined(LAYERED)
+    int face = gl_InstanceIndex;
+    gl_Layer = face;
+#else
+    int face = pushConstants.face;
+#endif
+
+    outFragPos = pushConstants.model * vec4(inPosition, 1);
+    gl_Position = matrices.values[face] * outFragPos;
     outIndex = pushConstants.index;
-}
\ No newline at end of file
+}
@@ -1,11 +1,13 @@
 #version 450
 #extension GL_KHR_vulkan_glsl : enable
+// Also needed without bindless textures, since every light can use a different shadow map level of detail.
+#extension GL_EXT_nonuniform_qualifier : enable
 #include "shader.glsl"
 
 // Light mapping.
-layout (set = 0, binding = 0) uniform Lights
+layout (set = 0, binding = 0) readonly buffer Lights
 {
-    Light values[LIGHT_COUNT];
+    Light values[];
 } lights;
 
 layout (set = 0, binding = 1) uniform LightInfo
@@ -13,10 +15,46 @@ layout (set = 0, binding = 1) uniform LightInfo
     int count;
 } lightInfo;
 
-layout (set = 0, binding = 2) uniform samplerCube lightMaps[LIGHT_COUNT];
+// Cubemap array for every shadow level of detail.
+layout (set = 0, binding = 2) uniform samplerCubeArray shadowMaps[SHADOW_LOD_COUNT];
+
+// Froxel grid of the current camera.
+layout (set = 0, binding = 3) readonly buffer Clusters
+{
+    float sliceScale;
+    float sliceBias;
+    // Offset into the light index list and the amount of lights.
+    uvec2 values[];
+} clusters;
+
+layout (set = 0, binding = 4) readonly buffer ClusterLights
+{
+    uint values[];
+} clusterLights;
+
+layout (set = 1, binding = 0) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+} camera;
 
 // Material.
+#ifdef BINDLESS
+// Global texture array, indexed by the material's texture index.
+layout (set = 2, binding = 0) uniform sampler2D textures[];
+
+#ifdef GPU_DRIVEN
+layout(location = 3) flat in uint inTextureIndex;
+#else
+layout (push_constant) uniform PushConstants
+{
+    mat4 model;
+    uint textureIndex;
+} pushConstants;
+#endif
+#else
 layout (set = 2, binding = 0) uniform sampler2D diffuseSampler;
+#endif
 
 layout(location = 0) in Data
 {
@@ -27,30 +65,65 @@ layout(location = 0) in Data
 
 layout(location = 0) out vec4 outColor;
 
+uint GetCluster()
+{
+    vec4 viewPos = camera.view * vec4(inData.fragPos, 1);
+    vec4 clipPos = camera.projection * viewPos;
+    vec2 tile = (clipPos.xy / clipPos.w * .5 + .5) * vec2(CLUSTER_X, CLUSTER_Y);
+    float slice = log(viewPos.z) * clusters.sliceScale - clusters.sliceBias;
+
+    uint x = uint(clamp(floor(tile.x), 0, CLUSTER_X - 1));
+    uint y = uint(clamp(floor(tile.y), 0, CLUSTER_Y - 1));
+    uint z = uint(clamp(floor(slice), 0, CLUSTER_Z - 1));
+    return x + (y + z * CLUSTER_Y) * CLUSTER_X;
+}
+
 float ShadowCalculation()
 {
+    // Only the lights that can reach this cluster are taken into account.
+    uvec2 cluster = clusters.values[GetCluster()];
+
     float shadowCoverage = 0;
+    float lightCount = 0;
 
-    for(int i = 0; i < lightInfo.count; ++i)
+    for(uint i = cluster.x; i < cluster.x + cluster.y; ++i)
     {
-        vec3 fragToLight = inData.fragPos - lights.values[i].pos;
+        Light light = lights.values[clusterLights.values[i]];
+
+        // Clusters are conservative, so the light might still be out of range.
+        vec3 fragToLight = inData.fragPos - light.pos;
+        float currentDepth = length(fragToLight);
+        if(currentDepth > light.range)
+            continue;
+        lightCount += 1;
+
+        if(light.shadowIndex < 0)
+            continue;
+
         fragToLight.z *= -1;
-        float closestDepth = texture(lightMaps[i], fragToLight).r;
-        closestDepth *= lights.values[i].range;
+        float closestDepth = texture(shadowMaps[nonuniformEXT(light.shadowLod)], vec4(fragToLight, light.shadowIndex)).r;
+        closestDepth *= light.range;
 
-        float currentDepth = length(fragToLight);  
         float bias = 0.05; 
         float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
         shadowCoverage += shadow;
     }
 
-    shadowCoverage /= lightInfo.count;
-    return shadowCoverage;
+    // Fragments that no light reaches are unlit.
+    if(lightCount == 0)
+        return 1.0;
+    return shadowCoverage / lightCount;
 }
 
 void main() 
 {
+#ifdef GPU_DRIVEN
+    vec4 color = texture(textures[nonuniformEXT(inTextureIndex)], inData.fragTexCoord);
+#elif defined(BINDLESS)
+    vec4 color = texture(textures[nonuniformEXT(pushConstants.textureIndex)], inData.fragTexCoord);
+#else
     vec4 color = texture(diffuseSampler, inData.fragTexCoord);
+#endif
     if(color.a < .01f)
         discard;
     outColor = color * (1.0 - ShadowCalculation());
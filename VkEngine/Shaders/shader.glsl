@@ -1,12 +1,32 @@
 #ifndef EXT
 #define EXT
 
-#define LIGHT_COUNT 6
+// Make sure this corresponds to the light system.
+#define SHADOW_LOD_COUNT 3
+// Dimensions of the light cluster grid.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
 
 struct Light
 {
     vec3 pos;
     float range;
+    // Cube index in the shadow map array, or -1 if the light has no shadow map.
+    int shadowIndex;
+    uint shadowLod;
+};
+
+// Renderer data used for GPU driven rendering.
+struct Instance
+{
+    mat4 model;
+    // Bounding sphere in model space, with the radius stored in w.
+    vec4 bounds;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint textureIndex;
 };
 
 #define LIGHT_MAX_COUNT 8;
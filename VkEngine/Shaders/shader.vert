@@ -12,10 +12,23 @@ layout (set = 1, binding = 0) uniform Camera
     mat4 projection;
 } camera;
 
+#ifdef GPU_DRIVEN
+// Instances prepared by the culling shader. The draw's first instance points to the drawn instance.
+layout (set = 3, binding = 0) readonly buffer Instances
+{
+    Instance values[];
+} instances;
+
+layout(location = 3) flat out uint outTextureIndex;
+#else
 layout (push_constant) uniform PushConstants
 {
     mat4 model;
+#ifdef BINDLESS
+    uint textureIndex;
+#endif
 } pushConstants;
+#endif
 
 layout(location = 0) out Data
 {
@@ -26,9 +39,17 @@ layout(location = 0) out Data
 
 void main() 
 {
+#ifdef GPU_DRIVEN
+    Instance instance = instances.values[gl_InstanceIndex];
+    mat4 model = instance.model;
+    outTextureIndex = instance.textureIndex;
+#else
+    mat4 model = pushConstants.model;
+#endif
+
     outData.normal = inNormal;
     outData.fragTexCoord = inTexCoords;
-    outData.fragPos = vec3(pushConstants.model * vec4(inPosition, 1.0));
+    outData.fragPos = vec3(model * vec4(inPosition, 1.0));
 
-    gl_Position = camera.projection * camera.view * pushConstants.model * vec4(inPosition, 1);
+    gl_Position = camera.projection * camera.view * model * vec4(inPosition, 1);
 }
\ No newline at end of file
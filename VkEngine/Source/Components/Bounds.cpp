@@ -0,0 +1,100 @@
+﻿#include "pch.h"
+#include "Components/Bounds.h"
+#include "Components/Material.h"
+#include "Components/Transform.h"
+#include <xmmintrin.h>
+
+BoundsSystem::BoundsSystem(ce::Cecsar& cecsar, MaterialSystem& materials, TransformSystem& transforms) :
+	System<Bounds>(cecsar), _materials(materials), _transforms(transforms)
+{
+
+}
+
+void BoundsSystem::Update()
+{
+	glm::mat4 modelMatrix;
+
+	for (auto& [index, bounds] : *this)
+	{
+		const auto& transform = _transforms[index];
+
+		// Use the same mesh as the renderers would.
+		const Mesh* mesh = &_materials.GetFallbackMesh();
+		if (_materials.Contains(index) && _materials[index].mesh)
+			mesh = _materials[index].mesh;
+
+		// The radius grows with the largest scale axis, so that the sphere still encloses rotated meshes.
+		transform.CreateModelMatrix(modelMatrix);
+		const glm::vec3 center = modelMatrix * glm::vec4(glm::vec3(mesh->bounds), 1);
+		const glm::vec3 scale = glm::abs(transform.scale);
+		const float maxScale = vi::Ut::Max(scale.x, vi::Ut::Max(scale.y, scale.z));
+
+		bounds.sphere = glm::vec4(center, mesh->bounds.w * maxScale);
+	}
+}
+
+glm::vec4 BoundsSystem::GetSphere(const uint16_t index)
+{
+	return Contains(index) ? (*this)[index].sphere : glm::vec4(0, 0, 0, FLT_MAX);
+}
+
+bool BoundsSystem::Intersects(const uint16_t index, const glm::vec3& position, const float range)
+{
+	const glm::vec4 sphere = GetSphere(index);
+	return glm::distance(glm::vec3(sphere), position) <= range + sphere.w;
+}
+
+bool BoundsSystem::Intersects(const Camera::Frustum& frustum, const glm::vec4& sphere)
+{
+	const glm::vec3 center = sphere;
+	for (auto& plane : frustum.planes)
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -sphere.w)
+			return false;
+	return true;
+}
+
+float BoundsSystem::GetCoverage(const glm::vec4& sphere, const glm::vec3& origin, const float fieldOfView)
+{
+	const float distance = glm::distance(glm::vec3(sphere), origin);
+	if (distance <= sphere.w)
+		return 1;
+
+	// Ratio between the projected radius and half the screen height.
+	const float radius = sphere.w / sqrt(distance * distance - sphere.w * sphere.w);
+	return vi::Ut::Min(radius / tanf(glm::radians(fieldOfView) * .5f), 1.f);
+}
+
+void BoundsSystem::Cull(const Camera::Frustum& frustum, const glm::vec4* spheres, const uint32_t count, bool* outVisible)
+{
+	uint32_t i = 0;
+
+	// Test four spheres at a time against every plane.
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&spheres[i].x);
+		__m128 y = _mm_loadu_ps(&spheres[i + 1].x);
+		__m128 z = _mm_loadu_ps(&spheres[i + 2].x);
+		__m128 radius = _mm_loadu_ps(&spheres[i + 3].x);
+		// Afterwards every register contains a single component of all four spheres.
+		_MM_TRANSPOSE4_PS(x, y, z, radius);
+		const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+		__m128 outside = _mm_setzero_ps();
+		for (auto& plane : frustum.planes)
+		{
+			__m128 distance = _mm_mul_ps(x, _mm_set1_ps(plane.x));
+			distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+			distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+		}
+
+		const int32_t mask = _mm_movemask_ps(outside);
+		for (uint32_t j = 0; j < 4; ++j)
+			outVisible[i + j] = !(mask & 1 << j);
+	}
+
+	// Test the remainder one by one.
+	for (; i < count; ++i)
+		outVisible[i] = Intersects(frustum, spheres[i]);
+}
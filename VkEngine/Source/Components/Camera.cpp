@@ -14,19 +14,22 @@ CameraSystem::CameraSystem(ce::Cecsar& cecsar,
 {
 	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
 	auto& layoutHandler = renderer.GetLayoutHandler();
+	auto& shaderHandler = renderer.GetShaderHandler();
 	auto& swapChain = renderer.GetSwapChain();
 
-	const uint32_t swapChainLength = swapChain.GetLength();
+	const uint32_t frameCount = swapChain.GetFrameCount();
 
 	// Create camera external layout.
 	vi::VkLayoutHandler::CreateInfo layoutInfo{};
 	layoutInfo.bindings.Add(GetBindingInfo());
 	_layout = layoutHandler.CreateLayout(layoutInfo);
 
-	// Only needs a single ubo per camera.
-	VkDescriptorType types = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uint32_t size = swapChainLength * capacity;
+	// Only needs a single dynamic ubo per frame, since the cameras only differ in offset.
+	VkDescriptorType types = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uint32_t size = frameCount;
 
+	_dynamicOffsets = vi::ArrayPtr<uint32_t>{ capacity, GMEM };
+	_frustums = vi::ArrayPtr<Camera::Frustum>{ capacity, GMEM };
 	_ubos = vi::ArrayPtr<Camera::Ubo>{ capacity, GMEM };
 	_descriptorSets = vi::ArrayPtr<VkDescriptorSet>(size, GMEM);
 
@@ -42,6 +45,20 @@ CameraSystem::CameraSystem(ce::Cecsar& cecsar,
 	descriptorSetCreateInfo.outSets = _descriptorSets.GetData();
 	descriptorSetCreateInfo.setCount = size;
 	descriptorPoolHandler.CreateSets(descriptorSetCreateInfo);
+
+	// The buffers never change, so the descriptor sets only have to be written once.
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		auto buffer = _uboAllocator.GetBuffer(i);
+
+		vi::VkShaderHandler::BufferBindInfo bindInfo{};
+		bindInfo.set = _descriptorSets[i];
+		bindInfo.buffer = &buffer;
+		bindInfo.range = sizeof(Camera::Ubo);
+		bindInfo.bindingIndex = 0;
+		bindInfo.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		shaderHandler.BindBuffer(bindInfo);
+	}
 }
 
 CameraSystem::~CameraSystem()
@@ -55,63 +72,54 @@ CameraSystem::~CameraSystem()
 
 void CameraSystem::Update()
 {
-	auto& memoryHandler = _renderer.GetMemoryHandler();
-	auto& shaderHandler = _renderer.GetShaderHandler();
 	auto& swapChain = _renderer.GetSwapChain();
-	auto& swapChainExt = _renderer.GetSwapChainExt();
-
-	// Calculate starting index for the descriptor sets,
-	// since they are reused.
-	const uint32_t imageIndex = swapChain.GetImageIndex();
-	const uint32_t descriptorSetStartIndex = GetDescriptorStartIndex();
-
-	// Reuse a single memory block for all the different frames and cameras.
-	const auto memory = _uboAllocator.GetMemory();
 
-	// Size of the frame memory block.
-	const size_t memSize = sizeof(Camera::Ubo) * GetLength();
-	// Offset from the start of the memory adress based on swap chain image index.
-	const size_t memOffset = _uboAllocator.GetOffset(imageIndex);
 	const auto extent = swapChain.GetExtent();
 	const float aspectRatio = static_cast<float>(extent.x) / extent.y;
 
-	// Create a buffer per frame and batch all the cameras in one go.
-	auto buffer = _uboAllocator.CreateBuffer();
-	memoryHandler.Bind(buffer, memory, memOffset);
-
-	vi::VkShaderHandler::BufferBindInfo bindInfo{};
-	bindInfo.buffer = &buffer;
-	bindInfo.range = sizeof(Camera::Ubo);
-	bindInfo.bindingIndex = 0;
+	_uboAllocator.BeginFrame();
 
 	uint32_t i = 0;
 	for (auto& [index, camera] : *this)
 	{
 		auto& transform = _transforms[index];
-		
-		// Update individual UBOs.
+
 		auto& ubo = _ubos[i];
 		ubo.view = glm::lookAt(transform.position, camera.lookAt, glm::vec3(0, 1, 0));
 		ubo.projection = glm::perspective(glm::radians(camera.fieldOfView),
 			aspectRatio, camera.clipNear, camera.clipFar);
 
-		auto& descriptor = _descriptorSets[descriptorSetStartIndex + i];
-
-		bindInfo.set = descriptor;
-		bindInfo.offset = sizeof(Camera::Ubo) * i;
-		shaderHandler.BindBuffer(bindInfo);
-
+		// Write directly into the persistently mapped memory.
+		_dynamicOffsets[i] = _uboAllocator.Allocate(&ubo);
+		_frustums[i] = CreateFrustum(ubo.projection * ubo.view);
 		i++;
 	}
+}
 
-	// Update all UBOs in one call.
-	memoryHandler.Map(memory, _ubos.GetData(), memOffset, memSize);
-	swapChainExt.Collect(buffer);
+VkDescriptorSet CameraSystem::GetDescriptor() const
+{
+	auto& swapChain = _renderer.GetSwapChain();
+	return _descriptorSets[swapChain.GetFrameIndex()];
+}
+
+uint32_t CameraSystem::GetDynamicOffset(const uint32_t index) const
+{
+	return _dynamicOffsets[index];
+}
+
+const Camera::Frustum& CameraSystem::GetFrustum(const uint32_t index) const
+{
+	return _frustums[index];
+}
+
+const Camera::Ubo& CameraSystem::GetUbo(const uint32_t index) const
+{
+	return _ubos[index];
 }
 
-VkDescriptorSet CameraSystem::GetDescriptor(const uint32_t sparseIndex) const
+uint32_t CameraSystem::GetCapacity() const
 {
-	return _descriptorSets[GetDescriptorStartIndex() + sparseIndex];
+	return static_cast<uint32_t>(_ubos.GetLength());
 }
 
 VkDescriptorSetLayout CameraSystem::GetLayout() const
@@ -122,14 +130,28 @@ VkDescriptorSetLayout CameraSystem::GetLayout() const
 vi::VkLayoutHandler::CreateInfo::Binding CameraSystem::GetBindingInfo()
 {
 	vi::VkLayoutHandler::CreateInfo::Binding camBinding{};
+	camBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	camBinding.size = sizeof(Camera::Ubo);
-	camBinding.flag = VK_SHADER_STAGE_VERTEX_BIT;
+	// The fragment shader uses the matrices to find the light cluster.
+	camBinding.flag = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 	return camBinding;
 }
 
-uint32_t CameraSystem::GetDescriptorStartIndex() const
+Camera::Frustum CameraSystem::CreateFrustum(const glm::mat4& viewProjection)
 {
-	auto& swapChain = _renderer.GetSwapChain();
-	const uint32_t imageIndex = swapChain.GetImageIndex();
-	return GetLength() * imageIndex;
+	// Extract the planes from the rows of the matrix. Depth ranges from zero to one, so the near plane is the third row itself.
+	const glm::mat4 rows = glm::transpose(viewProjection);
+
+	Camera::Frustum frustum{};
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	// Normalize, so that the distance to a plane can be compared to a sphere's radius.
+	for (auto& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+	return frustum;
 }
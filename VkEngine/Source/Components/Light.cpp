@@ -3,51 +3,68 @@
 #include "Rendering/VulkanRenderer.h"
 #include "Components/Material.h"
 #include "Components/Transform.h"
+#include "Components/Bounds.h"
 #include "VkRenderer/VkHandlers/VkSyncHandler.h"
 #include "VkRenderer/VkHandlers/VkCommandBufferHandler.h"
 #include "VkRenderer/VkHandlers/VkDescriptorPoolHandler.h"
 #include "VkRenderer/VkHandlers/VkRenderPassHandler.h"
 #include "VkRenderer/VkHandlers/VkLayoutHandler.h"
 #include "VkRenderer/VkCore/VkCoreSwapchain.h"
-#include "VkRenderer/VkHandlers/VkMemoryHandler.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
 #include "VkRenderer/VkHandlers/VkShaderHandler.h"
 #include "VkRenderer/VkHandlers/VkImageHandler.h"
 #include "VkRenderer/VkHandlers/VkFrameBufferHandler.h"
+#include "Rendering/CommandRecorder.h"
+#include "Rendering/PipelineRegistry.h"
 
-LightSystem::LightSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, MaterialSystem& materials,
-	ShadowCasterSystem& shadowCasters, TransformSystem& transforms, const Info& info) :
-	SmallSystem<Light>(cecsar, info.size), Dependency(renderer),
-	_materials(materials), _shadowCasters(shadowCasters), _transforms(transforms),
-	_shadowResolution(info.shadowResolution),
+LightSystem::LightSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, MaterialSystem& materials, ShadowCasterSystem& shadowCasters,
+	TransformSystem& transforms, BoundsSystem& bounds, CameraSystem& cameras, const Info& info) :
+	SmallSystem<Light>(cecsar, info.size), Dependency(renderer.GetShaderExt()), _renderer(renderer),
+	_materials(materials), _shadowCasters(shadowCasters), _transforms(transforms), _bounds(bounds), _cameras(cameras),
 	_geometryUboAllocator(renderer, info.size),
-	_fragmentLightUboAllocator(renderer, info.size),
+	_fragmentLightUboAllocator(renderer, info.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
 	_fragmentLightingUboAllocator(renderer, 1),
-	_geometryUbos(info.size, GMEM),
+	_clusterGridAllocator(renderer, cameras.GetCapacity(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+	_clusterIndexAllocator(renderer, cameras.GetCapacity(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
 	_fragmentUbos(info.size, GMEM),
-	_frames(renderer.GetSwapChain().GetLength(), GMEM)
+	_geometryOffsets(info.size, GMEM),
+	_faceFrustums(info.size * 6, GMEM),
+	_extDynamicOffsets(cameras.GetCapacity() * GetDynamicOffsetCount(), GMEM)
 {
-	auto& commandBufferHandler = renderer.GetCommandBufferHandler();
-	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
-	auto& layoutHandler = renderer.GetLayoutHandler();
-	auto& renderPassHandler = renderer.GetRenderPassHandler();
-	auto& shaderHandler = renderer.GetShaderExt();
-	auto& swapChain = renderer.GetSwapChain();
-	auto& syncHandler = renderer.GetSyncHandler();
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& layoutHandler = _renderer.GetLayoutHandler();
+	auto& renderPassHandler = _renderer.GetRenderPassHandler();
+	auto& shaderExt = _renderer.GetShaderExt();
+	auto& shaderHandler = _renderer.GetShaderHandler();
+	auto& swapChain = _renderer.GetSwapChain();
 
-	const uint32_t swapChainLength = swapChain.GetLength();
+	const uint32_t frameCount = swapChain.GetFrameCount();
 
-	ShaderExt::LoadInfo shaderLoadInfo{};
-	shaderLoadInfo.geometry = true;
-	_shader = shaderHandler.Load("light-", shaderLoadInfo);
+	// Prefer rendering all the faces in a single pass. Every method selects the face in the vertex shader.
+	_shadowMethod = ShadowMethod::perFace;
+	if (_renderer.IsMultiviewEnabled())
+		_shadowMethod = ShadowMethod::multiview;
+	else if (_renderer.IsViewportLayerEnabled())
+		_shadowMethod = ShadowMethod::viewportLayer;
+
+	memcpy(_shadowCoverages, info.shadowCoverages, sizeof _shadowCoverages);
+
+	const char* shaderNames[]
+	{
+		"light-multiview-",
+		"light-layered-",
+		"light-"
+	};
+	_shader = shaderExt.Load(shaderNames[static_cast<uint32_t>(_shadowMethod)]);
 
 	// Set up layout for rendering to the cubemaps.
 	vi::VkLayoutHandler::CreateInfo layoutInfo{};
 	auto& geomBinding = layoutInfo.bindings.Add();
-	geomBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	geomBinding.flag = VK_SHADER_STAGE_GEOMETRY_BIT;
+	geomBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	geomBinding.flag = VK_SHADER_STAGE_VERTEX_BIT;
 	geomBinding.size = sizeof(GeometryUbo);
 	auto& fragBinding = layoutInfo.bindings.Add();
-	fragBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	fragBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 	fragBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
 	fragBinding.size = sizeof(FragmentLightUbo) * GetLength();
 	_layout = layoutHandler.CreateLayout(layoutInfo);
@@ -57,99 +74,120 @@ LightSystem::LightSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, MaterialS
 	renderPassCreateInfo.useDepthAttachment = true;
 	renderPassCreateInfo.depthStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
 	renderPassCreateInfo.depthFinalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	// Every view renders to the cubemap face with the same index.
+	const uint32_t viewMask = 0b111111;
+	VkRenderPassMultiviewCreateInfoKHR multiviewCreateInfo{};
+	multiviewCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO_KHR;
+	multiviewCreateInfo.subpassCount = 1;
+	multiviewCreateInfo.pViewMasks = &viewMask;
+	multiviewCreateInfo.correlationMaskCount = 1;
+	multiviewCreateInfo.pCorrelationMasks = &viewMask;
+	if (_shadowMethod == ShadowMethod::multiview)
+		renderPassCreateInfo.pNext = &multiviewCreateInfo;
+
 	_renderPass = renderPassHandler.Create(renderPassCreateInfo);
 
-	// Create the image assets for the cubemaps.
-	CreateCubeMaps(swapChain, info.shadowResolution);
+	// Create the image assets for the shadow maps.
+	CreateShadowMaps(frameCount, info);
 
-	// Create descriptor sets.
-	_descriptorSets = vi::ArrayPtr<VkDescriptorSet>(swapChain.GetLength() * GetLength(), GMEM);
+	// Create descriptor sets. Only one is needed per frame, since the lights are separated by dynamic offsets.
+	_descriptorSets = vi::ArrayPtr<VkDescriptorSet>(frameCount, GMEM);
 
-	VkDescriptorType types = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uint32_t size = GetLength() * swapChainLength * (info.size + 1);
+	VkDescriptorType types[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC };
+	uint32_t sizes[] = { frameCount, frameCount };
 
 	vi::VkDescriptorPoolHandler::PoolCreateInfo descriptorPoolCreateInfo{};
-	descriptorPoolCreateInfo.types = &types;
-	descriptorPoolCreateInfo.capacities = &size;
-	descriptorPoolCreateInfo.typeCount = 1;
+	descriptorPoolCreateInfo.types = types;
+	descriptorPoolCreateInfo.capacities = sizes;
+	descriptorPoolCreateInfo.typeCount = 2;
 	_descriptorPool = descriptorPoolHandler.Create(descriptorPoolCreateInfo);
 
 	vi::VkDescriptorPoolHandler::SetCreateInfo descriptorSetCreateInfo{};
 	descriptorSetCreateInfo.layout = _layout;
 	descriptorSetCreateInfo.pool = _descriptorPool;
 	descriptorSetCreateInfo.outSets = _descriptorSets.GetData();
-	descriptorSetCreateInfo.setCount = GetLength() * swapChainLength;
+	descriptorSetCreateInfo.setCount = frameCount;
 	descriptorPoolHandler.CreateSets(descriptorSetCreateInfo);
 
-	// Set up sync objects for GPU syncronization.
-	for (auto& frame : _frames)
+	// The buffers never change, so the descriptor sets only have to be written once.
+	for (uint32_t i = 0; i < frameCount; ++i)
 	{
-		frame.commandBuffer = commandBufferHandler.Create();
-		frame.signalSemaphore = syncHandler.CreateSemaphore();
+		auto geomBuffer = _geometryUboAllocator.GetBuffer(i);
+		auto fragBuffer = _fragmentLightUboAllocator.GetBuffer(i);
+
+		vi::VkShaderHandler::BufferBindInfo bindInfo{};
+		bindInfo.set = _descriptorSets[i];
+		bindInfo.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+
+		bindInfo.buffer = &geomBuffer;
+		bindInfo.range = sizeof(GeometryUbo);
+		bindInfo.bindingIndex = 0;
+		shaderHandler.BindBuffer(bindInfo);
+
+		bindInfo.buffer = &fragBuffer;
+		bindInfo.range = sizeof(FragmentLightUbo) * GetLength();
+		bindInfo.bindingIndex = 1;
+		bindInfo.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		shaderHandler.BindBuffer(bindInfo);
 	}
 
-	OnRecreateSwapChainAssets();
+	// Compile the pipeline in the background, it's picked up when the shadows are first rendered.
+	vi::VkPipelineHandler::CreateInfo pipelineInfo{};
+	CreatePipelineInfo(pipelineInfo);
+	_renderer.GetPipelineRegistry().Prewarm(&pipelineInfo, 1);
+
 	CreateExtDescriptorDependencies();
 }
 
 LightSystem::~LightSystem()
 {
-	DestroySwapChainAssets();
+	DestroyPipeline();
 	DestroyExtDescriptorDependencies();
 
-	auto& commandBufferHandler = renderer.GetCommandBufferHandler();
-	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
-	auto& layoutHandler = renderer.GetLayoutHandler();
-	auto& renderPassHandler = renderer.GetRenderPassHandler();
-	auto& shaderHandler = renderer.GetShaderExt();
-	auto& syncHandler = renderer.GetSyncHandler();
-
-	for (auto& frame : _frames)
-	{
-		commandBufferHandler.Destroy(frame.commandBuffer);
-		syncHandler.DestroySemaphore(frame.signalSemaphore);
-	}
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& layoutHandler = _renderer.GetLayoutHandler();
+	auto& renderPassHandler = _renderer.GetRenderPassHandler();
+	auto& shaderExt = _renderer.GetShaderExt();
 
 	renderPassHandler.Destroy(_renderPass);
-	shaderHandler.DestroyShader(_shader);
+	shaderExt.DestroyShader(_shader);
 	layoutHandler.DestroyLayout(_layout);
-	DestroyCubeMaps();	
+	DestroyShadowMaps();
 	descriptorPoolHandler.Destroy(_descriptorPool);
 }
 
-void LightSystem::Render(const VkSemaphore waitSemaphore)
+void LightSystem::Render()
 {
-	auto& commandBufferHandler = renderer.GetCommandBufferHandler();
-	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
-	auto& memoryHandler = renderer.GetMemoryHandler();
-	auto& meshHandler = renderer.GetMeshHandler();
-	auto& pipelineHandler = renderer.GetPipelineHandler();
-	auto& renderPassHandler = renderer.GetRenderPassHandler();
-	auto& shaderHandler = renderer.GetShaderHandler();
-	auto& swapChain = renderer.GetSwapChain();
-	auto& swapChainExt = renderer.GetSwapChainExt();
-
-	const uint32_t imageIndex = swapChain.GetImageIndex();
-	const uint32_t offsetMultiplier = GetLength() * imageIndex;
-
-	auto& frame = _frames[imageIndex];
-	commandBufferHandler.BeginRecording(frame.commandBuffer);
+	auto& commandBufferHandler = _renderer.GetCommandBufferHandler();
+	auto& commandRecorder = _renderer.GetCommandRecorder();
+	auto& renderPassHandler = _renderer.GetRenderPassHandler();
+	auto& swapChain = _renderer.GetSwapChain();
+
+	const uint32_t frameIndex = swapChain.GetFrameIndex();
+
+	AcquirePipeline();
+
+	vi::CommandContext context{};
+	const auto commandBuffer = swapChain.AllocateCommandBuffer();
+	commandBufferHandler.BeginRecording(context, commandBuffer);
 
 	// Begin render pass.
 	VkClearValue depthStencil  = { 1.f, 0 };
 
-	const size_t geometryUboOffset = _geometryUboAllocator.GetOffset(imageIndex);
-	const size_t fragmentLightUboOffset = _fragmentLightUboAllocator.GetOffset(imageIndex);
-	const size_t fragmentLightingOffset = _fragmentLightingUboAllocator.GetOffset(imageIndex);
+	// Every level of detail has the same aspect ratio.
+	const glm::ivec2 shadowResolution = _shadowMaps[0].resolution;
+	const float aspect = static_cast<float>(shadowResolution.x) / shadowResolution.y;
+	const float near = 0.1f;
 
-	const auto geomMemory = _geometryUboAllocator.GetMemory();
-	const auto fragLightMemory = _fragmentLightUboAllocator.GetMemory();
-	const auto fragLightingMemory = _fragmentLightingUboAllocator.GetMemory();
+	// Lights that have been removed since this frame was last used no longer need their shadow maps.
+	ReleaseShadowSlots();
 
-	const float aspect = static_cast<float>(_shadowResolution.x) / _shadowResolution.y;
-	const float near = 0.1f;
+	_geometryUboAllocator.BeginFrame();
+	_fragmentLightUboAllocator.BeginFrame();
+	_fragmentLightingUboAllocator.BeginFrame();
 
-	PushConstant pushConstant{};
+	GeometryUbo geomUbo{};
 
 	// Forward all the lighting information to the UBO buffer arrays.
 	uint32_t i = 0;
@@ -159,7 +197,6 @@ void LightSystem::Render(const VkSemaphore waitSemaphore)
 		const auto& position = lightTransform.position;
 
 		// Update geometry ubo.
-		auto& geomUbo = _geometryUbos[i];
 		auto& shadowFaces = geomUbo.matrices;
 
 		const glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), aspect, near, light.range);
@@ -176,11 +213,24 @@ void LightSystem::Render(const VkSemaphore waitSemaphore)
 		for (auto& face : shadowFaces)
 			face = shadowProj * face;
 
+		if (_shadowMethod == ShadowMethod::perFace)
+			for (uint32_t face = 0; face < 6; ++face)
+				_faceFrustums[i * 6 + face] = CameraSystem::CreateFrustum(shadowFaces[face]);
+
+		// Write directly into the persistently mapped memory.
+		_geometryOffsets[i] = _geometryUboAllocator.Allocate(&geomUbo);
+
 		// Update fragment ubo.
 		auto& fragUbo = _fragmentUbos[i];
 		fragUbo.position = lightTransform.position;
 		fragUbo.range = light.range;
 
+		// Reassign the shadow maps every frame, so that the resolution follows the light's screen coverage.
+		uint32_t lod, slotIndex;
+		const bool hasSlot = AssignShadowSlot(lightIndex, GetShadowLod(position, light.range), lod, slotIndex);
+		fragUbo.shadowIndex = hasSlot ? static_cast<int32_t>(slotIndex) : -1;
+		fragUbo.shadowLod = hasSlot ? lod : 0;
+
 		++i;
 	}
 
@@ -188,114 +238,178 @@ void LightSystem::Render(const VkSemaphore waitSemaphore)
 	FragmentLightingUbo uboLighting{};
 	uboLighting.count = i;
 
-	memoryHandler.Map(geomMemory, _geometryUbos.GetData(), geometryUboOffset, sizeof(GeometryUbo) * GetLength());
-	memoryHandler.Map(fragLightMemory, _fragmentUbos.GetData(), fragmentLightUboOffset, sizeof(FragmentLightUbo) * GetLength());
-	memoryHandler.Map(fragLightingMemory, &uboLighting, fragmentLightingOffset, sizeof(FragmentLightingUbo));
-
-	vi::VkShaderHandler::BufferBindInfo geomBindInfo{};
-	geomBindInfo.range = sizeof(GeometryUbo);
-	geomBindInfo.bindingIndex = 0;
+	// The light array is shared by the shadow pass and the external descriptor set.
+	const uint32_t fragmentLightOffset = _fragmentLightUboAllocator.Allocate(_fragmentUbos.GetData(), GetLength());
+	const uint32_t fragmentLightingOffset = _fragmentLightingUboAllocator.Allocate(&uboLighting);
+	for (uint32_t j = 0; j < _cameras.GetCapacity(); ++j)
+	{
+		_extDynamicOffsets[j * GetDynamicOffsetCount()] = fragmentLightOffset;
+		_extDynamicOffsets[j * GetDynamicOffsetCount() + 1] = fragmentLightingOffset;
+	}
 
-	vi::VkShaderHandler::BufferBindInfo fragBindInfo{};
-	fragBindInfo.range = sizeof(FragmentLightUbo) * GetLength();
-	fragBindInfo.bindingIndex = 1;
+	UpdateClusters(i);
 
-	Mesh* mesh = nullptr;
-	meshHandler.Bind(_materials.GetFallbackMesh());
+	auto& descriptorSet = _descriptorSets[frameIndex];
+	// Shadow casters are split into ranges that are recorded in parallel.
+	const uint32_t casterCount = static_cast<uint32_t>(_shadowCasters.end().index);
 
 	// Actually start drawing the models based on the earlier calculated cubemap shadows.
 	i = 0;
 	for (const auto& [lightIndex, light] : *this)
 	{
-		// Create frame bound buffers.
-		auto geomBuffer = _geometryUboAllocator.CreateBuffer();
-		memoryHandler.Bind(geomBuffer, geomMemory, geometryUboOffset);
-		auto fragBuffer = _fragmentLightUboAllocator.CreateBuffer();
-		memoryHandler.Bind(fragBuffer, fragLightMemory, fragmentLightUboOffset);
+		const auto& lightUbo = _fragmentUbos[i];
 
-		auto& cubeMap = _cubeMaps[offsetMultiplier + i];
-		renderPassHandler.Begin(cubeMap.frameBuffer, _renderPass, {}, _shadowResolution, &depthStencil, 1);
-		pipelineHandler.Bind(_pipeline, _pipelineLayout);
+		// Lights without a shadow map don't cast shadows this frame.
+		if (lightUbo.shadowIndex < 0)
+		{
+			++i;
+			continue;
+		}
 
-		auto& descriptorSet = _descriptorSets[offsetMultiplier + i];
+		auto& shadowMap = _shadowMaps[lightUbo.shadowLod];
+		auto& slot = shadowMap.slots[lightUbo.shadowIndex];
+
+		// Static lights surrounded by static shadow casters can reuse the cubemap from the last time this frame was used.
+		const size_t hash = HashShadowCasters(lightUbo);
+		if (slot.cached && slot.hash == hash)
+		{
+			++i;
+			continue;
+		}
+		slot.cached = true;
+		slot.hash = hash;
 
-		geomBindInfo.set = descriptorSet;
-		geomBindInfo.buffer = &geomBuffer;
-		geomBindInfo.offset = sizeof(GeometryUbo) * i;
-		shaderHandler.BindBuffer(geomBindInfo);
+		uint32_t dynamicOffsets[]
+		{
+			_geometryOffsets[i],
+			fragmentLightOffset
+		};
 
-		fragBindInfo.set = descriptorSet;
-		fragBindInfo.buffer = &fragBuffer;
-		shaderHandler.BindBuffer(fragBindInfo);
+		// Either render all the faces at once, or every face in a separate pass.
+		const bool perFace = _shadowMethod == ShadowMethod::perFace;
+		const uint32_t passCount = perFace ? 6 : 1;
 
-		descriptorPoolHandler.BindSets(&descriptorSet, 1);
+		ShadowJob job{};
+		job.system = this;
+		job.descriptorSet = &descriptorSet;
+		job.dynamicOffsets = dynamicOffsets;
+		job.lightIndex = i;
 
-		// Draw everything that has a material, not taking into consideration the different renderers.
-		for (const auto& [matIndex, material] : _materials)
+		for (uint32_t face = 0; face < passCount; ++face)
 		{
-			const auto& transform = _transforms[matIndex];
+			const auto frameBuffer = perFace ? slot.faceFrameBuffers[face] : slot.frameBuffer;
+			renderPassHandler.Begin(context, frameBuffer, _renderPass, {}, shadowMap.resolution, &depthStencil, 1, 
+				VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			commandRecorder.BeginRenderPass(context, _renderPass, frameBuffer, shadowMap.resolution);
 
-			transform.CreateModelMatrix(pushConstant.modelMatrix);
-			pushConstant.index = i;
-			shaderHandler.UpdatePushConstant(_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, pushConstant);
+			job.face = face;
+			commandRecorder.Record(casterCount, RenderShadowRange, &job);
 
-			// Bind and draw mesh.
-			if (mesh != material.mesh)
-			{
-				mesh = material.mesh;
-				meshHandler.Bind(mesh ? *mesh : _materials.GetFallbackMesh());
-			}
-			meshHandler.Draw();
+			commandRecorder.EndRenderPass();
+			renderPassHandler.End(context);
 		}
 
-		renderPassHandler.End();
+		++i;
+	}
+
+	// Make the shadow maps available to the fragment shaders of the later passes.
+	// The render pass transitions the layout at the very end, so every graphics stage has to be included.
+	commandBufferHandler.Barrier(context,
+		VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 
-		swapChainExt.Collect(geomBuffer);
-		swapChainExt.Collect(fragBuffer);
+	commandBufferHandler.EndRecording(context);
+	swapChain.Enqueue(commandBuffer);
+}
 
-		++i;
+size_t LightSystem::HashShadowCasters(const FragmentLightUbo& light)
+{
+	// FNV offset basis. The shadow map assignment is left out, since the cache is stored per slot.
+	size_t hash = Hash(14695981039346656037ull, &light.position, sizeof light.position);
+	hash = Hash(hash, &light.range, sizeof light.range);
+
+	for (const auto& [casterIndex, caster] : _shadowCasters)
+	{
+		if (!_bounds.Intersects(casterIndex, light.position, light.range))
+			continue;
+
+		// Casters moving in or out of range change the hash as well.
+		const auto& transform = _transforms[casterIndex];
+		const Mesh* mesh = _materials.Contains(casterIndex) ? _materials[casterIndex].mesh : nullptr;
+		hash = Hash(hash, &casterIndex, sizeof casterIndex);
+		hash = Hash(hash, &transform, sizeof transform);
+		hash = Hash(hash, &mesh, sizeof mesh);
 	}
 
-	// Handle external descriptor set.
-	const auto extDescriptorSet = GetDescriptorSet(imageIndex);
+	return hash;
+}
 
-	auto fragLightExtBuffer = _fragmentLightUboAllocator.CreateBuffer();
-	memoryHandler.Bind(fragLightExtBuffer, fragLightMemory, fragmentLightUboOffset);
+size_t LightSystem::Hash(size_t hash, const void* data, const size_t size)
+{
+	// FNV-1a.
+	const auto bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
 
-	auto fragLightingExtBuffer = _fragmentLightingUboAllocator.CreateBuffer();
-	memoryHandler.Bind(fragLightingExtBuffer, fragLightingMemory, fragmentLightingOffset);
+void LightSystem::RenderShadowRange(vi::CommandContext& context, const uint32_t start, const uint32_t end, void* userPtr)
+{
+	const auto& job = *static_cast<ShadowJob*>(userPtr);
+	auto& system = *job.system;
 
-	swapChainExt.Collect(fragLightExtBuffer);
-	swapChainExt.Collect(fragLightingExtBuffer);
+	auto& descriptorPoolHandler = system._renderer.GetDescriptorPoolHandler();
+	auto& meshHandler = system._renderer.GetMeshHandler();
+	auto& pipelineHandler = system._renderer.GetPipelineHandler();
+	auto& shaderHandler = system._renderer.GetShaderHandler();
 
-	fragBindInfo.set = extDescriptorSet;
-	fragBindInfo.buffer = &fragLightExtBuffer;
-	fragBindInfo.offset = 0;
-	fragBindInfo.range = sizeof(FragmentLightUbo) * GetLength();
-	fragBindInfo.bindingIndex = 0;
-	shaderHandler.BindBuffer(fragBindInfo);
+	const auto& lightUbo = system._fragmentUbos[job.lightIndex];
+	const auto pipelineLayout = system._pipelineLayout;
+	const bool perFace = system._shadowMethod == ShadowMethod::perFace;
+	// When the face is selected through gl_Layer, every instance is drawn to a different face.
+	const uint32_t instanceCount = system._shadowMethod == ShadowMethod::viewportLayer ? 6 : 1;
 
-	fragBindInfo.set = extDescriptorSet;
-	fragBindInfo.buffer = &fragLightingExtBuffer;
-	fragBindInfo.offset = 0;
-	fragBindInfo.range = sizeof(FragmentLightingUbo);
-	fragBindInfo.bindingIndex = 1;
-	shaderHandler.BindBuffer(fragBindInfo);
+	// The range might be recorded in its own command buffer, so nothing has been bound yet.
+	pipelineHandler.Bind(context, system._pipeline, pipelineLayout);
+	descriptorPoolHandler.BindSets(context, job.descriptorSet, 1, job.dynamicOffsets, 2);
 
-	vi::VkCommandBufferHandler::SubmitInfo submitInfo{};
-	submitInfo.buffers = &frame.commandBuffer;
-	submitInfo.waitSemaphore = waitSemaphore;
-	submitInfo.signalSemaphore = frame.signalSemaphore;
-	submitInfo.buffersCount = 1;
+	Mesh* mesh = nullptr;
+	meshHandler.Bind(context, system._materials.GetFallbackMesh());
 
-	commandBufferHandler.EndRecording();
-	commandBufferHandler.Submit(submitInfo);
-}
+	PushConstant pushConstant{};
+	pushConstant.index = job.lightIndex;
+	pushConstant.face = job.face;
 
-VkSemaphore LightSystem::GetRenderFinishedSemaphore() const
-{
-	auto& swapChain = renderer.GetSwapChain();
-	return _frames[swapChain.GetImageIndex()].signalSemaphore;
+	const auto instances = system._shadowCasters.begin().begin;
+
+	// Draw every shadow caster within range of the light.
+	for (uint32_t i = start; i < end; ++i)
+	{
+		const uint16_t casterIndex = instances[i].key;
+
+		if (!system._bounds.Intersects(casterIndex, lightUbo.position, lightUbo.range))
+			continue;
+		if (perFace && !BoundsSystem::Intersects(system._faceFrustums[job.lightIndex * 6 + job.face], 
+			system._bounds.GetSphere(casterIndex)))
+			continue;
+
+		const auto& transform = system._transforms[casterIndex];
+		Mesh* casterMesh = system._materials.Contains(casterIndex) ? system._materials[casterIndex].mesh : nullptr;
+
+		transform.CreateModelMatrix(pushConstant.modelMatrix);
+		shaderHandler.UpdatePushConstant(context, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, pushConstant);
+
+		// Bind and draw mesh.
+		if (mesh != casterMesh)
+		{
+			mesh = casterMesh;
+			meshHandler.Bind(context, mesh ? *mesh : system._materials.GetFallbackMesh());
+		}
+		meshHandler.Draw(context, instanceCount);
+	}
 }
 
 VkDescriptorSetLayout LightSystem::GetLayout() const
@@ -308,62 +422,312 @@ VkDescriptorSet LightSystem::GetDescriptorSet(const uint32_t index) const
 	return _extDescriptorSets[index];
 }
 
-void LightSystem::CreateCubeMaps(vi::VkCoreSwapchain& swapChain, const glm::ivec2 resolution)
+const uint32_t* LightSystem::GetDynamicOffsets(const uint32_t cameraIndex) const
+{
+	return &_extDynamicOffsets[cameraIndex * GetDynamicOffsetCount()];
+}
+
+void LightSystem::UpdateClusters(const uint32_t lightCount)
+{
+	_clusterGridAllocator.BeginFrame();
+	_clusterIndexAllocator.BeginFrame();
+
+	// Write head and end of every cluster's range in the index list.
+	vi::ArrayPtr<glm::uvec2> ranges{ CLUSTER_COUNT, GMEM_TEMP };
+	glm::uvec3 min, max;
+
+	uint32_t cameraIndex = 0;
+	for (const auto& [camSparseIndex, camera] : _cameras)
+	{
+		const auto& ubo = _cameras.GetUbo(cameraIndex);
+		uint32_t* dynamicOffsets = &_extDynamicOffsets[cameraIndex * GetDynamicOffsetCount()];
+		++cameraIndex;
+
+		// Write directly into the persistently mapped memory. Only writes, since reading from it is slow.
+		const auto grid = _clusterGridAllocator.Reserve(dynamicOffsets[2]);
+		const auto indices = _clusterIndexAllocator.Reserve(dynamicOffsets[3]);
+
+		const float logDepth = log(camera.clipFar / camera.clipNear);
+		grid->sliceScale = CLUSTER_Z / logDepth;
+		grid->sliceBias = CLUSTER_Z * log(camera.clipNear) / logDepth;
+
+		// Count the lights in every cluster.
+		for (auto& range : ranges)
+			range = {};
+		for (uint32_t i = 0; i < lightCount; ++i)
+		{
+			if (!GetClusterBounds(ubo, camera, _fragmentUbos[i], min, max))
+				continue;
+			for (uint32_t z = min.z; z <= max.z; ++z)
+				for (uint32_t y = min.y; y <= max.y; ++y)
+					for (uint32_t x = min.x; x <= max.x; ++x)
+						++ranges[x + (y + z * CLUSTER_Y) * CLUSTER_X].y;
+		}
+
+		// Give every cluster its own range in the index list. Clusters that don't fit anymore are cut short.
+		uint32_t offset = 0;
+		for (uint32_t i = 0; i < CLUSTER_COUNT; ++i)
+		{
+			auto& range = ranges[i];
+			const uint32_t count = vi::Ut::Min(range.y, CLUSTER_INDEX_CAPACITY - offset);
+			grid->clusters[i] = { offset, count };
+			range = { offset, offset + count };
+			offset += count;
+		}
+
+		// Fill the index lists.
+		for (uint32_t i = 0; i < lightCount; ++i)
+		{
+			if (!GetClusterBounds(ubo, camera, _fragmentUbos[i], min, max))
+				continue;
+			for (uint32_t z = min.z; z <= max.z; ++z)
+				for (uint32_t y = min.y; y <= max.y; ++y)
+					for (uint32_t x = min.x; x <= max.x; ++x)
+					{
+						auto& range = ranges[x + (y + z * CLUSTER_Y) * CLUSTER_X];
+						if (range.x < range.y)
+							indices->values[range.x++] = i;
+					}
+		}
+	}
+}
+
+bool LightSystem::GetClusterBounds(const Camera::Ubo& ubo, const Camera& camera, 
+	const FragmentLightUbo& light, glm::uvec3& outMin, glm::uvec3& outMax)
+{
+	// Left handed, so the depth increases away from the camera.
+	const glm::vec3 center = glm::vec3(ubo.view * glm::vec4(light.position, 1));
+	const float nearDepth = center.z - light.range;
+	const float farDepth = center.z + light.range;
+	if (farDepth < camera.clipNear || nearDepth > camera.clipFar)
+		return false;
+
+	// Same exponential distribution as the shader uses.
+	const float logDepth = log(camera.clipFar / camera.clipNear);
+	const auto toSlice = [&camera, logDepth](const float depth)
+	{
+		const float slice = floor(log(depth / camera.clipNear) / logDepth * CLUSTER_Z);
+		return static_cast<uint32_t>(vi::Ut::Clamp<float>(slice, 0, CLUSTER_Z - 1));
+	};
+	outMin.z = toSlice(vi::Ut::Max(nearDepth, camera.clipNear));
+	outMax.z = toSlice(vi::Ut::Min(farDepth, camera.clipFar));
+
+	// When the light surrounds the near plane, it can cover any part of the screen.
+	if (nearDepth <= camera.clipNear)
+	{
+		outMin.x = 0;
+		outMin.y = 0;
+		outMax.x = CLUSTER_X - 1;
+		outMax.y = CLUSTER_Y - 1;
+		return true;
+	}
+
+	// Project the bounding box of the light's range. The extents are the largest at either the near or the far side.
+	const uint32_t dimensions[]{ CLUSTER_X, CLUSTER_Y };
+	for (uint32_t axis = 0; axis < 2; ++axis)
+	{
+		const float scale = ubo.projection[axis][axis];
+		const float lower = (center[axis] - light.range) * scale;
+		const float upper = (center[axis] + light.range) * scale;
+
+		const float ndcMin = vi::Ut::Min(vi::Ut::Min(lower / nearDepth, lower / farDepth), vi::Ut::Min(upper / nearDepth, upper / farDepth));
+		const float ndcMax = vi::Ut::Max(vi::Ut::Max(lower / nearDepth, lower / farDepth), vi::Ut::Max(upper / nearDepth, upper / farDepth));
+		if (ndcMax < -1 || ndcMin > 1)
+			return false;
+
+		const float dimension = static_cast<float>(dimensions[axis]);
+		outMin[axis] = static_cast<uint32_t>(vi::Ut::Clamp<float>(floor((ndcMin * .5f + .5f) * dimension), 0, dimension - 1));
+		outMax[axis] = static_cast<uint32_t>(vi::Ut::Clamp<float>(floor((ndcMax * .5f + .5f) * dimension), 0, dimension - 1));
+	}
+
+	return true;
+}
+
+uint32_t LightSystem::GetShadowLod(const glm::vec3& position, const float range)
+{
+	// Estimate the part of the screen covered by the light's range, using the camera it appears the largest in.
+	float coverage = 0;
+	for (const auto& [cameraIndex, camera] : _cameras)
+		coverage = vi::Ut::Max(coverage, BoundsSystem::GetCoverage(glm::vec4(position, range), 
+			_transforms[cameraIndex].position, camera.fieldOfView));
+
+	for (uint32_t i = 0; i < SHADOW_LOD_COUNT; ++i)
+		if (coverage >= _shadowCoverages[i])
+			return i;
+	return SHADOW_LOD_COUNT - 1;
+}
+
+bool LightSystem::AssignShadowSlot(const uint16_t lightIndex, const uint32_t lod, uint32_t& outLod, uint32_t& outIndex)
+{
+	const uint32_t frameIndex = _renderer.GetSwapChain().GetFrameIndex();
+
+	// Find the slot the light used the last time this frame was rendered, if any.
+	ShadowSlot* current = nullptr;
+	uint32_t currentLod = 0;
+	uint32_t currentIndex = 0;
+	for (uint32_t i = 0; i < SHADOW_LOD_COUNT && !current; ++i)
+	{
+		auto& shadowMap = _shadowMaps[i];
+		const uint32_t start = shadowMap.capacity * frameIndex;
+		for (uint32_t j = start; j < start + shadowMap.capacity; ++j)
+			if (shadowMap.slots[j].owner == lightIndex)
+			{
+				current = &shadowMap.slots[j];
+				currentLod = i;
+				currentIndex = j;
+				break;
+			}
+	}
+
+	// Try the preferred level of detail first, then the lower resolutions and only then the higher resolutions.
+	for (uint32_t i = 0; i < SHADOW_LOD_COUNT; ++i)
+	{
+		const uint32_t candidate = lod + i < SHADOW_LOD_COUNT ? lod + i : SHADOW_LOD_COUNT - 1 - i;
+
+		// Keeping the current slot is preferred over moving to a worse fit, and keeps the cache intact.
+		if (current && candidate == currentLod)
+		{
+			outLod = currentLod;
+			outIndex = currentIndex;
+			return true;
+		}
+
+		auto& shadowMap = _shadowMaps[candidate];
+		const uint32_t start = shadowMap.capacity * frameIndex;
+		for (uint32_t j = start; j < start + shadowMap.capacity; ++j)
+		{
+			auto& slot = shadowMap.slots[j];
+			if (slot.owner != -1)
+				continue;
+
+			if (current)
+				current->owner = -1;
+
+			slot.owner = lightIndex;
+			slot.cached = false;
+			outLod = candidate;
+			outIndex = j;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void LightSystem::ReleaseShadowSlots()
+{
+	const uint32_t frameIndex = _renderer.GetSwapChain().GetFrameIndex();
+
+	for (auto& shadowMap : _shadowMaps)
+	{
+		const uint32_t start = shadowMap.capacity * frameIndex;
+		for (uint32_t i = start; i < start + shadowMap.capacity; ++i)
+		{
+			auto& slot = shadowMap.slots[i];
+			if (slot.owner != -1 && !Contains(static_cast<uint16_t>(slot.owner)))
+				slot.owner = -1;
+		}
+	}
+}
+
+void LightSystem::CreateShadowMaps(const uint32_t frameCount, const Info& info)
 {
-	auto& commandBufferHandler = renderer.GetCommandBufferHandler();
-	auto& frameBufferHandler = renderer.GetFrameBufferHandler();
-	auto& imageHandler = renderer.GetImageHandler();
-	auto& memoryHandler = renderer.GetMemoryHandler();
-	auto& syncHandler = renderer.GetSyncHandler();
+	auto& commandBufferHandler = _renderer.GetCommandBufferHandler();
+	auto& frameBufferHandler = _renderer.GetFrameBufferHandler();
+	auto& gpuAllocator = _renderer.GetGpuAllocator();
+	auto& imageHandler = _renderer.GetImageHandler();
+	auto& swapChain = _renderer.GetSwapChain();
+	auto& syncHandler = _renderer.GetSyncHandler();
 
-	// Create image with 6 sides.
+	const auto format = swapChain.GetDepthBufferFormat();
+
+	// Create image info. Every cube takes up six layers.
 	vi::VkImageHandler::CreateInfo imageCreateInfo{};
-	imageCreateInfo.resolution = resolution;
-	imageCreateInfo.arrayLayers = 6;
-	imageCreateInfo.format = swapChain.GetDepthBufferFormat();
+	imageCreateInfo.format = format;
 	imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 	imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
-	// Create image view.
+	// Create image view info.
 	vi::VkImageHandler::ViewCreateInfo viewCreateInfo{};
-	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-	viewCreateInfo.layerCount = 6;
-	viewCreateInfo.format = swapChain.GetDepthBufferFormat();
+	viewCreateInfo.format = format;
 	viewCreateInfo.aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT;
 
 	// Create frame buffer info.
 	vi::VkFrameBufferHandler::CreateInfo frameBufferCreateInfo{};
 	frameBufferCreateInfo.imageViewCount = 1;
 	frameBufferCreateInfo.renderPass = _renderPass;
-	frameBufferCreateInfo.extent = _shadowResolution;
-	frameBufferCreateInfo.layerCount = 6;
 
 	// Create transition info.
 	vi::VkImageHandler::TransitionInfo transitionInfo{};
 	transitionInfo.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	transitionInfo.aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT;
-	transitionInfo.layerCount = 6;
 
 	// Start transition.
+	vi::CommandContext context{};
 	auto cmdBuffer = commandBufferHandler.Create();
-	commandBufferHandler.BeginRecording(cmdBuffer);
+	commandBufferHandler.BeginRecording(context, cmdBuffer);
 
-	// Use the create infos to create a cubemap for every swapchain image.
-	_cubeMaps.Reallocate(GetLength() * swapChain.GetLength(), GMEM);
-	for (auto& cubeMap : _cubeMaps)
+	for (uint32_t lod = 0; lod < SHADOW_LOD_COUNT; ++lod)
 	{
-		cubeMap.image = imageHandler.Create(imageCreateInfo);
-		cubeMap.memory = memoryHandler.Allocate(cubeMap.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		memoryHandler.Bind(cubeMap.image, cubeMap.memory);
+		auto& shadowMap = _shadowMaps[lod];
+		shadowMap.resolution = info.shadowResolution / (1 << lod);
+		shadowMap.capacity = info.shadowCapacities[lod];
+
+		// Every frame in flight has its own range of slots.
+		const uint32_t cubeCount = shadowMap.capacity * frameCount;
+
+		imageCreateInfo.resolution = shadowMap.resolution;
+		imageCreateInfo.arrayLayers = cubeCount * 6;
+		shadowMap.image = imageHandler.Create(imageCreateInfo);
+		shadowMap.memory = gpuAllocator.Allocate(shadowMap.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		gpuAllocator.Bind(shadowMap.image, shadowMap.memory);
+
+		viewCreateInfo.image = shadowMap.image;
+		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE_ARRAY;
+		viewCreateInfo.layerCount = cubeCount * 6;
+		viewCreateInfo.baseArrayLayer = 0;
+		shadowMap.view = imageHandler.CreateView(viewCreateInfo);
+
+		transitionInfo.image = shadowMap.image;
+		transitionInfo.layerCount = cubeCount * 6;
+		imageHandler.TransitionLayout(context, transitionInfo);
 
-		viewCreateInfo.image = cubeMap.image;
-		cubeMap.view = imageHandler.CreateView(viewCreateInfo);
+		frameBufferCreateInfo.extent = shadowMap.resolution;
+
+		shadowMap.slots = vi::ArrayPtr<ShadowSlot>(cubeCount, GMEM);
+		for (uint32_t i = 0; i < cubeCount; ++i)
+		{
+			auto& slot = shadowMap.slots[i];
+			slot.owner = -1;
+			slot.cached = false;
+
+			if (_shadowMethod != ShadowMethod::perFace)
+			{
+				viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+				viewCreateInfo.layerCount = 6;
+				viewCreateInfo.baseArrayLayer = i * 6;
+				slot.view = imageHandler.CreateView(viewCreateInfo);
+
+				// With multiview the layers are addressed through the view mask of the render pass instead.
+				frameBufferCreateInfo.imageViews = &slot.view;
+				frameBufferCreateInfo.layerCount = _shadowMethod == ShadowMethod::multiview ? 1 : 6;
+				slot.frameBuffer = frameBufferHandler.Create(frameBufferCreateInfo);
+				continue;
+			}
 
-		transitionInfo.image = cubeMap.image;
-		imageHandler.TransitionLayout(transitionInfo);
+			// Create the single layer views for rendering the faces separately.
+			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCreateInfo.layerCount = 1;
+			frameBufferCreateInfo.layerCount = 1;
+			for (uint32_t face = 0; face < 6; ++face)
+			{
+				viewCreateInfo.baseArrayLayer = i * 6 + face;
+				slot.faceViews[face] = imageHandler.CreateView(viewCreateInfo);
 
-		frameBufferCreateInfo.imageViews = &cubeMap.view;
-		cubeMap.frameBuffer = frameBufferHandler.Create(frameBufferCreateInfo);
+				frameBufferCreateInfo.imageViews = &slot.faceViews[face];
+				slot.faceFrameBuffers[face] = frameBufferHandler.Create(frameBufferCreateInfo);
+			}
+		}
 	}
 
 	const auto fence = syncHandler.CreateFence();
@@ -374,7 +738,7 @@ void LightSystem::CreateCubeMaps(vi::VkCoreSwapchain& swapChain, const glm::ivec
 	submitInfo.fence = fence;
 
 	// End recording and execute transitions.
-	commandBufferHandler.EndRecording();
+	commandBufferHandler.EndRecording(context);
 	commandBufferHandler.Submit(submitInfo);
 	syncHandler.WaitForFence(fence);
 
@@ -383,54 +747,82 @@ void LightSystem::CreateCubeMaps(vi::VkCoreSwapchain& swapChain, const glm::ivec
 	syncHandler.DestroyFence(fence);
 }
 
-void LightSystem::DestroyCubeMaps()
+void LightSystem::DestroyShadowMaps()
 {
-	auto& frameBufferHandler = renderer.GetFrameBufferHandler();
-	auto& imageHandler = renderer.GetImageHandler();
-	auto& memoryHandler = renderer.GetMemoryHandler();
+	auto& frameBufferHandler = _renderer.GetFrameBufferHandler();
+	auto& gpuAllocator = _renderer.GetGpuAllocator();
+	auto& imageHandler = _renderer.GetImageHandler();
 
-	for (auto& cubeMap : _cubeMaps)
+	for (auto& shadowMap : _shadowMaps)
 	{
-		frameBufferHandler.Destroy(cubeMap.frameBuffer);
-		imageHandler.DestroyView(cubeMap.view);
-		imageHandler.Destroy(cubeMap.image);
-		memoryHandler.Free(cubeMap.memory);
+		for (auto& slot : shadowMap.slots)
+		{
+			if (_shadowMethod != ShadowMethod::perFace)
+			{
+				frameBufferHandler.Destroy(slot.frameBuffer);
+				imageHandler.DestroyView(slot.view);
+				continue;
+			}
+
+			for (uint32_t face = 0; face < 6; ++face)
+			{
+				frameBufferHandler.Destroy(slot.faceFrameBuffers[face]);
+				imageHandler.DestroyView(slot.faceViews[face]);
+			}
+		}
+
+		imageHandler.DestroyView(shadowMap.view);
+		imageHandler.Destroy(shadowMap.image);
+		gpuAllocator.Free(shadowMap.memory);
 	}
 }
 
 void LightSystem::CreateExtDescriptorDependencies()
 {
-	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
-	auto& layoutHandler = renderer.GetLayoutHandler();
-	auto& shaderHandler = renderer.GetShaderHandler();
-	auto& swapChain = renderer.GetSwapChain();
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& layoutHandler = _renderer.GetLayoutHandler();
+	auto& shaderHandler = _renderer.GetShaderHandler();
+	auto& swapChain = _renderer.GetSwapChain();
 
 	vi::VkLayoutHandler::CreateInfo extLayoutInfo{};
 	auto& extFragLightBinding = extLayoutInfo.bindings.Add();
-	extFragLightBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	extFragLightBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 	extFragLightBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
 	extFragLightBinding.size = sizeof(FragmentLightUbo) * GetLength();
 	auto& extFragLightingInfoBinding = extLayoutInfo.bindings.Add();
-	extFragLightingInfoBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	extFragLightingInfoBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	extFragLightingInfoBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
 	extFragLightingInfoBinding.size = sizeof(FragmentLightingUbo);
-	auto& cubeMapsBinding = extLayoutInfo.bindings.Add();
-	cubeMapsBinding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	cubeMapsBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
-	cubeMapsBinding.count = GetLength();
+	auto& shadowMapsBinding = extLayoutInfo.bindings.Add();
+	shadowMapsBinding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	shadowMapsBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shadowMapsBinding.count = SHADOW_LOD_COUNT;
+	auto& clusterGridBinding = extLayoutInfo.bindings.Add();
+	clusterGridBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	clusterGridBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
+	clusterGridBinding.size = sizeof(ClusterGrid);
+	auto& clusterIndicesBinding = extLayoutInfo.bindings.Add();
+	clusterIndicesBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	clusterIndicesBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
+	clusterIndicesBinding.size = sizeof(ClusterIndices);
 	_extLayout = layoutHandler.CreateLayout(extLayoutInfo);
 
 	// Create descriptor sets.
-	const uint32_t length = swapChain.GetLength();
+	const uint32_t length = swapChain.GetFrameCount();
 	_extDescriptorSets.Reallocate(length, GMEM);
 
-	VkDescriptorType types[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
-	uint32_t sizes[] = { length * 2, length };
+	VkDescriptorType types[] = 
+	{ 
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER 
+	};
+	uint32_t sizes[] = { length * 3, length, length * SHADOW_LOD_COUNT };
 
 	vi::VkDescriptorPoolHandler::PoolCreateInfo descriptorPoolCreateInfo{};
 	descriptorPoolCreateInfo.types = types;
 	descriptorPoolCreateInfo.capacities = sizes;
-	descriptorPoolCreateInfo.typeCount = 2;
+	descriptorPoolCreateInfo.typeCount = 3;
 	_extDescriptorPool = descriptorPoolHandler.Create(descriptorPoolCreateInfo);
 
 	vi::VkDescriptorPoolHandler::SetCreateInfo descriptorSetCreateInfo{};
@@ -440,42 +832,74 @@ void LightSystem::CreateExtDescriptorDependencies()
 	descriptorSetCreateInfo.setCount = length;
 	descriptorPoolHandler.CreateSets(descriptorSetCreateInfo);
 
-	// Bind samplers to external descriptor set.
-	const uint32_t samplerCount = GetLength() * length;
-	_extSamplers.Reallocate(samplerCount, GMEM);
+	// Bind samplers to external descriptor set. The frames share the shadow map arrays, so they can share the samplers as well.
 	for (auto& sampler : _extSamplers)
 		sampler = shaderHandler.CreateSampler();
 
-	// Already bind all the cubemap samplers to the descriptors, because it won't change.
-	const uint32_t lightCount = GetLength();
-	const vi::ArrayPtr<VkImageLayout> layouts{GetLength(), GMEM_TEMP, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-	const vi::ArrayPtr<VkImageView> imageViews{GetLength(), GMEM_TEMP};
+	// Already bind all the buffers and shadow map arrays to the descriptors, because they won't change.
+	VkImageLayout layouts[SHADOW_LOD_COUNT];
+	VkImageView imageViews[SHADOW_LOD_COUNT];
+	for (uint32_t i = 0; i < SHADOW_LOD_COUNT; ++i)
+	{
+		layouts[i] = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageViews[i] = _shadowMaps[i].view;
+	}
 
 	for (uint32_t i = 0; i < length; ++i)
 	{
 		auto& descriptorSet = _extDescriptorSets[i];
-		const uint32_t index = i * lightCount;
 
-		for (uint32_t j = 0; j < GetLength(); ++j)
-			imageViews[j] = _cubeMaps[index + j].view;
+		// Bind the light buffers, which will be offset dynamically.
+		auto fragLightBuffer = _fragmentLightUboAllocator.GetBuffer(i);
+		auto fragLightingBuffer = _fragmentLightingUboAllocator.GetBuffer(i);
+
+		vi::VkShaderHandler::BufferBindInfo bufferBindInfo{};
+		bufferBindInfo.set = descriptorSet;
+
+		bufferBindInfo.buffer = &fragLightBuffer;
+		bufferBindInfo.range = sizeof(FragmentLightUbo) * GetLength();
+		bufferBindInfo.bindingIndex = 0;
+		bufferBindInfo.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		shaderHandler.BindBuffer(bufferBindInfo);
+
+		bufferBindInfo.buffer = &fragLightingBuffer;
+		bufferBindInfo.range = sizeof(FragmentLightingUbo);
+		bufferBindInfo.bindingIndex = 1;
+		bufferBindInfo.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		shaderHandler.BindBuffer(bufferBindInfo);
+
+		// Bind the cluster buffers, which are offset per camera.
+		auto clusterGridBuffer = _clusterGridAllocator.GetBuffer(i);
+		auto clusterIndexBuffer = _clusterIndexAllocator.GetBuffer(i);
+
+		bufferBindInfo.buffer = &clusterGridBuffer;
+		bufferBindInfo.range = sizeof(ClusterGrid);
+		bufferBindInfo.bindingIndex = 3;
+		bufferBindInfo.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		shaderHandler.BindBuffer(bufferBindInfo);
+
+		bufferBindInfo.buffer = &clusterIndexBuffer;
+		bufferBindInfo.range = sizeof(ClusterIndices);
+		bufferBindInfo.bindingIndex = 4;
+		shaderHandler.BindBuffer(bufferBindInfo);
 
 		vi::VkShaderHandler::SamplerBindInfo bindInfo{};
 		bindInfo.set = descriptorSet;
-		bindInfo.imageViews = imageViews.GetData();
-		bindInfo.layouts = layouts.GetData();
-		bindInfo.samplers = &_extSamplers[index];
+		bindInfo.imageViews = imageViews;
+		bindInfo.layouts = layouts;
+		bindInfo.samplers = _extSamplers;
 		bindInfo.bindingIndex = 2;
 		bindInfo.arrayIndex = 0;
-		bindInfo.count = GetLength();
+		bindInfo.count = SHADOW_LOD_COUNT;
 		shaderHandler.BindSampler(bindInfo);
 	}
 }
 
 void LightSystem::DestroyExtDescriptorDependencies() const
 {
-	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
-	auto& layoutHandler = renderer.GetLayoutHandler();
-	auto& shaderHandler = renderer.GetShaderHandler();
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& layoutHandler = _renderer.GetLayoutHandler();
+	auto& shaderHandler = _renderer.GetShaderHandler();
 
 	for (auto& sampler : _extSamplers)
 		shaderHandler.DestroySampler(sampler);
@@ -484,31 +908,45 @@ void LightSystem::DestroyExtDescriptorDependencies() const
 	descriptorPoolHandler.Destroy(_extDescriptorPool);
 }
 
-void LightSystem::OnRecreateSwapChainAssets()
+void LightSystem::OnReloadShaders()
 {
-	auto& pipelineHandler = renderer.GetPipelineHandler();
+	if (!_renderer.GetShaderExt().Refresh(_shader))
+		return;
 
+	DestroyPipeline();
+	_pipeline = VK_NULL_HANDLE;
+	AcquirePipeline();
+}
+
+void LightSystem::CreatePipelineInfo(vi::VkPipelineHandler::CreateInfo& outInfo) const
+{
+	auto& meshHandler = _renderer.GetMeshHandler();
+
+	outInfo.attributeDescriptions = meshHandler.GetAttributeDescriptions();
+	outInfo.bindingDescription = meshHandler.GetBindingDescription();
+	outInfo.pushConstants.Add({ sizeof(PushConstant), VK_SHADER_STAGE_VERTEX_BIT });
+	for (auto& module : _shader.modules)
+		outInfo.modules.Add(module);
+	outInfo.setLayouts.Add(_layout);
+	outInfo.renderPass = _renderPass;
+	outInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+}
+
+void LightSystem::AcquirePipeline()
+{
 	if (_pipeline)
-		DestroySwapChainAssets();
+		return;
 
 	vi::VkPipelineHandler::CreateInfo pipelineInfo{};
-	pipelineInfo.attributeDescriptions = Vertex::GetAttributeDescriptions();
-	pipelineInfo.bindingDescription = Vertex::GetBindingDescription();
-	pipelineInfo.pushConstants.Add({ sizeof(PushConstant), VK_SHADER_STAGE_VERTEX_BIT });
-	for (auto& module : _shader.modules)
-		pipelineInfo.modules.Add(module);
-	pipelineInfo.setLayouts.Add(_layout);
-	pipelineInfo.renderPass = _renderPass;
-	pipelineInfo.extent = _shadowResolution;
-	pipelineInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	
-	pipelineHandler.Create(pipelineInfo, _pipeline, _pipelineLayout);
+	CreatePipelineInfo(pipelineInfo);
+	_renderer.GetPipelineRegistry().Get(pipelineInfo, _pipeline, _pipelineLayout);
 }
 
-void LightSystem::DestroySwapChainAssets() const
+void LightSystem::DestroyPipeline() const
 {
-	auto& pipelineHandler = renderer.GetPipelineHandler();
-	pipelineHandler.Destroy(_pipeline, _pipelineLayout);
+	// If the shadows were never rendered, the prewarmed pipeline is cleaned up by the registry.
+	if (_pipeline)
+		_renderer.GetPipelineRegistry().Release(_pipeline);
 }
 
 ShadowCasterSystem::ShadowCasterSystem(ce::Cecsar& cecsar) : System<ShadowCaster>(cecsar)
@@ -11,7 +11,8 @@ MaterialSystem::MaterialSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer) :
 	auto& textureHandler = renderer.GetTextureHandler();
 
 	// Create fallback mesh and texture.
-	_fallbackMesh = meshHandler.Create(MeshHandler::GenerateCube());
+	_fallbackMesh = meshHandler.IsQuantized() ? meshHandler.Create(MeshHandler::Quantize(MeshHandler::GenerateCube())) :
+		meshHandler.Create(MeshHandler::GenerateCube());
 	_fallbackTexture = textureHandler.Create("Test", "png");
 }
 
@@ -33,3 +34,11 @@ Texture& MaterialSystem::GetFallbackTexture()
 {
 	return _fallbackTexture;
 }
+
+uint32_t MaterialSystem::GetLod(const Material& material, const float coverage)
+{
+	for (uint32_t i = 0; i < Mesh::MAX_LODS; ++i)
+		if (coverage >= material.lodCoverages[i])
+			return i;
+	return Mesh::MAX_LODS - 1;
+}
@@ -7,24 +7,47 @@
 #include "Components/Transform.h"
 #include "Rendering/MeshHandler.h"
 #include "Components/Light.h"
+#include "Components/Bounds.h"
 #include "VkRenderer/VkHandlers/VkDescriptorPoolHandler.h"
 #include "VkRenderer/VkCore/VkCoreSwapchain.h"
 #include "Rendering/PostEffectHandler.h"
+#include "Rendering/TextureHandler.h"
+#include "VkRenderer/VkHandlers/VkCommandBufferHandler.h"
+#include "VkRenderer/VkHandlers/VkSyncHandler.h"
+#include "Rendering/CommandRecorder.h"
+#include "Rendering/PipelineRegistry.h"
 
 RenderSystem::RenderSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, MaterialSystem& materials,
-	CameraSystem& cameras, LightSystem& lights, TransformSystem& transforms, const char* shaderName) :
-	System<Renderer>(cecsar), Dependency(renderer),
-	_materials(materials), _cameras(cameras), _lights(lights), _transforms(transforms)
+	CameraSystem& cameras, LightSystem& lights, TransformSystem& transforms, BoundsSystem& bounds, const char* shaderName) :
+	System<Renderer>(cecsar), Dependency(renderer.GetShaderExt()), _renderer(renderer),
+	_materials(materials), _cameras(cameras), _lights(lights), _transforms(transforms), _bounds(bounds),
+	_spheres(GetLength(), GMEM), _visible(GetLength(), GMEM),
+	_bindless(renderer.GetTextureHandler().IsBindless()),
+	_gpuDriven(renderer.IsIndirectDrawingEnabled())
 {
-	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
-	auto& layoutHandler = renderer.GetLayoutHandler();
-	auto& shaderExt = renderer.GetShaderExt();
-	auto& swapChain = renderer.GetSwapChain();
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& layoutHandler = _renderer.GetLayoutHandler();
+	auto& shaderExt = _renderer.GetShaderExt();
+	auto& swapChain = _renderer.GetSwapChain();
 
-	const uint32_t swapChainLength = swapChain.GetLength();
+	const uint32_t frameCount = swapChain.GetFrameCount();
 
 	_shader = shaderExt.Load(shaderName);
 
+	// The GPU driven renderers pick their texture and mesh range on the GPU, so everything has to be globally accessible.
+	if (_gpuDriven)
+	{
+		assert(_bindless && _renderer.GetMeshHandler().IsShared());
+		CreateGpuAssets();
+	}
+
+	// Bindless textures don't need any per-material descriptor sets.
+	if (_bindless)
+	{
+		CreatePipeline();
+		return;
+	}
+
 	// Create material layout.
 	vi::VkLayoutHandler::CreateInfo layoutInfo{};
 	auto& materialBinding = layoutInfo.bindings.Add();
@@ -32,10 +55,10 @@ RenderSystem::RenderSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, Materia
 	materialBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
 	_layout = layoutHandler.CreateLayout(layoutInfo);
 
-	_descriptorSets = vi::ArrayPtr<VkDescriptorSet>(swapChainLength * GetLength(), GMEM);
+	_descriptorSets = vi::ArrayPtr<VkDescriptorSet>(frameCount * GetLength(), GMEM);
 
 	VkDescriptorType types = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	uint32_t size = GetLength() * swapChain.GetLength();
+	uint32_t size = GetLength() * swapChain.GetFrameCount();
 
 	vi::VkDescriptorPoolHandler::PoolCreateInfo descriptorPoolCreateInfo{};
 	descriptorPoolCreateInfo.types = &types;
@@ -50,33 +73,110 @@ RenderSystem::RenderSystem(ce::Cecsar& cecsar, VulkanRenderer& renderer, Materia
 	descriptorSetCreateInfo.setCount = size;
 	descriptorPoolHandler.CreateSets(descriptorSetCreateInfo);
 
-	OnRecreateSwapChainAssets();
+	CreatePipeline();
 }
 
 RenderSystem::~RenderSystem()
 {
-	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
-	auto& layoutHandler = renderer.GetLayoutHandler();
-	auto& shaderExt = renderer.GetShaderExt();
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& layoutHandler = _renderer.GetLayoutHandler();
+	auto& shaderExt = _renderer.GetShaderExt();
 
-	DestroySwapChainAssets();
+	DestroyPipeline();
+	shaderExt.DestroyShader(_shader);
+
+	if (_gpuDriven)
+		DestroyGpuAssets();
+
+	if (_bindless)
+		return;
 
 	layoutHandler.DestroyLayout(_layout);
-	shaderExt.DestroyShader(_shader);
 	descriptorPoolHandler.Destroy(_descriptorPool);
 }
 
+void RenderSystem::Cull()
+{
+	if (!_gpuDriven)
+		return;
+
+	auto& commandBufferHandler = _renderer.GetCommandBufferHandler();
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& pipelineHandler = _renderer.GetPipelineHandler();
+	auto& shaderHandler = _renderer.GetShaderHandler();
+	auto& swapChain = _renderer.GetSwapChain();
+
+	auto& frame = _gpuFrames[swapChain.GetFrameIndex()];
+	const bool compact = _renderer.IsDrawIndirectCountEnabled();
+
+	// Only the transformations and draw parameters are written, the visibility is decided by the GPU.
+	const auto instances = static_cast<GpuInstance*>(frame.instanceMemory.mapped);
+	_instanceCount = 0;
+	for (const auto& [renderIndex, renderer] : *this)
+	{
+		auto& material = _materials[renderIndex];
+		const Mesh& mesh = material.mesh ? *material.mesh : _materials.GetFallbackMesh();
+		const Texture& texture = material.texture ? *material.texture : _materials.GetFallbackTexture();
+		// All the indirect draws use the index type the shared index buffer is bound with.
+		assert(mesh.indexType == _materials.GetFallbackMesh().indexType);
+
+		auto& instance = instances[_instanceCount++];
+		_transforms[renderIndex].CreateModelMatrix(instance.modelMatrix);
+		instance.bounds = mesh.bounds;
+		instance.indexCount = mesh.indexCount;
+		instance.firstIndex = mesh.firstIndex;
+		instance.vertexOffset = mesh.vertexOffset;
+		instance.textureIndex = texture.index;
+	}
+
+	// Reset the visible draw counts, since the culling shader increments them.
+	memset(frame.countMemory.mapped, 0, sizeof(uint32_t) * _cameras.GetLength());
+
+	vi::CommandContext context{};
+	const auto commandBuffer = swapChain.AllocateCommandBuffer();
+	commandBufferHandler.BeginRecording(context, commandBuffer);
+	pipelineHandler.Bind(context, _cullPipeline, _cullPipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
+	descriptorPoolHandler.BindSets(context, &frame.cullSet, 1);
+
+	CullPushConstant pushConstant{};
+	pushConstant.instanceCount = _instanceCount;
+	pushConstant.instanceCapacity = GetLength();
+	pushConstant.compact = compact;
+
+	for (uint32_t camIndex = 0; camIndex < _cameras.GetCount(); ++camIndex)
+	{
+		pushConstant.frustum = _cameras.GetFrustum(camIndex);
+		pushConstant.cameraIndex = camIndex;
+		shaderHandler.UpdatePushConstant(context, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, pushConstant);
+		shaderHandler.Dispatch(context, (_instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE);
+	}
+
+	// The draw commands and instances are read when drawing the scene, later in the same submit.
+	commandBufferHandler.Barrier(context,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+	commandBufferHandler.EndRecording(context);
+	swapChain.Enqueue(commandBuffer);
+}
+
 void RenderSystem::Draw()
 {
-	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
-	auto& meshHandler = renderer.GetMeshHandler();
-	auto& pipelineHandler = renderer.GetPipelineHandler();
-	auto& shaderHandler = renderer.GetShaderHandler();
-	auto& swapChain = renderer.GetSwapChain();
-	auto& swapChainExt = renderer.GetSwapChainExt();
+	auto& commandRecorder = _renderer.GetCommandRecorder();
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& meshHandler = _renderer.GetMeshHandler();
+	auto& pipelineHandler = _renderer.GetPipelineHandler();
+	auto& shaderHandler = _renderer.GetShaderHandler();
+	auto& swapChain = _renderer.GetSwapChain();
+	auto& swapChainExt = _renderer.GetSwapChainExt();
+	auto& textureHandler = _renderer.GetTextureHandler();
+
+	// Commands recorded on this thread go to the inline command buffer of the scene's render pass.
+	auto& context = commandRecorder.GetContext();
 
 	// Bind pipeline.
-	pipelineHandler.Bind(_pipeline, _pipelineLayout);
+	pipelineHandler.Bind(context, _pipeline, _pipelineLayout);
 
 	const uint32_t startIndex = GetDescriptorStartIndex();
 
@@ -90,27 +190,94 @@ void RenderSystem::Draw()
 		};
 		VkDescriptorSet values[3];
 	} sets{};
-	sets.lighting = _lights.GetDescriptorSet(swapChain.GetImageIndex());
+	sets.lighting = _lights.GetDescriptorSet(swapChain.GetFrameIndex());
+	sets.camera = _cameras.GetDescriptor();
+
+	// Dynamic offsets, ordered by set and binding. The last one is reserved for the camera.
+	constexpr uint32_t lightOffsetCount = LightSystem::GetDynamicOffsetCount();
+	uint32_t dynamicOffsets[lightOffsetCount + 1];
 
 	Mesh* mesh = nullptr;
-	meshHandler.Bind(_materials.GetFallbackMesh());
+	uint32_t lod = 0;
+	meshHandler.Bind(context, _materials.GetFallbackMesh());
 
 	glm::mat4 modelMatrix;
 
 	vi::VkShaderHandler::SamplerBindInfo bindInfo{};
 	bindInfo.bindingIndex = 0;
 
-	for (auto& [camIndex, camera] : _cameras)
+	// Gather the bounds up front, so that they can be culled against every camera in one go.
+	uint32_t renderCount = 0;
+	if (!_gpuDriven)
+		for (const auto& [renderIndex, renderer] : *this)
+			_spheres[renderCount++] = _bounds.GetSphere(renderIndex);
+
+	uint32_t camIndex = 0;
+	for (auto& [camSparseIndex, camera] : _cameras)
 	{
-		sets.camera = _cameras.GetDescriptor(camIndex);
+		const uint32_t cameraIndex = camIndex++;
+		const glm::vec3 cameraPosition = _transforms[camSparseIndex].position;
+		// Every camera has its own light clusters.
+		memcpy(dynamicOffsets, _lights.GetDynamicOffsets(cameraIndex), sizeof(uint32_t) * lightOffsetCount);
+		dynamicOffsets[lightOffsetCount] = _cameras.GetDynamicOffset(cameraIndex);
+
+		if (_gpuDriven)
+		{
+			auto& frame = _gpuFrames[swapChain.GetFrameIndex()];
+			VkDescriptorSet gpuSets[]
+			{
+				sets.lighting,
+				sets.camera,
+				textureHandler.GetBindlessSet(),
+				frame.instanceSet
+			};
+			descriptorPoolHandler.BindSets(context, gpuSets, sizeof gpuSets / sizeof(VkDescriptorSet),
+				dynamicOffsets, sizeof dynamicOffsets / sizeof(uint32_t));
+
+			// The culling shader already prepared a draw command for every visible renderer.
+			const VkDeviceSize drawOffset = sizeof(VkDrawIndexedIndirectCommand) * GetLength() * cameraIndex;
+			if (_renderer.IsDrawIndirectCountEnabled())
+				shaderHandler.DrawIndirectCount(context, frame.drawBuffer, drawOffset,
+					frame.countBuffer, sizeof(uint32_t) * cameraIndex, _instanceCount);
+			else
+				shaderHandler.DrawIndirect(context, frame.drawBuffer, drawOffset, _instanceCount);
+			continue;
+		}
+
+		BoundsSystem::Cull(_cameras.GetFrustum(cameraIndex), _spheres.GetData(), renderCount, _visible.GetData());
+
+		// All the textures are in the global array, so the renderers can be split over multiple threads without touching any shared state.
+		if (_bindless)
+		{
+			sets.material = textureHandler.GetBindlessSet();
+
+			DrawJob job{};
+			job.system = this;
+			job.sets = sets.values;
+			job.setCount = sizeof sets / sizeof(VkDescriptorSet);
+			job.dynamicOffsets = dynamicOffsets;
+			job.dynamicOffsetCount = sizeof dynamicOffsets / sizeof(uint32_t);
+			job.cameraPosition = cameraPosition;
+			job.fieldOfView = camera.fieldOfView;
+			commandRecorder.Record(renderCount, DrawBindlessRange, &job);
+			continue;
+		}
 
+		// Samplers are created and collected for every renderer, so this is recorded on the main thread.
+		uint32_t visibleIndex = 0;
 		for (const auto& [renderIndex, renderer] : *this)
 		{
+			const uint32_t index = visibleIndex++;
+			if (!_visible[index])
+				continue;
+
 			auto& material = _materials[renderIndex];
+			const auto& transform = _transforms[renderIndex];
+			Texture* texture = material.texture ? material.texture : &_materials.GetFallbackTexture();
+
 			sets.material = _descriptorSets[startIndex + renderIndex];
 
 			// Bind texture.
-			Texture* texture = material.texture ? material.texture : &_materials.GetFallbackTexture();
 			vi::VkShaderHandler::SamplerCreateInfo samplerCreateInfo{};
 			samplerCreateInfo.minLod = 0;
 			samplerCreateInfo.maxLod = texture->mipLevels;
@@ -125,24 +292,76 @@ void RenderSystem::Draw()
 			shaderHandler.BindSampler(bindInfo);
 
 			// Bind descriptor sets.
-			descriptorPoolHandler.BindSets(sets.values, sizeof sets / sizeof(VkDescriptorSet));
-
-			const auto& transform = _transforms[renderIndex];
+			descriptorPoolHandler.BindSets(context, sets.values, sizeof sets / sizeof(VkDescriptorSet),
+				dynamicOffsets, sizeof dynamicOffsets / sizeof(uint32_t));
 
 			// Update the world transformation as a mat4x4.
 			transform.CreateModelMatrix(modelMatrix);
-			shaderHandler.UpdatePushConstant(_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, modelMatrix);
+			shaderHandler.UpdatePushConstant(context, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, modelMatrix);
+
+			swapChainExt.Collect(sampler);
 
 			// Bind and draw mesh.
-			if (mesh != material.mesh)
+			const uint32_t meshLod = MaterialSystem::GetLod(material, 
+				BoundsSystem::GetCoverage(_spheres[index], cameraPosition, camera.fieldOfView));
+			if (mesh != material.mesh || lod != meshLod)
 			{
 				mesh = material.mesh;
-				meshHandler.Bind(mesh ? *mesh : _materials.GetFallbackMesh());
+				lod = meshLod;
+				meshHandler.Bind(context, mesh ? *mesh : _materials.GetFallbackMesh(), lod);
 			}
-			meshHandler.Draw();
+			meshHandler.Draw(context);
+		}
+	}
+}
 
-			swapChainExt.Collect(sampler);
+void RenderSystem::DrawBindlessRange(vi::CommandContext& context, const uint32_t start, const uint32_t end, void* userPtr)
+{
+	const auto& job = *static_cast<DrawJob*>(userPtr);
+	auto& system = *job.system;
+
+	auto& descriptorPoolHandler = system._renderer.GetDescriptorPoolHandler();
+	auto& meshHandler = system._renderer.GetMeshHandler();
+	auto& pipelineHandler = system._renderer.GetPipelineHandler();
+	auto& shaderHandler = system._renderer.GetShaderHandler();
+
+	// The range might be recorded in its own command buffer, so nothing has been bound yet.
+	pipelineHandler.Bind(context, system._pipeline, system._pipelineLayout);
+	descriptorPoolHandler.BindSets(context, job.sets, job.setCount, job.dynamicOffsets, job.dynamicOffsetCount);
+
+	Mesh* mesh = nullptr;
+	uint32_t lod = 0;
+	meshHandler.Bind(context, system._materials.GetFallbackMesh());
+
+	BindlessPushConstant pushConstant{};
+	const auto instances = system.begin().begin;
+
+	for (uint32_t i = start; i < end; ++i)
+	{
+		if (!system._visible[i])
+			continue;
+
+		const uint16_t renderIndex = instances[i].key;
+		auto& material = system._materials[renderIndex];
+		const auto& transform = system._transforms[renderIndex];
+		const Texture* texture = material.texture ? material.texture : &system._materials.GetFallbackTexture();
+
+		// Forward the texture index alongside the world transformation.
+		transform.CreateModelMatrix(pushConstant.modelMatrix);
+		pushConstant.textureIndex = texture->index;
+		shaderHandler.UpdatePushConstant(context, system._pipelineLayout,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, pushConstant);
+
+		// Bind and draw mesh.
+		const uint32_t meshLod = MaterialSystem::GetLod(material, 
+			BoundsSystem::GetCoverage(system._spheres[i], job.cameraPosition, job.fieldOfView));
+		if (mesh != material.mesh || lod != meshLod)
+		{
+			mesh = material.mesh;
+			lod = meshLod;
+			meshHandler.Bind(context, mesh ? *mesh : system._materials.GetFallbackMesh(), lod);
 		}
+		meshHandler.Draw(context);
 	}
 }
 
@@ -151,41 +370,220 @@ Shader& RenderSystem::GetShader()
 	return _shader;
 }
 
-void RenderSystem::OnRecreateSwapChainAssets()
+void RenderSystem::OnReloadShaders()
 {
-	if (_pipeline)
-		DestroySwapChainAssets();
+	auto& shaderExt = _renderer.GetShaderExt();
 
-	auto& pipelineHandler = renderer.GetPipelineHandler();
-	auto& postEffectHandler = renderer.GetPostEffectHandler();
+	// Compute pipelines aren't shared through the registry, so the culling pipeline is recreated directly.
+	if (_gpuDriven && shaderExt.Refresh(_cullShader))
+	{
+		_renderer.GetPipelineHandler().Destroy(_cullPipeline, _cullPipelineLayout);
+		CreateCullPipeline();
+	}
+
+	if (!shaderExt.Refresh(_shader))
+		return;
+
+	DestroyPipeline();
+	CreatePipeline();
+}
+
+void RenderSystem::CreatePipeline()
+{
+	auto& pipelineRegistry = _renderer.GetPipelineRegistry();
+	auto& postEffectHandler = _renderer.GetPostEffectHandler();
 
-	// This pipeline is assuming the usage of a model with standard vertices.
+	// This pipeline is assuming the usage of models with the vertex layout the mesh handler is configured for.
+	auto& meshHandler = _renderer.GetMeshHandler();
 	vi::VkPipelineHandler::CreateInfo pipelineInfo{};
-	pipelineInfo.attributeDescriptions = Vertex::GetAttributeDescriptions();
-	pipelineInfo.bindingDescription = Vertex::GetBindingDescription();
+	pipelineInfo.attributeDescriptions = meshHandler.GetAttributeDescriptions();
+	pipelineInfo.bindingDescription = meshHandler.GetBindingDescription();
 	pipelineInfo.setLayouts.Add(_lights.GetLayout());
 	pipelineInfo.setLayouts.Add(_cameras.GetLayout());
-	pipelineInfo.setLayouts.Add(_layout);
 	for (auto& module : _shader.modules)
 		pipelineInfo.modules.Add(module);
-	pipelineInfo.pushConstants.Add({ sizeof(glm::mat4), VK_SHADER_STAGE_VERTEX_BIT });
+
+	if (_gpuDriven)
+	{
+		// Transformations and texture indices are read from the instance buffer instead.
+		pipelineInfo.setLayouts.Add(_renderer.GetTextureHandler().GetBindlessLayout());
+		pipelineInfo.setLayouts.Add(_instanceLayout);
+	}
+	else if (_bindless)
+	{
+		pipelineInfo.setLayouts.Add(_renderer.GetTextureHandler().GetBindlessLayout());
+		pipelineInfo.pushConstants.Add({ sizeof(BindlessPushConstant), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT });
+	}
+	else
+	{
+		pipelineInfo.setLayouts.Add(_layout);
+		pipelineInfo.pushConstants.Add({ sizeof(glm::mat4), VK_SHADER_STAGE_VERTEX_BIT });
+	}
 
 	// This assumes the state of the engine currently draws to the post effect handler, and not to the swap chain.
 	pipelineInfo.renderPass = postEffectHandler.GetRenderPass();
-	pipelineInfo.extent = postEffectHandler.GetExtent();
 
-	pipelineHandler.Create(pipelineInfo, _pipeline, _pipelineLayout);
+	pipelineRegistry.Get(pipelineInfo, _pipeline, _pipelineLayout);
+}
+
+void RenderSystem::CreateGpuAssets()
+{
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& gpuAllocator = _renderer.GetGpuAllocator();
+	auto& layoutHandler = _renderer.GetLayoutHandler();
+	auto& shaderExt = _renderer.GetShaderExt();
+	auto& shaderHandler = _renderer.GetShaderHandler();
+	auto& swapChain = _renderer.GetSwapChain();
+
+	const uint32_t frameCount = swapChain.GetFrameCount();
+	const uint32_t capacity = GetLength();
+	const uint32_t cameraCapacity = _cameras.GetLength();
+
+	const VkDeviceSize instanceSize = sizeof(GpuInstance) * capacity;
+	const VkDeviceSize drawSize = sizeof(VkDrawIndexedIndirectCommand) * capacity * cameraCapacity;
+	const VkDeviceSize countSize = sizeof(uint32_t) * cameraCapacity;
+
+	ShaderExt::LoadInfo shaderLoadInfo{};
+	shaderLoadInfo.vertex = false;
+	shaderLoadInfo.fragment = false;
+	shaderLoadInfo.compute = true;
+	_cullShader = shaderExt.Load("cull-", shaderLoadInfo);
+
+	// Culling layout, with the instances as input and the draw commands as output.
+	vi::VkLayoutHandler::CreateInfo cullLayoutInfo{};
+	auto& instanceBinding = cullLayoutInfo.bindings.Add();
+	instanceBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceBinding.flag = VK_SHADER_STAGE_COMPUTE_BIT;
+	instanceBinding.size = instanceSize;
+	auto& drawBinding = cullLayoutInfo.bindings.Add();
+	drawBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	drawBinding.flag = VK_SHADER_STAGE_COMPUTE_BIT;
+	drawBinding.size = drawSize;
+	auto& countBinding = cullLayoutInfo.bindings.Add();
+	countBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	countBinding.flag = VK_SHADER_STAGE_COMPUTE_BIT;
+	countBinding.size = countSize;
+	_cullLayout = layoutHandler.CreateLayout(cullLayoutInfo);
+
+	// Instance layout, used by the vertex shader to look up the transformation of the drawn instance.
+	vi::VkLayoutHandler::CreateInfo instanceLayoutInfo{};
+	auto& vertInstanceBinding = instanceLayoutInfo.bindings.Add();
+	vertInstanceBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	vertInstanceBinding.flag = VK_SHADER_STAGE_VERTEX_BIT;
+	vertInstanceBinding.size = instanceSize;
+	_instanceLayout = layoutHandler.CreateLayout(instanceLayoutInfo);
+
+	CreateCullPipeline();
+
+	VkDescriptorType types = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	uint32_t size = frameCount * 4;
+
+	vi::VkDescriptorPoolHandler::PoolCreateInfo descriptorPoolCreateInfo{};
+	descriptorPoolCreateInfo.types = &types;
+	descriptorPoolCreateInfo.capacities = &size;
+	descriptorPoolCreateInfo.typeCount = 1;
+	_gpuDescriptorPool = descriptorPoolHandler.Create(descriptorPoolCreateInfo);
+
+	_gpuFrames = vi::ArrayPtr<GpuFrame>(frameCount, GMEM);
+	for (auto& frame : _gpuFrames)
+	{
+		frame.instanceBuffer = shaderHandler.CreateBuffer(instanceSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.instanceMemory = gpuAllocator.Allocate(frame.instanceBuffer,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		gpuAllocator.Bind(frame.instanceBuffer, frame.instanceMemory);
+
+		frame.drawBuffer = shaderHandler.CreateBuffer(drawSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+		frame.drawMemory = gpuAllocator.Allocate(frame.drawBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		gpuAllocator.Bind(frame.drawBuffer, frame.drawMemory);
+
+		frame.countBuffer = shaderHandler.CreateBuffer(countSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+		frame.countMemory = gpuAllocator.Allocate(frame.countBuffer,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		gpuAllocator.Bind(frame.countBuffer, frame.countMemory);
+
+		vi::VkDescriptorPoolHandler::SetCreateInfo descriptorSetCreateInfo{};
+		descriptorSetCreateInfo.pool = _gpuDescriptorPool;
+		descriptorSetCreateInfo.setCount = 1;
+		descriptorSetCreateInfo.layout = _cullLayout;
+		descriptorSetCreateInfo.outSets = &frame.cullSet;
+		descriptorPoolHandler.CreateSets(descriptorSetCreateInfo);
+		descriptorSetCreateInfo.layout = _instanceLayout;
+		descriptorSetCreateInfo.outSets = &frame.instanceSet;
+		descriptorPoolHandler.CreateSets(descriptorSetCreateInfo);
+
+		// The buffers never change, so the descriptor sets only have to be written once.
+		vi::VkShaderHandler::BufferBindInfo bindInfo{};
+		bindInfo.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindInfo.set = frame.cullSet;
+
+		bindInfo.buffer = &frame.instanceBuffer;
+		bindInfo.range = instanceSize;
+		bindInfo.bindingIndex = 0;
+		shaderHandler.BindBuffer(bindInfo);
+
+		bindInfo.buffer = &frame.drawBuffer;
+		bindInfo.range = drawSize;
+		bindInfo.bindingIndex = 1;
+		shaderHandler.BindBuffer(bindInfo);
+
+		bindInfo.buffer = &frame.countBuffer;
+		bindInfo.range = countSize;
+		bindInfo.bindingIndex = 2;
+		shaderHandler.BindBuffer(bindInfo);
+
+		bindInfo.set = frame.instanceSet;
+		bindInfo.buffer = &frame.instanceBuffer;
+		bindInfo.range = instanceSize;
+		bindInfo.bindingIndex = 0;
+		shaderHandler.BindBuffer(bindInfo);
+	}
+}
+
+void RenderSystem::DestroyGpuAssets()
+{
+	auto& descriptorPoolHandler = _renderer.GetDescriptorPoolHandler();
+	auto& gpuAllocator = _renderer.GetGpuAllocator();
+	auto& layoutHandler = _renderer.GetLayoutHandler();
+	auto& pipelineHandler = _renderer.GetPipelineHandler();
+	auto& shaderExt = _renderer.GetShaderExt();
+	auto& shaderHandler = _renderer.GetShaderHandler();
+
+	for (auto& frame : _gpuFrames)
+	{
+		shaderHandler.DestroyBuffer(frame.instanceBuffer);
+		gpuAllocator.Free(frame.instanceMemory);
+		shaderHandler.DestroyBuffer(frame.drawBuffer);
+		gpuAllocator.Free(frame.drawMemory);
+		shaderHandler.DestroyBuffer(frame.countBuffer);
+		gpuAllocator.Free(frame.countMemory);
+	}
+
+	pipelineHandler.Destroy(_cullPipeline, _cullPipelineLayout);
+	descriptorPoolHandler.Destroy(_gpuDescriptorPool);
+	layoutHandler.DestroyLayout(_cullLayout);
+	layoutHandler.DestroyLayout(_instanceLayout);
+	shaderExt.DestroyShader(_cullShader);
+}
+
+void RenderSystem::CreateCullPipeline()
+{
+	vi::VkPipelineHandler::ComputeCreateInfo pipelineInfo{};
+	pipelineInfo.module = _cullShader.modules[0].module;
+	pipelineInfo.setLayouts.Add(_cullLayout);
+	pipelineInfo.pushConstants.Add({ sizeof(CullPushConstant), VK_SHADER_STAGE_COMPUTE_BIT });
+	_renderer.GetPipelineHandler().CreateCompute(pipelineInfo, _cullPipeline, _cullPipelineLayout);
 }
 
-void RenderSystem::DestroySwapChainAssets() const
+void RenderSystem::DestroyPipeline() const
 {
-	auto& pipelineHandler = renderer.GetPipelineHandler();
-	pipelineHandler.Destroy(_pipeline, _pipelineLayout);
+	_renderer.GetPipelineRegistry().Release(_pipeline);
 }
 
 uint32_t RenderSystem::GetDescriptorStartIndex() const
 {
-	auto& swapChain = renderer.GetSwapChain();
-	const uint32_t imageIndex = swapChain.GetImageIndex();
-	return GetLength() * imageIndex;
+	auto& swapChain = _renderer.GetSwapChain();
+	const uint32_t frameIndex = swapChain.GetFrameIndex();
+	return GetLength() * frameIndex;
 }
@@ -4,7 +4,7 @@
 class GameState final
 {
 public:
-	Texture texture;
+	AssetStreamer::Handle texture;
 };
 
 typedef Engine<GameState> GameEngine;
@@ -16,9 +16,11 @@ int main()
 
 	info.start = [](Engine<GameState>& engine, GameState& gameState)
 	{
-		gameState.texture = engine.GetVulkanRenderer().GetTextureHandler().Create("Feather", "png");
+		auto& assetStreamer = engine.GetAssetStreamer();
+		gameState.texture = assetStreamer.Load("Feather", "png");
 
 		auto& cecsar = engine.GetCecsar();
+		auto& bounds = engine.GetBounds();
 		auto& cameras = engine.GetCameras();
 		auto& lights = engine.GetLights();
 		auto& materials = engine.GetMaterials();
@@ -44,13 +46,15 @@ int main()
 		shadowCasters.Insert(quad1);
 		auto& mat = materials.Insert(quad1);
 		renderers.Insert(quad1);
-		mat.texture = &gameState.texture;
+		bounds.Insert(quad1);
+		mat.texture = &assetStreamer.GetTexture(gameState.texture);
 		
 		const auto quad2 = cecsar.Add();
 		auto& quad3Transform = transforms.Insert(quad2);
 		shadowCasters.Insert(quad2);
 		materials.Insert(quad2);
 		renderers.Insert(quad2);
+		bounds.Insert(quad2);
 		quad3Transform.position = { 3, 1, 0 };
 		//quad3Transform.rotation.x = 360;
 		
@@ -87,7 +91,7 @@ int main()
 
 	info.cleanup = [](Engine<GameState>& engine, GameState& gameState)
 	{
-		engine.GetVulkanRenderer().GetTextureHandler().Destroy(gameState.texture);
+		engine.GetAssetStreamer().Unload(gameState.texture);
 	};
 
 	auto engine = GMEM.New<Engine<GameState>>();
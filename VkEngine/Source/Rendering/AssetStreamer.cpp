@@ -0,0 +1,211 @@
+﻿#include "pch.h"
+#include "Rendering/AssetStreamer.h"
+#include "Rendering/VulkanRenderer.h"
+
+AssetStreamer::AssetStreamer(VulkanRenderer& renderer, const Texture& placeholder, const Info& info) : 
+	_renderer(renderer), _placeholder(placeholder), _maxUploadsPerFrame(info.maxUploadsPerFrame)
+{
+	_slots = vi::ArrayPtr<Slot>{ info.capacity, GMEM };
+	_queued = vi::ArrayPtr<Handle>{ info.capacity, GMEM };
+
+	// Hand out the lowest handles first.
+	for (int32_t i = info.capacity - 1; i >= 0; --i)
+		_freeHandles.Add(i);
+
+	const uint32_t concurrency = std::thread::hardware_concurrency();
+	const uint32_t count = vi::Ut::Max<uint32_t>(1, vi::Ut::Min(info.workerCount, concurrency > 1 ? concurrency - 1 : 1));
+
+	_workers = vi::ArrayPtr<std::thread*>{ count, GMEM };
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto loop = &AssetStreamer::WorkerLoop;
+		auto self = this;
+		_workers[i] = GMEM.New<std::thread>(loop, self);
+	}
+}
+
+AssetStreamer::~AssetStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+
+	for (auto& worker : _workers)
+	{
+		worker->join();
+		GMEM.Delete(worker);
+	}
+	_workers.Free();
+
+	// Throw away the textures that were decoded but never uploaded.
+	Result result;
+	while (_results.TryPop(result))
+		TextureHandler::Free(result.pixels);
+
+	auto& textureHandler = _renderer.GetTextureHandler();
+	for (auto& slot : _slots)
+		if (slot.state == State::loaded)
+			textureHandler.Destroy(slot.texture);
+
+	_queued.Free();
+	_slots.Free();
+}
+
+AssetStreamer::Handle AssetStreamer::Load(const char* name, const char* extension, const int32_t priority)
+{
+	assert(_freeHandles.GetCount() > 0);
+	const Handle handle = _freeHandles.Pop();
+
+	auto& slot = _slots[handle];
+	slot.priority = priority;
+	const int32_t length = snprintf(slot.path, MAX_PATH_LENGTH, "Textures/%s.%s", name, extension);
+	assert(length > 0 && static_cast<uint32_t>(length) < MAX_PATH_LENGTH);
+	slot.texture = _placeholder;
+
+	slot.state = State::queued;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queued[_queuedCount++] = handle;
+	}
+	_wake.notify_one();
+
+	return handle;
+}
+
+void AssetStreamer::SetPriority(const Handle handle, const int32_t priority)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_slots[handle].priority = priority;
+}
+
+void AssetStreamer::Unload(const Handle handle)
+{
+	auto& slot = _slots[handle];
+	assert(slot.state != State::free && slot.state != State::cancelled);
+
+	if (slot.state == State::queued)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		// If it's no longer queued, a worker is decoding it. The slot is freed when the result comes in.
+		if (!RemoveQueued(handle))
+		{
+			slot.state = State::cancelled;
+			return;
+		}
+	}
+
+	if (slot.state == State::loaded)
+		_renderer.GetTextureHandler().Destroy(slot.texture);
+
+	slot.state = State::free;
+	_freeHandles.Add(handle);
+}
+
+Texture& AssetStreamer::GetTexture(const Handle handle) const
+{
+	return _slots[handle].texture;
+}
+
+bool AssetStreamer::IsLoaded(const Handle handle) const
+{
+	return _slots[handle].state == State::loaded;
+}
+
+void AssetStreamer::Update()
+{
+	auto& textureHandler = _renderer.GetTextureHandler();
+
+	Result result;
+	uint32_t uploadCount = 0;
+	while (uploadCount < _maxUploadsPerFrame && _results.TryPop(result))
+	{
+		auto& slot = _slots[result.handle];
+
+		// The workers are done with the slot once the result has been pushed.
+		if (slot.state == State::cancelled)
+		{
+			TextureHandler::Free(result.pixels);
+			slot.state = State::free;
+			_freeHandles.Add(result.handle);
+			continue;
+		}
+
+		if (!result.pixels)
+		{
+			slot.state = State::failed;
+			continue;
+		}
+
+		// Materials point to the slot, so they pick up the real texture from now on.
+		slot.texture = textureHandler.Create(result.pixels, result.resolution, result.channels);
+		slot.state = State::loaded;
+		TextureHandler::Free(result.pixels);
+		++uploadCount;
+	}
+}
+
+void AssetStreamer::WorkerLoop()
+{
+	while (true)
+	{
+		Handle handle;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this] { return _quit || _queuedCount > 0; });
+			if (_quit)
+				return;
+
+			handle = PopQueued();
+		}
+
+		// The path isn't touched by the main thread while decoding.
+		Result result{};
+		result.handle = handle;
+		int32_t w, h, d;
+		result.pixels = TextureHandler::Load(_slots[handle].path, w, h, d);
+		result.resolution = { w, h };
+		result.channels = static_cast<uint8_t>(d);
+
+		// Only happens when the main thread hasn't uploaded anything for a while.
+		while (!_results.TryPush(result))
+		{
+			{
+				// Results aren't popped while the workers are being joined, so the push would never succeed.
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (_quit)
+				{
+					TextureHandler::Free(result.pixels);
+					return;
+				}
+			}
+			std::this_thread::yield();
+		}
+	}
+}
+
+AssetStreamer::Handle AssetStreamer::PopQueued()
+{
+	uint32_t best = 0;
+	for (uint32_t i = 1; i < _queuedCount; ++i)
+		if (_slots[_queued[i]].priority > _slots[_queued[best]].priority)
+			best = i;
+
+	const Handle handle = _queued[best];
+	_queued[best] = _queued[--_queuedCount];
+	return handle;
+}
+
+bool AssetStreamer::RemoveQueued(const Handle handle)
+{
+	for (uint32_t i = 0; i < _queuedCount; ++i)
+	{
+		if (_queued[i] != handle)
+			continue;
+		_queued[i] = _queued[--_queuedCount];
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,151 @@
+﻿#include "pch.h"
+#include "Rendering/CommandRecorder.h"
+#include "Rendering/VulkanRenderer.h"
+#include "VkRenderer/VkHandlers/VkCommandBufferHandler.h"
+#include "VkRenderer/VkHandlers/VkRenderPassHandler.h"
+#include "VkRenderer/VkCore/VkCoreSwapchain.h"
+
+CommandRecorder::CommandRecorder(VulkanRenderer& renderer, JobSystem& jobSystem) : 
+	_renderer(renderer), _jobSystem(jobSystem)
+{
+	auto& commandBufferHandler = renderer.GetCommandBufferHandler();
+
+	const uint32_t threadCount = jobSystem.GetThreadCount();
+	const uint32_t poolCount = renderer.GetSwapChain().GetFrameCount() * threadCount;
+
+	_pools = vi::ArrayPtr<Pool>{ poolCount, GMEM };
+	for (auto& pool : _pools)
+		pool.pool = commandBufferHandler.CreatePool();
+	_buffers = vi::ArrayPtr<VkCommandBuffer>{ poolCount * MAX_SECONDARIES_PER_THREAD, GMEM, VK_NULL_HANDLE };
+	_recorded = vi::ArrayPtr<VkCommandBuffer>{ threadCount + 1, GMEM };
+
+	_inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+}
+
+CommandRecorder::~CommandRecorder()
+{
+	auto& commandBufferHandler = _renderer.GetCommandBufferHandler();
+
+	// Destroying the pools also frees their command buffers.
+	for (auto& pool : _pools)
+		commandBufferHandler.DestroyPool(pool.pool);
+
+	_recorded.Free();
+	_buffers.Free();
+	_pools.Free();
+}
+
+void CommandRecorder::BeginFrame()
+{
+	auto& commandBufferHandler = _renderer.GetCommandBufferHandler();
+
+	_frameIndex = _renderer.GetSwapChain().GetFrameIndex();
+
+	const uint32_t threadCount = _jobSystem.GetThreadCount();
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		auto& pool = _pools[_frameIndex * threadCount + i];
+		commandBufferHandler.ResetPool(pool.pool);
+		pool.used = 0;
+	}
+}
+
+void CommandRecorder::BeginRenderPass(vi::CommandContext& primary, 
+	const VkRenderPass renderPass, const VkFramebuffer frameBuffer, const glm::ivec2 extent)
+{
+	_primary = &primary;
+	_inheritance.renderPass = renderPass;
+	_inheritance.subpass = 0;
+	_inheritance.framebuffer = frameBuffer;
+	_extent = extent;
+	BeginInline();
+}
+
+void CommandRecorder::Record(const uint32_t count, const RecordRange record, void* userPtr)
+{
+	if (count == 0)
+		return;
+
+	const uint32_t rangeCount = vi::Ut::Min((count + MIN_RANGE_SIZE - 1) / MIN_RANGE_SIZE, _jobSystem.GetThreadCount());
+
+	// Not worth the overhead of a separate command buffer.
+	if (rangeCount == 1)
+	{
+		record(_inline, 0, count, userPtr);
+		return;
+	}
+
+	auto& commandBufferHandler = _renderer.GetCommandBufferHandler();
+
+	// Close the inline commands, so that they're executed before the ranges.
+	commandBufferHandler.EndRecording(_inline);
+
+	RangeJob job{};
+	job.recorder = this;
+	job.record = record;
+	job.userPtr = userPtr;
+	job.count = count;
+	job.rangeCount = rangeCount;
+	_jobSystem.Dispatch(rangeCount, RecordJob, &job);
+
+	commandBufferHandler.Execute(*_primary, _recorded.GetData(), rangeCount + 1);
+	BeginInline();
+}
+
+void CommandRecorder::EndRenderPass()
+{
+	auto& commandBufferHandler = _renderer.GetCommandBufferHandler();
+	commandBufferHandler.EndRecording(_inline);
+	commandBufferHandler.Execute(*_primary, _recorded.GetData(), 1);
+	_primary = nullptr;
+}
+
+vi::CommandContext& CommandRecorder::GetContext()
+{
+	assert(_primary);
+	return _inline;
+}
+
+VkCommandBuffer CommandRecorder::GetSecondary()
+{
+	const uint32_t poolIndex = _frameIndex * _jobSystem.GetThreadCount() + JobSystem::GetThreadIndex();
+	auto& pool = _pools[poolIndex];
+	assert(pool.used < MAX_SECONDARIES_PER_THREAD);
+
+	// Every thread only touches its own pool, so no synchronization is needed.
+	auto& buffer = _buffers[poolIndex * MAX_SECONDARIES_PER_THREAD + pool.used++];
+	if (!buffer)
+		buffer = _renderer.GetCommandBufferHandler().Create(pool.pool, true);
+	return buffer;
+}
+
+void CommandRecorder::BeginInline()
+{
+	const auto buffer = GetSecondary();
+	BeginSecondary(_inline, buffer);
+	_recorded[0] = buffer;
+}
+
+void CommandRecorder::BeginSecondary(vi::CommandContext& context, const VkCommandBuffer buffer) const
+{
+	_renderer.GetCommandBufferHandler().BeginRecording(context, buffer, &_inheritance);
+	_renderer.GetRenderPassHandler().SetViewport(context, {}, _extent);
+}
+
+void CommandRecorder::RecordJob(const uint32_t index, void* userPtr)
+{
+	const auto& job = *static_cast<RangeJob*>(userPtr);
+	auto& recorder = *job.recorder;
+	auto& commandBufferHandler = recorder._renderer.GetCommandBufferHandler();
+
+	const uint32_t start = job.count * index / job.rangeCount;
+	const uint32_t end = job.count * (index + 1) / job.rangeCount;
+
+	vi::CommandContext context{};
+	const auto buffer = recorder.GetSecondary();
+	recorder.BeginSecondary(context, buffer);
+	job.record(context, start, end, job.userPtr);
+	commandBufferHandler.EndRecording(context);
+
+	recorder._recorded[index + 1] = buffer;
+}
@@ -2,10 +2,46 @@
 #include "Rendering/MeshHandler.h"
 #include "VkRenderer/VkCore/VkCore.h"
 #include "VkRenderer/VkHandlers/VkShaderHandler.h"
-#include "VkRenderer/VkHandlers/VkMemoryHandler.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
+#include "Utils/MappedFile.h"
+#include <fstream>
 
-MeshHandler::MeshHandler(vi::VkCore& core): VkHandler(core)
+MeshHandler::MeshHandler(vi::VkCore& core, UploadQueue& uploadQueue, const Info& info): VkHandler(core), 
+	_uploadQueue(uploadQueue), _shared(info.sharedBuffers), _quantized(info.quantizedVertices)
 {
+	if (!_shared)
+		return;
+
+	auto& gpuAllocator = core.GetGpuAllocator();
+	auto& shaderHandler = core.GetShaderHandler();
+
+	// Meshes are copied into the shared buffers, so they are never mapped.
+	_vertexBuffer = shaderHandler.CreateBuffer(info.vertexCapacity,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	_vertexMemory = gpuAllocator.Allocate(_vertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	gpuAllocator.Bind(_vertexBuffer, _vertexMemory);
+
+	_indexBuffer = shaderHandler.CreateBuffer(info.indexCapacity,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	_indexMemory = gpuAllocator.Allocate(_indexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	gpuAllocator.Bind(_indexBuffer, _indexMemory);
+
+	_freeVertexRanges.Add({ 0, info.vertexCapacity });
+	_freeIndexRanges.Add({ 0, info.indexCapacity });
+}
+
+MeshHandler::~MeshHandler()
+{
+	if (!_shared)
+		return;
+
+	auto& gpuAllocator = core.GetGpuAllocator();
+	auto& shaderHandler = core.GetShaderHandler();
+
+	shaderHandler.DestroyBuffer(_vertexBuffer);
+	gpuAllocator.Free(_vertexMemory);
+	shaderHandler.DestroyBuffer(_indexBuffer);
+	gpuAllocator.Free(_indexMemory);
 }
 
 MeshHandler::VertexData<Vertex, Vertex::Index> MeshHandler::GenerateQuad(const ForwardAxis axis,
@@ -104,27 +140,289 @@ MeshHandler::VertexData<Vertex, Vertex::Index> MeshHandler::GenerateCube(vi::Fre
 	return cubeData;
 }
 
-void MeshHandler::Bind(Mesh& mesh)
+Mesh MeshHandler::Load(const char* name)
+{
+	vi::String path{ "Meshes/", GMEM_TEMP };
+	path.Append(name);
+	path.Append(".");
+	path.Append(FILE_EXTENSION);
+
+	MappedFile file{};
+	if (!file.Open(path.GetData()))
+		throw std::exception("Mesh file not found.");
+
+	const auto data = static_cast<const unsigned char*>(file.GetData());
+	const auto header = Validate(data, file.GetSize());
+	if (!header)
+		throw std::exception("Mesh file is invalid or out of date! Cook the mesh again.");
+	// The render and light systems only have pipelines for one vertex layout.
+	if (header->layout != (_quantized ? VertexLayout::quantized : VertexLayout::standard))
+		throw std::exception("Mesh file was cooked with a different vertex layout!");
+
+	// The mapping only has to stay alive until the data has been copied into the staging buffer.
+	CreateInfo info{};
+	info.vertices = data + header->vertexOffset;
+	info.vertexSize = static_cast<VkDeviceSize>(header->vertexStride) * header->vertexCount;
+	info.vertexStride = header->vertexStride;
+	info.indices = data + header->indexOffset;
+	info.indexSize = static_cast<VkDeviceSize>(header->indexStride) * header->indexCount;
+	info.indexStride = header->indexStride;
+	info.lods = header->lodIndexCounts;
+	info.lodCount = header->lodCount;
+	info.bounds = header->bounds;
+	return Create(info);
+}
+
+const MeshHandler::FileHeader* MeshHandler::Validate(const void* data, const size_t size)
+{
+	if (size < sizeof(FileHeader))
+		return nullptr;
+
+	const auto header = static_cast<const FileHeader*>(data);
+	if (header->magic != FILE_MAGIC || header->version != FILE_VERSION)
+		return nullptr;
+	if (header->lodCount == 0 || header->lodCount > Mesh::MAX_LODS)
+		return nullptr;
+	if (header->indexStride != sizeof(uint16_t) && header->indexStride != sizeof(uint32_t))
+		return nullptr;
+
+	uint32_t vertexStride = 0;
+	if (header->layout == VertexLayout::standard)
+		vertexStride = sizeof(Vertex);
+	else if (header->layout == VertexLayout::quantized)
+		vertexStride = sizeof(QuantizedVertex);
+	if (header->vertexStride != vertexStride)
+		return nullptr;
+
+	// Make sure the vertices and indices don't point outside of the file. 
+	// The sizes can't overflow, since they're calculated from 32 bit values.
+	const uint64_t vertexSize = static_cast<uint64_t>(header->vertexStride) * header->vertexCount;
+	const uint64_t indexSize = static_cast<uint64_t>(header->indexStride) * header->indexCount;
+	if (header->vertexOffset > size || vertexSize > size - header->vertexOffset)
+		return nullptr;
+	if (header->indexOffset > size || indexSize > size - header->indexOffset)
+		return nullptr;
+
+	// The levels of detail are stored back to back, and have to cover the indices exactly.
+	uint64_t lodIndexCount = 0;
+	for (uint32_t i = 0; i < header->lodCount; ++i)
+		lodIndexCount += header->lodIndexCounts[i];
+	if (lodIndexCount != header->indexCount)
+		return nullptr;
+
+	return header;
+}
+
+void MeshHandler::Bind(vi::CommandContext& context, Mesh& mesh, const uint32_t lod) const
 {
 	auto& shaderHandler = core.GetShaderHandler();
-	shaderHandler.BindVertexBuffer(mesh.vertexBuffer);
-	shaderHandler.BindIndicesBuffer(mesh.indexBuffer);
-	_boundIndexCount = mesh.indexCount;
+
+	// The context starts without any bound buffers, so the first bind of a recording always goes through.
+	if (mesh.vertexBuffer != context.vertexBuffer || mesh.indexBuffer != context.indexBuffer || 
+		mesh.indexType != context.indexType)
+	{
+		shaderHandler.BindVertexBuffer(context, mesh.vertexBuffer);
+		shaderHandler.BindIndicesBuffer(context, mesh.indexBuffer, mesh.indexType);
+	}
+
+	const auto& level = mesh.lods[vi::Ut::Min(lod, mesh.lodCount - 1)];
+	context.indexCount = level.indexCount;
+	context.firstIndex = level.firstIndex;
+	context.vertexOffset = mesh.vertexOffset;
 }
 
-void MeshHandler::Draw() const
+void MeshHandler::Draw(const vi::CommandContext& context, const uint32_t instanceCount) const
 {
-	assert(_boundIndexCount != UINT32_MAX);
-	core.GetShaderHandler().Draw(_boundIndexCount);
+	assert(context.indexCount != UINT32_MAX);
+	core.GetShaderHandler().Draw(context, context.indexCount, context.firstIndex, context.vertexOffset, instanceCount);
 }
 
-void MeshHandler::Destroy(const Mesh& mesh) const
+void MeshHandler::Destroy(const Mesh& mesh)
 {
-	auto& memoryHandler = core.GetMemoryHandler();
+	// Meshes in the shared buffers only have to give back their ranges.
+	if (_shared)
+	{
+		FreeRange(_freeVertexRanges, mesh.vertexRange);
+		FreeRange(_freeIndexRanges, mesh.indexRange);
+		return;
+	}
+
+	auto& gpuAllocator = core.GetGpuAllocator();
 	auto& shaderHandler = core.GetShaderHandler();
 
 	shaderHandler.DestroyBuffer(mesh.vertexBuffer);
-	memoryHandler.Free(mesh.vertexMemory);
+	gpuAllocator.Free(mesh.vertexMemory);
 	shaderHandler.DestroyBuffer(mesh.indexBuffer);
-	memoryHandler.Free(mesh.indexMemory);
+	gpuAllocator.Free(mesh.indexMemory);
+}
+
+bool MeshHandler::IsShared() const
+{
+	return _shared;
+}
+
+VkBuffer MeshHandler::GetVertexBuffer() const
+{
+	return _vertexBuffer;
+}
+
+VkBuffer MeshHandler::GetIndexBuffer() const
+{
+	return _indexBuffer;
+}
+
+bool MeshHandler::IsQuantized() const
+{
+	return _quantized;
+}
+
+VkVertexInputBindingDescription MeshHandler::GetBindingDescription() const
+{
+	return _quantized ? QuantizedVertex::GetBindingDescription() : Vertex::GetBindingDescription();
+}
+
+vi::Vector<VkVertexInputAttributeDescription> MeshHandler::GetAttributeDescriptions() const
+{
+	return _quantized ? QuantizedVertex::GetAttributeDescriptions() : Vertex::GetAttributeDescriptions();
+}
+
+Mesh MeshHandler::Create(const CreateInfo& info)
+{
+	auto& gpuAllocator = core.GetGpuAllocator();
+	auto& shaderHandler = core.GetShaderHandler();
+
+	Mesh mesh{};
+	mesh.indexCount = static_cast<uint32_t>(info.indexSize / info.indexStride);
+	mesh.indexType = GetIndexType(info.indexStride);
+	mesh.vertexRange.size = info.vertexSize;
+	mesh.indexRange.size = info.indexSize;
+	mesh.bounds = info.bounds;
+
+	if (_shared)
+	{
+		// Draw offsets are counted in vertices and indices, so the ranges are aligned to their element size.
+		mesh.vertexRange.offset = AllocateRange(_freeVertexRanges, info.vertexSize, info.vertexStride);
+		mesh.indexRange.offset = AllocateRange(_freeIndexRanges, info.indexSize, info.indexStride);
+		mesh.vertexOffset = static_cast<int32_t>(mesh.vertexRange.offset / info.vertexStride);
+		mesh.firstIndex = static_cast<uint32_t>(mesh.indexRange.offset / info.indexStride);
+		mesh.vertexBuffer = _vertexBuffer;
+		mesh.indexBuffer = _indexBuffer;
+	}
+	else
+	{
+		// Allocate shader efficient memory for the vertices.
+		mesh.vertexBuffer = shaderHandler.CreateBuffer(info.vertexSize,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+		mesh.vertexMemory = gpuAllocator.Allocate(mesh.vertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		gpuAllocator.Bind(mesh.vertexBuffer, mesh.vertexMemory);
+
+		// Allocate shader efficient memory for the indices.
+		mesh.indexBuffer = shaderHandler.CreateBuffer(info.indexSize,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		mesh.indexMemory = gpuAllocator.Allocate(mesh.indexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		gpuAllocator.Bind(mesh.indexBuffer, mesh.indexMemory);
+	}
+
+	// Both copies end up in the same batch, which is submitted before the next frame.
+	// The levels of detail are stored back to back, starting with the highest detail.
+	assert(info.lodCount <= Mesh::MAX_LODS);
+	mesh.lodCount = vi::Ut::Max<uint32_t>(info.lodCount, 1);
+	uint32_t firstIndex = mesh.firstIndex;
+	for (uint32_t i = 0; i < mesh.lodCount; ++i)
+	{
+		auto& lod = mesh.lods[i];
+		lod.firstIndex = firstIndex;
+		lod.indexCount = info.lodCount > 0 ? info.lods[i] : mesh.indexCount;
+		firstIndex += lod.indexCount;
+	}
+	assert(firstIndex - mesh.firstIndex == mesh.indexCount);
+	mesh.indexCount = mesh.lods[0].indexCount;
+
+	mesh.upload = _uploadQueue.UploadBuffer(info.vertices, info.vertexSize, mesh.vertexBuffer, mesh.vertexRange.offset,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	mesh.upload = _uploadQueue.UploadBuffer(info.indices, info.indexSize, mesh.indexBuffer, mesh.indexRange.offset,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+	return mesh;
+}
+
+VkIndexType MeshHandler::GetIndexType(const VkDeviceSize indexStride)
+{
+	assert(indexStride == sizeof(uint16_t) || indexStride == sizeof(uint32_t));
+	return indexStride == sizeof(uint32_t) ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+}
+
+bool MeshHandler::Save(const char* path, FileHeader& header, const void* vertices, const void* indices)
+{
+	const uint64_t vertexSize = static_cast<uint64_t>(header.vertexStride) * header.vertexCount;
+	const uint64_t indexSize = static_cast<uint64_t>(header.indexStride) * header.indexCount;
+
+	// The data directly follows the header, aligned so that it can be read in place from the mapping.
+	header.magic = FILE_MAGIC;
+	header.version = FILE_VERSION;
+	header.vertexOffset = vi::Ut::Align<uint64_t>(sizeof(FileHeader), 16);
+	header.indexOffset = vi::Ut::Align<uint64_t>(header.vertexOffset + vertexSize, 16);
+
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	if (!stream.is_open())
+		return false;
+
+	const char padding[16]{};
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+	stream.write(padding, static_cast<std::streamsize>(header.vertexOffset - sizeof(FileHeader)));
+	stream.write(static_cast<const char*>(vertices), static_cast<std::streamsize>(vertexSize));
+	stream.write(padding, static_cast<std::streamsize>(header.indexOffset - header.vertexOffset - vertexSize));
+	stream.write(static_cast<const char*>(indices), static_cast<std::streamsize>(indexSize));
+	return stream.good();
+}
+
+VkDeviceSize MeshHandler::AllocateRange(vi::Vector<Mesh::Range>& freeRanges,
+	const VkDeviceSize size, const VkDeviceSize alignment)
+{
+	const size_t count = freeRanges.GetCount();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Mesh::Range range = freeRanges[i];
+		const VkDeviceSize offset = vi::Ut::Align(range.offset, alignment);
+		const VkDeviceSize padding = offset - range.offset;
+		if (range.size < size + padding)
+			continue;
+
+		// The padding in front stays free, as does whatever remains behind the new range.
+		if (padding > 0)
+			freeRanges[i].size = padding;
+		else
+			freeRanges.RemoveAt(i);
+
+		const VkDeviceSize remainder = range.size - padding - size;
+		if (remainder > 0)
+			freeRanges.Add({ offset + size, remainder });
+		return offset;
+	}
+
+	throw std::exception("Shared mesh buffer capacity exceeded!");
+}
+
+void MeshHandler::FreeRange(vi::Vector<Mesh::Range>& freeRanges, const Mesh::Range& range)
+{
+	Mesh::Range merged = range;
+
+	// Since adjacent free ranges are always merged, there can be at most one neighbour on either side.
+	for (int32_t i = static_cast<int32_t>(freeRanges.GetCount()) - 1; i >= 0; --i)
+	{
+		const auto& other = freeRanges[i];
+		if (other.offset + other.size == merged.offset)
+		{
+			merged.offset = other.offset;
+			merged.size += other.size;
+			freeRanges.RemoveAt(i);
+		}
+		else if (merged.offset + merged.size == other.offset)
+		{
+			merged.size += other.size;
+			freeRanges.RemoveAt(i);
+		}
+	}
+
+	freeRanges.Add(merged);
 }
@@ -0,0 +1,533 @@
+﻿#include "pch.h"
+#include "Rendering/MeshOptimizer.h"
+#include <algorithm>
+#include <numeric>
+
+float MeshOptimizer::CalculateAcmr(const uint32_t* indices, const uint32_t indexCount, 
+	const uint32_t vertexCount, const uint32_t cacheSize)
+{
+	if (indexCount < 3)
+		return 0;
+
+	// Stores the moment every vertex entered the cache, so that a vertex is cached if it's one of the last ones to enter.
+	vi::ArrayPtr<uint32_t> timestamps{ vertexCount, GMEM_TEMP, 0 };
+	uint32_t time = cacheSize + 1;
+	uint32_t misses = 0;
+
+	for (uint32_t i = 0; i < indexCount; ++i)
+	{
+		const uint32_t index = indices[i];
+		if (time - timestamps[index] <= cacheSize)
+			continue;
+		timestamps[index] = time++;
+		++misses;
+	}
+
+	return static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+}
+
+void MeshOptimizer::Quadric::Add(const Quadric& other)
+{
+	a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+	b2 += other.b2; bc += other.bc; bd += other.bd;
+	c2 += other.c2; cd += other.cd;
+	d2 += other.d2;
+}
+
+double MeshOptimizer::Quadric::Evaluate(const glm::vec3& position) const
+{
+	const double x = position.x;
+	const double y = position.y;
+	const double z = position.z;
+
+	return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+		b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+		c2 * z * z + 2 * cd * z + d2;
+}
+
+MeshOptimizer::Quadric MeshOptimizer::Quadric::FromPlane(const glm::vec3& normal, const float distance, const float weight)
+{
+	const double a = normal.x;
+	const double b = normal.y;
+	const double c = normal.z;
+	const double d = distance;
+	const double w = weight;
+
+	return { a * a * w, a * b * w, a * c * w, a * d * w, b * b * w, b * c * w, b * d * w, c * c * w, c * d * w, d * d * w };
+}
+
+void MeshOptimizer::Optimize(const void* vertices, const size_t stride, const uint32_t vertexCount, const glm::vec3* positions,
+	vi::Vector<uint32_t>& indices, const Info& info, vi::Vector<uint32_t>& outVertexOrder, Stats& outStats)
+{
+	const auto indexCount = static_cast<uint32_t>(indices.GetCount());
+	assert(indexCount % 3 == 0);
+	assert(info.lodCount > 0 && info.lodCount <= Mesh::MAX_LODS);
+
+	outStats.acmrBefore = CalculateAcmr(indices.GetData(), indexCount, vertexCount);
+	outStats.vertexCountBefore = vertexCount;
+
+	// From here on the indices point to the working vertices, which refer back to the source vertices.
+	if (info.deduplicate)
+		Deduplicate(vertices, stride, vertexCount, indices, outVertexOrder);
+	else
+	{
+		outVertexOrder.Resize(vertexCount);
+		std::iota(outVertexOrder.GetData(), outVertexOrder.GetData() + vertexCount, 0);
+	}
+
+	const auto workingCount = static_cast<uint32_t>(outVertexOrder.GetCount());
+	vi::ArrayPtr<glm::vec3> workingPositions{ workingCount, GMEM_TEMP };
+	for (uint32_t i = 0; i < workingCount; ++i)
+		workingPositions[i] = positions[outVertexOrder[i]];
+
+	// Every level of detail is simplified from the original, so that the errors don't accumulate.
+	vi::Vector<uint32_t> lods[Mesh::MAX_LODS];
+	lods[0] = vi::Vector<uint32_t>{ indexCount, GMEM_TEMP, indexCount };
+	memcpy(lods[0].GetData(), indices.GetData(), sizeof(uint32_t) * indexCount);
+	outStats.lodCount = 1;
+	for (uint32_t i = 1; i < info.lodCount; ++i)
+	{
+		const double target = static_cast<double>(indexCount) * pow(info.lodReduction, i);
+		lods[i] = vi::Vector<uint32_t>{ static_cast<uint32_t>(target), GMEM_TEMP };
+		Simplify(lods[0], workingPositions, static_cast<uint32_t>(target) / 3 * 3, lods[i]);
+		if (lods[i].GetCount() == 0 || lods[i].GetCount() >= lods[i - 1].GetCount())
+			break;
+		++outStats.lodCount;
+	}
+
+	for (uint32_t i = 0; i < outStats.lodCount; ++i)
+	{
+		if (info.optimizeCache)
+			OptimizeCache(lods[i], workingCount);
+		if (info.optimizeOverdraw)
+			OptimizeOverdraw(lods[i], workingPositions, info.overdrawThreshold);
+	}
+
+	// The levels are stored back to back, so that they can share a single index buffer.
+	uint32_t lodIndexCount = 0;
+	for (uint32_t i = 0; i < outStats.lodCount; ++i)
+	{
+		outStats.lodIndexCounts[i] = static_cast<uint32_t>(lods[i].GetCount());
+		lodIndexCount += outStats.lodIndexCounts[i];
+	}
+
+	indices.Resize(lodIndexCount);
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < outStats.lodCount; ++i)
+	{
+		memcpy(indices.GetData() + offset, lods[i].GetData(), sizeof(uint32_t) * outStats.lodIndexCounts[i]);
+		offset += outStats.lodIndexCounts[i];
+	}
+
+	if (info.optimizeFetch)
+		OptimizeFetch(indices, outVertexOrder);
+
+	outStats.vertexCountAfter = static_cast<uint32_t>(outVertexOrder.GetCount());
+	outStats.acmrAfter = CalculateAcmr(indices.GetData(), outStats.lodIndexCounts[0], outStats.vertexCountAfter);
+}
+
+void MeshOptimizer::Deduplicate(const void* vertices, const size_t stride, const uint32_t vertexCount,
+	vi::Vector<uint32_t>& indices, vi::Vector<uint32_t>& outVertexOrder)
+{
+	const auto bytes = static_cast<const unsigned char*>(vertices);
+
+	// Sort the vertices by their contents, so that identical vertices end up next to each other.
+	vi::ArrayPtr<uint32_t> sorted{ vertexCount, GMEM_TEMP };
+	std::iota(sorted.GetData(), sorted.GetData() + vertexCount, 0);
+	std::sort(sorted.GetData(), sorted.GetData() + vertexCount, [bytes, stride](const uint32_t a, const uint32_t b)
+	{
+		const int32_t result = memcmp(bytes + a * stride, bytes + b * stride, stride);
+		return result < 0 || (result == 0 && a < b);
+	});
+
+	vi::ArrayPtr<uint32_t> remap{ vertexCount, GMEM_TEMP };
+	outVertexOrder.Clear();
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const uint32_t vertex = sorted[i];
+		if (i == 0 || memcmp(bytes + vertex * stride, bytes + sorted[i - 1] * stride, stride) != 0)
+			outVertexOrder.Add(vertex);
+		remap[vertex] = static_cast<uint32_t>(outVertexOrder.GetCount() - 1);
+	}
+
+	for (auto& index : indices)
+		index = remap[index];
+}
+
+void MeshOptimizer::OptimizeCache(vi::Vector<uint32_t>& indices, const uint32_t vertexCount)
+{
+	const auto indexCount = static_cast<uint32_t>(indices.GetCount());
+	const uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles that use every vertex. The remaining valence is the amount of triangles at the front of a vertex' list that haven't been drawn yet.
+	vi::ArrayPtr<uint32_t> remaining{ vertexCount, GMEM_TEMP, 0 };
+	for (const uint32_t index : indices)
+		++remaining[index];
+
+	vi::ArrayPtr<uint32_t> offsets{ vertexCount + 1, GMEM_TEMP, 0 };
+	for (uint32_t i = 0; i < vertexCount; ++i)
+		offsets[i + 1] = offsets[i] + remaining[i];
+
+	vi::ArrayPtr<uint32_t> adjacency{ indexCount, GMEM_TEMP };
+	vi::ArrayPtr<uint32_t> cursors{ vertexCount, GMEM_TEMP };
+	memcpy(cursors.GetData(), offsets.GetData(), sizeof(uint32_t) * vertexCount);
+	for (uint32_t i = 0; i < indexCount; ++i)
+		adjacency[cursors[indices[i]]++] = i / 3;
+
+	vi::ArrayPtr<int32_t> cachePositions{ vertexCount, GMEM_TEMP, -1 };
+	vi::ArrayPtr<float> vertexScores{ vertexCount, GMEM_TEMP };
+	for (uint32_t i = 0; i < vertexCount; ++i)
+		vertexScores[i] = GetVertexScore(-1, remaining[i]);
+
+	vi::ArrayPtr<bool> drawn{ triangleCount, GMEM_TEMP, false };
+	vi::ArrayPtr<uint32_t> output{ indexCount, GMEM_TEMP };
+	uint32_t outputCount = 0;
+
+	// Has room for the vertices of one more triangle, which are pushed out at the end of every step.
+	uint32_t cache[CACHE_SIZE + 3];
+	uint32_t cacheCount = 0;
+	uint32_t scanCursor = 0;
+	int32_t best = -1;
+
+	while (outputCount < indexCount)
+	{
+		// When none of the cached vertices are used by a remaining triangle, continue with the first remaining one.
+		if (best < 0)
+		{
+			while (drawn[scanCursor])
+				++scanCursor;
+			best = static_cast<int32_t>(scanCursor);
+		}
+
+		const uint32_t triangle = static_cast<uint32_t>(best);
+		const uint32_t* vertices = &indices[triangle * 3];
+		drawn[triangle] = true;
+		memcpy(&output[outputCount], vertices, sizeof(uint32_t) * 3);
+		outputCount += 3;
+
+		// Move the triangle's vertices to the front of the cache, and remove the triangle from their lists.
+		uint32_t newCache[CACHE_SIZE + 3];
+		uint32_t newCount = 0;
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			const uint32_t vertex = vertices[i];
+			const uint32_t start = offsets[vertex];
+			const uint32_t end = start + remaining[vertex];
+			for (uint32_t j = start; j < end; ++j)
+				if (adjacency[j] == triangle)
+				{
+					adjacency[j] = adjacency[end - 1];
+					--remaining[vertex];
+					break;
+				}
+
+			if (std::find(newCache, newCache + newCount, vertex) == newCache + newCount)
+				newCache[newCount++] = vertex;
+		}
+
+		for (uint32_t i = 0; i < cacheCount; ++i)
+			if (std::find(newCache, newCache + newCount, cache[i]) == newCache + newCount)
+				newCache[newCount++] = cache[i];
+
+		// Vertices that fell out of the cache lose their position.
+		for (uint32_t i = 0; i < newCount; ++i)
+		{
+			const uint32_t vertex = newCache[i];
+			cachePositions[vertex] = i < CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+			vertexScores[vertex] = GetVertexScore(cachePositions[vertex], remaining[vertex]);
+		}
+
+		// Only the triangles of the vertices that moved have a different score, so the best one is among them.
+		best = -1;
+		float bestScore = 0;
+		for (uint32_t i = 0; i < newCount; ++i)
+		{
+			const uint32_t vertex = newCache[i];
+			const uint32_t start = offsets[vertex];
+			const uint32_t end = start + remaining[vertex];
+			for (uint32_t j = start; j < end; ++j)
+			{
+				const uint32_t other = adjacency[j];
+				const uint32_t* otherVertices = &indices[other * 3];
+				const float score = vertexScores[otherVertices[0]] + vertexScores[otherVertices[1]] + vertexScores[otherVertices[2]];
+
+				if (i < CACHE_SIZE && score > bestScore)
+				{
+					bestScore = score;
+					best = static_cast<int32_t>(other);
+				}
+			}
+		}
+
+		cacheCount = vi::Ut::Min<uint32_t>(newCount, CACHE_SIZE);
+		memcpy(cache, newCache, sizeof(uint32_t) * cacheCount);
+	}
+
+	memcpy(indices.GetData(), output.GetData(), sizeof(uint32_t) * indexCount);
+}
+
+float MeshOptimizer::GetVertexScore(const int32_t cachePosition, const uint32_t remainingValence)
+{
+	// The vertex won't be used again.
+	if (remainingValence == 0)
+		return -1;
+
+	float score = 0;
+	if (cachePosition >= 0)
+	{
+		// The vertices of the last triangle get the same score, so that it doesn't matter in which order they were added.
+		if (cachePosition < 3)
+			score = .75f;
+		else
+			score = pow(1.f - static_cast<float>(cachePosition - 3) / static_cast<float>(CACHE_SIZE - 3), 1.5f);
+	}
+
+	// Favor vertices with few triangles left, so that no lone triangles are left behind.
+	score += 2.f * pow(static_cast<float>(remainingValence), -.5f);
+	return score;
+}
+
+void MeshOptimizer::OptimizeOverdraw(vi::Vector<uint32_t>& indices, const vi::ArrayPtr<glm::vec3>& positions, const float threshold)
+{
+	const auto indexCount = static_cast<uint32_t>(indices.GetCount());
+	const auto vertexCount = static_cast<uint32_t>(positions.GetLength());
+	const uint32_t triangleCount = indexCount / 3;
+
+	// A new cluster starts at every triangle that misses the cache for all of its vertices, 
+	// so that sorting the clusters barely affects the cache.
+	vi::Vector<uint32_t> clusters{ 16, GMEM_TEMP };
+	{
+		vi::ArrayPtr<uint32_t> timestamps{ vertexCount, GMEM_TEMP, 0 };
+		uint32_t time = CACHE_SIZE + 1;
+		for (uint32_t i = 0; i < triangleCount; ++i)
+		{
+			uint32_t misses = 0;
+			for (uint32_t j = 0; j < 3; ++j)
+			{
+				const uint32_t index = indices[i * 3 + j];
+				if (time - timestamps[index] <= CACHE_SIZE)
+					continue;
+				timestamps[index] = time++;
+				++misses;
+			}
+
+			if (misses == 3 || i == 0)
+				clusters.Add(i);
+		}
+	}
+
+	if (clusters.GetCount() < 2)
+		return;
+	clusters.Add(triangleCount);
+
+	const auto clusterCount = static_cast<uint32_t>(clusters.GetCount() - 1);
+	vi::ArrayPtr<glm::vec3> centroids{ clusterCount, GMEM_TEMP, glm::vec3(0) };
+	vi::ArrayPtr<glm::vec3> normals{ clusterCount, GMEM_TEMP, glm::vec3(0) };
+	glm::vec3 meshCentroid{ 0 };
+	float meshArea = 0;
+
+	for (uint32_t i = 0; i < clusterCount; ++i)
+	{
+		float area = 0;
+		for (uint32_t j = clusters[i]; j < clusters[i + 1]; ++j)
+		{
+			const auto& a = positions[indices[j * 3]];
+			const auto& b = positions[indices[j * 3 + 1]];
+			const auto& c = positions[indices[j * 3 + 2]];
+
+			// The length of the cross product is twice the triangle's area, so this is an area weighted normal.
+			const glm::vec3 normal = glm::cross(b - a, c - a);
+			const float triangleArea = glm::length(normal) * .5f;
+			centroids[i] += (a + b + c) / 3.f * triangleArea;
+			normals[i] += normal;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroids[i];
+		meshArea += area;
+		if (area > 0)
+			centroids[i] /= area;
+	}
+
+	if (meshArea <= 0)
+		return;
+	meshCentroid /= meshArea;
+
+	// Clusters that face away from the center are drawn first, since they're the most likely to occlude the others.
+	vi::ArrayPtr<float> sortKeys{ clusterCount, GMEM_TEMP };
+	for (uint32_t i = 0; i < clusterCount; ++i)
+	{
+		const float length = glm::length(normals[i]);
+		sortKeys[i] = length > 0 ? glm::dot(centroids[i] - meshCentroid, normals[i] / length) : 0;
+	}
+
+	vi::ArrayPtr<uint32_t> order{ clusterCount, GMEM_TEMP };
+	std::iota(order.GetData(), order.GetData() + clusterCount, 0);
+	std::stable_sort(order.GetData(), order.GetData() + clusterCount, [&sortKeys](const uint32_t a, const uint32_t b)
+	{
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	vi::ArrayPtr<uint32_t> sorted{ indexCount, GMEM_TEMP };
+	uint32_t sortedCount = 0;
+	for (const uint32_t cluster : order)
+	{
+		const uint32_t start = clusters[cluster] * 3;
+		const uint32_t count = clusters[cluster + 1] * 3 - start;
+		memcpy(&sorted[sortedCount], &indices[start], sizeof(uint32_t) * count);
+		sortedCount += count;
+	}
+
+	// Only keep the new order when it doesn't cost too much of the cache efficiency.
+	const float acmr = CalculateAcmr(indices.GetData(), indexCount, vertexCount);
+	if (CalculateAcmr(sorted.GetData(), indexCount, vertexCount) <= acmr * threshold)
+		memcpy(indices.GetData(), sorted.GetData(), sizeof(uint32_t) * indexCount);
+}
+
+void MeshOptimizer::OptimizeFetch(vi::Vector<uint32_t>& indices, vi::Vector<uint32_t>& vertexOrder)
+{
+	const auto vertexCount = static_cast<uint32_t>(vertexOrder.GetCount());
+	vi::ArrayPtr<uint32_t> remap{ vertexCount, GMEM_TEMP, UINT32_MAX };
+	vi::ArrayPtr<uint32_t> order{ vertexCount, GMEM_TEMP };
+	uint32_t orderCount = 0;
+
+	for (auto& index : indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = orderCount;
+			order[orderCount++] = vertexOrder[index];
+		}
+		index = remap[index];
+	}
+
+	// Vertices that aren't used by any level of detail are dropped.
+	memcpy(vertexOrder.GetData(), order.GetData(), sizeof(uint32_t) * orderCount);
+	vertexOrder.Resize(orderCount);
+}
+
+void MeshOptimizer::Simplify(const vi::Vector<uint32_t>& indices, const vi::ArrayPtr<glm::vec3>& positions,
+	const uint32_t targetIndexCount, vi::Vector<uint32_t>& outIndices)
+{
+	outIndices.Clear();
+	if (positions.GetLength() == 0)
+		return;
+
+	// Every vertex gets the planes of its triangles, weighted by their area.
+	const auto indexCount = static_cast<uint32_t>(indices.GetCount());
+	vi::ArrayPtr<Quadric> quadrics{ positions.GetLength(), GMEM_TEMP, Quadric{} };
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		const auto& a = positions[indices[i]];
+		const auto& b = positions[indices[i + 1]];
+		const auto& c = positions[indices[i + 2]];
+
+		const glm::vec3 cross = glm::cross(b - a, c - a);
+		const float length = glm::length(cross);
+		if (length <= 0)
+			continue;
+
+		const glm::vec3 normal = cross / length;
+		const auto quadric = Quadric::FromPlane(normal, -glm::dot(normal, a), length * .5f);
+		for (uint32_t j = 0; j < 3; ++j)
+			quadrics[indices[i + j]].Add(quadric);
+	}
+
+	glm::vec3 min{ FLT_MAX };
+	glm::vec3 max{ -FLT_MAX };
+	for (const auto& position : positions)
+	{
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+	}
+	const glm::vec3 extent = max - min;
+	const float size = vi::Ut::Max(extent.x, vi::Ut::Max(extent.y, extent.z));
+	if (size <= 0)
+		return;
+
+	// Finer grids keep more triangles, so search for the finest one that still fits the target.
+	uint32_t low = 1;
+	uint32_t high = 1024;
+	vi::Vector<uint32_t> candidate{ indexCount, GMEM_TEMP };
+	while (low <= high)
+	{
+		const uint32_t resolution = (low + high) / 2;
+		Cluster(indices, positions, quadrics, min, size / static_cast<float>(resolution), resolution, candidate);
+		if (candidate.GetCount() <= targetIndexCount)
+		{
+			std::swap(outIndices, candidate);
+			low = resolution + 1;
+		}
+		else
+			high = resolution - 1;
+	}
+}
+
+void MeshOptimizer::Cluster(const vi::Vector<uint32_t>& indices, const vi::ArrayPtr<glm::vec3>& positions,
+	const vi::ArrayPtr<Quadric>& quadrics, const glm::vec3& min, const float cellSize, const uint32_t resolution, 
+	vi::Vector<uint32_t>& outIndices)
+{
+	const auto vertexCount = static_cast<uint32_t>(positions.GetLength());
+
+	// Assign every vertex to a cell. Sorting the vertices by their cell keeps the vertices of a cell together.
+	vi::ArrayPtr<uint32_t> keys{ vertexCount, GMEM_TEMP };
+	vi::ArrayPtr<uint32_t> sorted{ vertexCount, GMEM_TEMP };
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const glm::vec3 cell = (positions[i] - min) / cellSize;
+		const uint32_t x = vi::Ut::Min(static_cast<uint32_t>(cell.x), resolution - 1);
+		const uint32_t y = vi::Ut::Min(static_cast<uint32_t>(cell.y), resolution - 1);
+		const uint32_t z = vi::Ut::Min(static_cast<uint32_t>(cell.z), resolution - 1);
+		keys[i] = x + (y + z * resolution) * resolution;
+		sorted[i] = i;
+	}
+
+	std::sort(sorted.GetData(), sorted.GetData() + vertexCount, [&keys](const uint32_t a, const uint32_t b)
+	{
+		return keys[a] < keys[b];
+	});
+
+	// Number the cells in order, and sum the quadrics per cell.
+	vi::ArrayPtr<uint32_t> vertexCells{ vertexCount, GMEM_TEMP };
+	vi::ArrayPtr<Quadric> cellQuadrics{ vertexCount, GMEM_TEMP, Quadric{} };
+	uint32_t cellCount = 0;
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const uint32_t vertex = sorted[i];
+		if (i == 0 || keys[vertex] != keys[sorted[i - 1]])
+			++cellCount;
+		vertexCells[vertex] = cellCount - 1;
+		cellQuadrics[cellCount - 1].Add(quadrics[vertex]);
+	}
+
+	// The vertex that fits the planes of the cell best represents it, so that no new vertices are needed.
+	vi::ArrayPtr<uint32_t> representatives{ cellCount, GMEM_TEMP, UINT32_MAX };
+	vi::ArrayPtr<double> errors{ cellCount, GMEM_TEMP, DBL_MAX };
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const uint32_t cell = vertexCells[i];
+		const double error = cellQuadrics[cell].Evaluate(positions[i]);
+		if (error >= errors[cell])
+			continue;
+		errors[cell] = error;
+		representatives[cell] = i;
+	}
+
+	// Triangles that collapsed into a line or point are removed.
+	const auto indexCount = static_cast<uint32_t>(indices.GetCount());
+	outIndices.Clear();
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		const uint32_t a = representatives[vertexCells[indices[i]]];
+		const uint32_t b = representatives[vertexCells[indices[i + 1]]];
+		const uint32_t c = representatives[vertexCells[indices[i + 2]]];
+		if (a == b || b == c || a == c)
+			continue;
+
+		outIndices.Add(a);
+		outIndices.Add(b);
+		outIndices.Add(c);
+	}
+}
@@ -0,0 +1,157 @@
+﻿#include "pch.h"
+#include "Rendering/PipelineCompiler.h"
+#include "VkRenderer/VkCore/VkCore.h"
+
+PipelineCompiler::PipelineCompiler(vi::VkCore& core, const uint32_t workerCount) : VkHandler(core)
+{
+	_jobs = vi::ArrayPtr<Job>{ CAPACITY, GMEM };
+
+	// Hand out the lowest handles first.
+	for (int32_t i = CAPACITY - 1; i >= 0; --i)
+		_freeHandles.Add(i);
+
+	const uint32_t concurrency = std::thread::hardware_concurrency();
+	const uint32_t count = vi::Ut::Max<uint32_t>(1, vi::Ut::Min(workerCount, concurrency > 1 ? concurrency - 1 : 1));
+
+	_workers = vi::ArrayPtr<std::thread*>{ count, GMEM };
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto loop = &PipelineCompiler::WorkerLoop;
+		auto self = this;
+		_workers[i] = GMEM.New<std::thread>(loop, self);
+	}
+}
+
+PipelineCompiler::~PipelineCompiler()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+
+	for (auto& worker : _workers)
+	{
+		worker->join();
+		GMEM.Delete(worker);
+	}
+	_workers.Free();
+
+	// Throw away the pipelines that were never picked up.
+	auto& pipelineHandler = core.GetPipelineHandler();
+	for (auto& job : _jobs)
+	{
+		if (job.state == State::done)
+			pipelineHandler.Destroy(job.pipeline, job.sharedLayout ? VK_NULL_HANDLE : job.layout);
+		if (job.state != State::free)
+			GMEM.Delete(job.info);
+	}
+
+	_jobs.Free();
+}
+
+PipelineCompiler::Handle PipelineCompiler::Compile(vi::VkPipelineHandler::CreateInfo& info, const VkPipelineLayout layout)
+{
+	assert(_freeHandles.GetCount() > 0);
+	const Handle handle = _freeHandles.Pop();
+
+	auto& job = _jobs[handle];
+	job.info = GMEM.New<vi::VkPipelineHandler::CreateInfo>();
+	*job.info = std::move(info);
+	job.layout = layout;
+	job.sharedLayout = layout != VK_NULL_HANDLE;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		job.state = State::queued;
+		_queue[(_queueStart + _queuedCount++) % CAPACITY] = handle;
+	}
+	_wake.notify_one();
+
+	return handle;
+}
+
+bool PipelineCompiler::IsReady(const Handle handle)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _jobs[handle].state == State::done;
+}
+
+void PipelineCompiler::Acquire(const Handle handle, VkPipeline& outPipeline, VkPipelineLayout& outLayout)
+{
+	auto& job = _jobs[handle];
+
+	bool compileHere;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		assert(job.state != State::free);
+
+		// Claim the job, so that the workers skip it when it comes up in the queue.
+		compileHere = job.state == State::queued;
+		if (compileHere)
+			job.state = State::compiling;
+		else
+			_done.wait(lock, [&job] { return job.state == State::done; });
+	}
+
+	if (compileHere)
+		Create(job, job.pipeline, job.layout);
+
+	outPipeline = job.pipeline;
+	outLayout = job.layout;
+
+	GMEM.Delete(job.info);
+	job = {};
+	_freeHandles.Add(handle);
+}
+
+void PipelineCompiler::WorkerLoop()
+{
+	while (true)
+	{
+		Handle handle;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this] { return _quit || _queuedCount > 0; });
+			if (_quit)
+				return;
+
+			handle = _queue[_queueStart];
+			_queueStart = (_queueStart + 1) % CAPACITY;
+			--_queuedCount;
+
+			// Already claimed by the main thread.
+			if (_jobs[handle].state != State::queued)
+				continue;
+			_jobs[handle].state = State::compiling;
+		}
+
+		// The info isn't touched by the main thread while compiling, and creating a pipeline doesn't allocate.
+		auto& job = _jobs[handle];
+		VkPipeline pipeline;
+		VkPipelineLayout layout;
+		Create(job, pipeline, layout);
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			job.pipeline = pipeline;
+			job.layout = layout;
+			job.state = State::done;
+		}
+		_done.notify_all();
+	}
+}
+
+void PipelineCompiler::Create(const Job& job, VkPipeline& outPipeline, VkPipelineLayout& outLayout) const
+{
+	auto& pipelineHandler = core.GetPipelineHandler();
+
+	if (!job.sharedLayout)
+	{
+		pipelineHandler.Create(*job.info, outPipeline, outLayout);
+		return;
+	}
+
+	outPipeline = pipelineHandler.CreatePipeline(*job.info, job.layout);
+	outLayout = job.layout;
+}
@@ -0,0 +1,323 @@
+﻿#include "pch.h"
+#include "Rendering/PipelineRegistry.h"
+#include "Rendering/VulkanRenderer.h"
+
+PipelineRegistry::PipelineRegistry(VulkanRenderer& renderer) : Dependency(renderer.GetShaderExt()), _renderer(renderer)
+{
+
+}
+
+PipelineRegistry::~PipelineRegistry()
+{
+	auto& pipelineHandler = _renderer.GetPipelineHandler();
+
+	// Only the prewarmed pipelines that were never taken should be left at this point.
+	for (auto& entry : _pipelines)
+	{
+		Resolve(entry);
+		pipelineHandler.Destroy(entry.pipeline, VK_NULL_HANDLE);
+		DestroyKey(entry.key);
+	}
+
+	for (auto& entry : _layouts)
+	{
+		pipelineHandler.Destroy(VK_NULL_HANDLE, entry.layout);
+		DestroyKey(entry.key);
+	}
+}
+
+void PipelineRegistry::Get(const vi::VkPipelineHandler::CreateInfo& info, VkPipeline& outPipeline, VkPipelineLayout& outLayout)
+{
+	vi::Vector<uint8_t> key{ 256, GMEM_TEMP };
+	WriteKey(info, key);
+	const size_t hash = Hash(key);
+
+	const int32_t index = FindPipeline(key, hash);
+	if (index != -1)
+	{
+		auto& entry = _pipelines[index];
+		Resolve(entry);
+
+		// The first caller takes over the reference the registry held on to.
+		if (entry.prewarmed)
+			entry.prewarmed = false;
+		else
+			++entry.refCount;
+
+		outPipeline = entry.pipeline;
+		outLayout = entry.layout;
+		return;
+	}
+
+	const auto layout = GetLayout(info);
+
+	PipelineEntry entry{};
+	entry.key = CreateKey(key, hash);
+	SetModules(entry, info);
+	entry.pipeline = _renderer.GetPipelineHandler().CreatePipeline(info, layout);
+	entry.layout = layout;
+	entry.refCount = 1;
+	_pipelines.Add(entry);
+
+	outPipeline = entry.pipeline;
+	outLayout = entry.layout;
+}
+
+void PipelineRegistry::Release(const VkPipeline pipeline)
+{
+	const uint32_t count = _pipelines.GetCount();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto& entry = _pipelines[i];
+		if (entry.pipeline != pipeline)
+			continue;
+
+		if (--entry.refCount > 0)
+			return;
+
+		_renderer.GetPipelineHandler().Destroy(entry.pipeline, VK_NULL_HANDLE);
+		ReleaseLayout(entry.layout);
+		DestroyKey(entry.key);
+		_pipelines.RemoveAt(i);
+		return;
+	}
+
+	// Pipeline wasn't created by the registry.
+	assert(false);
+}
+
+void PipelineRegistry::Prewarm(vi::VkPipelineHandler::CreateInfo* infos, const uint32_t count)
+{
+	auto& pipelineCompiler = _renderer.GetPipelineCompiler();
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto& info = infos[i];
+
+		vi::Vector<uint8_t> key{ 256, GMEM_TEMP };
+		WriteKey(info, key);
+		const size_t hash = Hash(key);
+
+		if (FindPipeline(key, hash) != -1)
+			continue;
+
+		// The registry holds on to its own reference, until the pipeline is first taken.
+		PipelineEntry entry{};
+		entry.key = CreateKey(key, hash);
+		SetModules(entry, info);
+		entry.layout = GetLayout(info);
+		entry.refCount = 1;
+		entry.pending = true;
+		entry.prewarmed = true;
+		entry.handle = pipelineCompiler.Compile(info, entry.layout);
+		_pipelines.Add(entry);
+	}
+}
+
+uint32_t PipelineRegistry::GetPipelineCount() const
+{
+	return _pipelines.GetCount();
+}
+
+uint32_t PipelineRegistry::GetLayoutCount() const
+{
+	return _layouts.GetCount();
+}
+
+void PipelineRegistry::OnReloadShaders()
+{
+	// Pipelines have already been evicted when the old modules were destroyed.
+}
+
+void PipelineRegistry::OnDestroyModule(const VkShaderModule module)
+{
+	auto& pipelineHandler = _renderer.GetPipelineHandler();
+
+	// Iterate backwards, since removed entries are replaced by the last one.
+	for (int32_t i = static_cast<int32_t>(_pipelines.GetCount()) - 1; i >= 0; --i)
+	{
+		auto& entry = _pipelines[i];
+
+		bool found = false;
+		for (uint32_t j = 0; j < entry.moduleCount; ++j)
+			found = found || entry.modules[j] == module;
+		if (!found)
+			continue;
+
+		// Pipelines that are in use keep working, they just can't be found anymore.
+		if (!entry.prewarmed)
+		{
+			entry.evicted = true;
+			continue;
+		}
+
+		// Prewarmed pipelines that nobody took yet have never been bound, so they can be destroyed right away.
+		// Resolving also makes sure that the module isn't destroyed while the pipeline is being compiled with it.
+		Resolve(entry);
+		pipelineHandler.Destroy(entry.pipeline, VK_NULL_HANDLE);
+		ReleaseLayout(entry.layout);
+		DestroyKey(entry.key);
+		_pipelines.RemoveAt(i);
+	}
+}
+
+int32_t PipelineRegistry::FindPipeline(const vi::Vector<uint8_t>& key, const size_t hash) const
+{
+	const int32_t count = _pipelines.GetCount();
+	for (int32_t i = 0; i < count; ++i)
+	{
+		const auto& entry = _pipelines[i];
+		if (!entry.evicted && Matches(entry.key, key, hash))
+			return i;
+	}
+	return -1;
+}
+
+VkPipelineLayout PipelineRegistry::GetLayout(const vi::VkPipelineHandler::CreateInfo& info)
+{
+	vi::Vector<uint8_t> key{ 64, GMEM_TEMP };
+	WriteLayoutKey(info, key);
+	const size_t hash = Hash(key);
+
+	for (auto& entry : _layouts)
+	{
+		if (!Matches(entry.key, key, hash))
+			continue;
+
+		++entry.refCount;
+		return entry.layout;
+	}
+
+	LayoutEntry entry{};
+	entry.key = CreateKey(key, hash);
+	entry.layout = _renderer.GetPipelineHandler().CreateLayout(info.setLayouts, info.pushConstants);
+	entry.refCount = 1;
+	_layouts.Add(entry);
+	return entry.layout;
+}
+
+void PipelineRegistry::ReleaseLayout(const VkPipelineLayout layout)
+{
+	const uint32_t count = _layouts.GetCount();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto& entry = _layouts[i];
+		if (entry.layout != layout)
+			continue;
+
+		if (--entry.refCount > 0)
+			return;
+
+		_renderer.GetPipelineHandler().Destroy(VK_NULL_HANDLE, entry.layout);
+		DestroyKey(entry.key);
+		_layouts.RemoveAt(i);
+		return;
+	}
+
+	assert(false);
+}
+
+void PipelineRegistry::Resolve(PipelineEntry& entry) const
+{
+	if (!entry.pending)
+		return;
+
+	VkPipelineLayout layout;
+	_renderer.GetPipelineCompiler().Acquire(entry.handle, entry.pipeline, layout);
+	assert(layout == entry.layout);
+	entry.pending = false;
+}
+
+void PipelineRegistry::SetModules(PipelineEntry& entry, const vi::VkPipelineHandler::CreateInfo& info)
+{
+	entry.moduleCount = static_cast<uint32_t>(info.modules.GetCount());
+	assert(entry.moduleCount <= vi::VkPipelineHandler::MAX_STAGES);
+	for (uint32_t i = 0; i < entry.moduleCount; ++i)
+		entry.modules[i] = info.modules[i].module;
+}
+
+void PipelineRegistry::WriteKey(const vi::VkPipelineHandler::CreateInfo& info, vi::Vector<uint8_t>& outKey)
+{
+	WriteLayoutKey(info, outKey);
+	Write(outKey, info.renderPass);
+
+	// Structs are written per member, since padding bytes are undefined.
+	Write(outKey, info.modules.GetCount());
+	for (auto& module : info.modules)
+	{
+		Write(outKey, module.module);
+		Write(outKey, module.flags);
+	}
+
+	Write(outKey, info.bindingDescription.binding);
+	Write(outKey, info.bindingDescription.stride);
+	Write(outKey, info.bindingDescription.inputRate);
+	Write(outKey, info.attributeDescriptions.GetCount());
+	for (auto& attribute : info.attributeDescriptions)
+	{
+		Write(outKey, attribute.location);
+		Write(outKey, attribute.binding);
+		Write(outKey, attribute.format);
+		Write(outKey, attribute.offset);
+	}
+
+	Write(outKey, info.primitiveTopology);
+	Write(outKey, info.primitiveRestartEnable);
+	Write(outKey, info.depthClampEnable);
+	Write(outKey, info.polygonMode);
+	Write(outKey, info.lineWidth);
+	Write(outKey, info.cullMode);
+	Write(outKey, info.frontFace);
+	Write(outKey, info.depthBufferEnabled);
+	Write(outKey, info.depthBufferCompareOp);
+	Write(outKey, info.samples);
+	Write(outKey, info.shaderSamplingEnabled);
+	Write(outKey, info.minSampleShading);
+}
+
+void PipelineRegistry::WriteLayoutKey(const vi::VkPipelineHandler::CreateInfo& info, vi::Vector<uint8_t>& outKey)
+{
+	// The counts separate the arrays, so that they can't be mistaken for one another.
+	Write(outKey, info.setLayouts.GetCount());
+	for (auto& setLayout : info.setLayouts)
+		Write(outKey, setLayout);
+	Write(outKey, info.pushConstants.GetCount());
+	for (auto& pushConstant : info.pushConstants)
+	{
+		Write(outKey, pushConstant.size);
+		Write(outKey, pushConstant.flag);
+	}
+}
+
+PipelineRegistry::Key PipelineRegistry::CreateKey(const vi::Vector<uint8_t>& key, const size_t hash)
+{
+	Key result{};
+	result.hash = hash;
+	result.size = static_cast<uint32_t>(key.GetCount());
+	result.data = static_cast<uint8_t*>(GMEM.MAlloc(result.size));
+	memcpy(result.data, key.GetData(), result.size);
+	return result;
+}
+
+void PipelineRegistry::DestroyKey(const Key& key)
+{
+	GMEM.MFree(key.data);
+}
+
+bool PipelineRegistry::Matches(const Key& key, const vi::Vector<uint8_t>& other, const size_t hash)
+{
+	return key.hash == hash && key.size == other.GetCount() && memcmp(key.data, other.GetData(), key.size) == 0;
+}
+
+size_t PipelineRegistry::Hash(const vi::Vector<uint8_t>& key)
+{
+	// FNV-1a.
+	size_t hash = 14695981039346656037ull;
+	const uint32_t count = key.GetCount();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		hash ^= key[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
@@ -2,23 +2,26 @@
 #include "Rendering/PostEffectHandler.h"
 #include "VkRenderer/VkHandlers/VkRenderPassHandler.h"
 #include "Rendering/VulkanRenderer.h"
+#include "Rendering/PipelineRegistry.h"
 #include "VkRenderer/VkCore/VkCorePhysicalDevice.h"
 #include "VkRenderer/VkHandlers/VkCommandBufferHandler.h"
 #include "VkRenderer/VkHandlers/VkSyncHandler.h"
 #include "VkRenderer/VkCore/VkCoreSwapchain.h"
 #include "VkRenderer/VkHandlers/VkImageHandler.h"
-#include "VkRenderer/VkHandlers/VkMemoryHandler.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
 #include "VkRenderer/VkHandlers/VkFrameBufferHandler.h"
 #include "VkRenderer/VkHandlers/VkLayoutHandler.h"
 #include "VkRenderer/VkHandlers/VkShaderHandler.h"
 #include "VkRenderer/VkHandlers/VkDescriptorPoolHandler.h"
+#include "Rendering/CommandRecorder.h"
 
 PostEffect::PostEffect(VulkanRenderer& renderer) : renderer(renderer)
 {
 
 }
 
-BasicPostEffect::BasicPostEffect(VulkanRenderer& renderer, const char* shaderName) : PostEffect(renderer)
+BasicPostEffect::BasicPostEffect(VulkanRenderer& renderer, const char* shaderName) : 
+	PostEffect(renderer), Dependency(renderer.GetShaderExt())
 {
 	// Load shader based on the given name.
 	auto& shaderExt = renderer.GetShaderExt();
@@ -33,7 +36,7 @@ BasicPostEffect::~BasicPostEffect()
 	shaderExt.DestroyShader(_shader);
 }
 
-void BasicPostEffect::Render(Frame& frame)
+void BasicPostEffect::Render(vi::CommandContext& context, Frame& frame)
 {
 	auto& descriptorPoolHandler = renderer.GetDescriptorPoolHandler();
 	auto& shaderHandler = renderer.GetShaderHandler();
@@ -43,8 +46,8 @@ void BasicPostEffect::Render(Frame& frame)
 	auto& swapChainext = renderer.GetSwapChainExt();
 
 	// Bind pipeline and render quad.
-	pipelineHandler.Bind(_pipeline, _pipelineLayout);
-	meshHandler.Bind(postEffectHandler.GetMesh());
+	pipelineHandler.Bind(context, _pipeline, _pipelineLayout);
+	meshHandler.Bind(context, postEffectHandler.GetMesh());
 
 	// Create a color sampler.
 	auto sampler = shaderHandler.CreateSampler();
@@ -72,8 +75,8 @@ void BasicPostEffect::Render(Frame& frame)
 
 	// Bind descriptor sets and draw post effect quad.
 	// Inputs are the color and depth images of the previous pass.
-	descriptorPoolHandler.BindSets(&frame.descriptorSet, 1);
-	meshHandler.Draw();
+	descriptorPoolHandler.BindSets(context, &frame.descriptorSet, 1);
+	meshHandler.Draw(context);
 
 	swapChainext.Collect(sampler);
 	swapChainext.Collect(depthSampler);
@@ -82,7 +85,7 @@ void BasicPostEffect::Render(Frame& frame)
 void BasicPostEffect::OnRecreateAssets()
 {
 	auto& swapChain = renderer.GetSwapChain();
-	auto& pipelineHandler = renderer.GetPipelineHandler();
+	auto& pipelineRegistry = renderer.GetPipelineRegistry();
 	auto& postEffectHandler = renderer.GetPostEffectHandler();
 
 	// Create a pipeline based on the created shader in startup.
@@ -92,21 +95,31 @@ void BasicPostEffect::OnRecreateAssets()
 	pipelineInfo.setLayouts.Add(postEffectHandler.GetLayout());
 	for (auto& module : _shader.modules)
 		pipelineInfo.modules.Add(module);
-	// Use the standard swapchain renderpass and extent.
+	// Use the standard swapchain renderpass. Render passes recreated by the swap chain stay compatible with it.
 	pipelineInfo.renderPass = swapChain.GetRenderPass();
-	pipelineInfo.extent = swapChain.GetExtent();
 
-	pipelineHandler.Create(pipelineInfo, _pipeline, _pipelineLayout);
+	pipelineRegistry.Get(pipelineInfo, _pipeline, _pipelineLayout);
+}
+
+void BasicPostEffect::OnReloadShaders()
+{
+	// The pipeline is only recreated if the post effect has been added.
+	if (!renderer.GetShaderExt().Refresh(_shader) || !_pipeline)
+		return;
+
+	DestroyAssets();
+	OnRecreateAssets();
 }
 
 void BasicPostEffect::DestroyAssets()
 {
-	auto& pipelineHandler = renderer.GetPipelineHandler();
-	pipelineHandler.Destroy(_pipeline, _pipelineLayout);
+	// The pipeline is only created once the post effect has been added.
+	if (_pipeline)
+		renderer.GetPipelineRegistry().Release(_pipeline);
 }
 
 PostEffectHandler::PostEffectHandler(VulkanRenderer& renderer, const VkSampleCountFlagBits msaaSamples) : 
-	VkHandler(renderer), Dependency(renderer), _renderer(renderer), _msaaSamples(msaaSamples)
+	VkHandler(renderer), Dependency(renderer), _renderer(renderer), _msaaSamples(msaaSamples), _graph(renderer)
 {
 	auto& meshHandler = renderer.GetMeshHandler();
 	auto& swapChain = renderer.GetSwapChain();
@@ -120,14 +133,29 @@ PostEffectHandler::PostEffectHandler(VulkanRenderer& renderer, const VkSampleCou
 	_layout = renderer.GetLayoutHandler().CreateLayout(layoutInfo);
 
 	VkDescriptorType uboType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	uint32_t blockSize = 8 * swapChain.GetLength();
+	uint32_t blockSize = 8 * swapChain.GetFrameCount();
 	_descriptorPool.Construct(_renderer, _layout, &uboType, &blockSize, 1, blockSize / 2);
 
 	// Create render quad.
 	_mesh = meshHandler.Create(MeshHandler::GenerateQuad());
-	_frames.Reallocate(_postEffects.GetLength() * swapChain.GetLength(), GMEM_VOL);
+	_frames.Reallocate(_postEffects.GetLength() * swapChain.GetFrameCount(), GMEM_VOL);
 
-	OnRecreateSwapChainAssets();
+	// This could basically use the same render pass as the swapchain, but I'm explicitely making it here too just to be safe.
+	// In case I ever change the swapchain render pass this would still work.
+	// The render graph takes care of all the layout transitions, so the attachments stay in the same layout.
+	const auto colorLayout = RenderGraph::GetLayout(RenderGraph::Usage::colorAttachment);
+	const auto depthLayout = RenderGraph::GetLayout(RenderGraph::Usage::depthAttachment);
+	vi::VkRenderPassHandler::CreateInfo renderPassCreateInfo{};
+	renderPassCreateInfo.useColorAttachment = true;
+	renderPassCreateInfo.colorInitialLayout = colorLayout;
+	renderPassCreateInfo.colorFinalLayout = colorLayout;
+	renderPassCreateInfo.useDepthAttachment = true;
+	renderPassCreateInfo.depthStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+	renderPassCreateInfo.depthInitialLayout = depthLayout;
+	renderPassCreateInfo.depthFinalLayout = depthLayout;
+	_renderPass = renderer.GetRenderPassHandler().Create(renderPassCreateInfo);
+
+	_extent = swapChain.GetExtent();
 }
 
 PostEffectHandler::~PostEffectHandler()
@@ -137,13 +165,13 @@ PostEffectHandler::~PostEffectHandler()
 
 	layoutHandler.DestroyLayout(_layout);
 	meshHandler.Destroy(_mesh);
-	DestroySwapChainAssets(true);
+	DestroyGraph();
+	_renderer.GetRenderPassHandler().Destroy(_renderPass);
 	_descriptorPool.Cleanup();
 }
 
-void PostEffectHandler::BeginFrame(const VkSemaphore waitSemaphore)
+void PostEffectHandler::BeginFrame()
 {
-	_waitSemaphore = waitSemaphore;
 	// Render everything to the first render pass.
 	LayerBeginFrame(0);
 }
@@ -152,16 +180,16 @@ void PostEffectHandler::EndFrame()
 {
 	auto& swapChain = core.GetSwapChain();
 
-	_imageIndex = swapChain.GetImageIndex();
+	_frameIndex = swapChain.GetFrameIndex();
 
-	const uint32_t swapChainLength = swapChain.GetLength();
+	const uint32_t frameCount = swapChain.GetFrameCount();
 	const uint32_t count = _postEffects.GetCount();
 
 	// Iterate and execute every post effect render pass.
 	for (uint32_t i = 0; i < count; ++i)
 	{
 		auto& postEffect = _postEffects[i];
-		auto& frame = _frames[swapChainLength * i + _imageIndex];
+		auto& frame = _frames[frameCount * i + _frameIndex];
 
 		// End current render pass.
 		LayerEndFrame(i);
@@ -169,7 +197,7 @@ void PostEffectHandler::EndFrame()
 		{
 			// Begin new render pass.
 			LayerBeginFrame(i + 1);
-			postEffect->Render(frame);
+			postEffect->Render(_context, frame);
 		}
 	}
 }
@@ -179,14 +207,7 @@ void PostEffectHandler::Render() const
 	// Draw the final render pass directly to the swap chain.
 	const uint32_t index = _postEffects.GetCount() - 1;
 	auto& finalLayer = _postEffects[index];
-	finalLayer->Render(GetActiveFrame(index));
-}
-
-VkSemaphore PostEffectHandler::GetRenderFinishedSemaphore() const
-{
-	// Get the render finished semaphore from the last post effect layer.
-	const uint32_t index = _postEffects.GetCount() - 1;
-	return GetActiveFrame(index).renderFinishedSemaphore;
+	finalLayer->Render(core.GetSwapChain().GetContext(), GetActiveFrame(index));
 }
 
 VkRenderPass PostEffectHandler::GetRenderPass() const
@@ -209,16 +230,25 @@ Mesh& PostEffectHandler::GetMesh()
 	return _mesh;
 }
 
+const RenderGraph& PostEffectHandler::GetRenderGraph() const
+{
+	return _graph;
+}
+
 void PostEffectHandler::Add(PostEffect* postEffect)
 {
+	// The new layer changes the graph, so it has to be built again.
+	DestroyGraph();
+
 	// Add a new post effect and create the layer assets for it.
 	_postEffects.Add(postEffect);
 
 	auto& swapChain = _renderer.GetSwapChain();
-	const uint32_t swapChainLength = swapChain.GetLength();
+	const uint32_t frameCount = swapChain.GetFrameCount();
 
-	_frames.Resize(_frames.GetCount() + swapChainLength);
-	RecreateLayerAssets(_postEffects.GetCount() - 1);
+	_frames.Resize(_frames.GetCount() + frameCount);
+	CreateLayerAssets(_postEffects.GetCount() - 1);
+	BuildGraph();
 }
 
 bool PostEffectHandler::IsEmpty() const
@@ -228,27 +258,11 @@ bool PostEffectHandler::IsEmpty() const
 
 void PostEffectHandler::OnRecreateSwapChainAssets()
 {
-	// If the render pass has been created before, it means that the previous assets need to be destroyed.
-	if (_renderPass)
-		DestroySwapChainAssets(false);
-
-	auto& renderPassHandler = _renderer.GetRenderPassHandler();
-	auto& swapChain = _renderer.GetSwapChain();
-
-	// This could basically use the same render pass as the swapchain, but I'm explicitely making it here too just to be safe.
-	// In case I ever change the swapchain render pass this would still work.
-	vi::VkRenderPassHandler::CreateInfo renderPassCreateInfo{};
-	renderPassCreateInfo.useColorAttachment = true;
-	renderPassCreateInfo.colorFinalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	renderPassCreateInfo.useDepthAttachment = true;
-	renderPassCreateInfo.depthStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
-	renderPassCreateInfo.depthFinalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	_renderPass = renderPassHandler.Create(renderPassCreateInfo);
-	// Update post effect resolution.
-	_extent = swapChain.GetExtent();
-
-	for (uint32_t i = 0; i < _postEffects.GetCount(); ++i)
-		RecreateLayerAssets(i);
+	// Only the render targets depend on the resolution, since the viewport is dynamic.
+	// The render pass and the pipelines of the layers are kept as they are.
+	DestroyGraph();
+	_extent = _renderer.GetSwapChain().GetExtent();
+	BuildGraph();
 }
 
 void PostEffectHandler::LayerBeginFrame(const uint32_t index)
@@ -257,167 +271,152 @@ void PostEffectHandler::LayerBeginFrame(const uint32_t index)
 	auto& renderPassHandler = core.GetRenderPassHandler();
 	auto& swapChain = core.GetSwapChain();
 
-	// Get the current swap chain image index.
-	_imageIndex = swapChain.GetImageIndex();
+	// Get the current frame in flight.
+	_frameIndex = swapChain.GetFrameIndex();
 
 	auto& frame = GetActiveFrame(index);
-	commandBufferHandler.BeginRecording(frame.commandBuffer);
+	frame.commandBuffer = swapChain.AllocateCommandBuffer();
+	commandBufferHandler.BeginRecording(_context, frame.commandBuffer);
+	// Transitions the render targets of this layer, and the images of the previous layer that it samples.
+	_graph.BeginPass(_context, index);
 
 	VkClearValue clearColors[2];
 	clearColors[0].color = { 0, 0, 0, 1 };
 	clearColors[1].depthStencil = { 1, 0 };
 
+	// The scene is rendered to the first layer, which can be recorded on multiple threads through secondary command buffers.
+	const bool secondary = index == 0;
+
 	// Begin this frame's render pass.
-	renderPassHandler.Begin(frame.frameBuffer, _renderPass, {},
-		_extent, clearColors, 2);
+	renderPassHandler.Begin(_context, frame.frameBuffer, _renderPass, {},
+		_extent, clearColors, 2, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+	if (secondary)
+		_renderer.GetCommandRecorder().BeginRenderPass(_context, _renderPass, frame.frameBuffer, _extent);
 }
 
-void PostEffectHandler::LayerEndFrame(const uint32_t index) const
+void PostEffectHandler::LayerEndFrame(const uint32_t index)
 {
 	auto& commandBufferHandler = core.GetCommandBufferHandler();
 	auto& renderPassHandler = core.GetRenderPassHandler();
 
 	auto& frame = GetActiveFrame(index);
 
-	renderPassHandler.End();
-	commandBufferHandler.EndRecording();
-
-	// Submit the swap chain layer render.
-	// The goal here is to send all layer submits to the GPU without having to stall the CPU.
-	// Therefore I'm using semaphores instead of fences to sequence them correctly.
-	vi::VkCommandBufferHandler::SubmitInfo info{};
-	info.buffers = &frame.commandBuffer;
-	info.buffersCount = 1;
-	info.waitSemaphore = index == 0 ? _waitSemaphore : GetActiveFrame(index -1).renderFinishedSemaphore;
-	info.signalSemaphore = frame.renderFinishedSemaphore;
-	info.fence = VK_NULL_HANDLE;
-	commandBufferHandler.Submit(info);
+	if (index == 0)
+		_renderer.GetCommandRecorder().EndRenderPass();
+	renderPassHandler.End(_context);
+
+	// The next layer records its own barriers, but the swap chain samples the last layer outside of the graph.
+	if (index == _postEffects.GetCount() - 1)
+		_graph.EndFrame(_context);
+
+	commandBufferHandler.EndRecording(_context);
+	core.GetSwapChain().Enqueue(frame.commandBuffer);
 }
 
-void PostEffectHandler::RecreateLayerAssets(const uint32_t index)
+void PostEffectHandler::CreateLayerAssets(const uint32_t index)
 {
-	auto& commandBufferHandler = core.GetCommandBufferHandler();
-	auto& frameBufferHandler = core.GetFrameBufferHandler();
-	auto& imageHandler = _renderer.GetImageHandler();
-	auto& memoryHandler = _renderer.GetMemoryHandler();
 	auto& swapChain = _renderer.GetSwapChain();
-	auto& syncHandler = _renderer.GetSyncHandler();
 
-	// Set up the first render pass to use anti aliasing, if enabled and if the device supports it.
-	auto msaaSamples = vi::VkCorePhysicalDevice::GetMaxUsableSampleCount(_renderer.GetPhysicalDevice());
-	msaaSamples = vi::Ut::Min(_msaaSamples, msaaSamples);
-
-	// Get color and depth image formats.
-	const auto format = swapChain.GetFormat();
-	const auto depthBufferFormat = swapChain.GetDepthBufferFormat();
-
-	const uint32_t swapChainLength = swapChain.GetLength();
+	const uint32_t frameCount = swapChain.GetFrameCount();
 	PostEffect::Frame* start = &GetStartFrame(index);
 
-	for (uint32_t i = 0; i < swapChainLength; ++i)
-	{
-		auto& frame = start[i];
-
-		frame.descriptorSet = _descriptorPool.Get();
-		frame.commandBuffer = commandBufferHandler.Create();
-		frame.renderFinishedSemaphore = syncHandler.CreateSemaphore();
-
-		// Create color image for the layer.
-		vi::VkImageHandler::CreateInfo colorImageCreateInfo{};
-		colorImageCreateInfo.resolution = _extent;
-		colorImageCreateInfo.format = format;
-		colorImageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-		if (index == 0)
-			colorImageCreateInfo.samples = msaaSamples;
-		frame.colorImage = imageHandler.Create(colorImageCreateInfo);
-
-		// Create depth image for the layer.
-		vi::VkImageHandler::CreateInfo depthImageCreateInfo{};
-		depthImageCreateInfo.resolution = _extent;
-		depthImageCreateInfo.format = depthBufferFormat;
-		depthImageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-		frame.depthImage = imageHandler.Create(depthImageCreateInfo);
-
-		frame.colorMemory = memoryHandler.Allocate(frame.colorImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		frame.depthMemory = memoryHandler.Allocate(frame.depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-		memoryHandler.Bind(frame.colorImage, frame.colorMemory);
-		memoryHandler.Bind(frame.depthImage, frame.depthMemory);
-
-		vi::VkImageHandler::ViewCreateInfo colorViewCreateInfo{};
-		colorViewCreateInfo.image = frame.colorImage;
-		colorViewCreateInfo.format = format;
-		frame.imageView = imageHandler.CreateView(colorViewCreateInfo);
-
-		vi::VkImageHandler::ViewCreateInfo depthViewCreateInfo{};
-		depthViewCreateInfo.image = frame.depthImage;
-		depthViewCreateInfo.format = depthBufferFormat;
-		depthViewCreateInfo.aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT;
-		frame.depthImageView = imageHandler.CreateView(depthViewCreateInfo);
-
-		// Create render target.
-		vi::VkFrameBufferHandler::CreateInfo frameBufferCreateInfo{};
-		frameBufferCreateInfo.imageViews = frame.imageViews;
-		frameBufferCreateInfo.imageViewCount = 2;
-		frameBufferCreateInfo.renderPass = _renderPass;
-		frameBufferCreateInfo.extent = _extent;
-		frame.frameBuffer = frameBufferHandler.Create(frameBufferCreateInfo);
-	}
+	for (uint32_t i = 0; i < frameCount; ++i)
+		start[i].descriptorSet = _descriptorPool.Get();
 
 	_postEffects[index]->OnRecreateAssets();
 }
 
-void PostEffectHandler::DestroyLayerAssets(const uint32_t index, const bool calledByDestructor) const
+void PostEffectHandler::BuildGraph()
 {
-	auto& commandBufferHandler = core.GetCommandBufferHandler();
 	auto& frameBufferHandler = core.GetFrameBufferHandler();
-	auto& imageHandler = _renderer.GetImageHandler();
-	auto& memoryHandler = _renderer.GetMemoryHandler();
 	auto& swapChain = _renderer.GetSwapChain();
-	auto& syncHandler = _renderer.GetSyncHandler();
 
-	const uint32_t swapChainLength = swapChain.GetLength();
-	PostEffect::Frame* start = &GetStartFrame(index);
+	const uint32_t count = _postEffects.GetCount();
+	if (count == 0)
+		return;
 
-	// Destroy the contents in the layers.
-	for (uint32_t i = 0; i < swapChainLength; ++i)
-	{
-		auto& frame = start[i];
+	// Set up the first render pass to use anti aliasing, if enabled and if the device supports it.
+	auto msaaSamples = vi::VkCorePhysicalDevice::GetMaxUsableSampleCount(_renderer.GetPhysicalDevice());
+	msaaSamples = vi::Ut::Min(_msaaSamples, msaaSamples);
 
-		commandBufferHandler.Destroy(frame.commandBuffer);
-		syncHandler.DestroySemaphore(frame.renderFinishedSemaphore);
+	RenderGraph::ImageInfo colorInfo{};
+	colorInfo.resolution = _extent;
+	colorInfo.format = swapChain.GetFormat();
+	colorInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-		frameBufferHandler.Destroy(frame.frameBuffer);
+	RenderGraph::ImageInfo depthInfo{};
+	depthInfo.resolution = _extent;
+	depthInfo.format = swapChain.GetDepthBufferFormat();
+	depthInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	depthInfo.aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT;
 
-		imageHandler.DestroyView(frame.imageView);
-		imageHandler.DestroyView(frame.depthImageView);
+	// Every layer renders to its own color and depth image, and samples the images of the previous layer.
+	// Since the images are only needed by two consecutive layers, every other layer can share the same memory.
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const auto pass = _graph.AddPass(i == 0 ? "scene" : "post effect");
+		colorInfo.samples = i == 0 ? msaaSamples : VK_SAMPLE_COUNT_1_BIT;
+		const auto color = _graph.AddImage(i == 0 ? "scene color" : "layer color", colorInfo);
+		const auto depth = _graph.AddImage(i == 0 ? "scene depth" : "layer depth", depthInfo);
+
+		_graph.Write(pass, color, RenderGraph::Usage::colorAttachment);
+		_graph.Write(pass, depth, RenderGraph::Usage::depthAttachment);
+		if (i == 0)
+			continue;
+		_graph.Read(pass, color - 2);
+		_graph.Read(pass, depth - 2);
+	}
 
-		imageHandler.Destroy(frame.colorImage);
-		imageHandler.Destroy(frame.depthImage);
+	// The last layer is sampled when rendering to the swap chain.
+	_graph.AddOutput(count * 2 - 2);
+	_graph.AddOutput(count * 2 - 1);
+	_graph.Compile();
 
-		memoryHandler.Free(frame.colorMemory);
-		memoryHandler.Free(frame.depthMemory);
+	const uint32_t frameCount = swapChain.GetFrameCount();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		PostEffect::Frame* start = &GetStartFrame(i);
+		for (uint32_t j = 0; j < frameCount; ++j)
+		{
+			auto& frame = start[j];
+			frame.colorImage = _graph.GetImage(i * 2, j);
+			frame.depthImage = _graph.GetImage(i * 2 + 1, j);
+			frame.imageView = _graph.GetView(i * 2, j);
+			frame.depthImageView = _graph.GetView(i * 2 + 1, j);
+
+			// Create render target.
+			vi::VkFrameBufferHandler::CreateInfo frameBufferCreateInfo{};
+			frameBufferCreateInfo.imageViews = frame.imageViews;
+			frameBufferCreateInfo.imageViewCount = 2;
+			frameBufferCreateInfo.renderPass = _renderPass;
+			frameBufferCreateInfo.extent = _extent;
+			frame.frameBuffer = frameBufferHandler.Create(frameBufferCreateInfo);
+		}
 	}
-
-	if(!calledByDestructor)
-		_postEffects[index]->DestroyAssets();
 }
 
-void PostEffectHandler::DestroySwapChainAssets(const bool calledByDestructor) const
+void PostEffectHandler::DestroyGraph()
 {
-	auto& renderPassHandler = _renderer.GetRenderPassHandler();
-	renderPassHandler.Destroy(_renderPass);
+	auto& frameBufferHandler = core.GetFrameBufferHandler();
+	auto& swapChain = _renderer.GetSwapChain();
 
+	const uint32_t frameCount = swapChain.GetFrameCount();
 	for (uint32_t i = 0; i < _postEffects.GetCount(); ++i)
-		DestroyLayerAssets(i, calledByDestructor);
+	{
+		PostEffect::Frame* start = &GetStartFrame(i);
+		for (uint32_t j = 0; j < frameCount; ++j)
+			frameBufferHandler.Destroy(start[j].frameBuffer);
+	}
+
+	_graph.Clear();
 }
 
 PostEffect::Frame& PostEffectHandler::GetStartFrame(const uint32_t index) const
 {
-	return _frames[_renderer.GetSwapChain().GetLength() * index];
+	return _frames[_renderer.GetSwapChain().GetFrameCount() * index];
 }
 
 PostEffect::Frame& PostEffectHandler::GetActiveFrame(const uint32_t index) const
 {
-	return (&GetStartFrame(index))[_imageIndex];
+	return (&GetStartFrame(index))[_frameIndex];
 }
@@ -0,0 +1,619 @@
+﻿#include "pch.h"
+#include "Rendering/RenderGraph.h"
+#include "Rendering/VulkanRenderer.h"
+#include "VkRenderer/VkCore/VkCoreSwapchain.h"
+#include "VkRenderer/VkHandlers/VkImageHandler.h"
+#include "VkRenderer/VkHandlers/VkMemoryHandler.h"
+
+RenderGraph::RenderGraph(VulkanRenderer& renderer) : _renderer(renderer)
+{
+
+}
+
+RenderGraph::~RenderGraph()
+{
+	Clear();
+}
+
+RenderGraph::Image RenderGraph::AddImage(const char* name, const ImageInfo& info)
+{
+	assert(!_compiled);
+
+	auto& image = _images.Add();
+	image.name = name;
+	image.info = info;
+	image.used = false;
+	image.output = false;
+	return static_cast<Image>(_images.GetCount() - 1);
+}
+
+RenderGraph::Pass RenderGraph::AddPass(const char* name)
+{
+	assert(!_compiled);
+
+	auto& pass = _passes.Add();
+	pass.name = name;
+	pass.culled = false;
+	return static_cast<Pass>(_passes.GetCount() - 1);
+}
+
+void RenderGraph::Read(const Pass pass, const Image image, const Usage usage)
+{
+	assert(!_compiled);
+	_accesses.Add({ pass, image, usage, false });
+}
+
+void RenderGraph::Write(const Pass pass, const Image image, const Usage usage)
+{
+	assert(!_compiled);
+	// Sampled images are read only.
+	assert(usage != Usage::sampled);
+	_accesses.Add({ pass, image, usage, true });
+}
+
+void RenderGraph::AddOutput(const Image image, const Usage usage)
+{
+	assert(!_compiled);
+
+	auto& data = _images[image];
+	data.output = true;
+	data.outputUsage = usage;
+}
+
+void RenderGraph::Compile()
+{
+	assert(!_compiled);
+	_compiled = true;
+
+	if (_passes.GetCount() == 0)
+		return;
+
+	Cull();
+	CalculateLifetimes();
+	CreateImages();
+	CreateAliases();
+	AllocateMemory();
+	CreateBarriers();
+}
+
+void RenderGraph::Clear()
+{
+	if (_compiled && !_vkImages.IsNull())
+	{
+		auto& gpuAllocator = _renderer.GetGpuAllocator();
+		auto& imageHandler = _renderer.GetImageHandler();
+
+		for (auto& view : _views)
+			if (view)
+				imageHandler.DestroyView(view);
+		for (auto& image : _vkImages)
+			if (image)
+				imageHandler.Destroy(image);
+		for (auto& memory : _memory)
+			gpuAllocator.Free(memory);
+
+		_views.Free();
+		_vkImages.Free();
+		_memory.Free();
+	}
+
+	_images.Clear();
+	_passes.Clear();
+	_accesses.Clear();
+	_barriers.Clear();
+	_aliases.Clear();
+	_outputBarrierStart = 0;
+	_compiled = false;
+}
+
+bool RenderGraph::BeginPass(const vi::CommandContext& context, const Pass pass) const
+{
+	assert(_compiled);
+
+	auto& data = _passes[pass];
+	if (data.culled)
+		return false;
+
+	RecordBarriers(context, data.barrierStart, data.barrierCount);
+	return true;
+}
+
+void RenderGraph::EndFrame(const vi::CommandContext& context) const
+{
+	assert(_compiled);
+	RecordBarriers(context, _outputBarrierStart, _barriers.GetCount() - _outputBarrierStart);
+}
+
+VkImage RenderGraph::GetImage(const Image image, const uint32_t frameIndex) const
+{
+	return _vkImages[frameIndex * _images.GetCount() + image];
+}
+
+VkImageView RenderGraph::GetView(const Image image, const uint32_t frameIndex) const
+{
+	return _views[frameIndex * _images.GetCount() + image];
+}
+
+bool RenderGraph::IsCulled(const Pass pass) const
+{
+	return _passes[pass].culled;
+}
+
+VkImageLayout RenderGraph::GetLayout(const Usage usage)
+{
+	switch (usage)
+	{
+	case Usage::colorAttachment:
+		return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	case Usage::depthAttachment:
+		return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	case Usage::sampled:
+		return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	default:
+		throw std::exception("Render graph usage not supported!");
+	}
+}
+
+void RenderGraph::Dump(std::ostream& stream) const
+{
+	const uint32_t imageCount = _images.GetCount();
+	const uint32_t passCount = _passes.GetCount();
+
+	uint32_t culledCount = 0;
+	for (auto& pass : _passes)
+		culledCount += pass.culled;
+
+	// Compare the memory footprint with what it would've been without aliasing.
+	VkDeviceSize aliasedSize = 0;
+	VkDeviceSize totalSize = 0;
+	for (auto& alias : _aliases)
+		aliasedSize += alias.memRequirements.size;
+	for (auto& image : _images)
+		if (image.used)
+			totalSize += image.memRequirements.size;
+
+	stream << "Render graph: " << passCount << " passes (" << culledCount << " culled), " <<
+		imageCount << " images in " << _aliases.GetCount() << " memory blocks." << std::endl;
+	stream << "Memory per frame in flight: " << aliasedSize << " bytes, " << totalSize << " bytes without aliasing." << std::endl;
+
+	const auto dumpBarriers = [&](const uint32_t start, const uint32_t count)
+	{
+		for (uint32_t i = start; i < start + count; ++i)
+		{
+			auto& barrier = _barriers[i];
+			stream << "\tbarrier " << _images[barrier.image].name << " #" << barrier.image << ": " <<
+				GetLayoutName(barrier.oldLayout) << " -> " << GetLayoutName(barrier.newLayout) << std::endl;
+		}
+	};
+
+	for (uint32_t i = 0; i < passCount; ++i)
+	{
+		auto& pass = _passes[i];
+		stream << "[" << i << "] " << pass.name << (pass.culled ? " (culled)" : "") << std::endl;
+
+		for (auto& access : _accesses)
+			if (access.pass == i)
+				stream << "\t" << (access.write ? "write " : "read ") << _images[access.image].name << " #" << access.image <<
+					" as " << GetUsageName(access.usage) << std::endl;
+
+		if (!pass.culled)
+			dumpBarriers(pass.barrierStart, pass.barrierCount);
+	}
+
+	stream << "Outputs" << std::endl;
+	for (uint32_t i = 0; i < imageCount; ++i)
+		if (_images[i].output)
+			stream << "\t" << _images[i].name << " #" << i << " as " << GetUsageName(_images[i].outputUsage) << std::endl;
+	dumpBarriers(_outputBarrierStart, _barriers.GetCount() - _outputBarrierStart);
+
+	stream << "Memory blocks" << std::endl;
+	for (uint32_t i = 0; i < _aliases.GetCount(); ++i)
+	{
+		stream << "\t[" << i << "] " << _aliases[i].memRequirements.size << " bytes:";
+		for (uint32_t j = 0; j < imageCount; ++j)
+		{
+			auto& image = _images[j];
+			if (image.used && image.alias == i)
+				stream << " " << image.name << " #" << j << " (passes " << image.firstPass << "-" << image.lastPass << ")";
+		}
+		stream << std::endl;
+	}
+}
+
+void RenderGraph::Cull()
+{
+	const uint32_t imageCount = _images.GetCount();
+	const uint32_t passCount = _passes.GetCount();
+
+	// Walk back from the outputs. A pass survives if it writes to an image that is needed later on,
+	// after which the images it reads are needed as well.
+	vi::ArrayPtr<bool> needed{ imageCount, GMEM_TEMP };
+	for (uint32_t i = 0; i < imageCount; ++i)
+		needed[i] = _images[i].output;
+
+	for (int32_t i = static_cast<int32_t>(passCount) - 1; i >= 0; --i)
+	{
+		auto& pass = _passes[i];
+		pass.culled = true;
+
+		for (auto& access : _accesses)
+			if (access.pass == static_cast<Pass>(i) && access.write && needed[access.image])
+				pass.culled = false;
+
+		if (pass.culled)
+			continue;
+
+		for (auto& access : _accesses)
+			if (access.pass == static_cast<Pass>(i) && !access.write)
+				needed[access.image] = true;
+	}
+}
+
+void RenderGraph::CalculateLifetimes()
+{
+	const uint32_t passCount = _passes.GetCount();
+
+	for (auto& image : _images)
+	{
+		image.used = false;
+		image.firstPass = passCount;
+		image.lastPass = 0;
+	}
+
+	for (auto& access : _accesses)
+	{
+		if (_passes[access.pass].culled)
+			continue;
+
+		auto& image = _images[access.image];
+		image.used = true;
+		image.firstPass = vi::Ut::Min(image.firstPass, access.pass);
+		image.lastPass = vi::Ut::Max(image.lastPass, access.pass);
+	}
+
+	// Outputs live until the end of the frame.
+	for (auto& image : _images)
+	{
+		if (!image.output)
+			continue;
+		if (!image.used)
+			throw std::exception("Render graph output is never written to!");
+		image.lastPass = passCount;
+	}
+}
+
+void RenderGraph::CreateImages()
+{
+	auto& imageHandler = _renderer.GetImageHandler();
+	auto& memoryHandler = _renderer.GetMemoryHandler();
+	auto& swapChain = _renderer.GetSwapChain();
+
+	const uint32_t frameCount = swapChain.GetFrameCount();
+	const uint32_t imageCount = _images.GetCount();
+
+	// Images that are only used by culled passes are never created.
+	_vkImages = vi::ArrayPtr<VkImage>(frameCount * imageCount, GMEM_VOL, VK_NULL_HANDLE);
+	_views = vi::ArrayPtr<VkImageView>(frameCount * imageCount, GMEM_VOL, VK_NULL_HANDLE);
+
+	for (uint32_t i = 0; i < frameCount; ++i)
+		for (uint32_t j = 0; j < imageCount; ++j)
+		{
+			auto& image = _images[j];
+			if (!image.used)
+				continue;
+
+			vi::VkImageHandler::CreateInfo createInfo{};
+			createInfo.resolution = image.info.resolution;
+			createInfo.format = image.info.format;
+			createInfo.usage = image.info.usage;
+			createInfo.samples = image.info.samples;
+
+			auto& vkImage = _vkImages[i * imageCount + j];
+			vkImage = imageHandler.Create(createInfo);
+			if (i == 0)
+				image.memRequirements = memoryHandler.GetRequirements(vkImage);
+		}
+}
+
+void RenderGraph::CreateAliases()
+{
+	const uint32_t imageCount = _images.GetCount();
+
+	// Place the largest images first, so that the smaller ones can share the blocks that are already there.
+	vi::ArrayPtr<uint32_t> order{ imageCount, GMEM_TEMP };
+	for (uint32_t i = 0; i < imageCount; ++i)
+	{
+		order[i] = i;
+		_images[i].alias = UINT32_MAX;
+	}
+
+	for (uint32_t i = 0; i < imageCount; ++i)
+		for (uint32_t j = i + 1; j < imageCount; ++j)
+			if (_images[order[j]].memRequirements.size > _images[order[i]].memRequirements.size)
+				order.Swap(i, j);
+
+	for (auto& index : order)
+	{
+		auto& image = _images[index];
+		if (!image.used)
+			continue;
+
+		const auto& requirements = image.memRequirements;
+		for (uint32_t i = 0; i < _aliases.GetCount(); ++i)
+		{
+			auto& alias = _aliases[i];
+			if (!(alias.memRequirements.memoryTypeBits & requirements.memoryTypeBits))
+				continue;
+
+			// The image can't share the block with an image that is alive at the same time.
+			bool overlaps = false;
+			for (auto& other : _images)
+				overlaps = overlaps || (other.alias == i &&
+					image.firstPass <= other.lastPass && other.firstPass <= image.lastPass);
+			if (overlaps)
+				continue;
+
+			image.alias = i;
+			alias.memRequirements.size = vi::Ut::Max(alias.memRequirements.size, requirements.size);
+			alias.memRequirements.alignment = vi::Ut::Max(alias.memRequirements.alignment, requirements.alignment);
+			alias.memRequirements.memoryTypeBits &= requirements.memoryTypeBits;
+			break;
+		}
+
+		if (image.alias != UINT32_MAX)
+			continue;
+
+		image.alias = _aliases.GetCount();
+		auto& alias = _aliases.Add();
+		alias.memRequirements = requirements;
+	}
+}
+
+void RenderGraph::AllocateMemory()
+{
+	auto& gpuAllocator = _renderer.GetGpuAllocator();
+	auto& imageHandler = _renderer.GetImageHandler();
+	auto& swapChain = _renderer.GetSwapChain();
+
+	const uint32_t frameCount = swapChain.GetFrameCount();
+	const uint32_t imageCount = _images.GetCount();
+	const uint32_t aliasCount = _aliases.GetCount();
+
+	_memory = vi::ArrayPtr<vi::VkGpuAllocator::Allocation>(frameCount * aliasCount, GMEM_VOL);
+
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		for (uint32_t j = 0; j < aliasCount; ++j)
+			_memory[i * aliasCount + j] = gpuAllocator.Allocate(_aliases[j].memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+
+		for (uint32_t j = 0; j < imageCount; ++j)
+		{
+			auto& image = _images[j];
+			if (!image.used)
+				continue;
+
+			const auto vkImage = _vkImages[i * imageCount + j];
+			gpuAllocator.Bind(vkImage, _memory[i * aliasCount + image.alias]);
+
+			vi::VkImageHandler::ViewCreateInfo viewCreateInfo{};
+			viewCreateInfo.image = vkImage;
+			viewCreateInfo.format = image.info.format;
+			viewCreateInfo.aspectFlags = image.info.aspectFlags;
+			_views[i * imageCount + j] = imageHandler.CreateView(viewCreateInfo);
+		}
+	}
+}
+
+void RenderGraph::CreateBarriers()
+{
+	// State of an image while walking through the passes.
+	struct State final
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		VkAccessFlags access = 0;
+		bool written = false;
+		bool lastWrite = false;
+	};
+
+	const uint32_t imageCount = _images.GetCount();
+	const uint32_t passCount = _passes.GetCount();
+
+	vi::ArrayPtr<State> states{ imageCount, GMEM_TEMP };
+	for (auto& state : states)
+		state = {};
+	for (auto& alias : _aliases)
+	{
+		alias.stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		alias.access = 0;
+	}
+
+	const auto addBarrier = [&](const Image image, const State& state, const VkImageLayout layout,
+		const VkPipelineStageFlags stage, const VkAccessFlags access)
+	{
+		_barriers.Add({ image, state.layout, layout, state.stage, stage, state.access, access });
+	};
+
+	for (uint32_t i = 0; i < passCount; ++i)
+	{
+		auto& pass = _passes[i];
+		pass.barrierStart = _barriers.GetCount();
+		pass.barrierCount = 0;
+
+		if (pass.culled)
+			continue;
+
+		for (auto& access : _accesses)
+		{
+			if (access.pass != i)
+				continue;
+
+			auto& state = states[access.image];
+			auto& alias = _aliases[_images[access.image].alias];
+
+			const auto layout = GetLayout(access.usage);
+			VkAccessFlags accessFlags;
+			VkPipelineStageFlags stage;
+			GetUsageMasks(access.usage, access.write, accessFlags, stage);
+
+			if (!state.written)
+			{
+				if (!access.write)
+					throw std::exception("Render graph image is read before it is written to!");
+
+				// The previous contents are discarded, but the memory might have been used by another image earlier in the frame.
+				State discarded{};
+				discarded.stage = alias.stage;
+				discarded.access = alias.access;
+				addBarrier(access.image, discarded, layout, stage, accessFlags);
+			}
+			else if (state.layout != layout || state.lastWrite || access.write)
+				addBarrier(access.image, state, layout, stage, accessFlags);
+			else
+			{
+				// Reading in the same layout doesn't need a barrier, but the next write has to wait for every read.
+				state.stage |= stage;
+				state.access |= accessFlags;
+				alias.stage = state.stage;
+				alias.access = state.access;
+				continue;
+			}
+
+			state = { layout, stage, accessFlags, true, access.write };
+			alias.stage = stage;
+			alias.access = accessFlags;
+		}
+
+		pass.barrierCount = _barriers.GetCount() - pass.barrierStart;
+	}
+
+	// Transition the outputs to the layout that they are used in outside of the graph.
+	_outputBarrierStart = _barriers.GetCount();
+	for (uint32_t i = 0; i < imageCount; ++i)
+	{
+		auto& image = _images[i];
+		if (!image.output)
+			continue;
+
+		auto& state = states[i];
+		const auto layout = GetLayout(image.outputUsage);
+		VkAccessFlags accessFlags;
+		VkPipelineStageFlags stage;
+		GetUsageMasks(image.outputUsage, false, accessFlags, stage);
+
+		if (state.layout != layout || state.lastWrite)
+			addBarrier(i, state, layout, stage, accessFlags);
+	}
+}
+
+void RenderGraph::RecordBarriers(const vi::CommandContext& context, const uint32_t start, const uint32_t count) const
+{
+	if (count == 0)
+		return;
+
+	auto& swapChain = _renderer.GetSwapChain();
+
+	const uint32_t frameIndex = swapChain.GetFrameIndex();
+
+	// Batch all the barriers of the pass in a single call.
+	vi::ArrayPtr<VkImageMemoryBarrier> barriers{ count, GMEM_TEMP };
+	VkPipelineStageFlags srcStage = 0;
+	VkPipelineStageFlags dstStage = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto& barrier = _barriers[start + i];
+		auto& image = _images[barrier.image];
+
+		// Depth stencil formats have to transition both aspects at once.
+		auto aspectFlags = image.info.aspectFlags;
+		const auto format = image.info.format;
+		if (aspectFlags & VK_IMAGE_ASPECT_DEPTH_BIT && (format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+			format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT))
+			aspectFlags |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+		auto& vkBarrier = barriers[i];
+		vkBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		vkBarrier.oldLayout = barrier.oldLayout;
+		vkBarrier.newLayout = barrier.newLayout;
+		vkBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		vkBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		vkBarrier.image = GetImage(barrier.image, frameIndex);
+		vkBarrier.subresourceRange.aspectMask = aspectFlags;
+		vkBarrier.subresourceRange.baseMipLevel = 0;
+		vkBarrier.subresourceRange.levelCount = 1;
+		vkBarrier.subresourceRange.baseArrayLayer = 0;
+		vkBarrier.subresourceRange.layerCount = 1;
+		vkBarrier.srcAccessMask = barrier.srcAccess;
+		vkBarrier.dstAccessMask = barrier.dstAccess;
+
+		srcStage |= barrier.srcStage;
+		dstStage |= barrier.dstStage;
+	}
+
+	vkCmdPipelineBarrier(context.buffer,
+		srcStage, dstStage,
+		0,
+		0, nullptr,
+		0, nullptr,
+		count, barriers.GetData()
+	);
+}
+
+void RenderGraph::GetUsageMasks(const Usage usage, const bool write,
+	VkAccessFlags& outAccessFlags, VkPipelineStageFlags& outPipelineStageFlags)
+{
+	switch (usage)
+	{
+	case Usage::colorAttachment:
+		outAccessFlags = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+		if (write)
+			outAccessFlags |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		outPipelineStageFlags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		break;
+	case Usage::depthAttachment:
+		outAccessFlags = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		if (write)
+			outAccessFlags |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		outPipelineStageFlags = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		break;
+	case Usage::sampled:
+		outAccessFlags = VK_ACCESS_SHADER_READ_BIT;
+		outPipelineStageFlags = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		break;
+	default:
+		throw std::exception("Render graph usage not supported!");
+	}
+}
+
+const char* RenderGraph::GetUsageName(const Usage usage)
+{
+	switch (usage)
+	{
+	case Usage::colorAttachment:
+		return "color attachment";
+	case Usage::depthAttachment:
+		return "depth attachment";
+	case Usage::sampled:
+		return "sampled";
+	default:
+		return "unknown";
+	}
+}
+
+const char* RenderGraph::GetLayoutName(const VkImageLayout layout)
+{
+	switch (layout)
+	{
+	case VK_IMAGE_LAYOUT_UNDEFINED:
+		return "undefined";
+	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		return "color attachment";
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		return "depth stencil attachment";
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+		return "shader read only";
+	default:
+		return "unknown";
+	}
+}
@@ -1,45 +1,79 @@
 ﻿#include "pch.h"
 #include "Rendering/ShaderExt.h"
-#include "Utils/FileReader.h"
+#include "Utils/MappedFile.h"
 #include "VkRenderer/VkCore/VkCore.h"
 #include "VkRenderer/VkHandlers/VkShaderHandler.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+ShaderExt::Dependency::Dependency(ShaderExt& shaderExt) : _shaderExt(shaderExt)
+{
+	_shaderExt._dependencies.Add(this);
+}
+
+ShaderExt::Dependency::~Dependency()
+{
+	_shaderExt._dependencies.Remove(this);
+}
+
+void ShaderExt::Dependency::OnDestroyModule(VkShaderModule)
+{
+}
 
 ShaderExt::ShaderExt(vi::VkCore& core) : VkHandler(core)
 {
 }
 
-Shader ShaderExt::Load(const char* name, const LoadInfo& info) const
+ShaderExt::~ShaderExt()
 {
-	auto& handler = core.GetShaderHandler();
+	if (!_watcher)
+		return;
 
-	const vi::String middle{ name, GMEM_TEMP };
-	vi::String postFixes[3]
-	{
-		{"vert.spv", GMEM_TEMP },
-		{"geom.spv", GMEM_TEMP },
-		{"frag.spv", GMEM_TEMP }
-	};
-	VkShaderStageFlagBits shaderStageFlags[3]
 	{
-		VK_SHADER_STAGE_VERTEX_BIT,
-		VK_SHADER_STAGE_GEOMETRY_BIT,
-		VK_SHADER_STAGE_FRAGMENT_BIT
-	};
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+
+	_watcher->join();
+	GMEM.Delete(_watcher);
+}
+
+Shader ShaderExt::Load(const char* name, const LoadInfo& info)
+{
+	assert(strlen(name) < Shader::MAX_NAME_LENGTH);
 
 	Shader shader{};
+	snprintf(shader.name, sizeof shader.name, "%s", name);
 
-	// Check for vertex, geometry and fragment shaders, if any.
-	for (uint32_t i = 0; i < 3; ++i)
+	// Check for vertex, geometry, fragment and compute shaders, if any.
+	for (uint32_t i = 0; i < STAGE_COUNT; ++i)
 	{
 		if (!info.values[i])
 			continue;
 
-		vi::String postFix{ postFixes[i], GMEM_TEMP };
-		const auto code = ToCode(middle, postFix);
-
 		auto& module = shader.modules.Add();
-		module.module = handler.CreateModule(code);
-		module.flags = shaderStageFlags[i];
+		module.flags = STAGE_FLAGS[i];
+
+		// Share the module if it has been loaded before.
+		const int32_t index = FindModule(name, i);
+		if (index != -1)
+		{
+			auto& entry = _modules[index];
+			++entry.refCount;
+			module.module = entry.module;
+			continue;
+		}
+
+		ModuleEntry entry{};
+		snprintf(entry.name, sizeof entry.name, "%s", name);
+		entry.stage = i;
+		entry.module = CreateModule(name, i);
+		entry.refCount = 1;
+		_modules.Add(entry);
+		module.module = entry.module;
 	}
 
 	return shader;
@@ -47,17 +81,275 @@ Shader ShaderExt::Load(const char* name, const LoadInfo& info) const
 
 void ShaderExt::DestroyShader(const Shader& shader)
 {
-	auto& handler = core.GetShaderHandler();
+	for (auto& module : shader.modules)
+	{
+		// Modules are found by name, since the handle might have been replaced by a reload.
+		const int32_t index = FindModule(shader.name, GetStage(module.flags));
+		assert(index != -1);
+
+		auto& entry = _modules[index];
+		if (--entry.refCount > 0)
+			continue;
+
+		DestroyModule(entry.module);
+		_modules.RemoveAt(index);
+	}
+}
+
+bool ShaderExt::Refresh(Shader& shader) const
+{
+	bool changed = false;
 
 	for (auto& module : shader.modules)
-		if (module.module)
-			handler.DestroyModule(module.module);
+	{
+		const int32_t index = FindModule(shader.name, GetStage(module.flags));
+		assert(index != -1);
+
+		const auto current = _modules[index].module;
+		changed = changed || module.module != current;
+		module.module = current;
+	}
+
+	return changed;
+}
+
+void ShaderExt::EnableHotReload(const HotReloadInfo& info)
+{
+	assert(!_watcher);
+
+	_manifest = info.manifest;
+	_compiler = info.compiler;
+	_pollInterval = info.pollInterval;
+	_onCompiled = info.onCompiled;
+
+	auto loop = &ShaderExt::WatchLoop;
+	auto self = this;
+	_watcher = GMEM.New<std::thread>(loop, self);
+}
+
+void ShaderExt::Update()
+{
+	if (!_watcher)
+		return;
+
+	// Copied out, so that the watcher isn't blocked while the modules are swapped.
+	vi::Vector<CompiledOutput> reloaded{ 4, GMEM_TEMP };
+	vi::Vector<CompiledOutput> failed{ 4, GMEM_TEMP };
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (const auto& output : _reloaded)
+			snprintf(reloaded.Add().name, MAX_PATH_LENGTH, "%s", output.c_str());
+		for (const auto& output : _failed)
+			snprintf(failed.Add().name, MAX_PATH_LENGTH, "%s", output.c_str());
+		_reloaded.clear();
+		_failed.clear();
+	}
+
+	if (_onCompiled)
+	{
+		for (const auto& output : failed)
+			_onCompiled(output.name, false);
+		for (const auto& output : reloaded)
+			_onCompiled(output.name, true);
+	}
+
+	if (reloaded.GetCount() == 0)
+		return;
+
+	char fileName[MAX_PATH_LENGTH];
+	bool changed = false;
+
+	// Only the modules that are currently in use are swapped, the others are loaded from the new file when they're needed.
+	for (auto& entry : _modules)
+	{
+		snprintf(fileName, sizeof fileName, "%s%s", entry.name, STAGE_POSTFIXES[entry.stage]);
+		bool isReloaded = false;
+		for (const auto& output : reloaded)
+			isReloaded = isReloaded || strcmp(output.name, fileName) == 0;
+		if (!isReloaded)
+			continue;
+
+		// The new module is created first, so that it can't get the handle of the old one. 
+		// Refresh relies on this to tell them apart. Pipelines keep working after their modules have been destroyed.
+		const auto module = entry.module;
+		entry.module = CreateModule(entry.name, entry.stage);
+		DestroyModule(module);
+		changed = true;
+	}
+
+	if (!changed)
+		return;
+
+	// The dependencies destroy pipelines that might still be in flight.
+	core.DeviceWaitIdle();
+	for (auto& dependency : _dependencies)
+		dependency->OnReloadShaders();
+}
+
+int32_t ShaderExt::FindModule(const char* name, const uint32_t stage) const
+{
+	const int32_t count = _modules.GetCount();
+	for (int32_t i = 0; i < count; ++i)
+	{
+		const auto& entry = _modules[i];
+		if (entry.stage == stage && strcmp(entry.name, name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+VkShaderModule ShaderExt::CreateModule(const char* name, const uint32_t stage) const
+{
+	char path[MAX_PATH_LENGTH];
+	snprintf(path, sizeof path, "%s%s%s", DIRECTORY, name, STAGE_POSTFIXES[stage]);
+
+	// SPIR-V is read straight from the mapped file, which is page aligned.
+	MappedFile file{};
+	if (!file.Open(path))
+		throw std::exception("Shader module not found.");
+
+	return core.GetShaderHandler().CreateModule(file.GetData(), file.GetSize());
+}
+
+void ShaderExt::DestroyModule(const VkShaderModule module)
+{
+	for (auto& dependency : _dependencies)
+		dependency->OnDestroyModule(module);
+	core.GetShaderHandler().DestroyModule(module);
+}
+
+uint32_t ShaderExt::GetStage(const VkShaderStageFlagBits flags)
+{
+	for (uint32_t i = 0; i < STAGE_COUNT; ++i)
+		if (STAGE_FLAGS[i] == flags)
+			return i;
+
+	assert(false);
+	return 0;
+}
+
+void ShaderExt::WatchLoop()
+{
+	namespace fs = std::filesystem;
+
+	auto jobs = ParseManifest();
+	std::vector<std::pair<std::string, fs::file_time_type>> files;
+	bool initialized = false;
+
+	while (true)
+	{
+		// The first pass only takes a snapshot of the sources.
+		if (initialized)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait_for(lock, std::chrono::milliseconds(_pollInterval), [this] { return _quit; });
+			if (_quit)
+				return;
+		}
+
+		std::vector<std::string> changed;
+		std::error_code error;
+
+		for (const auto& file : fs::directory_iterator(DIRECTORY, error))
+		{
+			const auto fileName = file.path().filename().string();
+			if (!IsSource(fileName))
+				continue;
+
+			// Files that are being written to might not be accessible.
+			const auto time = fs::last_write_time(file.path(), error);
+			if (error)
+				continue;
+
+			auto it = std::find_if(files.begin(), files.end(), [&fileName](const auto& other) { return other.first == fileName; });
+			if (it == files.end())
+			{
+				files.emplace_back(fileName, time);
+				if (initialized)
+					changed.push_back(fileName);
+				continue;
+			}
+
+			if (it->second == time)
+				continue;
+			it->second = time;
+			changed.push_back(fileName);
+		}
+
+		initialized = true;
+		if (changed.empty())
+			continue;
+
+		// Parse the manifest again, in case shaders have been added to it.
+		jobs = ParseManifest();
+
+		for (const auto& job : jobs)
+		{
+			// Changes to shared code affect every shader, since the includes aren't tracked.
+			bool affected = false;
+			for (const auto& fileName : changed)
+				affected = affected || fileName == job.source || fs::path(fileName).extension() == ".glsl";
+
+			if (!affected)
+				continue;
+
+			const bool compiled = Compile(job);
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (compiled)
+				_reloaded.push_back(job.output);
+			else
+				_failed.push_back(job.output);
+		}
+	}
+}
+
+std::vector<ShaderExt::SourceJob> ShaderExt::ParseManifest() const
+{
+	std::vector<SourceJob> jobs;
+	std::ifstream manifest(_manifest);
+
+	std::string line;
+	while (std::getline(manifest, line))
+	{
+		std::istringstream stream(line);
+		SourceJob job{};
+
+		// The first token is the compiler the manifest was written for.
+		std::string token;
+		stream >> token;
+		while (stream >> token)
+		{
+			if (token == "-o")
+				stream >> job.output;
+			else if (token.rfind("-D", 0) == 0)
+				job.defines += " " + token;
+			else if (IsSource(token))
+				job.source = token;
+		}
+
+		if (!job.source.empty() && !job.output.empty())
+			jobs.push_back(job);
+	}
+
+	return jobs;
+}
+
+bool ShaderExt::Compile(const SourceJob& job) const
+{
+	const std::string output = DIRECTORY + job.output;
+	const std::string temporary = output + ".tmp";
+	const std::string command = _compiler + " " + DIRECTORY + job.source + job.defines + " -o " + temporary;
+
+	if (std::system(command.c_str()) != 0)
+		return false;
+
+	std::error_code error;
+	std::filesystem::rename(temporary, output, error);
+	return !error;
 }
 
-vi::String ShaderExt::ToCode(const vi::String& name, const vi::String& postFix)
+bool ShaderExt::IsSource(const std::string& fileName)
 {
-	vi::String path{ "Shaders/", GMEM_TEMP };
-	path.Append(name);
-	path.Append(postFix);
-	return FileReader::Read(path);
+	const auto extension = std::filesystem::path(fileName).extension();
+	return extension == ".vert" || extension == ".geom" || extension == ".frag" || extension == ".comp" || extension == ".glsl";
 }
@@ -35,16 +35,16 @@ SwapChainExt::~SwapChainExt()
 void SwapChainExt::Update()
 {
 	auto& swapChain = core.GetSwapChain();
-	const uint32_t index = swapChain.GetImageIndex();
+	const uint32_t index = swapChain.GetFrameIndex();
 
 	// Check all objects in the garbage collection and delete those that have made a full rotation.
-	// In other words, delete those that have passed every swap chain image to make sure that we don't delete
+	// In other words, delete those that have passed every frame in flight to make sure that we don't delete
 	// anything that might still be used for images in flight.
 	for (int32_t i = _deleteables.GetCount() - 1; i >= 0; --i)
 	{
 		auto& deleteable = _deleteables[i];
 
-		// If the image has been deleted while this image was available.
+		// If the object has been deleted while this frame was in flight.
 		if (deleteable.index == index)
 		{
 			// If the image was created THIS frame, continue.
@@ -127,7 +127,7 @@ void SwapChainExt::Collect(const VkDescriptorSet descriptor, DescriptorPool& poo
 void SwapChainExt::Collect(Deleteable& deleteable)
 {
 	auto& swapChain = core.GetSwapChain();
-	deleteable.index = swapChain.GetImageIndex();
+	deleteable.index = swapChain.GetFrameIndex();
 
 	_deleteables.Add(deleteable);
 }
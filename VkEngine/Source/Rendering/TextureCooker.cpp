@@ -0,0 +1,335 @@
+﻿#include "pch.h"
+#include "Rendering/TextureCooker.h"
+#include <filesystem>
+#include <fstream>
+// Decoded directly, so that the cooker doesn't depend on the texture handler.
+#include <stb_image.h>
+
+bool TextureCooker::Cook(const char* srcPath, const char* dstPath, const Compression compression)
+{
+	int32_t w, h, d;
+	const auto pixels = stbi_load(srcPath, &w, &h, &d, STBI_rgb_alpha);
+	if (!pixels)
+		return false;
+
+	const auto file = CookPixels(pixels, w, h, d, compression);
+	stbi_image_free(pixels);
+
+	std::ofstream stream(dstPath, std::ios::binary | std::ios::trunc);
+	if (!stream.is_open())
+		return false;
+	stream.write(reinterpret_cast<const char*>(file.GetData()), static_cast<std::streamsize>(file.GetLength()));
+	return stream.good();
+}
+
+vi::ArrayPtr<unsigned char> TextureCooker::CookPixels(const unsigned char* pixels, const uint32_t width, const uint32_t height, 
+	const uint32_t channels, const Compression compression, vi::FreeListAllocator& allocator)
+{
+	const int32_t w = static_cast<int32_t>(width);
+	const int32_t h = static_cast<int32_t>(height);
+
+	Header header{};
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.compression = compression;
+	header.width = width;
+	header.height = height;
+	header.channels = channels;
+	// Same amount of levels as the runtime generation, with a minimum of 1.
+	header.mipLevels = vi::Ut::Min<uint32_t>(MAX_MIP_LEVELS, 
+		static_cast<uint32_t>(std::floor(std::log2(std::max(w, h)))) + 1);
+
+	// Calculate where every level starts.
+	uint64_t offset = (sizeof(Header) + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+	for (uint32_t i = 0; i < header.mipLevels; ++i)
+	{
+		auto& level = header.levels[i];
+		level.offset = offset;
+		level.size = GetLevelSize(compression, vi::Ut::Max(1, w >> i), vi::Ut::Max(1, h >> i));
+		offset = (offset + level.size + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+	}
+
+	vi::ArrayPtr<unsigned char> file{ offset, allocator, 0 };
+	memcpy(file.GetData(), &header, sizeof(Header));
+
+	// Every level is filtered from the previous one, and is kept uncompressed until it has been written.
+	// The levels only get smaller, so both buffers can hold every level after the first one.
+	const size_t size = static_cast<size_t>(w) * h * 4;
+	vi::ArrayPtr<unsigned char> current{ size, GMEM_TEMP };
+	vi::ArrayPtr<unsigned char> next{ static_cast<size_t>(vi::Ut::Max(1, w / 2)) * vi::Ut::Max(1, h / 2) * 4, GMEM_TEMP };
+	memcpy(current.GetData(), pixels, size);
+
+	for (uint32_t i = 0; i < header.mipLevels; ++i)
+	{
+		const uint32_t levelWidth = vi::Ut::Max(1, w >> i);
+		const uint32_t levelHeight = vi::Ut::Max(1, h >> i);
+		const auto dst = &file[static_cast<uint32_t>(header.levels[i].offset)];
+
+		if (compression == Compression::bc1)
+			CompressBc1(current.GetData(), levelWidth, levelHeight, dst);
+		else
+			memcpy(dst, current.GetData(), static_cast<size_t>(levelWidth) * levelHeight * 4);
+
+		if (i + 1 == header.mipLevels)
+			break;
+
+		Downsample(current.GetData(), levelWidth, levelHeight, next.GetData());
+		std::swap(current, next);
+	}
+
+	return file;
+}
+
+uint32_t TextureCooker::CookFolder(const char* folder, std::ostream& errors, const Compression compression)
+{
+	namespace fs = std::filesystem;
+
+	uint32_t failures = 0;
+	for (auto& entry : fs::directory_iterator(folder))
+	{
+		const auto& srcPath = entry.path();
+		if (!entry.is_regular_file() || srcPath.extension() != ".png")
+			continue;
+
+		auto dstPath = srcPath;
+		dstPath.replace_extension(EXTENSION);
+
+		// Skip the image if it hasn't changed since it was last cooked.
+		std::error_code error;
+		const auto dstTime = fs::last_write_time(dstPath, error);
+		if (!error && dstTime >= fs::last_write_time(srcPath))
+			continue;
+
+		if (Cook(srcPath.string().c_str(), dstPath.string().c_str(), compression))
+			continue;
+		errors << "Failed to cook texture: " << srcPath.string() << std::endl;
+		++failures;
+	}
+
+	return failures;
+}
+
+const TextureCooker::Header* TextureCooker::Validate(const void* data, const size_t size)
+{
+	if (size < sizeof(Header))
+		return nullptr;
+
+	const auto header = static_cast<const Header*>(data);
+	if (header->magic != MAGIC || header->version != VERSION)
+		return nullptr;
+	if (header->compression != Compression::none && header->compression != Compression::bc1)
+		return nullptr;
+	if (header->width == 0 || header->height == 0)
+		return nullptr;
+
+	// The smallest level can't be smaller than a single pixel.
+	uint32_t maxMipLevels = 0;
+	for (uint32_t extent = vi::Ut::Max(header->width, header->height); extent > 0; extent >>= 1)
+		++maxMipLevels;
+	if (header->mipLevels == 0 || header->mipLevels > vi::Ut::Min(maxMipLevels, MAX_MIP_LEVELS))
+		return nullptr;
+
+	// Make sure every level matches its resolution and doesn't point outside of the file.
+	for (uint32_t i = 0; i < header->mipLevels; ++i)
+	{
+		const auto& level = header->levels[i];
+		const uint32_t width = vi::Ut::Max(1u, header->width >> i);
+		const uint32_t height = vi::Ut::Max(1u, header->height >> i);
+		if (level.size != GetLevelSize(header->compression, width, height))
+			return nullptr;
+		if (level.offset % LEVEL_ALIGNMENT != 0 || level.offset > size || level.size > size - level.offset)
+			return nullptr;
+		// The levels are uploaded as one range, so they have to be stored from large to small.
+		if (i > 0 && level.offset < header->levels[i - 1].offset + header->levels[i - 1].size)
+			return nullptr;
+	}
+
+	return header;
+}
+
+VkFormat TextureCooker::GetFormat(const Compression compression)
+{
+	switch (compression)
+	{
+	case Compression::bc1:
+		return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+	default:
+		return VK_FORMAT_R8G8B8A8_SRGB;
+	}
+}
+
+uint64_t TextureCooker::GetLevelSize(const Compression compression, const uint32_t width, const uint32_t height)
+{
+	switch (compression)
+	{
+	case Compression::bc1:
+		return static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * 8;
+	default:
+		return static_cast<uint64_t>(width) * height * 4;
+	}
+}
+
+void TextureCooker::Downsample(const unsigned char* src, const uint32_t srcWidth, const uint32_t srcHeight, unsigned char* dst)
+{
+	const uint32_t dstWidth = vi::Ut::Max(1u, srcWidth / 2);
+	const uint32_t dstHeight = vi::Ut::Max(1u, srcHeight / 2);
+
+	for (uint32_t y = 0; y < dstHeight; ++y)
+		for (uint32_t x = 0; x < dstWidth; ++x)
+		{
+			float sum[4]{};
+
+			// Sample a 2x2 area, which collapses to a line when one of the dimensions is already 1.
+			for (uint32_t j = 0; j < 2; ++j)
+				for (uint32_t i = 0; i < 2; ++i)
+				{
+					const uint32_t sx = vi::Ut::Min(x * 2 + i, srcWidth - 1);
+					const uint32_t sy = vi::Ut::Min(y * 2 + j, srcHeight - 1);
+					const auto pixel = &src[(sy * srcWidth + sx) * 4];
+					for (uint32_t c = 0; c < 3; ++c)
+						sum[c] += ToLinear(pixel[c]);
+					// Alpha is stored linearly.
+					sum[3] += pixel[3];
+				}
+
+			const auto pixel = &dst[(y * dstWidth + x) * 4];
+			for (uint32_t c = 0; c < 3; ++c)
+				pixel[c] = ToSrgb(sum[c] / 4);
+			pixel[3] = static_cast<unsigned char>(sum[3] / 4 + .5f);
+		}
+}
+
+void TextureCooker::CompressBc1(const unsigned char* src, const uint32_t width, const uint32_t height, unsigned char* dst)
+{
+	unsigned char block[16 * 4];
+
+	for (uint32_t by = 0; by < height; by += 4)
+		for (uint32_t bx = 0; bx < width; bx += 4)
+		{
+			// Blocks that stick out of the image repeat the edge pixels.
+			for (uint32_t y = 0; y < 4; ++y)
+				for (uint32_t x = 0; x < 4; ++x)
+				{
+					const uint32_t sx = vi::Ut::Min(bx + x, width - 1);
+					const uint32_t sy = vi::Ut::Min(by + y, height - 1);
+					memcpy(&block[(y * 4 + x) * 4], &src[(sy * width + sx) * 4], 4);
+				}
+
+			CompressBc1Block(block, dst);
+			dst += 8;
+		}
+}
+
+void TextureCooker::CompressBc1Block(const unsigned char* pixels, unsigned char* dst)
+{
+	uint32_t min[3]{ 255, 255, 255 };
+	uint32_t max[3]{ 0, 0, 0 };
+	bool transparent = false;
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		const auto pixel = &pixels[i * 4];
+		if (pixel[3] < 128)
+		{
+			transparent = true;
+			continue;
+		}
+
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			min[c] = vi::Ut::Min<uint32_t>(min[c], pixel[c]);
+			max[c] = vi::Ut::Max<uint32_t>(max[c], pixel[c]);
+		}
+	}
+
+	// Fully transparent block.
+	if (max[0] < min[0])
+		min[0] = min[1] = min[2] = max[0] = max[1] = max[2] = 0;
+
+	// The endpoints span the bounding box of the colors.
+	uint16_t color0 = To565(max[0], max[1], max[2]);
+	uint16_t color1 = To565(min[0], min[1], min[2]);
+
+	// The order of the endpoints decides the mode. Four colors when the first one is larger, 
+	// otherwise three colors and a transparent one.
+	if (transparent ? color0 > color1 : color0 < color1)
+		std::swap(color0, color1);
+
+	uint32_t palette[4][3];
+	From565(color0, palette[0]);
+	From565(color1, palette[1]);
+	for (uint32_t c = 0; c < 3; ++c)
+		if (color0 > color1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+
+	// Identical endpoints select the first color everywhere, except for the transparent pixels.
+	const uint32_t colorCount = color0 > color1 ? 4 : color0 == color1 && !transparent ? 1 : 3;
+
+	uint32_t indices = 0;
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		const auto pixel = &pixels[i * 4];
+		uint32_t index = 3;
+
+		if (!transparent || pixel[3] >= 128)
+		{
+			uint32_t bestDistance = UINT32_MAX;
+			for (uint32_t j = 0; j < colorCount; ++j)
+			{
+				uint32_t distance = 0;
+				for (uint32_t c = 0; c < 3; ++c)
+				{
+					const int32_t difference = static_cast<int32_t>(pixel[c]) - static_cast<int32_t>(palette[j][c]);
+					distance += difference * difference;
+				}
+
+				if (distance >= bestDistance)
+					continue;
+				bestDistance = distance;
+				index = j;
+			}
+		}
+
+		indices |= index << i * 2;
+	}
+
+	memcpy(dst, &color0, 2);
+	memcpy(dst + 2, &color1, 2);
+	memcpy(dst + 4, &indices, 4);
+}
+
+float TextureCooker::ToLinear(const unsigned char value)
+{
+	const float c = value / 255.f;
+	return c <= .04045f ? c / 12.92f : std::pow((c + .055f) / 1.055f, 2.4f);
+}
+
+unsigned char TextureCooker::ToSrgb(const float value)
+{
+	const float c = value <= .0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - .055f;
+	return static_cast<unsigned char>(vi::Ut::Clamp(c, 0.f, 1.f) * 255.f + .5f);
+}
+
+uint16_t TextureCooker::To565(const uint32_t r, const uint32_t g, const uint32_t b)
+{
+	return static_cast<uint16_t>((r * 31 + 127) / 255 << 11 | (g * 63 + 127) / 255 << 5 | (b * 31 + 127) / 255);
+}
+
+void TextureCooker::From565(const uint16_t color, uint32_t* outRgb)
+{
+	const uint32_t r = color >> 11 & 31;
+	const uint32_t g = color >> 5 & 63;
+	const uint32_t b = color & 31;
+	// Replicate the high bits into the low bits, so that the full range is covered.
+	outRgb[0] = r << 3 | r >> 2;
+	outRgb[1] = g << 2 | g >> 4;
+	outRgb[2] = b << 3 | b >> 2;
+}
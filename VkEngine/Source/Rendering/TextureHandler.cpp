@@ -2,26 +2,74 @@
 #include "Rendering/TextureHandler.h"
 #include "VkRenderer/VkCore/VkCore.h"
 
-#define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-#include "VkRenderer/VkHandlers/VkSyncHandler.h"
-#include "VkRenderer/VkHandlers/VkCommandBufferHandler.h"
 #include "VkRenderer/VkHandlers/VkImageHandler.h"
-#include "VkRenderer/VkHandlers/VkMemoryHandler.h"
+#include "VkRenderer/VkHandlers/VkGpuAllocator.h"
 #include "VkRenderer/VkHandlers/VkShaderHandler.h"
+#include "VkRenderer/VkHandlers/VkLayoutHandler.h"
+#include "VkRenderer/VkHandlers/VkDescriptorPoolHandler.h"
+#include "Rendering/TextureCooker.h"
+#include "Utils/MappedFile.h"
 
-TextureHandler::TextureHandler(vi::VkCore& core) : VkHandler(core)
+TextureHandler::TextureHandler(vi::VkCore& core, UploadQueue& uploadQueue, const uint32_t bindlessCapacity) : 
+	VkHandler(core), _uploadQueue(uploadQueue), _bindlessCapacity(bindlessCapacity)
 {
+	if (!core.IsDescriptorIndexingEnabled())
+		return;
+
+	auto& descriptorPoolHandler = core.GetDescriptorPoolHandler();
+	auto& layoutHandler = core.GetLayoutHandler();
+	auto& shaderHandler = core.GetShaderHandler();
+
+	// Create a single sampler2D array that is allowed to be partially filled, and can be updated while bound.
+	vi::VkLayoutHandler::CreateInfo layoutInfo{};
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	auto& texturesBinding = layoutInfo.bindings.Add();
+	texturesBinding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	texturesBinding.flag = VK_SHADER_STAGE_FRAGMENT_BIT;
+	texturesBinding.count = bindlessCapacity;
+	texturesBinding.bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+	_bindlessLayout = layoutHandler.CreateLayout(layoutInfo);
+
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	vi::VkDescriptorPoolHandler::PoolCreateInfo poolCreateInfo{};
+	poolCreateInfo.types = &type;
+	poolCreateInfo.capacities = &bindlessCapacity;
+	poolCreateInfo.typeCount = 1;
+	poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	_bindlessPool = descriptorPoolHandler.Create(poolCreateInfo);
+
+	vi::VkDescriptorPoolHandler::SetCreateInfo setCreateInfo{};
+	setCreateInfo.pool = _bindlessPool;
+	setCreateInfo.layout = _bindlessLayout;
+	setCreateInfo.setCount = 1;
+	setCreateInfo.outSets = &_bindlessSet;
+	descriptorPoolHandler.CreateSets(setCreateInfo);
+
+	// Mip levels are clamped by the image views, so a single sampler can be used for all the textures.
+	vi::VkShaderHandler::SamplerCreateInfo samplerCreateInfo{};
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.maxFilter = VK_FILTER_NEAREST;
+	_bindlessSampler = shaderHandler.CreateSampler(samplerCreateInfo);
 }
 
-Texture TextureHandler::Create(const char* name, const char* extension) const
+TextureHandler::~TextureHandler()
 {
-	auto& commandBufferHandler = core.GetCommandBufferHandler();
-	auto& imageHandler = core.GetImageHandler();
-	auto& memoryHandler = core.GetMemoryHandler();
+	if (!IsBindless())
+		return;
+
+	auto& descriptorPoolHandler = core.GetDescriptorPoolHandler();
+	auto& layoutHandler = core.GetLayoutHandler();
 	auto& shaderHandler = core.GetShaderHandler();
-	auto& syncHandler = core.GetSyncHandler();
 
+	shaderHandler.DestroySampler(_bindlessSampler);
+	descriptorPoolHandler.Destroy(_bindlessPool);
+	layoutHandler.DestroyLayout(_bindlessLayout);
+}
+
+Texture TextureHandler::Create(const char* name, const char* extension)
+{
 	vi::String path{ "Textures/", GMEM_TEMP };
 	vi::String postFix{ extension, GMEM_TEMP };
 
@@ -29,202 +77,170 @@ Texture TextureHandler::Create(const char* name, const char* extension) const
 	path.Append(".");
 	path.Append(extension);
 
+	if (strcmp(extension, TextureCooker::EXTENSION) == 0)
+		return CreateCooked(path.GetData());
+
 	int32_t w, h, d;
 	const auto tex = Load(path.GetData(), w, h, d);
+	assert(tex);
+	auto texture = Create(tex, { w, h }, d);
+	Free(tex);
+	return texture;
+}
+
+Texture TextureHandler::Create(const unsigned char* pixels, const glm::ivec2 resolution, const uint8_t channels)
+{
+	const int32_t w = resolution.x;
+	const int32_t h = resolution.y;
+
 	// Calculate the amount of mip map levels, with a minimum of 1.
 	const uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(w, h)))) + 1;
 
-	// First create a staging buffer before copying it to a GPU readonly location.
-	const auto texStagingBuffer = shaderHandler.CreateBuffer(sizeof(unsigned char) * w * h * 4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	const auto texStagingMem = memoryHandler.Allocate(texStagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	memoryHandler.Bind(texStagingBuffer, texStagingMem);
-	memoryHandler.Map(texStagingMem, tex, 0, w * h * d);
+	// The mip levels are generated by blitting from the previous level.
+	auto texture = CreateImage(resolution, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, 
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	texture.channels = channels;
+
+	// The pixels are copied into the staging ring, so they can be freed right away. The image is always loaded as RGBA.
+	texture.upload = _uploadQueue.UploadImage(pixels, sizeof(unsigned char) * w * h * 4, texture.image, 
+		{ w, h }, mipLevels, VK_FORMAT_R8G8B8A8_SRGB);
+
+	if (IsBindless())
+		RegisterBindless(texture);
+
+	return texture;
+}
+
+Texture TextureHandler::CreateCooked(const char* path)
+{
+	MappedFile file{};
+	if (!file.Open(path))
+		throw std::exception("Texture file not found.");
+	const auto header = TextureCooker::Validate(file.GetData(), file.GetSize());
+	if (!header)
+		throw std::exception("Texture file is invalid or out of date! Cook the texture again.");
+
+	const auto format = TextureCooker::GetFormat(header->compression);
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(core.GetPhysicalDevice(), format, &formatProperties);
+	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+		throw std::exception("Texture format not supported by the hardware! Cook the texture without compression.");
+
+	const glm::ivec2 resolution{ header->width, header->height };
+	auto texture = CreateImage(resolution, header->mipLevels, format, 
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	texture.channels = header->channels;
+
+	// The levels are stored back to back, so they can be copied from the mapped file in one go.
+	VkDeviceSize levelOffsets[TextureCooker::MAX_MIP_LEVELS];
+	const auto& firstLevel = header->levels[0];
+	const auto& lastLevel = header->levels[header->mipLevels - 1];
+	for (uint32_t i = 0; i < header->mipLevels; ++i)
+		levelOffsets[i] = header->levels[i].offset - firstLevel.offset;
+
+	const auto data = static_cast<const unsigned char*>(file.GetData()) + firstLevel.offset;
+	texture.upload = _uploadQueue.UploadImageLevels(data, lastLevel.offset + lastLevel.size - firstLevel.offset, 
+		levelOffsets, texture.image, resolution, header->mipLevels);
+
+	if (IsBindless())
+		RegisterBindless(texture);
+
+	return texture;
+}
+
+Texture TextureHandler::CreateImage(const glm::ivec2 resolution, const uint32_t mipLevels, 
+	const VkFormat format, const VkImageUsageFlags usage) const
+{
+	auto& gpuAllocator = core.GetGpuAllocator();
+	auto& imageHandler = core.GetImageHandler();
 
 	// Create the image.
 	vi::VkImageHandler::CreateInfo imgCreateInfo{};
-	imgCreateInfo.resolution = { w, h };
+	imgCreateInfo.resolution = resolution;
 	imgCreateInfo.mipLevels = mipLevels;
-	imgCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imgCreateInfo.format = format;
+	imgCreateInfo.usage = usage;
 	const auto img = imageHandler.Create(imgCreateInfo);
-	const auto imgMem = memoryHandler.Allocate(img, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	memoryHandler.Bind(img, imgMem);
-
-	// Transition the images layout.
-	vi::VkImageHandler::TransitionInfo transitionInfo{};
-	transitionInfo.image = img;
-	transitionInfo.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	transitionInfo.mipLevels = mipLevels;
-	auto imgCmd = commandBufferHandler.Create();
-	commandBufferHandler.BeginRecording(imgCmd);
-	imageHandler.TransitionLayout(transitionInfo);
-	commandBufferHandler.EndRecording();
-
-	const auto imgFence = syncHandler.CreateFence();
-
-	// Submit the image layout transition.
-	vi::VkCommandBufferHandler::SubmitInfo submitInfo{};
-	submitInfo.buffers = &imgCmd;
-	submitInfo.buffersCount = 1;
-	submitInfo.fence = imgFence;
-	commandBufferHandler.Submit(submitInfo);
-	syncHandler.WaitForFence(imgFence);
-
-	// Copy the buffer content to the actual image.
-	commandBufferHandler.BeginRecording(imgCmd);
-	shaderHandler.CopyBuffer(texStagingBuffer, img, {w, h});
-	commandBufferHandler.EndRecording();
-	commandBufferHandler.Submit(submitInfo);
-	syncHandler.WaitForFence(imgFence);
-
-	syncHandler.DestroyFence(imgFence);
-	commandBufferHandler.Destroy(imgCmd);
-	shaderHandler.DestroyBuffer(texStagingBuffer);
-	memoryHandler.Free(texStagingMem);
-
-	Free(tex);
-
-	GenerateMipMaps(img, { w, h }, mipLevels, VK_FORMAT_R8G8B8A8_SRGB);
+	const auto imgMem = gpuAllocator.Allocate(img, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	gpuAllocator.Bind(img, imgMem);
 
 	// Create a corresponding image view.
 	vi::VkImageHandler::ViewCreateInfo viewCreateInfo{};
 	viewCreateInfo.image = img;
+	viewCreateInfo.format = format;
 	viewCreateInfo.mipLevels = mipLevels;
 
 	// Fill the texture data.
 	Texture texture{};
-	texture.resolution = { w, h };
-	texture.channels = d;
+	texture.resolution = resolution;
 	texture.mipLevels = mipLevels;
 	texture.image = img;
 	texture.memory = imgMem;
 	texture.imageView = imageHandler.CreateView(viewCreateInfo);
-
 	return texture;
 }
 
-void TextureHandler::Destroy(const Texture& texture) const
+void TextureHandler::Destroy(const Texture& texture)
 {
+	auto& gpuAllocator = core.GetGpuAllocator();
 	auto& imageHandler = core.GetImageHandler();
-	auto& memoryHandler = core.GetMemoryHandler();
+
+	if (IsBindless())
+		UnregisterBindless(texture);
 
 	imageHandler.DestroyView(texture.imageView);
 	imageHandler.Destroy(texture.image);
-	memoryHandler.Free(texture.memory);
+	gpuAllocator.Free(texture.memory);
 }
 
-void TextureHandler::GenerateMipMaps(
-	const VkImage image, 
-	const glm::ivec2 resolution,
-	const uint32_t mipLevels,
-	const VkFormat imageFormat) const
+bool TextureHandler::IsBindless() const
 {
-	VkFormatProperties formatProperties;
-	vkGetPhysicalDeviceFormatProperties(core.GetPhysicalDevice(), imageFormat, &formatProperties);
-	assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
-
-	auto& commandBufferHandler = core.GetCommandBufferHandler();
-	auto& syncHandler = core.GetSyncHandler();
-
-	auto commandBuffer = commandBufferHandler.Create();
-	commandBufferHandler.BeginRecording(commandBuffer);
+	return _bindlessLayout;
+}
 
-	const auto fence = syncHandler.CreateFence();
+VkDescriptorSetLayout TextureHandler::GetBindlessLayout() const
+{
+	return _bindlessLayout;
+}
 
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.image = image;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.levelCount = 1;
+VkDescriptorSet TextureHandler::GetBindlessSet() const
+{
+	return _bindlessSet;
+}
 
-	int32_t mipWidth = resolution.x;
-	int32_t mipHeight = resolution.y;
+void TextureHandler::RegisterBindless(Texture& texture)
+{
+	auto& shaderHandler = core.GetShaderHandler();
 
-	// Create all the separate mip levels.
-	for (uint32_t i = 1; i < mipLevels; i++) 
+	// Reuse freed up slots before growing the array.
+	if (_bindlessFreeIndices.GetCount() > 0)
+		texture.index = _bindlessFreeIndices.Pop();
+	else
 	{
-		barrier.subresourceRange.baseMipLevel = i - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
-
-		// Copy the original image data into a smaller image.
-		VkImageBlit blit{};
-		blit.srcOffsets[0] = { 0, 0, 0 };
-		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
-		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.srcSubresource.mipLevel = i - 1;
-		blit.srcSubresource.baseArrayLayer = 0;
-		blit.srcSubresource.layerCount = 1;
-		blit.dstOffsets[0] = { 0, 0, 0 };
-		blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.dstSubresource.mipLevel = i;
-		blit.dstSubresource.baseArrayLayer = 0;
-		blit.dstSubresource.layerCount = 1;
-
-		vkCmdBlitImage(commandBuffer,
-			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &blit,
-			VK_FILTER_LINEAR);
-
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
-
-		mipWidth = mipWidth == 1 ? mipWidth : mipWidth / 2;
-		mipHeight = mipHeight == 1 ? mipHeight : mipHeight / 2;
+		assert(_bindlessCount < _bindlessCapacity);
+		texture.index = _bindlessCount++;
 	}
 
-	// Because this assumes the old and new layout, it isn't a public method.
-	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-	vkCmdPipelineBarrier(commandBuffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier);
-
-	commandBufferHandler.EndRecording();
-
-	vi::VkCommandBufferHandler::SubmitInfo submitInfo{};
-	submitInfo.buffers = &commandBuffer;
-	submitInfo.buffersCount = 1;
-	submitInfo.fence = fence;
-	commandBufferHandler.Submit(submitInfo);
-	syncHandler.WaitForFence(fence);
-
-	commandBufferHandler.Destroy(commandBuffer);
-	syncHandler.DestroyFence(fence);
+	vi::VkShaderHandler::SamplerBindInfo bindInfo{};
+	bindInfo.set = _bindlessSet;
+	bindInfo.imageViews = &texture.imageView;
+	bindInfo.layouts = &texture.layout;
+	bindInfo.samplers = &_bindlessSampler;
+	bindInfo.bindingIndex = 0;
+	bindInfo.arrayIndex = texture.index;
+	shaderHandler.BindSampler(bindInfo);
+}
+
+void TextureHandler::UnregisterBindless(const Texture& texture)
+{
+	// The descriptor is left as is, since the array is partially bound it won't be accessed anymore.
+	if (texture.index != UINT32_MAX)
+		_bindlessFreeIndices.Add(texture.index);
 }
 
 unsigned char* TextureHandler::Load(const std::string& path, int32_t& width, int32_t& height, int32_t& numChannels)
 {
-	const auto pixels = stbi_load(path.c_str(), &width, &height, &numChannels, STBI_rgb_alpha);
-	assert(pixels);
-	return pixels;
+	return stbi_load(path.c_str(), &width, &height, &numChannels, STBI_rgb_alpha);
 }
 
 void TextureHandler::Free(unsigned char* pixels)
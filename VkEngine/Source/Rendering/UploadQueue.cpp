@@ -0,0 +1,547 @@
+﻿#include "pch.h"
+#include "Rendering/UploadQueue.h"
+#include "VkRenderer/VkCore/VkCore.h"
+#include "VkRenderer/VkCore/VkCoreLogicalDevice.h"
+#include "VkRenderer/VkCore/VkCorePhysicalDevice.h"
+#include "VkRenderer/VkHandlers/VkCommandBufferHandler.h"
+#include "VkRenderer/VkHandlers/VkSyncHandler.h"
+#include "VkRenderer/VkHandlers/VkShaderHandler.h"
+
+UploadQueue::UploadQueue(vi::VkCore& core, const VkDeviceSize stagingCapacity) : VkHandler(core), 
+	_stagingCapacity(stagingCapacity)
+{
+	auto& commandBufferHandler = core.GetCommandBufferHandler();
+	auto& gpuAllocator = core.GetGpuAllocator();
+	auto& shaderHandler = core.GetShaderHandler();
+	auto& syncHandler = core.GetSyncHandler();
+
+	const auto families = vi::VkCorePhysicalDevice::GetQueueFamilies(core.GetSurface(), core.GetPhysicalDevice());
+	_graphicsFamily = families.graphics;
+	_transferFamily = families.transfer;
+
+	// The staging ring stays mapped for the lifetime of the queue.
+	_stagingBuffer = shaderHandler.CreateBuffer(stagingCapacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	_stagingMemory = gpuAllocator.Allocate(_stagingBuffer, 
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	gpuAllocator.Bind(_stagingBuffer, _stagingMemory);
+
+	for (auto& batch : _batches)
+	{
+		batch.graphicsPool = commandBufferHandler.CreatePool(_graphicsFamily);
+		batch.graphicsCommandBuffer = commandBufferHandler.Create(batch.graphicsPool);
+		batch.fence = syncHandler.CreateFence();
+
+		// Without a dedicated transfer queue, the copies are recorded in the graphics command buffer.
+		if (!IsDedicated())
+		{
+			batch.transferCommandBuffer = batch.graphicsCommandBuffer;
+			continue;
+		}
+
+		batch.transferPool = commandBufferHandler.CreatePool(_transferFamily);
+		batch.transferCommandBuffer = commandBufferHandler.Create(batch.transferPool);
+		batch.transferFinished = syncHandler.CreateSemaphore();
+	}
+}
+
+UploadQueue::~UploadQueue()
+{
+	auto& commandBufferHandler = core.GetCommandBufferHandler();
+	auto& gpuAllocator = core.GetGpuAllocator();
+	auto& shaderHandler = core.GetShaderHandler();
+	auto& syncHandler = core.GetSyncHandler();
+
+	// Pending uploads are discarded, since the resources they target have already been destroyed.
+	while (_batches[_oldest].inFlight)
+		Retire(true);
+
+	for (auto& batch : _batches)
+	{
+		DestroyTemporary(batch);
+		commandBufferHandler.DestroyPool(batch.graphicsPool);
+		syncHandler.DestroyFence(batch.fence);
+
+		if (!IsDedicated())
+			continue;
+
+		commandBufferHandler.DestroyPool(batch.transferPool);
+		syncHandler.DestroySemaphore(batch.transferFinished);
+	}
+
+	shaderHandler.DestroyBuffer(_stagingBuffer);
+	gpuAllocator.Free(_stagingMemory);
+}
+
+UploadQueue::Handle UploadQueue::UploadBuffer(const void* data, const VkDeviceSize size, 
+	const VkBuffer dstBuffer, const VkDeviceSize dstOffset,
+	const VkPipelineStageFlags dstStage, const VkAccessFlags dstAccess)
+{
+	VkBuffer srcBuffer;
+	const auto srcOffset = AllocateStaging(data, size, 16, srcBuffer);
+	auto& batch = BeginBatch();
+
+	VkBufferCopy region{};
+	region.srcOffset = srcOffset;
+	region.dstOffset = dstOffset;
+	region.size = size;
+	vkCmdCopyBuffer(batch.transferCommandBuffer, srcBuffer, dstBuffer, 1, &region);
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = dstBuffer;
+	barrier.offset = dstOffset;
+	barrier.size = size;
+
+	if (!IsDedicated())
+	{
+		vkCmdPipelineBarrier(batch.graphicsCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr);
+		return batch.handle;
+	}
+
+	// Release the range on the transfer queue and acquire it on the graphics queue.
+	// Both barriers have to describe the same transfer, but the access on the other queue is ignored.
+	barrier.srcQueueFamilyIndex = _transferFamily;
+	barrier.dstQueueFamilyIndex = _graphicsFamily;
+	barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(batch.transferCommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr,
+		1, &barrier,
+		0, nullptr);
+
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(batch.graphicsCommandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+		0, nullptr,
+		1, &barrier,
+		0, nullptr);
+
+	batch.waitStages |= dstStage;
+	return batch.handle;
+}
+
+UploadQueue::Handle UploadQueue::UploadImage(const void* data, const VkDeviceSize size, const VkImage dstImage,
+	const glm::ivec2 resolution, const uint32_t mipLevels, const VkFormat format)
+{
+	// The mip levels are generated by blitting, which requires linear filtering.
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(core.GetPhysicalDevice(), format, &formatProperties);
+	assert(mipLevels == 1 || formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+
+	VkBuffer srcBuffer;
+	const auto srcOffset = AllocateStaging(data, size, 16, srcBuffer);
+	auto& batch = BeginBatch();
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = srcOffset;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { static_cast<uint32_t>(resolution.x), static_cast<uint32_t>(resolution.y), 1 };
+
+	RecordImageCopy(batch, srcBuffer, dstImage, &region, 1, mipLevels);
+	RecordMipMaps(batch.graphicsCommandBuffer, dstImage, resolution, mipLevels);
+	return batch.handle;
+}
+
+UploadQueue::Handle UploadQueue::UploadImageLevels(const void* data, const VkDeviceSize size, const VkDeviceSize* levelOffsets,
+	const VkImage dstImage, const glm::ivec2 resolution, const uint32_t mipLevels)
+{
+	// Offsets have to be a multiple of the texel block size, which is never larger than 16 bytes.
+	VkBuffer srcBuffer;
+	const auto srcOffset = AllocateStaging(data, size, 16, srcBuffer);
+	auto& batch = BeginBatch();
+
+	vi::ArrayPtr<VkBufferImageCopy> regions{ mipLevels, GMEM_TEMP };
+	for (uint32_t i = 0; i < mipLevels; ++i)
+	{
+		auto& region = regions[i];
+		region.bufferOffset = srcOffset + levelOffsets[i];
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = i;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent =
+		{
+			vi::Ut::Max<uint32_t>(1, resolution.x >> i),
+			vi::Ut::Max<uint32_t>(1, resolution.y >> i),
+			1
+		};
+	}
+
+	RecordImageCopy(batch, srcBuffer, dstImage, regions.GetData(), mipLevels, mipLevels);
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = dstImage;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(batch.graphicsCommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	return batch.handle;
+}
+
+void UploadQueue::RecordImageCopy(Batch& batch, const VkBuffer srcBuffer, const VkImage image, 
+	const VkBufferImageCopy* regions, const uint32_t regionCount, const uint32_t mipLevels) const
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	// Every level is written to, either by the copy or by the mip map generation.
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(batch.transferCommandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	vkCmdCopyBufferToImage(batch.transferCommandBuffer, srcBuffer, image, 
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regionCount, regions);
+
+	if (IsDedicated())
+	{
+		// Blitting isn't supported on transfer queues, so the image is handed over to the graphics queue in the same layout.
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = _transferFamily;
+		barrier.dstQueueFamilyIndex = _graphicsFamily;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(batch.transferCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(batch.graphicsCommandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		batch.waitStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+}
+
+void UploadQueue::Update()
+{
+	Retire(false);
+	Submit();
+}
+
+bool UploadQueue::IsResident(const Handle handle)
+{
+	Retire(false);
+	return handle <= _residentHandle;
+}
+
+void UploadQueue::WaitIdle()
+{
+	Submit();
+	while (_batches[_oldest].inFlight)
+		Retire(true);
+}
+
+bool UploadQueue::IsDedicated() const
+{
+	return _transferFamily != _graphicsFamily;
+}
+
+UploadQueue::Batch& UploadQueue::BeginBatch()
+{
+	auto& batch = _batches[_current];
+	if (batch.recording)
+		return batch;
+
+	// Only happens when every batch is in flight, in which case this is also the oldest one.
+	while (batch.inFlight)
+		Retire(true);
+
+	auto& commandBufferHandler = core.GetCommandBufferHandler();
+	commandBufferHandler.ResetPool(batch.graphicsPool);
+	if (IsDedicated())
+		commandBufferHandler.ResetPool(batch.transferPool);
+
+	// Recorded directly instead of through the command buffer handler, 
+	// since uploads can happen while a frame is being recorded on the same thread.
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	auto result = vkBeginCommandBuffer(batch.graphicsCommandBuffer, &beginInfo);
+	assert(!result);
+	if (IsDedicated())
+	{
+		result = vkBeginCommandBuffer(batch.transferCommandBuffer, &beginInfo);
+		assert(!result);
+	}
+
+	batch.handle = _nextHandle++;
+	batch.waitStages = 0;
+	batch.recording = true;
+	return batch;
+}
+
+void UploadQueue::Submit()
+{
+	auto& batch = _batches[_current];
+	if (!batch.recording)
+		return;
+
+	auto& commandBufferHandler = core.GetCommandBufferHandler();
+
+	auto result = vkEndCommandBuffer(batch.graphicsCommandBuffer);
+	assert(!result);
+
+	vi::VkCommandBufferHandler::SubmitInfo submitInfo{};
+	submitInfo.buffers = &batch.graphicsCommandBuffer;
+	submitInfo.buffersCount = 1;
+	submitInfo.fence = batch.fence;
+
+	if (IsDedicated())
+	{
+		result = vkEndCommandBuffer(batch.transferCommandBuffer);
+		assert(!result);
+
+		vi::VkCommandBufferHandler::SubmitInfo transferSubmitInfo{};
+		transferSubmitInfo.buffers = &batch.transferCommandBuffer;
+		transferSubmitInfo.buffersCount = 1;
+		transferSubmitInfo.signalSemaphore = batch.transferFinished;
+		transferSubmitInfo.queue = core.GetQueues().transfer;
+		commandBufferHandler.Submit(transferSubmitInfo);
+
+		submitInfo.waitSemaphore = batch.transferFinished;
+		submitInfo.waitStage = batch.waitStages;
+	}
+
+	// The graphics side is submitted before the frame, so the frame can use the uploads without waiting for the fence.
+	commandBufferHandler.Submit(submitInfo);
+
+	batch.stagingEnd = _stagingHead;
+	batch.recording = false;
+	batch.inFlight = true;
+	_current = (_current + 1) % MAX_BATCHES;
+}
+
+void UploadQueue::Retire(bool wait)
+{
+	auto& syncHandler = core.GetSyncHandler();
+
+	// Batches finish in submission order, so the first one that's still busy ends the search.
+	while (_batches[_oldest].inFlight)
+	{
+		auto& batch = _batches[_oldest];
+		if (!syncHandler.IsSignaled(batch.fence))
+		{
+			if (!wait)
+				return;
+			syncHandler.WaitForFence(batch.fence);
+			wait = false;
+		}
+
+		batch.inFlight = false;
+		DestroyTemporary(batch);
+		_residentHandle = batch.handle;
+		_stagingTail = batch.stagingEnd;
+		_oldest = (_oldest + 1) % MAX_BATCHES;
+	}
+}
+
+VkDeviceSize UploadQueue::AllocateStaging(const void* data, const VkDeviceSize size, 
+	const VkDeviceSize alignment, VkBuffer& outBuffer)
+{
+	// Larger uploads will never fit in the ring, so they get a buffer of their own.
+	if (size > _stagingCapacity)
+	{
+		auto& gpuAllocator = core.GetGpuAllocator();
+		auto& shaderHandler = core.GetShaderHandler();
+
+		// The buffer is owned by the batch that copies from it, which can only hold one.
+		if (_batches[_current].temporaryBuffer)
+			Submit();
+		auto& batch = BeginBatch();
+
+		batch.temporaryBuffer = shaderHandler.CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		batch.temporaryMemory = gpuAllocator.Allocate(batch.temporaryBuffer,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		gpuAllocator.Bind(batch.temporaryBuffer, batch.temporaryMemory);
+
+		memcpy(batch.temporaryMemory.mapped, data, size);
+		outBuffer = batch.temporaryBuffer;
+		return 0;
+	}
+
+	VkDeviceSize offset;
+	while (!TryAllocateStaging(size, alignment, offset))
+	{
+		// The ring is full, so the pending uploads are submitted and the oldest batch has to free up its range.
+		Submit();
+		Retire(true);
+	}
+
+	memcpy(static_cast<char*>(_stagingMemory.mapped) + offset, data, size);
+	outBuffer = _stagingBuffer;
+	return offset;
+}
+
+bool UploadQueue::TryAllocateStaging(const VkDeviceSize size, const VkDeviceSize alignment, VkDeviceSize& outOffset)
+{
+	// Nothing uses the ring anymore, so the allocation can start at the beginning.
+	// This also tells a full ring apart from an empty one, since the head and tail are equal in both cases.
+	const bool empty = !_batches[_oldest].inFlight && !_batches[_current].recording;
+	if (empty)
+	{
+		_stagingHead = 0;
+		_stagingTail = 0;
+	}
+
+	const VkDeviceSize offset = (_stagingHead + alignment - 1) / alignment * alignment;
+
+	// The used range wraps around the end, so the free range is between the head and the tail.
+	if (!empty && _stagingHead <= _stagingTail)
+	{
+		if (offset + size > _stagingTail)
+			return false;
+		outOffset = offset;
+	}
+	// Place it at the end if it fits, otherwise wrap around to the start.
+	else if (offset + size <= _stagingCapacity)
+		outOffset = offset;
+	else if (size <= _stagingTail)
+		outOffset = 0;
+	else
+		return false;
+
+	_stagingHead = outOffset + size;
+	return true;
+}
+
+void UploadQueue::DestroyTemporary(Batch& batch)
+{
+	if (!batch.temporaryBuffer)
+		return;
+
+	auto& gpuAllocator = core.GetGpuAllocator();
+	auto& shaderHandler = core.GetShaderHandler();
+
+	shaderHandler.DestroyBuffer(batch.temporaryBuffer);
+	gpuAllocator.Free(batch.temporaryMemory);
+	batch.temporaryBuffer = VK_NULL_HANDLE;
+	batch.temporaryMemory = {};
+}
+
+void UploadQueue::RecordMipMaps(const VkCommandBuffer commandBuffer, const VkImage image, 
+	const glm::ivec2 resolution, const uint32_t mipLevels)
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = 1;
+
+	int32_t mipWidth = resolution.x;
+	int32_t mipHeight = resolution.y;
+
+	// Create all the separate mip levels.
+	for (uint32_t i = 1; i < mipLevels; i++) 
+	{
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		// Copy the original image data into a smaller image.
+		VkImageBlit blit{};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = i;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		vkCmdBlitImage(commandBuffer,
+			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit,
+			VK_FILTER_LINEAR);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		mipWidth = mipWidth == 1 ? mipWidth : mipWidth / 2;
+		mipHeight = mipHeight == 1 ? mipHeight : mipHeight / 2;
+	}
+
+	// The last level has only been written to.
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+}
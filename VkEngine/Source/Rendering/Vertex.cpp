@@ -1,5 +1,11 @@
 ﻿#include "pch.h"
 #include "Rendering/Vertex.h"
+#include <glm/gtc/packing.hpp>
+
+glm::vec3 Vertex::GetPosition() const
+{
+	return position;
+}
 
 VkVertexInputBindingDescription Vertex::GetBindingDescription()
 {
@@ -34,3 +40,64 @@ vi::Vector<VkVertexInputAttributeDescription> Vertex::GetAttributeDescriptions()
 
 	return attributeDescriptions;
 }
+
+QuantizedVertex QuantizedVertex::Quantize(const Vertex& vertex)
+{
+	QuantizedVertex quantized{};
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		quantized.position[i] = glm::packHalf1x16(vertex.position[i]);
+		const float normal = vi::Ut::Clamp(vertex.normal[i], -1.f, 1.f);
+		quantized.normal[i] = static_cast<int8_t>(std::round(normal * 127.f));
+	}
+	quantized.normal[3] = 0;
+
+	for (uint32_t i = 0; i < 2; ++i)
+		quantized.textureCoordinates[i] = glm::packHalf1x16(vertex.textureCoordinates[i]);
+	return quantized;
+}
+
+glm::vec3 QuantizedVertex::GetPosition() const
+{
+	return
+	{
+		glm::unpackHalf1x16(position[0]),
+		glm::unpackHalf1x16(position[1]),
+		glm::unpackHalf1x16(position[2])
+	};
+}
+
+VkVertexInputBindingDescription QuantizedVertex::GetBindingDescription()
+{
+	VkVertexInputBindingDescription bindingDescription{};
+	bindingDescription.binding = 0;
+	bindingDescription.stride = sizeof(QuantizedVertex);
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return bindingDescription;
+}
+
+vi::Vector<VkVertexInputAttributeDescription> QuantizedVertex::GetAttributeDescriptions()
+{
+	vi::Vector<VkVertexInputAttributeDescription> attributeDescriptions{ 3, GMEM_TEMP, 3 };
+
+	// The padding components are dropped, since the shader only reads three of them.
+	auto& position = attributeDescriptions[0];
+	position.binding = 0;
+	position.location = 0;
+	position.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	position.offset = offsetof(QuantizedVertex, position);
+
+	auto& normal = attributeDescriptions[1];
+	normal.binding = 0;
+	normal.location = 1;
+	normal.format = VK_FORMAT_R8G8B8A8_SNORM;
+	normal.offset = offsetof(QuantizedVertex, normal);
+
+	auto& texCoords = attributeDescriptions[2];
+	texCoords.binding = 0;
+	texCoords.location = 2;
+	texCoords.format = VK_FORMAT_R16G16_SFLOAT;
+	texCoords.offset = offsetof(QuantizedVertex, textureCoordinates);
+
+	return attributeDescriptions;
+}
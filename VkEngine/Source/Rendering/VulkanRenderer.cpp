@@ -1,27 +1,41 @@
 ﻿#include "pch.h"
 #include "VkRenderer/VkCore/VkCoreInfo.h"
+#include "Rendering/CommandRecorder.h"
 #include "Rendering/MeshHandler.h"
+#include "Rendering/PipelineCompiler.h"
+#include "Rendering/PipelineRegistry.h"
 #include "Rendering/PostEffectHandler.h"
 #include "Rendering/VulkanRenderer.h"
 #include "Rendering/TextureHandler.h"
 #include "Rendering/SwapChainExt.h"
+#include "Rendering/UploadQueue.h"
 
 VulkanRenderer::VulkanRenderer(vi::VkCoreInfo& info, const Info& addInfo) : VkCore(info)
 {
-	_meshHandler = GMEM.New<MeshHandler>(*this);
+	_uploadQueue = GMEM.New<UploadQueue>(*this, addInfo.uploadStagingCapacity);
+	_meshHandler = GMEM.New<MeshHandler>(*this, *_uploadQueue, addInfo.meshInfo);
 	_shaderExt = GMEM.New<ShaderExt>(*this);
-	_textureHandler = GMEM.New<TextureHandler>(*this);
+	_textureHandler = GMEM.New<TextureHandler>(*this, *_uploadQueue, addInfo.bindlessTextureCapacity);
 	_swapChainExt = GMEM.New<SwapChainExt>(*this);
 	_postEffectHandler = GMEM.New<PostEffectHandler>(*this, addInfo.msaaSamples);
+	_jobSystem = GMEM.New<JobSystem>(addInfo.workerCount);
+	_commandRecorder = GMEM.New<CommandRecorder>(*this, *_jobSystem);
+	_pipelineCompiler = GMEM.New<PipelineCompiler>(*this, addInfo.pipelineCompilerThreads);
+	_pipelineRegistry = GMEM.New<PipelineRegistry>(*this);
 }
 
 VulkanRenderer::~VulkanRenderer()
 {
+	GMEM.Delete(_pipelineRegistry);
+	GMEM.Delete(_pipelineCompiler);
+	GMEM.Delete(_commandRecorder);
+	GMEM.Delete(_jobSystem);
 	GMEM.Delete(_postEffectHandler);
 	GMEM.Delete(_textureHandler);
 	GMEM.Delete(_shaderExt);
 	GMEM.Delete(_meshHandler);
 	GMEM.Delete(_swapChainExt);
+	GMEM.Delete(_uploadQueue);
 }
 
 MeshHandler& VulkanRenderer::GetMeshHandler() const
@@ -48,3 +62,28 @@ PostEffectHandler& VulkanRenderer::GetPostEffectHandler() const
 {
 	return *_postEffectHandler;
 }
+
+JobSystem& VulkanRenderer::GetJobSystem() const
+{
+	return *_jobSystem;
+}
+
+CommandRecorder& VulkanRenderer::GetCommandRecorder() const
+{
+	return *_commandRecorder;
+}
+
+UploadQueue& VulkanRenderer::GetUploadQueue() const
+{
+	return *_uploadQueue;
+}
+
+PipelineCompiler& VulkanRenderer::GetPipelineCompiler() const
+{
+	return *_pipelineCompiler;
+}
+
+PipelineRegistry& VulkanRenderer::GetPipelineRegistry() const
+{
+	return *_pipelineRegistry;
+}
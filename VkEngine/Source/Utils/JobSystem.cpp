@@ -0,0 +1,118 @@
+﻿#include "pch.h"
+#include "Utils/JobSystem.h"
+
+thread_local uint32_t JobSystem::_threadIndex = 0;
+
+JobSystem::JobSystem(const uint32_t workerCount)
+{
+	const uint32_t concurrency = std::thread::hardware_concurrency();
+	const uint32_t count = vi::Ut::Min(workerCount, concurrency > 1 ? concurrency - 1 : 0);
+
+	if (count == 0)
+		return;
+
+	_workers = vi::ArrayPtr<std::thread*>{ count, GMEM };
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		// The dispatching thread has index 0.
+		uint32_t threadIndex = i + 1;
+		auto loop = &JobSystem::WorkerLoop;
+		auto self = this;
+		_workers[i] = GMEM.New<std::thread>(loop, self, threadIndex);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+
+	for (auto& worker : _workers)
+	{
+		worker->join();
+		GMEM.Delete(worker);
+	}
+	_workers.Free();
+}
+
+void JobSystem::Dispatch(const uint32_t count, const Job job, void* userPtr)
+{
+	if (count == 0)
+		return;
+
+	{
+		// Workers that are still in the previous job could otherwise take indices from this one before it is set up.
+		std::unique_lock<std::mutex> lock(_mutex);
+		_done.wait(lock, [this] { return _active == 0; });
+
+		_job = job;
+		_userPtr = userPtr;
+		_remaining = count;
+		_count = count;
+		_next = 0;
+		++_generation;
+	}
+	_wake.notify_all();
+
+	Work();
+
+	// Wait for the workers to finish the indices they took.
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this] { return _remaining == 0; });
+}
+
+uint32_t JobSystem::GetThreadCount() const
+{
+	return _workers.GetLength() + 1;
+}
+
+uint32_t JobSystem::GetThreadIndex()
+{
+	return _threadIndex;
+}
+
+void JobSystem::WorkerLoop(const uint32_t threadIndex)
+{
+	_threadIndex = threadIndex;
+
+	uint32_t generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this, generation] { return _quit || _generation != generation; });
+			if (_quit)
+				return;
+			generation = _generation;
+			++_active;
+		}
+
+		Work();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--_active == 0)
+			_done.notify_all();
+	}
+}
+
+void JobSystem::Work()
+{
+	while (true)
+	{
+		const uint32_t index = _next++;
+		if (index >= _count)
+			return;
+
+		_job(index, _userPtr);
+
+		// The last index to finish wakes up the dispatching thread.
+		if (--_remaining == 0)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_done.notify_all();
+		}
+	}
+}
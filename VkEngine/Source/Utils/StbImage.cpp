@@ -0,0 +1,5 @@
+﻿#include "pch.h"
+
+// The image decoder is compiled in its own translation unit, since both the texture handler and the texture cooker use it.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
@@ -0,0 +1,32 @@
+﻿#include "pch.h"
+#include "Tests.h"
+
+// Every test runs on its own data, and the exit code fails the build when any of the checks failed.
+
+namespace
+{
+	uint32_t failures = 0;
+}
+
+void Check(const bool condition, const char* message)
+{
+	if (condition)
+		return;
+	std::cerr << "Failed: " << message << std::endl;
+	++failures;
+}
+
+int main()
+{
+	TestTextureCooker();
+	TestMeshOptimizer();
+
+	if (failures > 0)
+	{
+		std::cerr << failures << " checks failed." << std::endl;
+		return 1;
+	}
+
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}
@@ -0,0 +1,91 @@
+﻿#include "pch.h"
+#include "Rendering/MeshOptimizer.h"
+#include "Tests.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+// Optimizes a grid with shuffled triangles, which simulates a mesh that was exported in an unfavourable order.
+
+namespace
+{
+	// Large enough for the vertices to exceed a single block of the temporary allocator.
+	constexpr uint32_t RESOLUTION = 64;
+
+	// Rolling terrain, so that the triangles face different directions and can be simplified.
+	// Every triangle has its own vertices, so that the deduplication has something to merge.
+	MeshHandler::VertexData<Vertex, uint32_t> GenerateGrid()
+	{
+		constexpr uint32_t rowLength = RESOLUTION + 1;
+		constexpr uint32_t triangleCount = RESOLUTION * RESOLUTION * 2;
+
+		uint32_t order[triangleCount];
+		std::iota(order, order + triangleCount, 0);
+		std::shuffle(order, order + triangleCount, std::mt19937(1337));
+
+		MeshHandler::VertexData<Vertex, uint32_t> grid{};
+		grid.vertices = vi::ArrayPtr<Vertex>(triangleCount * 3, GMEM_TEMP);
+		grid.indices = vi::ArrayPtr<uint32_t>(triangleCount * 3, GMEM_TEMP);
+
+		for (uint32_t i = 0; i < triangleCount; ++i)
+		{
+			const uint32_t quad = order[i] / 2;
+			const uint32_t x = quad % RESOLUTION;
+			const uint32_t y = quad / RESOLUTION;
+			const uint32_t corner = y * rowLength + x;
+			const uint32_t quadCorners[6]{ corner, corner + rowLength, corner + rowLength + 1, corner, corner + rowLength + 1, corner + 1 };
+
+			for (uint32_t j = 0; j < 3; ++j)
+			{
+				const uint32_t gridIndex = quadCorners[order[i] % 2 * 3 + j];
+				const auto fX = static_cast<float>(gridIndex % rowLength);
+				const auto fY = static_cast<float>(gridIndex / rowLength);
+
+				auto& vertex = grid.vertices[i * 3 + j];
+				vertex.position = { fX, sin(fX * .4f) * cos(fY * .4f) * 4, fY };
+				vertex.textureCoordinates = { fX / RESOLUTION, fY / RESOLUTION };
+				grid.indices[i * 3 + j] = i * 3 + j;
+			}
+		}
+
+		return grid;
+	}
+}
+
+void TestMeshOptimizer()
+{
+	const auto grid = GenerateGrid();
+	const auto vertexCount = static_cast<uint32_t>(grid.vertices.GetLength());
+	const auto indexCount = static_cast<uint32_t>(grid.indices.GetLength());
+
+	MeshOptimizer::Info info{};
+	info.lodCount = Mesh::MAX_LODS;
+	MeshOptimizer::Stats stats{};
+	const auto optimized = MeshOptimizer::Optimize(grid, info, &stats);
+
+	Check(stats.acmrBefore == MeshOptimizer::CalculateAcmr(grid.indices.GetData(), indexCount, vertexCount), 
+		"cache miss ratio before is measured on the source");
+	Check(stats.acmrAfter < stats.acmrBefore, "cache miss ratio decreases");
+	Check(stats.vertexCountBefore == vertexCount, "vertex count before matches the source");
+	Check(stats.vertexCountAfter == (RESOLUTION + 1) * (RESOLUTION + 1), "duplicate vertices are merged");
+	Check(optimized.vertices.GetLength() == stats.vertexCountAfter, "vertex count after matches the output");
+
+	Check(stats.lodCount > 1, "levels of detail are generated");
+	Check(stats.lodIndexCounts[0] == indexCount, "first level of detail keeps every triangle");
+	uint32_t lodIndexCount = 0;
+	for (uint32_t i = 0; i < stats.lodCount; ++i)
+	{
+		Check(stats.lodIndexCounts[i] % 3 == 0, "level of detail contains whole triangles");
+		if (i > 0)
+			Check(stats.lodIndexCounts[i] < stats.lodIndexCounts[i - 1], "level of detail index count shrinks");
+		lodIndexCount += stats.lodIndexCounts[i];
+	}
+	Check(optimized.indices.GetLength() == lodIndexCount, "levels of detail are stored back to back");
+	Check(optimized.lods.GetLength() == stats.lodCount, "level of detail counts are returned");
+
+	// Both the deduplication and the fetch order remap the indices.
+	bool inRange = true;
+	for (const auto index : optimized.indices)
+		inRange = inRange && index < optimized.vertices.GetLength();
+	Check(inRange, "every index points to a vertex");
+}
@@ -0,0 +1,9 @@
+﻿#pragma once
+
+// Counts a failed check and writes its message, so that the remaining checks still run.
+void Check(bool condition, const char* message);
+
+// Round trip test for the cooked texture container.
+void TestTextureCooker();
+// Checks the vertex cache, levels of detail and vertex remapping of the mesh optimizer.
+void TestMeshOptimizer();
@@ -0,0 +1,182 @@
+﻿#include "pch.h"
+#include "Rendering/TextureCooker.h"
+#include "Tests.h"
+
+// Cooks generated images, validates them and compares the levels against the source pixels.
+
+namespace
+{
+	// Deliberately not a multiple of the block size or a power of two, so that the edge blocks and the odd mip sizes are covered.
+	constexpr uint32_t WIDTH = 18;
+	constexpr uint32_t HEIGHT = 10;
+	constexpr uint32_t CHANNELS = 3;
+
+	// Expands a 5 or 6 bit channel the same way the hardware does, so that the generated colors survive BC1 exactly.
+	unsigned char Expand(const uint32_t value, const uint32_t bits)
+	{
+		return static_cast<unsigned char>(value << (8 - bits) | value >> (2 * bits - 8));
+	}
+
+	// Every 4x4 block has a single color, and some of them are partially transparent.
+	vi::ArrayPtr<unsigned char> GenerateImage()
+	{
+		vi::ArrayPtr<unsigned char> pixels{ WIDTH * HEIGHT * 4, GMEM_TEMP };
+		for (uint32_t y = 0; y < HEIGHT; ++y)
+			for (uint32_t x = 0; x < WIDTH; ++x)
+			{
+				const uint32_t block = y / 4 * 5 + x / 4;
+				const auto pixel = &pixels[(y * WIDTH + x) * 4];
+				pixel[0] = Expand(block * 7 % 32, 5);
+				pixel[1] = Expand(block * 13 % 64, 6);
+				pixel[2] = Expand(31 - block % 32, 5);
+				pixel[3] = block % 4 == 3 && x % 2 == 0 ? 0 : 255;
+			}
+		return pixels;
+	}
+
+	// Reference BC1 decoder, independent from the encoder.
+	void DecodeBc1Block(const unsigned char* block, unsigned char* outPixels)
+	{
+		const uint16_t color0 = static_cast<uint16_t>(block[0] | block[1] << 8);
+		const uint16_t color1 = static_cast<uint16_t>(block[2] | block[3] << 8);
+		const uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | static_cast<uint32_t>(block[7]) << 24;
+
+		unsigned char palette[4][4]{};
+		const uint16_t colors[2]{ color0, color1 };
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			palette[i][0] = Expand(colors[i] >> 11 & 31, 5);
+			palette[i][1] = Expand(colors[i] >> 5 & 63, 6);
+			palette[i][2] = Expand(colors[i] & 31, 5);
+			palette[i][3] = 255;
+		}
+		for (uint32_t c = 0; c < 3; ++c)
+			if (color0 > color1)
+			{
+				palette[2][c] = static_cast<unsigned char>((2 * palette[0][c] + palette[1][c]) / 3);
+				palette[3][c] = static_cast<unsigned char>((palette[0][c] + 2 * palette[1][c]) / 3);
+			}
+			else
+				palette[2][c] = static_cast<unsigned char>((palette[0][c] + palette[1][c]) / 2);
+		palette[2][3] = 255;
+		palette[3][3] = color0 > color1 ? 255 : 0;
+
+		for (uint32_t i = 0; i < 16; ++i)
+			memcpy(&outPixels[i * 4], palette[indices >> i * 2 & 3], 4);
+	}
+
+	const TextureCooker::Header* CookAndValidate(const vi::ArrayPtr<unsigned char>& pixels,
+		const TextureCooker::Compression compression, vi::ArrayPtr<unsigned char>& outFile)
+	{
+		outFile = TextureCooker::CookPixels(pixels.GetData(), WIDTH, HEIGHT, CHANNELS, compression);
+		const auto header = TextureCooker::Validate(outFile.GetData(), outFile.GetLength());
+		Check(header, "cooked container is valid");
+		if (!header)
+			return nullptr;
+
+		Check(header->compression == compression, "compression is stored");
+		Check(header->width == WIDTH && header->height == HEIGHT, "resolution is stored");
+		Check(header->channels == CHANNELS, "channels are stored");
+
+		// 18 x 10, 9 x 5, 4 x 2, 2 x 1, 1 x 1.
+		Check(header->mipLevels == 5, "mip level count matches the runtime generation");
+		for (uint32_t i = 0; i < header->mipLevels; ++i)
+		{
+			const auto& level = header->levels[i];
+			const uint32_t width = vi::Ut::Max(1u, WIDTH >> i);
+			const uint32_t height = vi::Ut::Max(1u, HEIGHT >> i);
+			Check(level.size == TextureCooker::GetLevelSize(compression, width, height), "mip level size matches its resolution");
+			Check(level.offset % TextureCooker::LEVEL_ALIGNMENT == 0, "mip level is aligned");
+			if (i > 0)
+				Check(level.offset >= header->levels[i - 1].offset + header->levels[i - 1].size, "mip levels don't overlap");
+		}
+		return header;
+	}
+
+	void TestUncompressed(const vi::ArrayPtr<unsigned char>& pixels)
+	{
+		vi::ArrayPtr<unsigned char> file{};
+		const auto header = CookAndValidate(pixels, TextureCooker::Compression::none, file);
+		if (!header)
+			return;
+
+		const auto level = file.GetData() + header->levels[0].offset;
+		Check(memcmp(level, pixels.GetData(), pixels.GetLength()) == 0, "uncompressed level 0 equals the source");
+	}
+
+	void TestBc1(const vi::ArrayPtr<unsigned char>& pixels)
+	{
+		vi::ArrayPtr<unsigned char> file{};
+		const auto header = CookAndValidate(pixels, TextureCooker::Compression::bc1, file);
+		if (!header)
+			return;
+
+		const auto level = file.GetData() + header->levels[0].offset;
+		unsigned char decoded[16 * 4];
+		bool equal = true;
+
+		for (uint32_t by = 0; by < (HEIGHT + 3) / 4; ++by)
+			for (uint32_t bx = 0; bx < (WIDTH + 3) / 4; ++bx)
+			{
+				DecodeBc1Block(&level[(by * ((WIDTH + 3) / 4) + bx) * 8], decoded);
+
+				// Pixels outside of the image aren't compared.
+				for (uint32_t y = 0; y < 4 && by * 4 + y < HEIGHT; ++y)
+					for (uint32_t x = 0; x < 4 && bx * 4 + x < WIDTH; ++x)
+					{
+						const auto src = &pixels[((by * 4 + y) * WIDTH + bx * 4 + x) * 4];
+						const auto dst = &decoded[(y * 4 + x) * 4];
+						// Transparent pixels only have to stay transparent.
+						if (src[3] < 128)
+							equal = equal && dst[3] == 0;
+						else
+							equal = equal && memcmp(src, dst, 4) == 0;
+					}
+			}
+
+		Check(equal, "BC1 blocks decode to the source colors");
+	}
+
+	void TestValidation(const vi::ArrayPtr<unsigned char>& pixels)
+	{
+		auto file = TextureCooker::CookPixels(pixels.GetData(), WIDTH, HEIGHT, CHANNELS, TextureCooker::Compression::none);
+
+		Check(!TextureCooker::Validate(file.GetData(), sizeof(TextureCooker::Header) - 1), "truncated header is rejected");
+		// The file is padded after the last level, so cut into the level itself.
+		const auto& last = reinterpret_cast<const TextureCooker::Header*>(file.GetData())->levels[4];
+		Check(!TextureCooker::Validate(file.GetData(), last.offset + last.size - 1), "truncated level is rejected");
+
+		vi::ArrayPtr<unsigned char> stale{ file, GMEM_TEMP };
+		reinterpret_cast<TextureCooker::Header*>(stale.GetData())->version = TextureCooker::VERSION + 1;
+		Check(!TextureCooker::Validate(stale.GetData(), stale.GetLength()), "other version is rejected");
+
+		vi::ArrayPtr<unsigned char> unknown{ file, GMEM_TEMP };
+		reinterpret_cast<TextureCooker::Header*>(unknown.GetData())->compression = static_cast<TextureCooker::Compression>(2);
+		Check(!TextureCooker::Validate(unknown.GetData(), unknown.GetLength()), "unknown compression is rejected");
+
+		vi::ArrayPtr<unsigned char> empty{ file, GMEM_TEMP };
+		reinterpret_cast<TextureCooker::Header*>(empty.GetData())->height = 0;
+		Check(!TextureCooker::Validate(empty.GetData(), empty.GetLength()), "zero resolution is rejected");
+
+		vi::ArrayPtr<unsigned char> tooManyLevels{ file, GMEM_TEMP };
+		reinterpret_cast<TextureCooker::Header*>(tooManyLevels.GetData())->mipLevels = 6;
+		Check(!TextureCooker::Validate(tooManyLevels.GetData(), tooManyLevels.GetLength()), "more levels than the resolution allows are rejected");
+
+		vi::ArrayPtr<unsigned char> wrongSize{ file, GMEM_TEMP };
+		reinterpret_cast<TextureCooker::Header*>(wrongSize.GetData())->levels[1].size -= 4;
+		Check(!TextureCooker::Validate(wrongSize.GetData(), wrongSize.GetLength()), "level size that doesn't match its resolution is rejected");
+
+		// The sum wraps around to a small number, so a naive bounds check would accept it.
+		vi::ArrayPtr<unsigned char> overflow{ file, GMEM_TEMP };
+		reinterpret_cast<TextureCooker::Header*>(overflow.GetData())->levels[0].offset = UINT64_MAX - TextureCooker::LEVEL_ALIGNMENT + 1;
+		Check(!TextureCooker::Validate(overflow.GetData(), overflow.GetLength()), "level offset that overflows is rejected");
+	}
+}
+
+void TestTextureCooker()
+{
+	const auto pixels = GenerateImage();
+	TestUncompressed(pixels);
+	TestBc1(pixels);
+	TestValidation(pixels);
+}
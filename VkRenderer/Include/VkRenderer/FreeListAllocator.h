@@ -8,7 +8,8 @@ namespace vi
 	class FreeListAllocator final
 	{
 	public:
-		/// <param name="capacity">Capacity per block. Allocator will create multiple blocks if memory runs out.</param>
+		/// <param name="capacity">Capacity per block. Allocator will create multiple blocks if memory runs out.<br>
+		/// Larger allocations get a block of their own, which is deleted when they are freed.</param>
 		explicit FreeListAllocator(size_t capacity);
 		~FreeListAllocator();
 
@@ -45,6 +46,8 @@ namespace vi
 			size_t* next;
 			// Linked list.
 			Block* child = nullptr;
+			// Holds a single allocation that is larger than the capacity.
+			bool dedicated = false;
 
 			explicit Block(size_t capacity);
 			~Block();
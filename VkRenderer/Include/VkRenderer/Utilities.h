@@ -34,6 +34,12 @@ namespace vi
 		template <typename T>
 		[[nodiscard]] static T Abs(const T& t);
 
+		/// <summary>
+		/// Rounds value t up to the nearest multiple of the alignment.
+		/// </summary>
+		template <typename T>
+		[[nodiscard]] static T Align(const T& t, const T& alignment);
+
 		[[nodiscard]] static glm::vec2 RotateDegrees(glm::vec2 v, float degrees);
 
 		[[nodiscard]] static glm::vec2 RotateRadians(glm::vec2 v, const float radians);
@@ -107,6 +113,12 @@ namespace vi
 		return t > 0 ? t : t * -1;
 	}
 
+	template <typename T>
+	T Ut::Align(const T& t, const T& alignment)
+	{
+		return (t + alignment - 1) / alignment * alignment;
+	}
+
 	template <typename T, typename U>
 	void Ut::LinSort(T* arr, U* comparables, const size_t from, const size_t to)
 	{
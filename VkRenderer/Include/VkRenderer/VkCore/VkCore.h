@@ -12,6 +12,7 @@ namespace vi
 	class VkCommandBufferHandler;
 	class VkDescriptorPoolHandler;
 	class VkFrameBufferHandler;
+	class VkGpuAllocator;
 	class VkImageHandler;
 	class VkLayoutHandler;
 	class VkMemoryHandler;
@@ -41,6 +42,16 @@ namespace vi
 		[[nodiscard]] VkDevice GetLogicalDevice() const;
 		[[nodiscard]] Queues GetQueues() const;
 		[[nodiscard]] VkCommandPool GetCommandPool() const;
+		/// <returns>If VK_EXT_descriptor_indexing has been enabled on the logical device.</returns>
+		[[nodiscard]] bool IsDescriptorIndexingEnabled() const;
+		/// <returns>If multi draw indirect has been enabled on the logical device.</returns>
+		[[nodiscard]] bool IsIndirectDrawingEnabled() const;
+		/// <returns>If VK_KHR_draw_indirect_count has been enabled on the logical device.</returns>
+		[[nodiscard]] bool IsDrawIndirectCountEnabled() const;
+		/// <returns>If VK_KHR_multiview has been enabled on the logical device.</returns>
+		[[nodiscard]] bool IsMultiviewEnabled() const;
+		/// <returns>If VK_EXT_shader_viewport_index_layer has been enabled on the logical device.</returns>
+		[[nodiscard]] bool IsViewportLayerEnabled() const;
 
 		[[nodiscard]] WindowHandler& GetWindowHandler() const;
 		[[nodiscard]] VkCoreSwapchain& GetSwapChain() const;
@@ -48,6 +59,7 @@ namespace vi
 		[[nodiscard]] VkCommandBufferHandler& GetCommandBufferHandler() const;
 		[[nodiscard]] VkDescriptorPoolHandler& GetDescriptorPoolHandler() const;
 		[[nodiscard]] VkFrameBufferHandler& GetFrameBufferHandler() const;
+		[[nodiscard]] VkGpuAllocator& GetGpuAllocator() const;
 		[[nodiscard]] VkImageHandler& GetImageHandler() const;
 		[[nodiscard]] VkLayoutHandler& GetLayoutHandler() const;
 		[[nodiscard]] VkMemoryHandler& GetMemoryHandler() const;
@@ -59,6 +71,11 @@ namespace vi
 	private:
 		WindowHandler* _windowHandler;
 		VkSurfaceKHR _surface;
+		bool _descriptorIndexing;
+		bool _indirectDrawing;
+		bool _drawIndirectCount = false;
+		bool _multiview = false;
+		bool _viewportLayer = false;
 
 		VkCoreDebugger* _debugger;
 		VkCoreInstance* _instance;
@@ -70,6 +87,7 @@ namespace vi
 		VkCommandBufferHandler* _commandBufferHandler;
 		VkDescriptorPoolHandler* _descriptorPoolHandler;
 		VkFrameBufferHandler* _frameBufferHandler;
+		VkGpuAllocator* _gpuAllocator;
 		VkImageHandler* _imageHandler;
 		VkLayoutHandler* _layoutHandler;
 		VkMemoryHandler* _memoryHandler;
@@ -17,5 +17,25 @@ namespace vi
 		Vector<const char*> validationLayers{ 1, GMEM_TEMP };
 		// Optional extensions for the vulkan instance.
 		Vector<const char*> instanceExtensions{ 0, GMEM_TEMP };
+		// Enables the VK_EXT_descriptor_indexing features that are required for bindless descriptor arrays.
+		// The extension itself is always enabled, since the shadow maps are indexed non-uniformly.
+		bool descriptorIndexing = false;
+		// Enables multi draw indirect and non-zero first instances, which are required for GPU driven rendering.
+		// VK_KHR_draw_indirect_count is enabled as well if the device supports it.
+		bool indirectDrawing = false;
+		// Enables VK_KHR_multiview, or VK_EXT_shader_viewport_index_layer if multiview is not supported.
+		// Both are optional, and allow rendering to multiple image layers without a geometry shader.
+		bool layeredRendering = false;
+		// Size of the GPU memory blocks that buffers and images are sub-allocated from.
+		VkDeviceSize memoryBlockSize = 64 * 1024 * 1024;
+		// Smallest range of GPU memory that can be sub-allocated. Lower values require more bookkeeping per block.
+		VkDeviceSize minMemoryAllocationSize = 4096;
+		// Amount of frames the CPU can prepare while the GPU is still busy, usually 2 or 3.
+		// Per-frame resources scale with this instead of with the amount of swap chain images.
+		// More frames improve throughput at the cost of latency.
+		uint32_t framesInFlight = 2;
+		// File that the pipeline cache is loaded from on startup and saved to on shutdown, so that pipelines only compile once.
+		// Has to outlive the core. Set to nullptr to only keep the cache in memory.
+		const char* pipelineCachePath = "pipelines.cache";
 	};
 }
\ No newline at end of file
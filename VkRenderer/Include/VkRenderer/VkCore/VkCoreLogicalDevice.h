@@ -17,8 +17,10 @@ namespace vi
 			{
 				VkQueue graphics;
 				VkQueue present;
+				// Same as the graphics queue if the hardware doesn't have a dedicated transfer family.
+				VkQueue transfer;
 			};
-			VkQueue values[2];
+			VkQueue values[3];
 		};
 	};
 
@@ -25,10 +25,13 @@ namespace vi
 				{
 					uint32_t graphics;
 					uint32_t present;
+					// Dedicated transfer family if the hardware has one, otherwise the graphics family.
+					uint32_t transfer;
 				};
 
-				uint32_t values[2]
+				uint32_t values[3]
 				{
+					UINT32_MAX,
 					UINT32_MAX,
 					UINT32_MAX
 				};
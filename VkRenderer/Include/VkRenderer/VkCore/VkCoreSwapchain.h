@@ -1,4 +1,6 @@
 ﻿#pragma once
+#include "../VkHandlers/VkGpuAllocator.h"
+#include "../VkHandlers/CommandContext.h"
 
 namespace vi
 {
@@ -16,6 +18,9 @@ namespace vi
 		friend VkCore;
 		friend VkCorePhysicalDevice;
 
+		// Maximum amount of command buffers that can be handed out per frame.
+		static constexpr uint32_t MAX_FRAME_COMMAND_BUFFERS = 16;
+
 		explicit VkCoreSwapchain(VkCore& core);
 
 		/// <summary>
@@ -25,9 +30,19 @@ namespace vi
 		/// Useful for when you want to do some rendering before actually drawing to the swap chain image.</param>
 		void BeginFrame(bool callWaitForImage = true);
 		/// <summary>
-		/// Call this at the end of the frame.
+		/// Call this at the end of the frame. Submits all the enqueued command buffers alongside the swap chain's own.
+		/// </summary>
+		void EndFrame();
+		/// <summary>
+		/// Adds a recorded command buffer to this frame's submission, so that the entire frame only needs a single submit.<br>
+		/// Command buffers execute in the order they have been enqueued. Use pipeline barriers to synchronize them.
+		/// </summary>
+		void Enqueue(VkCommandBuffer commandBuffer);
+		/// <summary>
+		/// Hands out a primary command buffer that can be recorded once during the current frame.<br>
+		/// Every frame in flight has its own transient pool, which is reset in bulk once the frame is reused.
 		/// </summary>
-		void EndFrame(VkSemaphore overrideWaitSemaphore = VK_NULL_HANDLE);
+		[[nodiscard]] VkCommandBuffer AllocateCommandBuffer();
 
 		/// <summary>
 		/// Waits until a new image target is available. Called by BeginFrame by default.
@@ -38,10 +53,14 @@ namespace vi
 		/// </summary>
 		void Reconstruct();
 
-		/// <returns>Amount of images in the swap chain.</returns>
+		/// <returns>Amount of images in the swap chain. Per-frame resources should use the frame count instead.</returns>
 		[[nodiscard]] uint32_t GetLength() const;
 		/// <returns>Current image count.</returns>
 		[[nodiscard]] uint32_t GetImageIndex() const;
+		/// <returns>Amount of frames that can be in flight.</returns>
+		[[nodiscard]] uint32_t GetFrameCount() const;
+		/// <returns>Index of the current frame in flight, which is safe to reuse the resources of after WaitForImage.</returns>
+		[[nodiscard]] uint32_t GetFrameIndex() const;
 		/// <returns>Resolution of the images.</returns>
 		[[nodiscard]] glm::ivec2 GetExtent() const;
 		/// <returns>Depth buffer image format.</returns>
@@ -50,13 +69,13 @@ namespace vi
 		[[nodiscard]] VkFormat GetFormat() const;
 		/// <returns>Render pass in use by the swapchain.</returns>
 		[[nodiscard]] VkRenderPass GetRenderPass() const;
+		/// <returns>Recording of the swap chain's own command buffer. Only valid between BeginFrame and EndFrame.</returns>
+		[[nodiscard]] CommandContext& GetContext();
 		/// <returns>If the current render assets are outdated by the swapchain.</returns>
 		[[nodiscard]] VkSemaphore GetImageAvaiableSemaphore() const;
 		[[nodiscard]] bool GetShouldRecreateAssets() const;
 
 	private:
-#define _MAX_FRAMES_IN_FLIGHT 3
-
 		/// <summary>
 		/// Contains the details to create the swap chain with.
 		/// </summary>
@@ -96,12 +115,10 @@ namespace vi
 			VkImage image;
 			// Depth image.
 			VkImage depthImage;
-			VkDeviceMemory depthImageMemory;
+			VkGpuAllocator::Allocation depthImageMemory;
 
 			// Render target.
 			VkFramebuffer frameBuffer;
-			// Reusable command buffer for the drawing operation.
-			VkCommandBuffer commandBuffer;
 		};
 
 		/// <summary>
@@ -115,12 +132,25 @@ namespace vi
 			VkSemaphore renderFinishedSemaphore;
 			// Triggers once the image is no longer in flight.
 			VkFence inFlightFence;
+			// Command buffer for the drawing operation.
+			VkCommandBuffer commandBuffer;
+
+			// Transient pool that is reset as a whole, without releasing its memory, so that the next recordings can reuse it.
+			VkCommandPool commandPool;
+			// Command buffers allocated from the pool, which are handed out linearly.
+			VkCommandBuffer commandBuffers[MAX_FRAME_COMMAND_BUFFERS];
+			// Amount of command buffers that have been allocated, and the amount handed out this frame.
+			uint32_t commandBufferCount;
+			uint32_t usedCommandBufferCount;
 		};
 
 		VkCore& _core;
 
 		ArrayPtr<Image> _images;
 		ArrayPtr<Frame> _frames;
+		CommandContext _context{};
+		// Command buffers that will be submitted at the end of the frame.
+		Vector<VkCommandBuffer> _queue{ 8, GMEM };
 		// Fences for the images that are currently in flight. fences can be null.
 		ArrayPtr<VkFence> _inFlight;
 
@@ -142,7 +172,7 @@ namespace vi
 		// Is true if the swapchain is no longer the correct shape, like when the window has been resized.
 		VkResult _shouldRecreateAssets;
 
-		void Construct();
+		void Construct(uint32_t framesInFlight);
 		void Cleanup() const;
 		void IntReconstruct(bool executeCleanup = true);
 
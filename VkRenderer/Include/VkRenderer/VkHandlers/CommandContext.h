@@ -0,0 +1,27 @@
+﻿#pragma once
+
+namespace vi
+{
+	/// <summary>
+	/// State of a single command buffer recording, which every recording command takes explicitly.<br>
+	/// Contexts aren't shared, so every thread can record its own command buffer without synchronization.<br>
+	/// The bound state is reset when the recording begins, since command buffers don't inherit it from each other.
+	/// </summary>
+	struct CommandContext final
+	{
+		VkCommandBuffer buffer = VK_NULL_HANDLE;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+		// Bound geometry buffers, so that redundant binds can be skipped.
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+		// Range of the bound index buffer that the next mesh draw uses.
+		uint32_t indexCount = UINT32_MAX;
+		uint32_t firstIndex = 0;
+		int32_t vertexOffset = 0;
+	};
+}
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "VkHandler.h"
+#include "CommandContext.h"
 
 namespace vi
 {
@@ -18,26 +19,48 @@ namespace vi
 			uint32_t buffersCount;
 
 			VkSemaphore waitSemaphore = VK_NULL_HANDLE;
+			// Pipeline stage at which the wait semaphore has to be signaled.
+			VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 			VkSemaphore signalSemaphore = VK_NULL_HANDLE;
 			VkFence fence = VK_NULL_HANDLE;
+			// Queue to submit to. Uses the graphics queue by default.
+			VkQueue queue = VK_NULL_HANDLE;
 		};
 
 		explicit VkCommandBufferHandler(VkCore& core);
 
 		/// <returns>Handle that can be used to record and execute render commands, like drawing.</returns>
-		[[nodiscard]] VkCommandBuffer Create() const;
-		/// <returns>Override recording for target command buffer.</returns>
-		void BeginRecording(VkCommandBuffer commandBuffer);
-		/// <returns>End recording for current command buffer.</returns>
-		void EndRecording();
-		void Destroy(VkCommandBuffer commandBuffer) const;
-		/// <returns>Get the command buffer that is currently being recorded.</returns>
-		[[nodiscard]] VkCommandBuffer GetCurrent() const;
+		/// <param name="pool">Pool to allocate from. Uses the core command pool by default, which should only be used from the main thread.</param>
+		/// <param name="secondary">Secondary command buffers can be recorded on other threads and executed from a primary command buffer.</param>
+		[[nodiscard]] VkCommandBuffer Create(VkCommandPool pool = VK_NULL_HANDLE, bool secondary = false) const;
+		/// <summary>
+		/// Begins recording the command buffer into the context, which is then passed to every command that is recorded.<br>
+		/// Every thread has to record into its own context, but multiple contexts can be recorded on the same thread at once.<br>
+		/// Command buffers are not reset individually, so they either have to be new or come from a pool that has been reset.<br>
+		/// Secondary command buffers need the inheritance info, after which they continue the render pass that is active in the primary command buffer.
+		/// </summary>
+		void BeginRecording(CommandContext& context, VkCommandBuffer commandBuffer, 
+			const VkCommandBufferInheritanceInfo* inheritance = nullptr) const;
+		// Ends recording the command buffer of the context.
+		void EndRecording(CommandContext& context) const;
+		void Destroy(VkCommandBuffer commandBuffer, VkCommandPool pool = VK_NULL_HANDLE) const;
+
+		/// <returns>Command pool that can be used by a single thread, for short lived command buffers that are reset together.</returns>
+		/// <param name="queueFamily">Family of the queue the command buffers are submitted to. Uses the graphics family by default.</param>
+		[[nodiscard]] VkCommandPool CreatePool(uint32_t queueFamily = UINT32_MAX) const;
+		// Resets all the command buffers allocated from the pool. Their memory is kept, so that the next recordings can reuse it.
+		void ResetPool(VkCommandPool pool) const;
+		void DestroyPool(VkCommandPool pool) const;
+		// Executes secondary command buffers from the primary command buffer of the context.
+		void Execute(const CommandContext& context, const VkCommandBuffer* buffers, uint32_t count) const;
 
 		/// <returns>Submit any number of command buffers to be executed.</returns>
 		void Submit(const SubmitInfo& info) const;
-
-	private:
-		VkCommandBuffer _current = VK_NULL_HANDLE;
+		/// <summary>
+		/// Records a global memory barrier in the command buffer of the context.<br>
+		/// Commands submitted to the same queue are ordered, so this also synchronizes with later command buffers in the same submit.
+		/// </summary>
+		void Barrier(const CommandContext& context, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, 
+			VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) const;
 	};
 }
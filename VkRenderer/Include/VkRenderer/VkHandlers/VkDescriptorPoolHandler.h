@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "VkHandler.h"
+#include "CommandContext.h"
 
 namespace vi
 {
@@ -19,6 +20,8 @@ namespace vi
 			// The amount of each type of buffer present in the pool.
 			const uint32_t* capacities;
 			uint32_t typeCount;
+			// Pool flags, like update after bind.
+			VkDescriptorPoolCreateFlags flags = 0;
 		};
 
 		/// <summary>
@@ -41,10 +44,13 @@ namespace vi
 		[[nodiscard]] VkDescriptorPool Create(const PoolCreateInfo& info) const;
 		void CreateSets(const SetCreateInfo& info) const;
 		/// <summary>
-		/// Binds any number of sets (soft cap on most hardware is 4) to be used to forward data to the GPU.
+		/// Binds any number of sets (soft cap on most hardware is 4) to be used to forward data to the GPU.<br>
+		/// The sets are bound to the pipeline that was last bound to the context.
 		/// </summary>
 		/// <param name="sets">Sets which to bind.</param>
-		void BindSets(VkDescriptorSet* sets, uint32_t setCount) const;
+		/// <param name="dynamicOffsets">Offsets for the dynamic buffers in the sets, in binding order.</param>
+		void BindSets(const CommandContext& context, VkDescriptorSet* sets, uint32_t setCount, 
+			const uint32_t* dynamicOffsets = nullptr, uint32_t dynamicOffsetCount = 0) const;
 		void Destroy(VkDescriptorPool pool) const;
 	};
 }
@@ -0,0 +1,142 @@
+﻿#pragma once
+#include "VkHandler.h"
+
+namespace vi
+{
+	class VkCore;
+
+	/// <summary>
+	/// Sub-allocates GPU memory from large blocks, so that not every buffer and image needs its own vkAllocateMemory call.<br>
+	/// Blocks are partitioned with a buddy allocator and pooled per memory type and per resource tiling.<br>
+	/// Since linear and optimal resources never share a block, bufferImageGranularity never has to be padded for.
+	/// </summary>
+	class VkGpuAllocator final : public VkHandler
+	{
+		struct Block;
+
+	public:
+		/// <summary>
+		/// Range of GPU memory handed out by the allocator.
+		/// </summary>
+		struct Allocation final
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0;
+			VkDeviceSize size = 0;
+			// Points to the start of the range if the memory is host visible.
+			void* mapped = nullptr;
+
+		private:
+			friend VkGpuAllocator;
+
+			// Block this range is part of. Nullptr if the allocation has its own memory.
+			Block* _block = nullptr;
+			// Buddy order of the range.
+			uint32_t _order = 0;
+		};
+
+		/// <summary>
+		/// Overview of the GPU memory usage, useful for debugging purposes.
+		/// </summary>
+		struct Stats final
+		{
+			// Amount of blocks that are being sub-allocated from.
+			uint32_t blockCount = 0;
+			// Amount of resources that were too large for a block and got their own memory.
+			uint32_t dedicatedCount = 0;
+			// Amount of live allocations, including the dedicated ones.
+			uint32_t allocationCount = 0;
+			// Total amount of memory allocated from the GPU.
+			VkDeviceSize reserved = 0;
+			// Total amount of memory handed out to resources, including buddy padding.
+			VkDeviceSize used = 0;
+			// Largest range that can still be handed out without creating a new block.
+			VkDeviceSize largestFreeRange = 0;
+		};
+
+		/// <summary>
+		/// Called when an allocation can be moved to a fuller block during defragmentation.<br>
+		/// Copy the resource to the destination range and rebind it, or return false to leave it where it is.
+		/// </summary>
+		typedef bool (*MoveCallback)(const Allocation& src, const Allocation& dst, void* userPtr);
+
+		/// <param name="blockSize">Size of a single block. Has to be a power of two multiple of the minimum allocation size.</param>
+		/// <param name="minAllocationSize">Smallest range that can be handed out.</param>
+		explicit VkGpuAllocator(VkCore& core, VkDeviceSize blockSize, VkDeviceSize minAllocationSize);
+		~VkGpuAllocator();
+
+		/// <param name="buffer">Buffer to allocate memory for.</param>
+		/// <param name="flags">Memory flags.</param>
+		/// <returns>Range of GPU memory.</returns>
+		[[nodiscard]] Allocation Allocate(VkBuffer buffer, VkMemoryPropertyFlags flags);
+		/// <param name="image">Image to allocate memory for. Assumes optimal tiling.</param>
+		/// <param name="flags">Memory flags.</param>
+		/// <returns>Range of GPU memory.</returns>
+		[[nodiscard]] Allocation Allocate(VkImage image, VkMemoryPropertyFlags flags);
+		/// <param name="memRequirements">Requirements for the memory being allocated.</param>
+		/// <param name="flags">Memory flags.</param>
+		/// <param name="linear">If the memory will be used for buffers or linearly tiled images.</param>
+		/// <returns>Range of GPU memory.</returns>
+		[[nodiscard]] Allocation Allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags flags, bool linear);
+		/// <summary>
+		/// Bind a buffer to an allocated range.
+		/// </summary>
+		void Bind(VkBuffer buffer, const Allocation& allocation) const;
+		/// <summary>
+		/// Bind an image to an allocated range.
+		/// </summary>
+		void Bind(VkImage image, const Allocation& allocation) const;
+		void Free(const Allocation& allocation);
+
+		/// <summary>
+		/// Moves allocations out of sparsely used blocks into fuller ones, after which the empty blocks are released.<br>
+		/// Only the given allocations are considered, and they are updated in place when moved.
+		/// </summary>
+		/// <param name="allocations">Allocations that are allowed to move.</param>
+		/// <param name="count">Amount of allocations.</param>
+		/// <param name="callback">Moves the resource to the new range.</param>
+		/// <param name="userPtr">Forwarded to the callback.</param>
+		/// <returns>Amount of allocations that have been moved.</returns>
+		uint32_t Defragment(Allocation* allocations, uint32_t count, MoveCallback callback, void* userPtr = nullptr);
+		/// <summary>
+		/// Releases all the blocks that have no allocations left.
+		/// </summary>
+		void FreeEmptyBlocks();
+
+		[[nodiscard]] Stats GetStats() const;
+
+	private:
+		struct Block final
+		{
+			VkDeviceMemory memory;
+			// Persistently mapped memory, if the memory type is host visible.
+			char* mapped = nullptr;
+			// Index of the pool this block is part of.
+			uint32_t pool;
+			// Binary tree that stores the order + 1 of the largest free range in every subtree. Zero means fully used.
+			ArrayPtr<uint8_t> tree;
+			uint32_t allocationCount = 0;
+			VkDeviceSize used = 0;
+			// Linked list.
+			Block* next = nullptr;
+		};
+
+		VkDeviceSize _blockSize;
+		VkDeviceSize _minAllocationSize;
+		// Order of a range that covers an entire block.
+		uint32_t _maxOrder = 0;
+
+		// Linked list of blocks for every memory type, with separate pools for linear and optimal resources.
+		Block* _pools[VK_MAX_MEMORY_TYPES * 2]{};
+		Stats _stats{};
+
+		[[nodiscard]] Block* CreateBlock(uint32_t poolIndex, uint32_t typeIndex, VkMemoryPropertyFlags flags);
+		void DestroyBlock(Block* block);
+
+		[[nodiscard]] bool TryAllocate(Block& block, uint32_t order, Allocation& outAllocation);
+		void FreeRange(Block& block, VkDeviceSize offset, uint32_t order) const;
+
+		[[nodiscard]] uint32_t GetOrder(VkDeviceSize size) const;
+		[[nodiscard]] bool IsHostVisible(uint32_t typeIndex) const;
+	};
+}
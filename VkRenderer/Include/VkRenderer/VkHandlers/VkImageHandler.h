@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "VkHandler.h"
+#include "CommandContext.h"
 
 namespace vi
 {
@@ -43,6 +44,8 @@ namespace vi
 			VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D;
 			// The amount of layers in the image.
 			uint32_t layerCount = 1;
+			// The first layer the view starts at.
+			uint32_t baseArrayLayer = 0;
 			// The depth of the mipmap chain.
 			uint32_t mipLevels = 1;
 			// Format of the image.
@@ -75,7 +78,7 @@ namespace vi
 		/// <summary>
 		/// Transition the layout of an image. Used when the application of the image changes (render target to texture for instance).
 		/// </summary>
-		void TransitionLayout(const TransitionInfo& info) const;
+		void TransitionLayout(const CommandContext& context, const TransitionInfo& info) const;
 		void Destroy(VkImage image) const;
 
 		/// <returns>Object that can read an image a certain way.</returns>
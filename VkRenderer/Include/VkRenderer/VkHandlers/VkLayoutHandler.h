@@ -24,12 +24,15 @@ namespace vi
 				size_t size = sizeof(int32_t);
 				uint32_t count = 1;
 				// Where the binding is used during rendering (vertex, fragment etc).
-				VkShaderStageFlagBits flag;
+				VkShaderStageFlags flag;
 				// Binding index for the shader binding. If not set, will default to this struct's index. 
 				int32_t binding = -1;
+				// Descriptor indexing flags, like partially bound or update after bind.
+				VkDescriptorBindingFlagsEXT bindingFlags = 0;
 			};
 
 			Vector<Binding> bindings{4, GMEM_TEMP};
+			VkDescriptorSetLayoutCreateFlags flags = 0;
 		};
 
 		explicit VkLayoutHandler(VkCore& core);
@@ -52,6 +52,16 @@ namespace vi
 		/// <param name="offset">GPU memory offset.</param>
 		/// <param name="size">Size of transferable memory range.</param>
 		void Map(VkDeviceMemory memory, T* input, VkDeviceSize offset, size_t size = sizeof(T));	
+		/// <summary>
+		/// Map a GPU memory range and keep it mapped until it's unmapped.<br>
+		/// Useful for memory that is updated every frame.
+		/// </summary>
+		/// <param name="memory">GPU memory location.</param>
+		/// <param name="offset">GPU memory offset.</param>
+		/// <param name="size">Size of the mapped memory range.</param>
+		/// <returns>CPU pointer to the mapped memory range.</returns>
+		[[nodiscard]] void* MapPersistent(VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size) const;
+		void Unmap(VkDeviceMemory memory) const;
 		void Free(VkDeviceMemory memory) const;
 
 		/// <summary>
@@ -61,8 +71,14 @@ namespace vi
 		/// <param name="properties">Required properties for the memory.</param>
 		/// <returns></returns>
 		[[nodiscard]] uint32_t FindType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+		/// <returns>Memory properties of the physical device. Only queried once.</returns>
+		[[nodiscard]] const VkPhysicalDeviceMemoryProperties& GetProperties() const;
 
 	private:
+		// The properties never change, so they are cached after the first query.
+		mutable VkPhysicalDeviceMemoryProperties _properties{};
+		mutable bool _propertiesQueried = false;
+
 		void IntMap(VkDeviceMemory memory, void* input, VkDeviceSize offset, size_t size) const;
 	};
 
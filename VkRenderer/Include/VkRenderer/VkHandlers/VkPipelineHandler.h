@@ -1,16 +1,23 @@
 ﻿#pragma once
 #include "VkHandler.h"
+#include "CommandContext.h"
 
 namespace vi
 {
 	/// <summary>
-	/// Contains some core functionality for vulkan pipelines.
+	/// Contains some core functionality for vulkan pipelines.<br>
+	/// All pipelines are created through a shared pipeline cache, which can be stored on disk between runs.
 	/// </summary>
 	class VkPipelineHandler final : public VkHandler
 	{
 	public:
+		// Upper bounds for the create infos, so that creating a pipeline doesn't allocate.
+		static constexpr uint32_t MAX_STAGES = 5;
+		static constexpr uint32_t MAX_PUSH_CONSTANTS = 4;
+
 		/// <summary>
-		/// Struct that contains information for creating a pipeline.
+		/// Struct that contains information for creating a pipeline.<br>
+		/// The viewport and scissor are dynamic state, which the render pass handler sets when beginning a render pass.
 		/// </summary>
 		struct CreateInfo final
 		{
@@ -42,8 +49,6 @@ namespace vi
 			VkPrimitiveTopology primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 			// Whether or not there can be gaps in the topology (multiple separate meshes).
 			VkBool32 primitiveRestartEnable = VK_FALSE;
-			// Shape of the render target. Usually the same size as the screen.
-			glm::ivec2 extent;
 			// Clamps depth between 0 and 1.
 			VkBool32 depthClampEnable = VK_FALSE;
 			// Shape of the polygons. Can support things like wireframe.
@@ -67,17 +72,60 @@ namespace vi
 			float minSampleShading = .2f;
 		};
 
+		/// <summary>
+		/// Struct that contains information for creating a compute pipeline.
+		/// </summary>
+		struct ComputeCreateInfo final
+		{
+			VkShaderModule module;
+			Vector<VkDescriptorSetLayout> setLayouts{1, GMEM_TEMP};
+			Vector<CreateInfo::PushConstant> pushConstants{1, GMEM_TEMP};
+		};
+
 		explicit VkPipelineHandler(VkCore& core);
 
+		// Creation is thread safe, as long as the info isn't modified in the meantime.
 		void Create(const CreateInfo& info, VkPipeline& outPipeline, VkPipelineLayout& outLayout) const;
-		void Bind(VkPipeline pipeline, VkPipelineLayout layout);
+		// Creates a pipeline that uses an existing layout, which has to match the info's set layouts and push constants.
+		[[nodiscard]] VkPipeline CreatePipeline(const CreateInfo& info, VkPipelineLayout layout) const;
+		[[nodiscard]] VkPipelineLayout CreateLayout(const Vector<VkDescriptorSetLayout>& setLayouts,
+			const Vector<CreateInfo::PushConstant>& pushConstants) const;
+		void CreateCompute(const ComputeCreateInfo& info, VkPipeline& outPipeline, VkPipelineLayout& outLayout) const;
+		// Binds the pipeline to the context, which remembers it for the descriptor sets that are bound afterwards.
+		void Bind(CommandContext& context, VkPipeline pipeline, VkPipelineLayout layout, 
+			VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) const;
+		// Either of them can be a null handle, for when the layout is shared between pipelines.
 		void Destroy(VkPipeline pipeline, VkPipelineLayout layout) const;
 
-		[[nodiscard]] VkPipeline GetCurrent() const;
-		[[nodiscard]] VkPipelineLayout GetCurrentLayout() const;
+		// Creates the pipeline cache. If the path is valid, the cache starts with the contents of the file, 
+		// but only if they were written by the same device and driver.
+		void SetupCache(const char* path);
+		// Saves the pipeline cache to the path it was set up with, and destroys it.
+		void CleanupCache();
+		[[nodiscard]] VkPipelineCache GetCache() const;
 
 	private:
-		VkPipeline _current;
-		VkPipelineLayout _currentLayout;
+		// "VKPC" in little endian.
+		static constexpr uint32_t CACHE_MAGIC = 0x43504B56;
+		// Increment this when the header changes.
+		static constexpr uint32_t CACHE_VERSION = 1;
+
+		// Precedes the cache data on disk. The driver rejects data from other devices by itself,
+		// but doesn't have to reject data from other driver versions.
+		struct CacheHeader final
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vendorId;
+			uint32_t deviceId;
+			uint32_t driverVersion;
+			uint8_t uuid[VK_UUID_SIZE];
+			uint64_t dataSize;
+		};
+
+		VkPipelineCache _cache = VK_NULL_HANDLE;
+		const char* _cachePath = nullptr;
+
+		[[nodiscard]] CacheHeader CreateCacheHeader() const;
 	};
 }
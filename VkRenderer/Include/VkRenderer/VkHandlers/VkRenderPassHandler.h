@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "VkHandler.h"
+#include "CommandContext.h"
 
 namespace vi
 {
@@ -21,6 +22,7 @@ namespace vi
 
 			bool useDepthAttachment = true;
 			VkAttachmentStoreOp depthStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			VkImageLayout depthInitialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 			VkImageLayout depthFinalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 			void* pNext = nullptr;
 		};
@@ -29,10 +31,16 @@ namespace vi
 
 		/// <summary>Object that can be used to render a scene.</summary>
 		[[nodiscard]] VkRenderPass Create(const CreateInfo& info = {}) const;
-		void Begin(VkFramebuffer frameBuffer, VkRenderPass renderPass,
+		// When the contents are secondary command buffers, the render pass can only be recorded through them.
+		// Inline render passes have their viewport and scissor set to the render area. 
+		// Secondary command buffers don't inherit those, so they have to set them through SetViewport.
+		void Begin(const CommandContext& context, VkFramebuffer frameBuffer, VkRenderPass renderPass,
 			glm::ivec2 offset, glm::ivec2 extent,
-			VkClearValue* clearColors, uint32_t clearColorsCount) const;
-		void End() const;
+			VkClearValue* clearColors, uint32_t clearColorsCount, 
+			VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) const;
+		void End(const CommandContext& context) const;
+		// Sets the viewport and scissor of the context's command buffer.
+		void SetViewport(const CommandContext& context, glm::ivec2 offset, glm::ivec2 extent) const;
 		void Destroy(VkRenderPass renderPass) const;
 	};
 }
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "VkHandler.h"
+#include "CommandContext.h"
 
 namespace vi
 {
@@ -48,15 +49,28 @@ namespace vi
 			uint32_t bindingIndex;
 			uint32_t arrayIndex = 0;
 			uint32_t count = 1;
+			// Use dynamic uniform buffers when the offset changes every draw.
+			VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		};
 
 		explicit VkShaderHandler(VkCore& core);
 
 		/// <summary> Draws a list of vertices based on the given pipeline.</summary>
-		void Draw(uint32_t indexCount) const;
+		void Draw(const CommandContext& context, uint32_t indexCount, 
+			uint32_t firstIndex = 0, int32_t vertexOffset = 0, uint32_t instanceCount = 1) const;
+		/// <summary> Draws using VkDrawIndexedIndirectCommands stored in a GPU buffer.</summary>
+		void DrawIndirect(const CommandContext& context, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount) const;
+		/// <summary> Draws using VkDrawIndexedIndirectCommands, where the amount of draws is read from a GPU buffer as well.<br>
+		/// Requires VK_KHR_draw_indirect_count.</summary>
+		void DrawIndirectCount(const CommandContext& context, VkBuffer buffer, VkDeviceSize offset,
+			VkBuffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount);
+		/// <summary> Dispatches the bound compute pipeline.</summary>
+		void Dispatch(const CommandContext& context, uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1) const;
 
 		/// <returns>Shader module based on compiled spv file.</returns>
 		[[nodiscard]] VkShaderModule CreateModule(const String& data) const;
+		/// <returns>Shader module based on SPIR-V code, which has to be 4 byte aligned.</returns>
+		[[nodiscard]] VkShaderModule CreateModule(const void* code, size_t size) const;
 		void DestroyModule(VkShaderModule module) const;
 
 		/// <returns>Object that can be used to use images as attachments during shader stages.</returns>
@@ -66,32 +80,37 @@ namespace vi
 
 		/// <returns>Object that can be used to attach memory data during shader stages.</returns>
 		[[nodiscard]] VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags flags) const;
-		void BindVertexBuffer(VkBuffer buffer) const;
-		void BindIndicesBuffer(VkBuffer buffer) const;
+		void BindVertexBuffer(CommandContext& context, VkBuffer buffer) const;
+		void BindIndicesBuffer(CommandContext& context, VkBuffer buffer, VkIndexType indexType = VK_INDEX_TYPE_UINT16) const;
 		void BindBuffer(const BufferBindInfo& bindInfo) const;
-		void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0) const;
-		void CopyBuffer(VkBuffer srcBuffer, VkImage dstImage, glm::ivec2 resolution) const;
+		void CopyBuffer(const CommandContext& context, VkBuffer srcBuffer, VkBuffer dstBuffer, 
+			VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0) const;
+		void CopyBuffer(const CommandContext& context, VkBuffer srcBuffer, VkImage dstImage, glm::ivec2 resolution) const;
 		void DestroyBuffer(VkBuffer buffer) const;
 
 		/// <summary>
 		/// Very cheap but limited way to transfer memory to the GPU.
 		/// </summary>
 		/// <typeparam name="T"></typeparam>
+		/// <param name="context">Recording to add the push constant to.</param>
 		/// <param name="layout">Target pipeline layout.</param>
 		/// <param name="flag">Target shader stage(s).</param>
 		/// <param name="input">Data to transfer tot the GPU.</param>
 		template <typename T>
-		void UpdatePushConstant(VkPipelineLayout layout, VkFlags flag, const T& input);
+		void UpdatePushConstant(const CommandContext& context, VkPipelineLayout layout, VkFlags flag, const T& input);
 
 	private:
-		void IntUpdatePushConstant(VkPipelineLayout layout, VkFlags flag, void const* input, size_t size);
+		// Extension function, loaded when first used.
+		PFN_vkCmdDrawIndexedIndirectCountKHR _drawIndexedIndirectCount = nullptr;
+
+		void IntUpdatePushConstant(const CommandContext& context, VkPipelineLayout layout, VkFlags flag, void const* input, size_t size);
 	};
 
 	template <typename T>
-	void VkShaderHandler::UpdatePushConstant(
+	void VkShaderHandler::UpdatePushConstant(const CommandContext& context,
 		const VkPipelineLayout layout,
 		const VkFlags flag, const T& input)
 	{
-		IntUpdatePushConstant(layout, flag, &input, sizeof(T));
+		IntUpdatePushConstant(context, layout, flag, &input, sizeof(T));
 	}
 }
@@ -18,6 +18,8 @@ namespace vi
 		/// <returns>Object that can act as a wait handle for CPU operations.</returns>
 		[[nodiscard]] VkFence CreateFence() const;
 		void WaitForFence(VkFence fence) const;
+		/// <returns>If the fence has been signaled, without waiting for it.</returns>
+		[[nodiscard]] bool IsSignaled(VkFence fence) const;
 		void DestroyFence(VkFence fence) const;
 	};
 }
\ No newline at end of file
@@ -24,7 +24,6 @@ namespace vi
 	{
 		if (size == 0)
 			return nullptr;
-		assert(size <= _capacity);
 
 		// Try out all the blocks until allocation is successful.	
 		Block* previous = nullptr;
@@ -41,7 +40,11 @@ namespace vi
 		}
 
 		// If no block has enough space available, create a new block.
-		const auto block = new Block(_capacity);
+		// Allocations that don't fit in a block, including the range header, get a block of their own.
+		const size_t required = size + 2 * sizeof(size_t);
+		const bool dedicated = required > _capacity;
+		const auto block = new Block(dedicated ? required : _capacity);
+		block->dedicated = dedicated;
 		previous->child = block;
 		return block->TryAllocate(size);
 	}
@@ -49,12 +52,22 @@ namespace vi
 	bool FreeListAllocator::MFree(void* ptr) const
 	{
 		// Tries to free the pointer.
+		Block* previous = nullptr;
 		Block* current = _block;
 		while (current)
 		{
+			// Dedicated blocks only hold a single range, so they are released as a whole.
+			if (current->dedicated && ptr == current->data + 2)
+			{
+				previous->child = current->child;
+				delete current;
+				return true;
+			}
+
 			if (current->TryFree(ptr))
 				return true;
 
+			previous = current;
 			current = current->child;
 		}
 
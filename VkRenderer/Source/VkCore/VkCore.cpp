@@ -14,6 +14,7 @@
 #include "VkHandlers/VkCommandBufferHandler.h"
 #include "VkHandlers/VkDescriptorPoolHandler.h"
 #include "VkHandlers/VkFrameBufferHandler.h"
+#include "VkHandlers/VkGpuAllocator.h"
 #include "VkHandlers/VkImageHandler.h"
 #include "VkHandlers/VkLayoutHandler.h"
 #include "VkHandlers/VkMemoryHandler.h"
@@ -40,6 +41,7 @@ namespace vi
 		_commandBufferHandler = GMEM.New<VkCommandBufferHandler>(*this);
 		_descriptorPoolHandler = GMEM.New<VkDescriptorPoolHandler>(*this);
 		_frameBufferHandler = GMEM.New<VkFrameBufferHandler>(*this);
+		_gpuAllocator = GMEM.New<VkGpuAllocator>(*this, info.memoryBlockSize, info.minMemoryAllocationSize);
 		_imageHandler = GMEM.New<VkImageHandler>(*this);
 		_layoutHandler = GMEM.New<VkLayoutHandler>(*this);
 		_memoryHandler = GMEM.New<VkMemoryHandler>(*this);
@@ -51,6 +53,13 @@ namespace vi
 		// Add required tags.
 		info.deviceExtensions.Add(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 		info.validationLayers.Add("VK_LAYER_KHRONOS_validation");
+		// Add optional tags.
+		_descriptorIndexing = info.descriptorIndexing;
+		// Descriptor indexing, multiview and the feature checks below depend on the extended feature queries.
+		info.instanceExtensions.Add(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		// Always required, since every fragment can index a different shadow map level of detail.
+		info.deviceExtensions.Add(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+		info.deviceExtensions.Add(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
 		// Check debugging support.
 		VkCoreDebugger::CheckValidationSupport(info);
 
@@ -64,19 +73,77 @@ namespace vi
 
 		// Choose GPU card.
 		_physicalDevice->Setup(info, *_instance, _surface);
+
+		// The extension being available doesn't mean every feature of it is, so query them separately.
+		const auto getFeatures = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+			vkGetInstanceProcAddr(*_instance, "vkGetPhysicalDeviceFeatures2KHR"));
+		assert(getFeatures);
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		VkPhysicalDeviceFeatures2KHR features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		features.pNext = &indexingFeatures;
+		getFeatures(*_physicalDevice, &features);
+
+		if (!features.features.shaderSampledImageArrayDynamicIndexing ||
+			!indexingFeatures.shaderSampledImageArrayNonUniformIndexing)
+			throw std::exception("Non-uniform sampled image indexing is not supported by the selected GPU!");
+
+		if (_descriptorIndexing && (
+			!indexingFeatures.runtimeDescriptorArray ||
+			!indexingFeatures.descriptorBindingPartiallyBound ||
+			!indexingFeatures.descriptorBindingSampledImageUpdateAfterBind))
+			throw std::exception("Descriptor indexing is not supported by the selected GPU!");
+
+		_indirectDrawing = info.indirectDrawing;
+		if (_indirectDrawing)
+		{
+			if (!features.features.multiDrawIndirect || !features.features.drawIndirectFirstInstance)
+				throw std::exception("Indirect drawing is not supported by the selected GPU!");
+
+			// The count variant is optional, since culled draws can also be skipped with an instance count of zero.
+			const char* countExtension = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+			const ArrayPtr<const char*> countExtensions{ &countExtension, 1 };
+			_drawIndirectCount = VkCorePhysicalDevice::CheckDeviceExtensionSupport(*_physicalDevice, countExtensions);
+			if (_drawIndirectCount)
+				info.deviceExtensions.Add(countExtension);
+		}
+
+		if (info.layeredRendering)
+		{
+			// Prefer multiview, since it lets the driver share the vertex work between the views.
+			const char* multiviewExtension = VK_KHR_MULTIVIEW_EXTENSION_NAME;
+			const ArrayPtr<const char*> multiviewExtensions{ &multiviewExtension, 1 };
+			_multiview = VkCorePhysicalDevice::CheckDeviceExtensionSupport(*_physicalDevice, multiviewExtensions);
+			if (_multiview)
+				info.deviceExtensions.Add(multiviewExtension);
+
+			const char* layerExtension = VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME;
+			const ArrayPtr<const char*> layerExtensions{ &layerExtension, 1 };
+			_viewportLayer = !_multiview && VkCorePhysicalDevice::CheckDeviceExtensionSupport(*_physicalDevice, layerExtensions);
+			if (_viewportLayer)
+				info.deviceExtensions.Add(layerExtension);
+		}
+
 		// Create interface for said GPU card.
 		_logicalDevice->Setup(info, _surface, *_physicalDevice);
 		// Set up pool of render commands.
 		_commandPool->Setup(_surface, *_physicalDevice, *_logicalDevice);
 		// Construct swap chain for image presentation.
-		_swapChain->Construct();
+		_swapChain->Construct(info.framesInFlight);
+		// Load the pipelines compiled in earlier runs.
+		_pipelineHandler->SetupCache(info.pipelineCachePath);
 	}
 
 	VkCore::~VkCore()
 	{
 		DeviceWaitIdle();
 
+		_pipelineHandler->CleanupCache();
 		_swapChain->Cleanup();
+		// The allocator releases its memory blocks, so it has to go before the logical device.
+		GMEM.Delete(_gpuAllocator);
 		_commandPool->Cleanup(*_logicalDevice);
 		_logicalDevice->Cleanup();
 		vkDestroySurfaceKHR(*_instance, _surface, nullptr);
@@ -137,6 +204,31 @@ namespace vi
 		return *_commandPool;
 	}
 
+	bool VkCore::IsDescriptorIndexingEnabled() const
+	{
+		return _descriptorIndexing;
+	}
+
+	bool VkCore::IsIndirectDrawingEnabled() const
+	{
+		return _indirectDrawing;
+	}
+
+	bool VkCore::IsDrawIndirectCountEnabled() const
+	{
+		return _drawIndirectCount;
+	}
+
+	bool VkCore::IsMultiviewEnabled() const
+	{
+		return _multiview;
+	}
+
+	bool VkCore::IsViewportLayerEnabled() const
+	{
+		return _viewportLayer;
+	}
+
 	WindowHandler& VkCore::GetWindowHandler() const
 	{
 		return *_windowHandler;
@@ -162,6 +254,11 @@ namespace vi
 		return *_frameBufferHandler;
 	}
 
+	VkGpuAllocator& VkCore::GetGpuAllocator() const
+	{
+		return *_gpuAllocator;
+	}
+
 	VkImageHandler& VkCore::GetImageHandler() const
 	{
 		return *_imageHandler;
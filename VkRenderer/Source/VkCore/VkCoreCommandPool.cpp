@@ -13,10 +13,11 @@ namespace vi
 		const auto families = VkCorePhysicalDevice::GetQueueFamilies(surface, physicalDevice);
 
 		// Create a generic pool that will work with any render command, using the graphic command family.
+		// Only used for one time commands, since the per-frame command buffers come from pools that are reset in bulk.
 		VkCommandPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		poolInfo.queueFamilyIndex = families.graphics;
-		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
 		const auto result = vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &_value);
 		assert(!result);
@@ -34,14 +34,47 @@ namespace vi
 			queueCreateInfos.Add(queueCreateInfo);
 		}
 
-		// Assumed that anti aliasing, sampling and geometry shaders are used.
+		// Assumed that anti aliasing and sampling are used.
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
 		deviceFeatures.sampleRateShading = VK_TRUE;
-		deviceFeatures.geometryShader = VK_TRUE;
+		// Shadow maps are stored in cubemap arrays, one for every level of detail, which are indexed per light.
+		deviceFeatures.imageCubeArray = VK_TRUE;
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+		// Needed for GPU driven rendering, where every draw references its instance through the first instance.
+		deviceFeatures.multiDrawIndirect = info.indirectDrawing;
+		deviceFeatures.drawIndirectFirstInstance = info.indirectDrawing;
+		// Allows cooked textures to be block compressed, whenever the hardware supports it.
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+		deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+		// Without this, 32 bit indices are limited to 2^24 - 1.
+		deviceFeatures.fullDrawIndexUint32 = supportedFeatures.fullDrawIndexUint32;
+
+		// Support is checked by the core before the device is created.
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures{};
+		descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		// Needed for the shadow maps, which are always indexed per light.
+		descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		// Features needed for bindless descriptor arrays.
+		descriptorIndexingFeatures.runtimeDescriptorArray = info.descriptorIndexing;
+		descriptorIndexingFeatures.descriptorBindingPartiallyBound = info.descriptorIndexing;
+		descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = info.descriptorIndexing;
 
 		const auto& deviceExtensions = info.deviceExtensions;
 
+		// The multiview feature is guaranteed to be supported when the extension is, so it only has to be enabled.
+		VkPhysicalDeviceMultiviewFeaturesKHR multiviewFeatures{};
+		multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES_KHR;
+		multiviewFeatures.multiview = VK_TRUE;
+
+		void* pNext = nullptr;
+		for (auto& extension : deviceExtensions)
+			if (strcmp(extension, VK_KHR_MULTIVIEW_EXTENSION_NAME) == 0)
+				pNext = &multiviewFeatures;
+		descriptorIndexingFeatures.pNext = pNext;
+		pNext = &descriptorIndexingFeatures;
+
 		// Create interface to the selected GPU hardware.
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -50,6 +83,7 @@ namespace vi
 		createInfo.pEnabledFeatures = &deviceFeatures;
 		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.GetCount());
 		createInfo.ppEnabledExtensionNames = deviceExtensions.GetData();
+		createInfo.pNext = pNext;
 
 		// Only enable debug layers when in debug mode.
 		createInfo.enabledLayerCount = 0;
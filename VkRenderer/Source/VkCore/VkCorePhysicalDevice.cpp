@@ -90,22 +90,27 @@ namespace vi
 		for (const auto& queueFamily : queueFamilies)
 		{
 			// If the graphics family is present.
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && families.graphics == UINT32_MAX)
 				families.graphics = i;
 
 			VkBool32 presentSupport = false;
 			vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
 
 			// Since this is a renderer made for games, we need to be able to render to the screen.
-			if (presentSupport)
+			if (presentSupport && families.present == UINT32_MAX)
 				families.present = i;
 
-			// If all families have been found.
-			if (families)
-				break;
+			// Families that only support transfers are usually backed by dedicated DMA engines, which copy alongside the rendering.
+			const VkQueueFlags flags = queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
+			if (flags == VK_QUEUE_TRANSFER_BIT && families.transfer == UINT32_MAX)
+				families.transfer = i;
 			i++;
 		}
 
+		// Graphics queues always support transfers.
+		if (families.transfer == UINT32_MAX)
+			families.transfer = families.graphics;
+
 		return families;
 	}
 
@@ -118,7 +123,7 @@ namespace vi
 			return false;
 		if (!deviceInfo.features.samplerAnisotropy)
 			return false;
-		if (!deviceInfo.features.geometryShader)
+		if (!deviceInfo.features.imageCubeArray)
 			return false;
 		return true;
 	}
@@ -5,6 +5,7 @@
 #include "VkCore/VkCorePhysicalDevice.h"
 #include "VkHandlers/VkCommandBufferHandler.h"
 #include "VkHandlers/VkFrameBufferHandler.h"
+#include "VkHandlers/VkGpuAllocator.h"
 #include "VkHandlers/VkImageHandler.h"
 #include "VkHandlers/VkMemoryHandler.h"
 #include "VkHandlers/VkRenderPassHandler.h"
@@ -71,6 +72,11 @@ namespace vi
 		return _renderPass;
 	}
 
+	CommandContext& VkCoreSwapchain::GetContext()
+	{
+		return _context;
+	}
+
 	VkSemaphore VkCoreSwapchain::GetImageAvaiableSemaphore() const
 	{
 		return _frames[_frameIndex].imageAvailableSemaphore;
@@ -87,10 +93,12 @@ namespace vi
 			WaitForImage();
 
 		auto& commandBufferHandler = _core.GetCommandBufferHandler();
+		auto& frame = _frames[_frameIndex];
 		auto& image = _images[_imageIndex];
 
 		// Begin recording the command.
-		commandBufferHandler.BeginRecording(image.commandBuffer);
+		frame.commandBuffer = AllocateCommandBuffer();
+		commandBufferHandler.BeginRecording(_context, frame.commandBuffer);
 
 		// Clear the image.
 		VkClearValue clearColors[2];
@@ -98,7 +106,7 @@ namespace vi
 		clearColors[1].depthStencil = { 1, 0 };
 
 		// Begin the renderpass and clear the previous drawing on the attached image.
-		_core.GetRenderPassHandler().Begin(image.frameBuffer, _renderPass, {},
+		_core.GetRenderPassHandler().Begin(_context, image.frameBuffer, _renderPass, {},
 			{ _extent.width, _extent.height }, clearColors, 2);
 	}
 
@@ -121,30 +129,37 @@ namespace vi
 		return result;
 	}
 
-	void VkCoreSwapchain::EndFrame(const VkSemaphore overrideWaitSemaphore)
+	void VkCoreSwapchain::EndFrame()
 	{
 		auto& frame = _frames[_frameIndex];
-		auto& image = _images[_imageIndex];
 
 		auto& commandBufferHandler = _core.GetCommandBufferHandler();
 		auto& renderPassHandler = _core.GetRenderPassHandler();
 
-		renderPassHandler.End();
-		commandBufferHandler.EndRecording();
+		renderPassHandler.End(_context);
+		commandBufferHandler.EndRecording(_context);
 
-		// Finish the render pass and submit it to the command buffer.
+		// Finish the render pass and submit the entire frame in one go.
+		// Only the writes to the swap chain image have to wait for it to become available.
+		_queue.Add(frame.commandBuffer);
 		VkCommandBufferHandler::SubmitInfo info{};
-		info.buffers = &image.commandBuffer;
-		info.buffersCount = 1;
-		info.waitSemaphore = overrideWaitSemaphore ? overrideWaitSemaphore : frame.imageAvailableSemaphore;
+		info.buffers = _queue.GetData();
+		info.buffersCount = static_cast<uint32_t>(_queue.GetCount());
+		info.waitSemaphore = frame.imageAvailableSemaphore;
 		info.signalSemaphore = frame.renderFinishedSemaphore;
 		info.fence = frame.inFlightFence;
 		commandBufferHandler.Submit(info);
+		_queue.Clear();
 
 		const auto result = Present();
 		_shouldRecreateAssets = result;
 	}
 
+	void VkCoreSwapchain::Enqueue(const VkCommandBuffer commandBuffer)
+	{
+		_queue.Add(commandBuffer);
+	}
+
 	void VkCoreSwapchain::WaitForImage()
 	{
 		auto& frame = _frames[_frameIndex];
@@ -152,6 +167,10 @@ namespace vi
 
 		// Wait until the swapchain has a new image available.
 		syncHandler.WaitForFence(frame.inFlightFence);
+
+		// The command buffers of this frame are no longer in use, so they can all be reset at once.
+		_core.GetCommandBufferHandler().ResetPool(frame.commandPool);
+		frame.usedCommandBufferCount = 0;
 		const auto result = vkAcquireNextImageKHR(_core.GetLogicalDevice(), 
 			_swapChain, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &_imageIndex);
 		assert(!result);
@@ -195,14 +214,17 @@ namespace vi
 		return imageCount;
 	}
 
-	void VkCoreSwapchain::Construct()
+	void VkCoreSwapchain::Construct(const uint32_t framesInFlight)
 	{
+		assert(framesInFlight > 0);
+
 		const SupportDetails support = QuerySwapChainSupport(_core.GetSurface(), _core.GetPhysicalDevice());
 		const uint32_t imageCount = support.GetRecommendedImageCount();
 
 		// These array's don't ever resize, so reusing these arrays means that there will be no memory fragmentation.
+		// The amount of frames is independent from the amount of images, since the images are only used as render targets.
 		_images = ArrayPtr<Image>(imageCount, GMEM);
-		_frames = ArrayPtr<Frame>(_MAX_FRAMES_IN_FLIGHT, GMEM);
+		_frames = ArrayPtr<Frame>(framesInFlight, GMEM);
 		_inFlight = ArrayPtr<VkFence>(imageCount, GMEM, VK_NULL_HANDLE);
 
 		const VkSurfaceFormatKHR surfaceFormat = ChooseSurfaceFormat(support.formats);
@@ -232,6 +254,16 @@ namespace vi
 		return _imageIndex;
 	}
 
+	uint32_t VkCoreSwapchain::GetFrameCount() const
+	{
+		return _frames.GetLength();
+	}
+
+	uint32_t VkCoreSwapchain::GetFrameIndex() const
+	{
+		return _frameIndex;
+	}
+
 	void VkCoreSwapchain::Cleanup() const
 	{
 		auto& syncHandler = _core.GetSyncHandler();
@@ -371,16 +403,31 @@ namespace vi
 		}
 	}
 
+	VkCommandBuffer VkCoreSwapchain::AllocateCommandBuffer()
+	{
+		auto& frame = _frames[_frameIndex];
+		assert(frame.usedCommandBufferCount < MAX_FRAME_COMMAND_BUFFERS);
+
+		// Only allocate new command buffers when more are needed than in any of the previous frames.
+		if (frame.usedCommandBufferCount == frame.commandBufferCount)
+			frame.commandBuffers[frame.commandBufferCount++] = _core.GetCommandBufferHandler().Create(frame.commandPool);
+		return frame.commandBuffers[frame.usedCommandBufferCount++];
+	}
+
 	void VkCoreSwapchain::ConstructFrames() const
 	{
+		auto& commandBufferHandler = _core.GetCommandBufferHandler();
 		auto& syncHandler = _core.GetSyncHandler();
 
-		// Construct the sync objects.
+		// Construct the sync objects and the command pools.
 		for (auto& frame : _frames)
 		{
 			frame.imageAvailableSemaphore = syncHandler.CreateSemaphore();
 			frame.renderFinishedSemaphore = syncHandler.CreateSemaphore();
 			frame.inFlightFence = syncHandler.CreateFence();
+			frame.commandPool = commandBufferHandler.CreatePool();
+			frame.commandBufferCount = 0;
+			frame.usedCommandBufferCount = 0;
 		}
 	}
 
@@ -388,25 +435,11 @@ namespace vi
 	{
 		auto& commandBufferHandler = _core.GetCommandBufferHandler();
 		auto& frameBufferHandler = _core.GetFrameBufferHandler();
+		auto& gpuAllocator = _core.GetGpuAllocator();
 		auto& imageHandler = _core.GetImageHandler();
-		auto& memoryHandler = _core.GetMemoryHandler();
 		auto& syncHandler = _core.GetSyncHandler();
 
-		const auto commandPool = _core.GetCommandPool();
-		const auto logicalDevice = _core.GetLogicalDevice();
-
 		const uint32_t length = _images.GetLength();
-		const auto commandBuffers = ArrayPtr<VkCommandBuffer>(length, GMEM_TEMP);
-
-		// Create a reusable command buffer.
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = length;
-
-		const auto result = vkAllocateCommandBuffers(logicalDevice, &allocInfo, commandBuffers.GetData());
-		assert(!result);
 
 		for (uint32_t i = 0; i < length; ++i)
 		{
@@ -418,8 +451,8 @@ namespace vi
 			imageCreateInfo.format = _depthBufferFormat;
 			imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
 			image.depthImage = imageHandler.Create(imageCreateInfo);
-			image.depthImageMemory = memoryHandler.Allocate(image.depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			memoryHandler.Bind(image.depthImage, image.depthImageMemory);
+			image.depthImageMemory = gpuAllocator.Allocate(image.depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			gpuAllocator.Bind(image.depthImage, image.depthImageMemory);
 
 			// Create the depth image view.
 			VkImageHandler::ViewCreateInfo imageViewCreateInfo{};
@@ -437,9 +470,10 @@ namespace vi
 			transitionInfo.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 			transitionInfo.aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT;
 
-			commandBufferHandler.BeginRecording(cmdBuffer);
-			imageHandler.TransitionLayout(transitionInfo);
-			commandBufferHandler.EndRecording();
+			CommandContext context{};
+			commandBufferHandler.BeginRecording(context, cmdBuffer);
+			imageHandler.TransitionLayout(context, transitionInfo);
+			commandBufferHandler.EndRecording(context);
 
 			// It would be better to do all the swapchain images at once, but the performance gain is neglectable
 			// since it only executes once per swapchain recreation, so I'm a bit lazy here.
@@ -460,26 +494,23 @@ namespace vi
 			frameBufferCreateInfo.renderPass = _renderPass;
 			frameBufferCreateInfo.extent = { _extent.width, _extent.height };
 			image.frameBuffer = frameBufferHandler.Create(frameBufferCreateInfo);
-			image.commandBuffer = commandBuffers[i];
 		}
 	}
 
 	void VkCoreSwapchain::FreeBuffers() const
 	{
-		auto& commandBufferHandler = _core.GetCommandBufferHandler();
 		auto& frameBufferHandler = _core.GetFrameBufferHandler();
+		auto& gpuAllocator = _core.GetGpuAllocator();
 		auto& imageHandler = _core.GetImageHandler();
-		auto& memoryHandler = _core.GetMemoryHandler();
 
 		// Destroys the depth image and the frame buffer.
 		for (auto& image : _images)
 		{
 			imageHandler.DestroyView(image.depthImageView);
 			imageHandler.Destroy(image.depthImage);
-			memoryHandler.Free(image.depthImageMemory);
+			gpuAllocator.Free(image.depthImageMemory);
 
 			frameBufferHandler.Destroy(image.frameBuffer);
-			commandBufferHandler.Destroy(image.commandBuffer);
 		}
 	}
 
@@ -498,11 +529,13 @@ namespace vi
 
 	void VkCoreSwapchain::FreeFrames() const
 	{
+		auto& commandBufferHandler = _core.GetCommandBufferHandler();
 		auto& syncHandler = _core.GetSyncHandler();
 
-		// Destroy the sync objects.
+		// Destroy the sync objects and the command pools, which also frees their command buffers.
 		for (const auto& frame : _frames)
 		{
+			commandBufferHandler.DestroyPool(frame.commandPool);
 			syncHandler.DestroySemaphore(frame.imageAvailableSemaphore);
 			syncHandler.DestroySemaphore(frame.renderFinishedSemaphore);
 			syncHandler.DestroyFence(frame.inFlightFence);
@@ -2,15 +2,16 @@
 #include "VkHandlers/VkCommandBufferHandler.h"
 #include "VkCore/VkCore.h"
 #include "VkCore/VkCoreLogicalDevice.h"
+#include "VkCore/VkCorePhysicalDevice.h"
 
 namespace vi
 {
-	VkCommandBuffer VkCommandBufferHandler::Create() const
+	VkCommandBuffer VkCommandBufferHandler::Create(const VkCommandPool pool, const bool secondary) const
 	{
 		VkCommandBufferAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = core.GetCommandPool();
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = pool ? pool : core.GetCommandPool();
+		allocInfo.level = secondary ? VK_COMMAND_BUFFER_LEVEL_SECONDARY : VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 		allocInfo.commandBufferCount = 1;
 
 		VkCommandBuffer commandBuffer;
@@ -20,33 +21,69 @@ namespace vi
 		return commandBuffer;
 	}
 
-	void VkCommandBufferHandler::BeginRecording(const VkCommandBuffer commandBuffer)
+	void VkCommandBufferHandler::BeginRecording(CommandContext& context, const VkCommandBuffer commandBuffer, 
+		const VkCommandBufferInheritanceInfo* inheritance) const
 	{
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		vkResetCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		if (inheritance)
+		{
+			beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = inheritance;
+		}
 
-		_current = commandBuffer;
+		const auto result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		assert(!result);
+
+		// Nothing has been bound to the new command buffer yet.
+		context = {};
+		context.buffer = commandBuffer;
 	}
 
-	void VkCommandBufferHandler::EndRecording()
+	void VkCommandBufferHandler::EndRecording(CommandContext& context) const
 	{
-		const auto result = vkEndCommandBuffer(_current);
+		const auto result = vkEndCommandBuffer(context.buffer);
 		assert(!result);
-		_current = VK_NULL_HANDLE;
+		context.buffer = VK_NULL_HANDLE;
+	}
+
+	void VkCommandBufferHandler::Destroy(const VkCommandBuffer commandBuffer, const VkCommandPool pool) const
+	{
+		vkFreeCommandBuffers(core.GetLogicalDevice(), pool ? pool : core.GetCommandPool(), 1, &commandBuffer);
 	}
 
-	void VkCommandBufferHandler::Destroy(const VkCommandBuffer commandBuffer) const
+	VkCommandPool VkCommandBufferHandler::CreatePool(const uint32_t queueFamily) const
 	{
-		vkFreeCommandBuffers(core.GetLogicalDevice(), core.GetCommandPool(), 1, &commandBuffer);
+		const auto families = VkCorePhysicalDevice::GetQueueFamilies(core.GetSurface(), core.GetPhysicalDevice());
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamily == UINT32_MAX ? families.graphics : queueFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		VkCommandPool pool;
+		const auto result = vkCreateCommandPool(core.GetLogicalDevice(), &poolInfo, nullptr, &pool);
+		assert(!result);
+		return pool;
 	}
 
-	VkCommandBuffer VkCommandBufferHandler::GetCurrent() const
+	void VkCommandBufferHandler::ResetPool(const VkCommandPool pool) const
 	{
-		return _current;
+		const auto result = vkResetCommandPool(core.GetLogicalDevice(), pool, 0);
+		assert(!result);
+	}
+
+	void VkCommandBufferHandler::DestroyPool(const VkCommandPool pool) const
+	{
+		vkDestroyCommandPool(core.GetLogicalDevice(), pool, nullptr);
+	}
+
+	void VkCommandBufferHandler::Execute(const CommandContext& context, const VkCommandBuffer* buffers, const uint32_t count) const
+	{
+		if (count > 0)
+			vkCmdExecuteCommands(context.buffer, count, buffers);
 	}
 
 	void VkCommandBufferHandler::Submit(const SubmitInfo& info) const
@@ -54,10 +91,9 @@ namespace vi
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		submitInfo.waitSemaphoreCount = info.waitSemaphore ? 1 : 0;
 		submitInfo.pWaitSemaphores = &info.waitSemaphore;
-		submitInfo.pWaitDstStageMask = &waitStage;
+		submitInfo.pWaitDstStageMask = &info.waitStage;
 		submitInfo.commandBufferCount = info.buffersCount;
 		submitInfo.pCommandBuffers = info.buffers;
 		submitInfo.signalSemaphoreCount = info.signalSemaphore ? 1 : 0;
@@ -65,10 +101,29 @@ namespace vi
 
 		if(info.fence)
 			vkResetFences(core.GetLogicalDevice(), 1, &info.fence);
-		const auto result = vkQueueSubmit(core.GetQueues().graphics, 1, &submitInfo, info.fence);
+		const auto queue = info.queue ? info.queue : core.GetQueues().graphics;
+		const auto result = vkQueueSubmit(queue, 1, &submitInfo, info.fence);
 		assert(!result);
 	}
 
+	void VkCommandBufferHandler::Barrier(const CommandContext& context,
+		const VkPipelineStageFlags srcStage, const VkAccessFlags srcAccess,
+		const VkPipelineStageFlags dstStage, const VkAccessFlags dstAccess) const
+	{
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+
+		vkCmdPipelineBarrier(context.buffer,
+			srcStage, dstStage,
+			0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr
+		);
+	}
+
 	VkCommandBufferHandler::VkCommandBufferHandler(VkCore& core) : VkHandler(core)
 	{
 		
@@ -1,8 +1,6 @@
 ﻿#include "pch.h"
 #include "VkHandlers/VkDescriptorPoolHandler.h"
 #include "VkCore/VkCore.h"
-#include "VkHandlers/VkCommandBufferHandler.h"
-#include "VkHandlers/VkPipelineHandler.h"
 
 namespace vi
 {
@@ -21,6 +19,7 @@ namespace vi
 
 		VkDescriptorPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = info.flags;
 		poolInfo.poolSizeCount = info.typeCount;
 		poolInfo.pPoolSizes = sizes.GetData();
 		poolInfo.maxSets = maxSets;
@@ -45,11 +44,12 @@ namespace vi
 		assert(!result);
 	}
 
-	void VkDescriptorPoolHandler::BindSets(VkDescriptorSet* sets, const uint32_t setCount) const
+	void VkDescriptorPoolHandler::BindSets(const CommandContext& context, VkDescriptorSet* sets, const uint32_t setCount,
+		const uint32_t* dynamicOffsets, const uint32_t dynamicOffsetCount) const
 	{
-		vkCmdBindDescriptorSets(core.GetCommandBufferHandler().GetCurrent(), 
-			VK_PIPELINE_BIND_POINT_GRAPHICS, core.GetPipelineHandler().GetCurrentLayout(), 
-			0, setCount, sets, 0, nullptr);
+		assert(context.layout);
+		vkCmdBindDescriptorSets(context.buffer, context.bindPoint, context.layout, 
+			0, setCount, sets, dynamicOffsetCount, dynamicOffsets);
 	}
 
 	void VkDescriptorPoolHandler::Destroy(const VkDescriptorPool pool) const
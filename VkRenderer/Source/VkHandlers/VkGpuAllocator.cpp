@@ -0,0 +1,337 @@
+﻿#include "pch.h"
+#include "VkHandlers/VkGpuAllocator.h"
+#include "VkCore/VkCore.h"
+#include "VkHandlers/VkMemoryHandler.h"
+
+namespace vi
+{
+	VkGpuAllocator::VkGpuAllocator(VkCore& core,
+		const VkDeviceSize blockSize, const VkDeviceSize minAllocationSize) : VkHandler(core),
+		_blockSize(blockSize), _minAllocationSize(minAllocationSize)
+	{
+		while ((_minAllocationSize << _maxOrder) < _blockSize)
+			++_maxOrder;
+		assert((_minAllocationSize << _maxOrder) == _blockSize);
+	}
+
+	VkGpuAllocator::~VkGpuAllocator()
+	{
+		for (auto& pool : _pools)
+			while (pool)
+				DestroyBlock(pool);
+	}
+
+	VkGpuAllocator::Allocation VkGpuAllocator::Allocate(
+		const VkBuffer buffer,
+		const VkMemoryPropertyFlags flags)
+	{
+		return Allocate(core.GetMemoryHandler().GetRequirements(buffer), flags, true);
+	}
+
+	VkGpuAllocator::Allocation VkGpuAllocator::Allocate(
+		const VkImage image,
+		const VkMemoryPropertyFlags flags)
+	{
+		return Allocate(core.GetMemoryHandler().GetRequirements(image), flags, false);
+	}
+
+	VkGpuAllocator::Allocation VkGpuAllocator::Allocate(
+		const VkMemoryRequirements& memRequirements,
+		const VkMemoryPropertyFlags flags, const bool linear)
+	{
+		auto& memoryHandler = core.GetMemoryHandler();
+
+		const uint32_t typeIndex = memoryHandler.FindType(memRequirements.memoryTypeBits, flags);
+		const VkDeviceSize size = Ut::Max(memRequirements.size, memRequirements.alignment);
+
+		Allocation allocation{};
+
+		// Resources that don't fit in a block get their own memory.
+		if (size > _blockSize)
+		{
+			allocation.memory = memoryHandler.Allocate(memRequirements, flags);
+			allocation.size = memRequirements.size;
+			if (IsHostVisible(typeIndex))
+				allocation.mapped = memoryHandler.MapPersistent(allocation.memory, 0, VK_WHOLE_SIZE);
+
+			_stats.dedicatedCount++;
+			_stats.allocationCount++;
+			_stats.reserved += memRequirements.size;
+			_stats.used += memRequirements.size;
+			return allocation;
+		}
+
+		// Buddy ranges are aligned to their own size, so rounding up to a power of two also satisfies the alignment.
+		const uint32_t order = GetOrder(size);
+		const uint32_t poolIndex = typeIndex * 2 + !linear;
+
+		Block* block = _pools[poolIndex];
+		while (block)
+		{
+			if (TryAllocate(*block, order, allocation))
+			{
+				allocation.size = memRequirements.size;
+				return allocation;
+			}
+			block = block->next;
+		}
+
+		// If no block has enough space available, create a new block.
+		block = CreateBlock(poolIndex, typeIndex, flags);
+		const bool result = TryAllocate(*block, order, allocation);
+		assert(result);
+		allocation.size = memRequirements.size;
+		return allocation;
+	}
+
+	void VkGpuAllocator::Bind(const VkBuffer buffer, const Allocation& allocation) const
+	{
+		core.GetMemoryHandler().Bind(buffer, allocation.memory, allocation.offset);
+	}
+
+	void VkGpuAllocator::Bind(const VkImage image, const Allocation& allocation) const
+	{
+		core.GetMemoryHandler().Bind(image, allocation.memory, allocation.offset);
+	}
+
+	void VkGpuAllocator::Free(const Allocation& allocation)
+	{
+		auto& memoryHandler = core.GetMemoryHandler();
+
+		// Dedicated allocations can be returned to the GPU directly.
+		if (!allocation._block)
+		{
+			if (allocation.mapped)
+				memoryHandler.Unmap(allocation.memory);
+			memoryHandler.Free(allocation.memory);
+
+			_stats.dedicatedCount--;
+			_stats.allocationCount--;
+			_stats.reserved -= allocation.size;
+			_stats.used -= allocation.size;
+			return;
+		}
+
+		auto& block = *allocation._block;
+		FreeRange(block, allocation.offset, allocation._order);
+
+		const VkDeviceSize rangeSize = _minAllocationSize << allocation._order;
+		block.allocationCount--;
+		block.used -= rangeSize;
+		_stats.allocationCount--;
+		_stats.used -= rangeSize;
+
+		// Release empty blocks, but keep the first block of every pool to prevent it from being reallocated constantly.
+		if (block.allocationCount == 0 && _pools[block.pool] != &block)
+			DestroyBlock(&block);
+	}
+
+	uint32_t VkGpuAllocator::Defragment(Allocation* allocations,
+		const uint32_t count, const MoveCallback callback, void* userPtr)
+	{
+		uint32_t moved = 0;
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			auto& allocation = allocations[i];
+			Block* src = allocation._block;
+
+			// Dedicated allocations are never part of a block.
+			if (!src)
+				continue;
+
+			// Only move into blocks that are used more, so that the sparse blocks end up empty.
+			Allocation dst{};
+			Block* block = _pools[src->pool];
+			while (block)
+			{
+				if (block != src && block->used > src->used && TryAllocate(*block, allocation._order, dst))
+					break;
+				block = block->next;
+			}
+
+			if (!block)
+				continue;
+			dst.size = allocation.size;
+
+			if (!callback(allocation, dst, userPtr))
+			{
+				Free(dst);
+				continue;
+			}
+
+			Free(allocation);
+			allocation = dst;
+			moved++;
+		}
+
+		FreeEmptyBlocks();
+		return moved;
+	}
+
+	void VkGpuAllocator::FreeEmptyBlocks()
+	{
+		for (auto& pool : _pools)
+		{
+			Block* block = pool;
+			while (block)
+			{
+				Block* next = block->next;
+				if (block->allocationCount == 0)
+					DestroyBlock(block);
+				block = next;
+			}
+		}
+	}
+
+	VkGpuAllocator::Stats VkGpuAllocator::GetStats() const
+	{
+		Stats stats = _stats;
+
+		for (auto& pool : _pools)
+		{
+			const Block* block = pool;
+			while (block)
+			{
+				const uint8_t largest = block->tree[0];
+				if (largest)
+					stats.largestFreeRange = Ut::Max(stats.largestFreeRange, _minAllocationSize << (largest - 1));
+				block = block->next;
+			}
+		}
+
+		return stats;
+	}
+
+	VkGpuAllocator::Block* VkGpuAllocator::CreateBlock(const uint32_t poolIndex,
+		const uint32_t typeIndex, const VkMemoryPropertyFlags flags)
+	{
+		auto& memoryHandler = core.GetMemoryHandler();
+
+		VkMemoryRequirements memRequirements{};
+		memRequirements.size = _blockSize;
+		memRequirements.alignment = 1;
+		memRequirements.memoryTypeBits = 1 << typeIndex;
+
+		const auto block = GMEM.New<Block>();
+		block->memory = memoryHandler.Allocate(memRequirements, flags);
+		block->pool = poolIndex;
+
+		// Host visible memory can only be mapped once, so map the entire block and hand out offsets into it.
+		if (IsHostVisible(typeIndex))
+			block->mapped = static_cast<char*>(memoryHandler.MapPersistent(block->memory, 0, _blockSize));
+
+		// Every node starts out as entirely free.
+		const uint32_t nodeCount = (1u << (_maxOrder + 1)) - 1;
+		block->tree = ArrayPtr<uint8_t>(nodeCount, GMEM);
+		for (uint32_t depth = 0; depth <= _maxOrder; ++depth)
+		{
+			const uint32_t start = (1u << depth) - 1;
+			const uint32_t end = (1u << (depth + 1)) - 1;
+			for (uint32_t i = start; i < end; ++i)
+				block->tree[i] = static_cast<uint8_t>(_maxOrder - depth + 1);
+		}
+
+		// Add to the front, so that new allocations try the empty block first.
+		block->next = _pools[poolIndex];
+		_pools[poolIndex] = block;
+
+		_stats.blockCount++;
+		_stats.reserved += _blockSize;
+		return block;
+	}
+
+	void VkGpuAllocator::DestroyBlock(Block* block)
+	{
+		auto& memoryHandler = core.GetMemoryHandler();
+
+		// Remove from the linked list.
+		Block** current = &_pools[block->pool];
+		while (*current != block)
+			current = &(*current)->next;
+		*current = block->next;
+
+		if (block->mapped)
+			memoryHandler.Unmap(block->memory);
+		memoryHandler.Free(block->memory);
+
+		_stats.blockCount--;
+		_stats.reserved -= _blockSize;
+		GMEM.Delete(block);
+	}
+
+	bool VkGpuAllocator::TryAllocate(Block& block, const uint32_t order, Allocation& outAllocation)
+	{
+		auto& tree = block.tree;
+		if (tree[0] <= order)
+			return false;
+
+		// Descend to the requested order, picking the child with the tightest fit to keep large ranges intact.
+		uint32_t index = 0;
+		for (uint32_t current = _maxOrder; current > order; --current)
+		{
+			const uint32_t left = index * 2 + 1;
+			const uint8_t l = tree[left];
+			const uint8_t r = tree[left + 1];
+			index = l > order && (r <= order || l <= r) ? left : left + 1;
+		}
+
+		const VkDeviceSize rangeSize = _minAllocationSize << order;
+		const VkDeviceSize offset = (index + 1 - (1u << (_maxOrder - order))) * rangeSize;
+		tree[index] = 0;
+
+		// Update the largest free ranges of the parents.
+		while (index > 0)
+		{
+			index = (index - 1) / 2;
+			tree[index] = Ut::Max(tree[index * 2 + 1], tree[index * 2 + 2]);
+		}
+
+		outAllocation.memory = block.memory;
+		outAllocation.offset = offset;
+		outAllocation.mapped = block.mapped ? block.mapped + offset : nullptr;
+		outAllocation._block = &block;
+		outAllocation._order = order;
+
+		block.allocationCount++;
+		block.used += rangeSize;
+		_stats.allocationCount++;
+		_stats.used += rangeSize;
+		return true;
+	}
+
+	void VkGpuAllocator::FreeRange(Block& block, const VkDeviceSize offset, uint32_t order) const
+	{
+		auto& tree = block.tree;
+
+		uint32_t index = static_cast<uint32_t>(offset / (_minAllocationSize << order)) + (1u << (_maxOrder - order)) - 1;
+		assert(!tree[index]);
+		tree[index] = static_cast<uint8_t>(order + 1);
+
+		// Merge with the buddies where possible.
+		while (index > 0)
+		{
+			index = (index - 1) / 2;
+			++order;
+
+			const uint8_t l = tree[index * 2 + 1];
+			const uint8_t r = tree[index * 2 + 2];
+			// If both halves are entirely free, so is the parent.
+			tree[index] = l == order && r == order ? static_cast<uint8_t>(order + 1) : Ut::Max(l, r);
+		}
+	}
+
+	uint32_t VkGpuAllocator::GetOrder(const VkDeviceSize size) const
+	{
+		uint32_t order = 0;
+		while ((_minAllocationSize << order) < size)
+			++order;
+		return order;
+	}
+
+	bool VkGpuAllocator::IsHostVisible(const uint32_t typeIndex) const
+	{
+		const auto& properties = core.GetMemoryHandler().GetProperties();
+		return properties.memoryTypes[typeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	}
+}
@@ -1,7 +1,6 @@
 ﻿#include "pch.h"
 #include "VkHandlers/VkImageHandler.h"
 #include "VkCore/VkCore.h"
-#include "VkHandlers/VkCommandBufferHandler.h"
 
 namespace vi
 {
@@ -29,7 +28,7 @@ namespace vi
 		return image;
 	}
 
-	void VkImageHandler::TransitionLayout(const TransitionInfo& info) const
+	void VkImageHandler::TransitionLayout(const CommandContext& context, const TransitionInfo& info) const
 	{
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -50,7 +49,7 @@ namespace vi
 		GetLayoutMasks(info.oldLayout, barrier.srcAccessMask, srcStage);
 		GetLayoutMasks(info.newLayout, barrier.dstAccessMask, dstStage);
 
-		vkCmdPipelineBarrier(core.GetCommandBufferHandler().GetCurrent(),
+		vkCmdPipelineBarrier(context.buffer,
 			srcStage, dstStage,
 			0,
 			0, nullptr,
@@ -81,7 +80,7 @@ namespace vi
 		createInfo.subresourceRange.aspectMask = info.aspectFlags;
 		createInfo.subresourceRange.baseMipLevel = 0;
 		createInfo.subresourceRange.levelCount = info.mipLevels;
-		createInfo.subresourceRange.baseArrayLayer = 0;
+		createInfo.subresourceRange.baseArrayLayer = info.baseArrayLayer;
 		createInfo.subresourceRange.layerCount = info.layerCount;
 
 		VkImageView imageView;
@@ -8,6 +8,8 @@ namespace vi
 	{
 		const uint32_t bindingsCount = info.bindings.GetCount();
 		const ArrayPtr<VkDescriptorSetLayoutBinding> layoutBindings(bindingsCount, GMEM_TEMP);
+		const ArrayPtr<VkDescriptorBindingFlagsEXT> bindingFlags(bindingsCount, GMEM_TEMP);
+		bool usesBindingFlags = false;
 
 		for (uint32_t i = 0; i < bindingsCount; ++i)
 		{
@@ -18,12 +20,21 @@ namespace vi
 			uboLayoutBinding.descriptorType = binding.type;
 			uboLayoutBinding.descriptorCount = binding.count;
 			uboLayoutBinding.stageFlags = binding.flag;
+
+			bindingFlags[i] = binding.bindingFlags;
+			usesBindingFlags = usesBindingFlags || binding.bindingFlags;
 		}
 
+		// Only chain the binding flags when descriptor indexing is actually used.
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+		bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		bindingFlagsInfo.bindingCount = bindingsCount;
+		bindingFlagsInfo.pBindingFlags = bindingFlags.GetData();
+
 		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.pNext = nullptr;
-		layoutInfo.flags = 0;
+		layoutInfo.pNext = usesBindingFlags ? &bindingFlagsInfo : nullptr;
+		layoutInfo.flags = info.flags;
 		layoutInfo.bindingCount = bindingsCount;
 		layoutInfo.pBindings = layoutBindings.GetData();
 
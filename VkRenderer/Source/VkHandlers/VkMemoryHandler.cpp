@@ -70,6 +70,20 @@ namespace vi
 		vkUnmapMemory(logicalDevice, memory);
 	}
 
+	void* VkMemoryHandler::MapPersistent(const VkDeviceMemory memory, 
+		const VkDeviceSize offset, const VkDeviceSize size) const
+	{
+		void* data;
+		const auto result = vkMapMemory(core.GetLogicalDevice(), memory, offset, size, 0, &data);
+		assert(!result);
+		return data;
+	}
+
+	void VkMemoryHandler::Unmap(const VkDeviceMemory memory) const
+	{
+		vkUnmapMemory(core.GetLogicalDevice(), memory);
+	}
+
 	void VkMemoryHandler::Free(const VkDeviceMemory memory) const
 	{
 		vkFreeMemory(core.GetLogicalDevice(), memory, nullptr);
@@ -79,8 +93,7 @@ namespace vi
 		const uint32_t typeFilter, 
 		const VkMemoryPropertyFlags properties) const
 	{
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(core.GetPhysicalDevice(), &memProperties);
+		const auto& memProperties = GetProperties();
 
 		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
 			if (typeFilter & 1 << i)
@@ -95,6 +108,18 @@ namespace vi
 		throw std::exception("Memory type not available!");
 	}
 
+	const VkPhysicalDeviceMemoryProperties& VkMemoryHandler::GetProperties() const
+	{
+		// The handler is created before the physical device is chosen, so it can't be queried in the constructor.
+		if (!_propertiesQueried)
+		{
+			vkGetPhysicalDeviceMemoryProperties(core.GetPhysicalDevice(), &_properties);
+			_propertiesQueried = true;
+		}
+
+		return _properties;
+	}
+
 	VkMemoryHandler::VkMemoryHandler(VkCore& core) : VkHandler(core)
 	{
 
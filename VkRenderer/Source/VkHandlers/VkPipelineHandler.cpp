@@ -1,16 +1,24 @@
 ﻿#include "pch.h"
 #include "VkHandlers/VkPipelineHandler.h"
 #include "VkCore/VkCore.h"
-#include "VkHandlers/VkCommandBufferHandler.h"
+#include <fstream>
 
 namespace vi
 {
+
 	void VkPipelineHandler::Create(const CreateInfo& info, 
 		VkPipeline& outPipeline, VkPipelineLayout& outLayout) const
+	{
+		outLayout = CreateLayout(info.setLayouts, info.pushConstants);
+		outPipeline = CreatePipeline(info, outLayout);
+	}
+
+	VkPipeline VkPipelineHandler::CreatePipeline(const CreateInfo& info, const VkPipelineLayout layout) const
 	{
 		const auto logicalDevice = core.GetLogicalDevice();
 		const uint32_t modulesCount = info.modules.GetCount();
-		const ArrayPtr<VkPipelineShaderStageCreateInfo> modules{ modulesCount, GMEM_TEMP };
+		assert(modulesCount <= MAX_STAGES);
+		VkPipelineShaderStageCreateInfo modules[MAX_STAGES]{};
 
 		for (uint32_t i = 0; i < modulesCount; ++i)
 		{
@@ -35,24 +43,11 @@ namespace vi
 		inputAssembly.topology = info.primitiveTopology;
 		inputAssembly.primitiveRestartEnable = info.primitiveRestartEnable;
 
-		VkViewport viewport{};
-		viewport.x = 0;
-		viewport.y = 0;
-		viewport.width = static_cast<float>(info.extent.x);
-		viewport.height = static_cast<float>(info.extent.y);
-		viewport.minDepth = 0;
-		viewport.maxDepth = 1;
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = { static_cast<uint32_t>(info.extent.x), static_cast<uint32_t>(info.extent.y) };
-
+		// The viewport and scissor are dynamic, so that the pipeline doesn't depend on the resolution.
 		VkPipelineViewportStateCreateInfo viewportState{};
 		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
 		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
 
 		VkPipelineRasterizationStateCreateInfo rasterizer{};
 		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -81,23 +76,16 @@ namespace vi
 		colorBlending.attachmentCount = 1;
 		colorBlending.pAttachments = &colorBlendAttachment;
 
-		VkPipelineDynamicStateCreateInfo dynamicState{};
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.dynamicStateCount = 0;
-		dynamicState.pDynamicStates = nullptr;
-
-		const uint32_t pushConstantRangeCount = info.pushConstants.GetCount();
-		const ArrayPtr<VkPushConstantRange> pushConstantRanges{ pushConstantRangeCount, GMEM_TEMP };
-
-		for (uint32_t i = 0; i < pushConstantRangeCount; ++i)
+		const VkDynamicState dynamicStates[]
 		{
-			auto& original = info.pushConstants[i];
-			auto& pushConstantRange = pushConstantRanges[i];
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
 
-			pushConstantRange.offset = 0;
-			pushConstantRange.size = original.size;
-			pushConstantRange.stageFlags = original.flag;
-		}
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = sizeof dynamicStates / sizeof(VkDynamicState);
+		dynamicState.pDynamicStates = dynamicStates;
 
 		VkPipelineDepthStencilStateCreateInfo depthStencil{};
 		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
@@ -107,20 +95,10 @@ namespace vi
 		depthStencil.depthBoundsTestEnable = VK_FALSE;
 		depthStencil.stencilTestEnable = VK_FALSE;
 
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = info.setLayouts.GetCount();
-		pipelineLayoutInfo.pSetLayouts = info.setLayouts.GetData();
-		pipelineLayoutInfo.pushConstantRangeCount = info.pushConstants.GetCount();
-		pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.GetData();
-
-		auto result = vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &outLayout);
-		assert(!result);
-
 		VkGraphicsPipelineCreateInfo pipelineInfo{};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 		pipelineInfo.stageCount = modulesCount;
-		pipelineInfo.pStages = modules.GetData();
+		pipelineInfo.pStages = modules;
 		pipelineInfo.pVertexInputState = &vertexInputInfo;
 		pipelineInfo.pInputAssemblyState = &inputAssembly;
 		pipelineInfo.pViewportState = &viewportState;
@@ -128,22 +106,43 @@ namespace vi
 		pipelineInfo.pMultisampleState = &multisampling;
 		pipelineInfo.pDepthStencilState = info.depthBufferEnabled ? &depthStencil : nullptr;
 		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.pDynamicState = nullptr;
-		pipelineInfo.layout = outLayout;
+		pipelineInfo.pDynamicState = &dynamicState;
+		pipelineInfo.layout = layout;
 		pipelineInfo.renderPass = info.renderPass;
 		pipelineInfo.subpass = 0;
 		pipelineInfo.basePipelineHandle = info.basePipeline;
 		pipelineInfo.basePipelineIndex = info.basePipelineIndex;
 
-		result = vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &outPipeline);
+		VkPipeline pipeline;
+		const auto result = vkCreateGraphicsPipelines(logicalDevice, _cache, 1, &pipelineInfo, nullptr, &pipeline);
+		assert(!result);
+		return pipeline;
+	}
+
+	void VkPipelineHandler::CreateCompute(const ComputeCreateInfo& info,
+		VkPipeline& outPipeline, VkPipelineLayout& outLayout) const
+	{
+		outLayout = CreateLayout(info.setLayouts, info.pushConstants);
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = info.module;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = outLayout;
+
+		const auto result = vkCreateComputePipelines(core.GetLogicalDevice(), _cache, 1, &pipelineInfo, nullptr, &outPipeline);
 		assert(!result);
 	}
 
-	void VkPipelineHandler::Bind(const VkPipeline pipeline, const VkPipelineLayout layout)
+	void VkPipelineHandler::Bind(CommandContext& context, const VkPipeline pipeline, 
+		const VkPipelineLayout layout, const VkPipelineBindPoint bindPoint) const
 	{
-		_current = pipeline;
-		_currentLayout = layout;
-		vkCmdBindPipeline(core.GetCommandBufferHandler().GetCurrent(), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		context.pipeline = pipeline;
+		context.layout = layout;
+		context.bindPoint = bindPoint;
+		vkCmdBindPipeline(context.buffer, bindPoint, pipeline);
 	}
 
 	void VkPipelineHandler::Destroy(const VkPipeline pipeline, const VkPipelineLayout layout) const
@@ -153,14 +152,120 @@ namespace vi
 		vkDestroyPipelineLayout(logicalDevice, layout, nullptr);
 	}
 
-	VkPipeline VkPipelineHandler::GetCurrent() const
+	VkPipelineLayout VkPipelineHandler::CreateLayout(const Vector<VkDescriptorSetLayout>& setLayouts,
+		const Vector<CreateInfo::PushConstant>& pushConstants) const
+	{
+		const uint32_t pushConstantRangeCount = pushConstants.GetCount();
+		assert(pushConstantRangeCount <= MAX_PUSH_CONSTANTS);
+		VkPushConstantRange pushConstantRanges[MAX_PUSH_CONSTANTS]{};
+
+		for (uint32_t i = 0; i < pushConstantRangeCount; ++i)
+		{
+			auto& original = pushConstants[i];
+			auto& pushConstantRange = pushConstantRanges[i];
+
+			pushConstantRange.offset = 0;
+			pushConstantRange.size = original.size;
+			pushConstantRange.stageFlags = original.flag;
+		}
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = setLayouts.GetCount();
+		pipelineLayoutInfo.pSetLayouts = setLayouts.GetData();
+		pipelineLayoutInfo.pushConstantRangeCount = pushConstantRangeCount;
+		pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges;
+
+		VkPipelineLayout layout;
+		const auto result = vkCreatePipelineLayout(core.GetLogicalDevice(), &pipelineLayoutInfo, nullptr, &layout);
+		assert(!result);
+		return layout;
+	}
+
+	VkPipelineHandler::CacheHeader VkPipelineHandler::CreateCacheHeader() const
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(core.GetPhysicalDevice(), &properties);
+
+		CacheHeader header{};
+		header.magic = CACHE_MAGIC;
+		header.version = CACHE_VERSION;
+		header.vendorId = properties.vendorID;
+		header.deviceId = properties.deviceID;
+		header.driverVersion = properties.driverVersion;
+		memcpy(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+		return header;
+	}
+
+	void VkPipelineHandler::SetupCache(const char* path)
+	{
+		_cachePath = path;
+
+		// Data from another device or driver is thrown away, in which case the cache starts out empty.
+		ArrayPtr<char> data{};
+		std::ifstream stream;
+		if (path)
+			stream.open(path, std::ios::binary);
+		if (stream.is_open())
+		{
+			CacheHeader header{};
+			stream.read(reinterpret_cast<char*>(&header), sizeof(CacheHeader));
+
+			const CacheHeader expected = CreateCacheHeader();
+			const bool valid = stream.good() && header.magic == expected.magic && header.version == expected.version &&
+				header.vendorId == expected.vendorId && header.deviceId == expected.deviceId && 
+				header.driverVersion == expected.driverVersion && memcmp(header.uuid, expected.uuid, VK_UUID_SIZE) == 0;
+
+			if (valid)
+			{
+				data = ArrayPtr<char>{ header.dataSize, GMEM_TEMP };
+				stream.read(data.GetData(), static_cast<std::streamsize>(header.dataSize));
+				if (!stream.good())
+					data.Free();
+			}
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.GetLength();
+		cacheInfo.pInitialData = data.GetData();
+
+		const auto result = vkCreatePipelineCache(core.GetLogicalDevice(), &cacheInfo, nullptr, &_cache);
+		assert(!result);
+	}
+
+	void VkPipelineHandler::CleanupCache()
 	{
-		return _current;
+		const auto logicalDevice = core.GetLogicalDevice();
+
+		if (_cachePath)
+		{
+			size_t size = 0;
+			auto result = vkGetPipelineCacheData(logicalDevice, _cache, &size, nullptr);
+			assert(!result);
+
+			ArrayPtr<char> data{ size, GMEM_TEMP };
+			result = vkGetPipelineCacheData(logicalDevice, _cache, &size, data.GetData());
+			assert(!result);
+
+			CacheHeader header = CreateCacheHeader();
+			header.dataSize = size;
+
+			std::ofstream stream(_cachePath, std::ios::binary | std::ios::trunc);
+			if (stream.is_open())
+			{
+				stream.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+				stream.write(data.GetData(), static_cast<std::streamsize>(size));
+			}
+		}
+
+		vkDestroyPipelineCache(logicalDevice, _cache, nullptr);
+		_cache = VK_NULL_HANDLE;
 	}
 
-	VkPipelineLayout VkPipelineHandler::GetCurrentLayout() const
+	VkPipelineCache VkPipelineHandler::GetCache() const
 	{
-		return _currentLayout;
+		return _cache;
 	}
 
 	VkPipelineHandler::VkPipelineHandler(VkCore& core) : VkHandler(core)
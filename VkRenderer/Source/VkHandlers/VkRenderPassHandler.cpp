@@ -2,7 +2,6 @@
 #include "VkHandlers/VkRenderPassHandler.h"
 #include "VkCore/VkCore.h"
 #include "VkCore/VkCoreSwapchain.h"
-#include "VkHandlers/VkCommandBufferHandler.h"
 
 namespace vi
 {
@@ -63,7 +62,7 @@ namespace vi
 			depthDescription.storeOp = info.depthStoreOp;
 			depthDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			depthDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			depthDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			depthDescription.initialLayout = info.depthInitialLayout;
 			depthDescription.finalLayout = info.depthFinalLayout;
 
 			dependency.srcStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
@@ -88,12 +87,14 @@ namespace vi
 	}
 
 	void VkRenderPassHandler::Begin(
+		const CommandContext& context,
 		const VkFramebuffer frameBuffer, 
 		const VkRenderPass renderPass, 
 		const glm::ivec2 offset,
 		const glm::ivec2 extent, 
 		VkClearValue* clearColors, 
-		const uint32_t clearColorsCount) const
+		const uint32_t clearColorsCount,
+		const VkSubpassContents contents) const
 	{
 		const VkExtent2D extentVk
 		{
@@ -111,12 +112,33 @@ namespace vi
 		renderPassInfo.clearValueCount = clearColorsCount;
 		renderPassInfo.pClearValues = clearColors;
 
-		vkCmdBeginRenderPass(core.GetCommandBufferHandler().GetCurrent(), &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(context.buffer, &renderPassInfo, contents);
+		if (contents == VK_SUBPASS_CONTENTS_INLINE)
+			SetViewport(context, offset, extent);
 	}
 
-	void VkRenderPassHandler::End() const
+	void VkRenderPassHandler::End(const CommandContext& context) const
 	{
-		vkCmdEndRenderPass(core.GetCommandBufferHandler().GetCurrent());
+		vkCmdEndRenderPass(context.buffer);
+	}
+
+	void VkRenderPassHandler::SetViewport(const CommandContext& context, const glm::ivec2 offset, const glm::ivec2 extent) const
+	{
+		const auto commandBuffer = context.buffer;
+
+		VkViewport viewport{};
+		viewport.x = static_cast<float>(offset.x);
+		viewport.y = static_cast<float>(offset.y);
+		viewport.width = static_cast<float>(extent.x);
+		viewport.height = static_cast<float>(extent.y);
+		viewport.minDepth = 0;
+		viewport.maxDepth = 1;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor{};
+		scissor.offset = { offset.x, offset.y };
+		scissor.extent = { static_cast<uint32_t>(extent.x), static_cast<uint32_t>(extent.y) };
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 	}
 
 	void VkRenderPassHandler::Destroy(const VkRenderPass renderPass) const
@@ -1,21 +1,51 @@
 ﻿#include "pch.h"
 #include "VkHandlers/VkShaderHandler.h"
 #include "VkCore/VkCore.h"
-#include "VkHandlers/VkCommandBufferHandler.h"
 
 namespace vi
 {
-	void VkShaderHandler::Draw(const uint32_t indexCount) const
+	void VkShaderHandler::Draw(const CommandContext& context, const uint32_t indexCount, const uint32_t firstIndex,
+		const int32_t vertexOffset, const uint32_t instanceCount) const
 	{
-		vkCmdDrawIndexed(core.GetCommandBufferHandler().GetCurrent(), indexCount, 1, 0, 0, 0);
+		vkCmdDrawIndexed(context.buffer, indexCount, instanceCount, firstIndex, vertexOffset, 0);
+	}
+
+	void VkShaderHandler::DrawIndirect(const CommandContext& context, const VkBuffer buffer, const VkDeviceSize offset, const uint32_t drawCount) const
+	{
+		vkCmdDrawIndexedIndirect(context.buffer, 
+			buffer, offset, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+
+	void VkShaderHandler::DrawIndirectCount(const CommandContext& context, const VkBuffer buffer, const VkDeviceSize offset,
+		const VkBuffer countBuffer, const VkDeviceSize countOffset, const uint32_t maxDrawCount)
+	{
+		assert(core.IsDrawIndirectCountEnabled());
+
+		// The loader doesn't export extension functions, so it has to be fetched from the device.
+		if (!_drawIndexedIndirectCount)
+			_drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+				vkGetDeviceProcAddr(core.GetLogicalDevice(), "vkCmdDrawIndexedIndirectCountKHR"));
+
+		_drawIndexedIndirectCount(context.buffer, buffer, offset, 
+			countBuffer, countOffset, maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+
+	void VkShaderHandler::Dispatch(const CommandContext& context, const uint32_t groupCountX, const uint32_t groupCountY, const uint32_t groupCountZ) const
+	{
+		vkCmdDispatch(context.buffer, groupCountX, groupCountY, groupCountZ);
 	}
 
 	VkShaderModule VkShaderHandler::CreateModule(const String& data) const
+	{
+		return CreateModule(data.GetData(), data.GetLength());
+	}
+
+	VkShaderModule VkShaderHandler::CreateModule(const void* code, const size_t size) const
 	{
 		VkShaderModuleCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = data.GetLength();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(data.GetData());
+		createInfo.codeSize = size;
+		createInfo.pCode = static_cast<const uint32_t*>(code);
 
 		VkShaderModule vkModule;
 		const auto result = vkCreateShaderModule(core.GetLogicalDevice(), &createInfo, nullptr, &vkModule);
@@ -115,15 +145,18 @@ namespace vi
 		return vertexBuffer;
 	}
 
-	void VkShaderHandler::BindVertexBuffer(const VkBuffer buffer) const
+	void VkShaderHandler::BindVertexBuffer(CommandContext& context, const VkBuffer buffer) const
 	{
 		VkDeviceSize offset = 0;
-		vkCmdBindVertexBuffers(core.GetCommandBufferHandler().GetCurrent(), 0, 1, &buffer, &offset);
+		vkCmdBindVertexBuffers(context.buffer, 0, 1, &buffer, &offset);
+		context.vertexBuffer = buffer;
 	}
 
-	void VkShaderHandler::BindIndicesBuffer(const VkBuffer buffer) const
+	void VkShaderHandler::BindIndicesBuffer(CommandContext& context, const VkBuffer buffer, const VkIndexType indexType) const
 	{
-		vkCmdBindIndexBuffer(core.GetCommandBufferHandler().GetCurrent(), buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdBindIndexBuffer(context.buffer, buffer, 0, indexType);
+		context.indexBuffer = buffer;
+		context.indexType = indexType;
 	}
 
 	void VkShaderHandler::BindBuffer(const BufferBindInfo& bindInfo) const
@@ -135,7 +168,7 @@ namespace vi
 		descriptorWrite.dstSet = bindInfo.set;
 		descriptorWrite.dstBinding = bindInfo.bindingIndex;
 		descriptorWrite.dstArrayElement = bindInfo.arrayIndex;
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite.descriptorType = bindInfo.type;
 		descriptorWrite.descriptorCount = bindInfo.count;
 
 		const auto logicalDevice = core.GetLogicalDevice();
@@ -166,6 +199,7 @@ namespace vi
 	}
 
 	void VkShaderHandler::CopyBuffer(
+		const CommandContext& context,
 		const VkBuffer srcBuffer, 
 		const VkBuffer dstBuffer, 
 		const VkDeviceSize size, 
@@ -176,10 +210,11 @@ namespace vi
 		region.srcOffset = srcOffset;
 		region.dstOffset = dstOffset;
 		region.size = size;
-		vkCmdCopyBuffer(core.GetCommandBufferHandler().GetCurrent(), srcBuffer, dstBuffer, 1, &region);
+		vkCmdCopyBuffer(context.buffer, srcBuffer, dstBuffer, 1, &region);
 	}
 
 	void VkShaderHandler::CopyBuffer(
+		const CommandContext& context,
 		const VkBuffer srcBuffer, 
 		const VkImage dstImage, 
 		const glm::ivec2 resolution) const
@@ -202,7 +237,7 @@ namespace vi
 		subResource.baseArrayLayer = 0;
 		subResource.layerCount = 1;
 
-		vkCmdCopyBufferToImage(core.GetCommandBufferHandler().GetCurrent(), srcBuffer, dstImage,
+		vkCmdCopyBufferToImage(context.buffer, srcBuffer, dstImage,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 	}
 
@@ -216,9 +251,9 @@ namespace vi
 
 	}
 
-	void VkShaderHandler::IntUpdatePushConstant(const VkPipelineLayout layout, 
+	void VkShaderHandler::IntUpdatePushConstant(const CommandContext& context, const VkPipelineLayout layout, 
 		const VkFlags flag, void const * input, const size_t size)
 	{
-		vkCmdPushConstants(core.GetCommandBufferHandler().GetCurrent(), layout, flag, 0, size, input);
+		vkCmdPushConstants(context.buffer, layout, flag, 0, size, input);
 	}
 }
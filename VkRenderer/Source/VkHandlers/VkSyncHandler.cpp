@@ -37,6 +37,11 @@ namespace vi
 		vkWaitForFences(core.GetLogicalDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
 	}
 
+	bool VkSyncHandler::IsSignaled(const VkFence fence) const
+	{
+		return vkGetFenceStatus(core.GetLogicalDevice(), fence) == VK_SUCCESS;
+	}
+
 	void VkSyncHandler::DestroyFence(const VkFence fence) const
 	{
 		vkDestroyFence(core.GetLogicalDevice(), fence, nullptr);